@@ -0,0 +1,461 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <ctime>
+#include <math.h>
+#include <malloc.h>
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/utilities.h>
+#include <bayesship/dataUtilities.h>
+#include <bayesship/proposalFunctions.h>
+
+#include <omp.h>
+
+/*! \file
+ *
+ * # Proposal efficiency benchmarks
+ *
+ * Runs the sampler on a few standard targets with each proposal class, and reports numbers that can be compared across proposals:
+ *
+ * acceptance rate of the proposal, ESS per likelihood evaluation, ESS per CPU-second (including any proposal training, since training happens inside sample()), and the memory the proposal holds on to at the end of the run.
+ *
+ * Every proposal (other than the gaussian itself) is run in a mixture with 20% gaussian steps, the way the proposals are used in practice -- the history based proposals (DE, KDE, GMM) have nothing to draw from otherwise. The acceptance rate is for the proposal being benchmarked only.
+ */
+
+void RT_ERROR_MSG();
+int proposalBenchmarks(int argc, char *argv[]);
+int main(int argc, char *argv[])
+{
+	std::cout<<"Proposal benchmarks"<<std::endl;
+	if(argc < 2){
+		RT_ERROR_MSG();
+		return 1;
+	}
+	int runtimeOpt = std::stoi(argv[1]);
+	if(runtimeOpt == 0){
+		std::cout<<"Proposal efficiency benchmarks -- results in data/proposal_benchmarks.csv"<<std::endl;
+		return proposalBenchmarks(argc, argv);
+	}
+	else{
+		RT_ERROR_MSG();
+		return 1;
+	}
+
+	return 0;
+}
+
+//#####################################################
+//#####################################################
+/*Targets*/
+
+/*! Correlated gaussian -- covariance rho^|i-j| (AR(1)), so the inverse (the Fisher matrix) is tridiagonal*/
+const int gaussianDim = 5;
+const double gaussianRho = .9;
+
+class correlatedGaussian_L : public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *pos, int chainID)
+	{
+		double *x = pos->parameters;
+		double norm = 1./(1.-gaussianRho*gaussianRho);
+		double ll = x[0]*x[0] + x[gaussianDim-1]*x[gaussianDim-1];
+		for(int i = 1 ; i<gaussianDim-1; i++){
+			ll += (1.+gaussianRho*gaussianRho)*x[i]*x[i];
+		}
+		for(int i = 0 ; i<gaussianDim-1; i++){
+			ll -= 2.*gaussianRho*x[i]*x[i+1];
+		}
+		return -.5*norm*ll;
+	}
+};
+
+double correlatedGaussianFisherElement(int i, int j)
+{
+	double norm = 1./(1.-gaussianRho*gaussianRho);
+	if(i == j){
+		if(i == 0 || i == gaussianDim-1){
+			return norm;
+		}
+		return norm*(1.+gaussianRho*gaussianRho);
+	}
+	if(abs(i-j) == 1){
+		return -norm*gaussianRho;
+	}
+	return 0;
+}
+
+void correlatedGaussianFisher(bayesship::positionInfo *pos, double **fisher, void *parameters)
+{
+	for(int i = 0 ; i<gaussianDim; i++){
+		for(int j = 0 ; j<gaussianDim; j++){
+			fisher[i][j] = correlatedGaussianFisherElement(i,j);
+		}
+	}
+}
+
+void correlatedGaussianBlockFisher(bayesship::positionInfo *pos, double **fisher, std::vector<int> ids, void *parameters)
+{
+	/*The Fisher matrix of a block (with the other parameters held fixed) is the block of the full Fisher matrix*/
+	for(size_t i = 0 ; i<ids.size(); i++){
+		for(size_t j = 0 ; j<ids.size(); j++){
+			fisher[i][j] = correlatedGaussianFisherElement(ids[i],ids[j]);
+		}
+	}
+}
+
+/*! Bimodal -- equal mixture of unit gaussians at (+-3, 0)*/
+class bimodal_L : public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *pos, int chainID)
+	{
+		double x = pos->parameters[0];
+		double y = pos->parameters[1];
+		double a = -.5*((x-3)*(x-3) + y*y);
+		double b = -.5*((x+3)*(x+3) + y*y);
+		double m = std::max(a,b);
+		return m + log(exp(a-m) + exp(b-m));
+	}
+};
+
+void bimodalFisher(bayesship::positionInfo *pos, double **fisher, void *parameters)
+{
+	/*Each mode is a unit gaussian*/
+	for(int i = 0 ; i<2; i++){
+		for(int j = 0 ; j<2; j++){
+			fisher[i][j] = (i==j) ? 1 : 0;
+		}
+	}
+}
+
+void bimodalBlockFisher(bayesship::positionInfo *pos, double **fisher, std::vector<int> ids, void *parameters)
+{
+	for(size_t i = 0 ; i<ids.size(); i++){
+		for(size_t j = 0 ; j<ids.size(); j++){
+			fisher[i][j] = (i==j) ? 1 : 0;
+		}
+	}
+}
+
+/*! Nested (layered) model for the RJ moves -- every active parameter is a unit gaussian at 1, and each extra layer costs a factor of .6*/
+const int layeredDim = 5;
+
+class layered_L : public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *pos, int chainID)
+	{
+		double ll = 0;
+		for(int i = 0 ; i<layeredDim; i++){
+			if(pos->status[i]){
+				ll += -.5*(pos->parameters[i]-1)*(pos->parameters[i]-1) + log(.6);
+			}
+		}
+		return ll;
+	}
+};
+
+/*! Flat prior on a box -- RJ aware*/
+class box_P : public bayesship::probabilityFn
+{
+public:
+	int dim;
+	double bound;
+	virtual double eval(bayesship::positionInfo *pos, int chainID)
+	{
+		double lp = 0;
+		for(int i = 0 ; i<dim; i++){
+			if(pos->RJ && !pos->status[i]){
+				continue;
+			}
+			if(fabs(pos->parameters[i]) > bound){
+				return -std::numeric_limits<double>::infinity();
+			}
+			lp -= log(2*bound);
+		}
+		return lp;
+	}
+};
+
+//#####################################################
+//#####################################################
+/*Harness*/
+
+/*! \brief Bytes currently allocated on the heap (malloc and new) -- 0 if it can't be measured on this platform
+ */
+long long heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 info = mallinfo2();
+	return (long long)info.uordblks + (long long)info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+struct benchTarget
+{
+	std::string name;
+	bayesship::probabilityFn *likelihood;
+	int maxDim;
+	bool RJ;
+	double bound;
+	bayesship::FisherCalculation fisher;
+	bayesship::blockFisherCalculation blockFisher;
+	std::vector<std::vector<int>> blocks;
+};
+
+struct benchResult
+{
+	double acceptance=0;
+	long long likelihoodEvals=0;
+	double ess=-1;
+	double cpuSeconds=0;
+	long long proposalBytes=0;
+};
+
+/*! \brief Build the proposal named proposalName for target -- nullptr if it doesn't apply
+ */
+bayesship::proposal *makeProposal(std::string proposalName, benchTarget &target, bayesship::bayesshipSampler *sampler, int chainN, void **fisherParameters)
+{
+	std::vector<double> blockProb(target.blocks.size(), 1./target.blocks.size());
+	std::vector<int> allDims;
+	for(int i = 0 ; i<target.maxDim; i++){
+		allDims.push_back(i);
+	}
+	if(proposalName == "gaussian"){
+		return new bayesship::gaussianProposal(chainN, target.maxDim, sampler);
+	}
+	if(target.RJ){
+		if(proposalName == "sequentialLayerRJ"){
+			return new bayesship::sequentialLayerRJProposal(sampler, .5);
+		}
+		if(proposalName == "randomLayerRJ"){
+			return new bayesship::randomLayerRJProposal(sampler, .5);
+		}
+		return nullptr;
+	}
+	if(proposalName == "Fisher"){
+		return new bayesship::fisherProposal(chainN, target.maxDim, target.fisher, fisherParameters, 200, sampler);
+	}
+	if(proposalName == "blockFisher"){
+		return new bayesship::blockFisherProposal(chainN, target.maxDim, target.blockFisher, fisherParameters, 200, sampler, target.blocks, blockProb);
+	}
+	if(proposalName == "DE"){
+		return new bayesship::differentialEvolutionProposal(sampler);
+	}
+	if(proposalName == "blockDE"){
+		return new bayesship::blockDifferentialEvolutionProposal(sampler, target.blocks, blockProb);
+	}
+	if(proposalName == "KDE"){
+		return new bayesship::KDEProposal(chainN, target.maxDim, sampler, false, 5000, 1000, 5);
+	}
+	if(proposalName == "GMM"){
+		std::vector<std::vector<int>> gmmBlocks = {allDims};
+		std::vector<double> gmmProb = {1};
+		return new bayesship::GMMProposal(chainN, target.maxDim, sampler, gmmBlocks, gmmProb, 4, 10, 10, 1e-10, false, 1000);
+	}
+	return nullptr;
+}
+
+/*! \brief Sample target with proposalName (mixed with gaussian steps) and measure it
+ *
+ * Returns false if the proposal doesn't apply to target
+ */
+bool runProposalBenchmark(benchTarget &target, std::string proposalName, int iterations, benchResult *result)
+{
+	box_P *prior = new box_P();
+	prior->dim = target.maxDim;
+	prior->bound = target.bound;
+	bayesship::bayesshipSampler *sampler = new bayesship::bayesshipSampler(target.likelihood, prior);
+	sampler->maxDim = target.maxDim;
+	sampler->RJ = target.RJ;
+	sampler->minDim = (target.RJ) ? 1 : 0;
+	sampler->ensembleN = 2;
+	sampler->ensembleSize = 5;
+	sampler->threads = 1;
+	sampler->threadPool = false;
+	sampler->iterations = iterations;
+	sampler->burnIterations = iterations/5;
+	sampler->priorIterations = 0;
+	sampler->writePriorData = false;
+	sampler->ignoreExistingCheckpoint = true;
+	sampler->outputDir = "data/";
+	sampler->outputFileMoniker = "proposalBenchmark_"+target.name+"_"+proposalName;
+	int chainN = sampler->ensembleN*sampler->ensembleSize;
+	sampler->initialPosition = new bayesship::positionInfo(target.maxDim, target.RJ);
+	for(int i = 0 ; i<target.maxDim; i++){
+		sampler->initialPosition->parameters[i] = (target.RJ) ? 1 : .1;
+		if(target.RJ){
+			sampler->initialPosition->status[i] = 1;
+		}
+	}
+	void **fisherParameters = new void*[chainN];
+	for(int i = 0 ; i<chainN; i++){
+		fisherParameters[i] = nullptr;
+	}
+
+	/*The gaussian steps that every mixture shares are allocated before the heap is measured*/
+	bayesship::proposal *filler = (proposalName == "gaussian") ? nullptr : new bayesship::gaussianProposal(chainN, target.maxDim, sampler);
+	long long heapStart = heapInUse();
+	bayesship::proposal *tested = makeProposal(proposalName, target, sampler, chainN, fisherParameters);
+	if(!tested){
+		delete filler;
+		delete [] fisherParameters;
+		delete sampler->initialPosition;
+		delete sampler;
+		delete prior;
+		return false;
+	}
+	bayesship::proposal *proposals[2] = {tested, filler};
+	double proposalProb[2] = {.8,.2};
+	int proposalN = (filler) ? 2 : 1;
+	if(!filler){
+		proposalProb[0] = 1;
+	}
+	bayesship::proposalData *pf = new bayesship::proposalData(chainN, proposalN, proposals, proposalProb);
+	sampler->proposalFns = pf;
+
+	std::clock_t cpuStart = std::clock();
+	sampler->sample();
+	result->cpuSeconds = (double)(std::clock() - cpuStart)/CLOCKS_PER_SEC;
+
+	long long accepts = 0;
+	long long rejects = 0;
+	result->likelihoodEvals = 0;
+	for(int i = 0 ; i<chainN; i++){
+		result->likelihoodEvals += sampler->data->likelihoodEvals[i];
+	}
+	/*Acceptance of the benchmarked proposal on the cold chains*/
+	for(int e = 0 ; e<sampler->ensembleN; e++){
+		int chainID = sampler->chainIndex(e,0);
+		accepts += sampler->data->successN[chainID][0];
+		rejects += sampler->data->rejectN[chainID][0];
+	}
+	result->acceptance = (accepts+rejects > 0) ? (double)accepts/(accepts+rejects) : 0;
+	result->ess = -1;
+	if(!target.RJ){
+		/*ACs were updated at the end of sample()*/
+		result->ess = (double)sampler->data->countIndependentSamples()*sampler->ensembleN;
+	}
+
+	/*Whatever is left on the heap once the sampler lets go of its data belongs to the proposal*/
+	sampler->deallocateMemory();
+	result->proposalBytes = heapInUse() - heapStart - (long long)sizeof(bayesship::proposalData);
+
+	delete pf;
+	delete tested;
+	delete filler;
+	delete [] fisherParameters;
+	delete sampler->initialPosition;
+	sampler->initialPosition = nullptr;
+	delete sampler;
+	delete prior;
+	return true;
+}
+
+int proposalBenchmarks(int argc, char *argv[])
+{
+	int iterations = 20000;
+	if(argc > 2){
+		iterations = std::stoi(argv[2]);
+	}
+	std::vector<std::string> proposalNames = {"gaussian","Fisher","blockFisher","DE","blockDE","KDE","GMM","sequentialLayerRJ","randomLayerRJ"};
+	if(argc > 3){
+		proposalNames.clear();
+		std::string list(argv[3]);
+		size_t start = 0;
+		while(start <= list.size()){
+			size_t comma = list.find(',', start);
+			if(comma == std::string::npos){
+				comma = list.size();
+			}
+			if(comma > start){
+				proposalNames.push_back(list.substr(start, comma-start));
+			}
+			start = comma+1;
+		}
+	}
+
+	correlatedGaussian_L *gaussianL = new correlatedGaussian_L();
+	bimodal_L *bimodalL = new bimodal_L();
+	layered_L *layeredL = new layered_L();
+	std::vector<benchTarget> targets(3);
+	targets[0].name = "correlatedGaussian";
+	targets[0].likelihood = gaussianL;
+	targets[0].maxDim = gaussianDim;
+	targets[0].RJ = false;
+	targets[0].bound = 20;
+	targets[0].fisher = correlatedGaussianFisher;
+	targets[0].blockFisher = correlatedGaussianBlockFisher;
+	targets[0].blocks = {{0,1,2},{3,4}};
+
+	targets[1].name = "bimodal";
+	targets[1].likelihood = bimodalL;
+	targets[1].maxDim = 2;
+	targets[1].RJ = false;
+	targets[1].bound = 10;
+	targets[1].fisher = bimodalFisher;
+	targets[1].blockFisher = bimodalBlockFisher;
+	targets[1].blocks = {{0},{1}};
+
+	targets[2].name = "layeredRJ";
+	targets[2].likelihood = layeredL;
+	targets[2].maxDim = layeredDim;
+	targets[2].RJ = true;
+	targets[2].bound = 5;
+	targets[2].fisher = nullptr;
+	targets[2].blockFisher = nullptr;
+
+	std::ofstream outFile("data/proposal_benchmarks.csv");
+	outFile<<"target,proposal,acceptance,likelihoodEvals,ESS,ESSPerLikelihoodEval,CPUSeconds,ESSPerCPUSecond,proposalBytes"<<std::endl;
+	std::vector<std::string> table;
+	for(size_t t = 0 ; t<targets.size(); t++){
+		/*Short warm up run, so one-time allocations (output buffers, library state) aren't charged to the first proposal*/
+		benchResult warmUp;
+		runProposalBenchmark(targets[t], "gaussian", 500, &warmUp);
+		for(size_t p = 0 ; p<proposalNames.size(); p++){
+			benchResult result;
+			if(!runProposalBenchmark(targets[t], proposalNames[p], iterations, &result)){
+				continue;
+			}
+			double essPerEval = (result.ess >= 0 && result.likelihoodEvals > 0) ? result.ess/result.likelihoodEvals : -1;
+			double essPerCPU = (result.ess >= 0 && result.cpuSeconds > 0) ? result.ess/result.cpuSeconds : -1;
+			outFile<<targets[t].name<<","<<proposalNames[p]<<","<<result.acceptance<<","<<result.likelihoodEvals<<","<<result.ess<<","<<essPerEval<<","<<result.cpuSeconds<<","<<essPerCPU<<","<<result.proposalBytes<<std::endl;
+
+			std::ostringstream row;
+			row<<std::left<<std::setw(20)<<targets[t].name<<std::setw(20)<<proposalNames[p];
+			row<<std::setw(12)<<result.acceptance<<std::setw(14)<<essPerEval<<std::setw(14)<<essPerCPU<<result.proposalBytes;
+			table.push_back(row.str());
+		}
+	}
+	outFile.close();
+
+	std::cout<<std::endl<<"ESS entries of -1 are not available (RJ targets)"<<std::endl;
+	std::cout<<std::left<<std::setw(20)<<"target"<<std::setw(20)<<"proposal"<<std::setw(12)<<"acceptance"<<std::setw(14)<<"ESS/eval"<<std::setw(14)<<"ESS/CPU-s"<<"bytes"<<std::endl;
+	for(size_t i = 0 ; i<table.size(); i++){
+		std::cout<<table[i]<<std::endl;
+	}
+
+	delete gaussianL;
+	delete bimodalL;
+	delete layeredL;
+	return 0;
+}
+
+//#####################################################
+//#####################################################
+
+void RT_ERROR_MSG()
+{
+	std::cout<<"ERROR -- incorrect arguments"<<std::endl;
+	std::cout<<"Please supply a test number:"<<std::endl;
+	std::cout<<"0 -- Proposal efficiency benchmarks (optional: iterations, comma separated list of proposals)"<<std::endl;
+	return;
+
+}
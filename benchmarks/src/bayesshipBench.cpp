@@ -0,0 +1,473 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <nlohmann/json.hpp>
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/utilities.h>
+#include <bayesship/dataUtilities.h>
+#include <bayesship/proposalFunctions.h>
+#include "../../examples/gaussian1D/src/gaussian1D.h"
+#include "../../examples/bimodal2D/src/bimodal2D.h"
+#include "../../examples/rosenbock/src/rosenbock.h"
+#include "../../examples/chebyshevTransdimensional/src/chebyshevTransdimensional.h"
+
+/*! \file
+ *
+ * # End-to-end throughput benchmark
+ *
+ * Runs the example workloads headless over a matrix of sampler configurations, and writes wall time, likelihood evaluations/sec, swaps/sec, ESS/sec, and peak RSS for each configuration as JSON.
+ *
+ * Every configuration runs in its own (forked) process, so the peak RSS belongs to that configuration alone.
+ */
+
+//##############################################################
+// Workloads -- the examples' targets (examples/*/src/*.h)
+//##############################################################
+
+/*! \brief Owns everything a workload hands to the sampler
+ */
+struct benchWorkload
+{
+	bayesship::probabilityFn *likelihood=nullptr;
+	bayesship::probabilityFn *prior=nullptr;
+	bayesship::proposal **proposals=nullptr;
+	int proposalN=0;
+	bayesship::positionInfo *initialPosition=nullptr;
+	bool RJ=false;
+	int maxDim=1;
+	int minDim=0;
+	/*! Parameters of the targets that take them by pointer*/
+	std::vector<double> coefficients;
+	std::vector<double> data;
+	double **bounds=nullptr;
+	trans_helper *chebyshevHelper=nullptr;
+	/*! The chebyshev targets read maxDim from the sampler -- set by setSampler*/
+	chebyshevLikelihood *chebyshevL=nullptr;
+	chebyshevPrior *chebyshevP=nullptr;
+
+	/*! \brief Hand the sampler to the targets that need it*/
+	void setSampler(bayesship::bayesshipSampler *sampler)
+	{
+		if(chebyshevL){
+			chebyshevL->sampler = sampler;
+			chebyshevP->sampler = sampler;
+		}
+	}
+
+	~benchWorkload()
+	{
+		delete likelihood;
+		delete prior;
+		for(int i = 0 ; i<proposalN; i++){
+			delete proposals[i];
+		}
+		delete [] proposals;
+		delete initialPosition;
+		if(bounds){
+			for(int i = 0 ; i<maxDim; i++){
+				delete [] bounds[i];
+			}
+			delete [] bounds;
+		}
+		delete chebyshevHelper;
+	}
+};
+
+/*! \brief Build the named workload -- returns nullptr for an unknown name
+ */
+benchWorkload *makeWorkload(std::string name)
+{
+	benchWorkload *workload = new benchWorkload();
+	if(name == "gaussian1D"){
+		workload->prior = new gaussian1DPrior();
+		workload->likelihood = new gaussian1DLikelihood();
+		workload->maxDim = 1;
+	}
+	else if(name == "bimodal2D"){
+		workload->prior = new bimodal2DPrior();
+		workload->likelihood = new bimodal2DLikelihood();
+		workload->maxDim = 2;
+	}
+	else if(name == "rosenbock"){
+		/*Same parameters as the example*/
+		rosenbockLikelihood *likelihood = new rosenbockLikelihood();
+		likelihood->a = 1./20.;
+		likelihood->mu = 1.;
+		likelihood->n1 = 3;
+		likelihood->n2 = 2;
+		likelihood->n = (likelihood->n1-1)*likelihood->n2 + 1;
+		workload->maxDim = likelihood->n;
+		workload->coefficients.assign(likelihood->n, 100./20.);
+		likelihood->b = workload->coefficients.data();
+		rosenbockPrior *prior = new rosenbockPrior();
+		workload->bounds = new double*[workload->maxDim];
+		for(int i = 0 ; i<workload->maxDim; i++){
+			workload->bounds[i] = new double[2];
+			workload->bounds[i][0] = -1e3;
+			workload->bounds[i][1] = 1e3;
+		}
+		prior->maxDim = workload->maxDim;
+		prior->maxBounds = workload->bounds;
+		workload->prior = prior;
+		workload->likelihood = likelihood;
+	}
+	else if(name == "chebyshevTransdimensional"){
+		/*Synthetic version of the example's data set (3 coefficients, unit noise), so the benchmark doesn't depend on the working directory*/
+		workload->RJ = true;
+		workload->maxDim = 10;
+		workload->minDim = 2;
+		workload->chebyshevHelper = new trans_helper;
+		workload->chebyshevHelper->N = 100;
+		workload->chebyshevHelper->dt = 1;
+		workload->chebyshevHelper->r = nullptr;
+		std::mt19937 generator(1);
+		std::normal_distribution<double> noise(0,1);
+		double coeff[3] = {1.5, -2., 1.};
+		double dn = 2. / ( workload->chebyshevHelper->N-1);
+		for(int i = 0 ; i<workload->chebyshevHelper->N; i++){
+			workload->data.push_back(Chebyshev_fn(3, coeff, -1 + i*dn) + noise(generator));
+		}
+		workload->chebyshevHelper->data = workload->data.data();
+		workload->chebyshevL = new chebyshevLikelihood();
+		workload->chebyshevP = new chebyshevPrior();
+		workload->chebyshevL->h = workload->chebyshevHelper;
+		workload->likelihood = workload->chebyshevL;
+		workload->prior = workload->chebyshevP;
+	}
+	else{
+		delete workload;
+		return nullptr;
+	}
+	workload->initialPosition = new bayesship::positionInfo(workload->maxDim, workload->RJ);
+	for(int i = 0 ; i<workload->maxDim; i++){
+		workload->initialPosition->parameters[i] = (workload->RJ) ? .5 : 0;
+		if(workload->RJ){
+			workload->initialPosition->status[i] = 1;
+		}
+	}
+	if(workload->RJ){
+		workload->initialPosition->modelID = 0;
+	}
+	return workload;
+}
+
+//##############################################################
+// Benchmark driver
+//##############################################################
+
+struct benchConfig
+{
+	std::string workload;
+	int threads;
+	int ensembleN;
+	int ensembleSize;
+	bool threadPool;
+};
+
+struct benchOptions
+{
+	std::vector<std::string> workloads = {"gaussian1D","bimodal2D","rosenbock","chebyshevTransdimensional"};
+	std::vector<int> threads = {1,2,4};
+	std::vector<int> ensembleN = {2};
+	std::vector<int> ensembleSize = {5};
+	std::vector<int> threadPool = {0,1};
+	int iterations = 5000;
+	/*! Off by default, so the wall time (and every rate) covers the main run only*/
+	int burnIterations = 0;
+	/*! Weak scaling -- ensembleN is multiplied by the thread count*/
+	bool weak = false;
+	bool verbose = false;
+	std::string outputDir = "data/";
+	std::string outputFile = "";
+};
+
+std::vector<std::string> splitList(std::string list)
+{
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while(std::getline(stream, item, ',')){
+		if(!item.empty()){
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+std::vector<int> splitIntList(std::string list)
+{
+	std::vector<int> items;
+	std::vector<std::string> strings = splitList(list);
+	for(size_t i = 0 ; i<strings.size(); i++){
+		items.push_back(std::stoi(strings[i]));
+	}
+	return items;
+}
+
+/*! \brief Run one configuration in the current process and return its measurements
+ */
+nlohmann::json runConfig(benchConfig config, benchOptions options)
+{
+	nlohmann::json result;
+	benchWorkload *workload = makeWorkload(config.workload);
+	bayesship::bayesshipSampler *sampler = new bayesship::bayesshipSampler(workload->likelihood,workload->prior);
+	workload->setSampler(sampler);
+	sampler->maxDim = workload->maxDim;
+	sampler->minDim = workload->minDim;
+	sampler->RJ = workload->RJ;
+	sampler->coldOnlyStorage = true;
+	sampler->ignoreExistingCheckpoint = true;
+	sampler->writePriorData = false;
+	sampler->priorIterations = 0;
+	sampler->burnIterations = options.burnIterations;
+	sampler->iterations = options.iterations;
+	sampler->threads = config.threads;
+	sampler->ensembleN = config.ensembleN;
+	sampler->ensembleSize = config.ensembleSize;
+	sampler->threadPool = config.threadPool;
+	sampler->swapProb = .1;
+	sampler->restrictSwapTemperatures = false;
+	sampler->isolateEnsembles = false;
+	sampler->outputDir = options.outputDir;
+	sampler->outputFileMoniker = "bench_"+config.workload;
+	sampler->initialPosition = workload->initialPosition;
+	int chainN = config.ensembleN*config.ensembleSize;
+	if(workload->RJ){
+		workload->proposalN = 3;
+		workload->proposals = new bayesship::proposal*[3];
+		workload->proposals[0] = new bayesship::gaussianProposal(chainN, sampler->maxDim, sampler);
+		workload->proposals[1] = new bayesship::differentialEvolutionProposal(sampler);
+		workload->proposals[2] = new bayesship::sequentialLayerRJProposal(sampler, .5);
+		double proposalFnProb[3] = {.3,.4,.3};
+		sampler->proposalFns = new bayesship::proposalData(chainN, 3, workload->proposals, proposalFnProb);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	sampler->sample();
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	long long likelihoodEvals = 0;
+	long long swaps = 0;
+	bayesship::samplerData *phases[2] = {sampler->burnData, sampler->data};
+	for(int p = 0 ; p<2; p++){
+		if(!phases[p]){
+			continue;
+		}
+		for(int i = 0 ; i<chainN; i++){
+			likelihoodEvals += phases[p]->likelihoodEvals[i];
+			for(int j = 0 ; j<chainN; j++){
+				swaps += phases[p]->swapAccepts[i][j] + phases[p]->swapRejects[i][j];
+			}
+		}
+	}
+	result["wallSeconds"] = wall;
+	result["likelihoodEvals"] = likelihoodEvals;
+	result["likelihoodEvalsPerSecond"] = likelihoodEvals/wall;
+	result["swaps"] = swaps;
+	result["swapsPerSecond"] = swaps/wall;
+	if(!workload->RJ){
+		/*ACs were updated at the end of sample()*/
+		double ess = (double)sampler->data->countIndependentSamples()*config.ensembleN;
+		result["ess"] = ess;
+		result["essPerSecond"] = ess/wall;
+	}
+	else{
+		result["ess"] = nullptr;
+		result["essPerSecond"] = nullptr;
+	}
+
+	if(sampler->proposalFns && workload->RJ){
+		delete sampler->proposalFns;
+		sampler->proposalFns = nullptr;
+	}
+	delete sampler;
+	delete workload;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result["peakRSSKB"] = (long long)usage.ru_maxrss;
+	return result;
+}
+
+/*! \brief Run one configuration in a child process, so its peak RSS is isolated from the other runs
+ */
+nlohmann::json runConfigIsolated(benchConfig config, benchOptions options)
+{
+	nlohmann::json result;
+	result["workload"] = config.workload;
+	result["threads"] = config.threads;
+	result["ensembleN"] = config.ensembleN;
+	result["ensembleSize"] = config.ensembleSize;
+	result["threadPool"] = config.threadPool;
+	result["iterations"] = options.iterations;
+	result["burnIterations"] = options.burnIterations;
+	if(config.threadPool && config.threads < 3){
+		result["skipped"] = "threadPool needs at least 3 threads";
+		return result;
+	}
+
+	int fds[2];
+	if(pipe(fds) != 0){
+		result["error"] = "could not create pipe";
+		return result;
+	}
+	std::cout.flush();
+	pid_t pid = fork();
+	if(pid == 0){
+		close(fds[0]);
+		if(!options.verbose){
+			int devNull = open("/dev/null", O_WRONLY);
+			dup2(devNull, STDOUT_FILENO);
+			close(devNull);
+		}
+		std::string output = runConfig(config, options).dump();
+		size_t written = 0;
+		while(written < output.size()){
+			ssize_t n = write(fds[1], output.c_str()+written, output.size()-written);
+			if(n <= 0){
+				break;
+			}
+			written+=n;
+		}
+		close(fds[1]);
+		std::cout.flush();
+		_exit(0);
+	}
+	close(fds[1]);
+	std::string output;
+	char buffer[4096];
+	ssize_t n;
+	while((n = read(fds[0], buffer, sizeof(buffer))) > 0){
+		output.append(buffer, n);
+	}
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || output.empty()){
+		result["error"] = "benchmark process failed";
+		return result;
+	}
+	nlohmann::json measured = nlohmann::json::parse(output);
+	for(auto it = measured.begin(); it != measured.end(); ++it){
+		result[it.key()] = it.value();
+	}
+	return result;
+}
+
+void usage()
+{
+	std::cout<<"bayesship_bench -- end-to-end throughput benchmark"<<std::endl;
+	std::cout<<"Options (lists are comma separated):"<<std::endl;
+	std::cout<<"  --workloads       gaussian1D,bimodal2D,rosenbock,chebyshevTransdimensional"<<std::endl;
+	std::cout<<"  --threads         thread counts (default 1,2,4)"<<std::endl;
+	std::cout<<"  --ensembleN       ensemble counts (default 2)"<<std::endl;
+	std::cout<<"  --ensembleSize    temperatures per ensemble (default 5)"<<std::endl;
+	std::cout<<"  --threadPool      0 (lockstep), 1 (async thread pool) (default 0,1)"<<std::endl;
+	std::cout<<"  --iterations      steps per chain in the main run (default 5000)"<<std::endl;
+	std::cout<<"  --burnIterations  burn in steps per chain (default 0)"<<std::endl;
+	std::cout<<"  --weak            weak scaling -- multiply ensembleN by the thread count"<<std::endl;
+	std::cout<<"  --outputDir       directory for the sampler's output files (default data/)"<<std::endl;
+	std::cout<<"  --output          JSON file for the results (default stdout)"<<std::endl;
+	std::cout<<"  --verbose         show the sampler's output"<<std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	benchOptions options;
+	for(int i = 1 ; i<argc; i++){
+		std::string arg(argv[i]);
+		if(arg == "--help" || arg == "-h"){
+			usage();
+			return 0;
+		}
+		else if(arg == "--weak"){
+			options.weak = true;
+			continue;
+		}
+		else if(arg == "--verbose"){
+			options.verbose = true;
+			continue;
+		}
+		if(i+1 >= argc){
+			std::cout<<"ERROR -- missing value for "<<arg<<std::endl;
+			usage();
+			return 1;
+		}
+		std::string value(argv[++i]);
+		if(arg == "--workloads"){ options.workloads = splitList(value);}
+		else if(arg == "--threads"){ options.threads = splitIntList(value);}
+		else if(arg == "--ensembleN"){ options.ensembleN = splitIntList(value);}
+		else if(arg == "--ensembleSize"){ options.ensembleSize = splitIntList(value);}
+		else if(arg == "--threadPool"){ options.threadPool = splitIntList(value);}
+		else if(arg == "--iterations"){ options.iterations = std::stoi(value);}
+		else if(arg == "--burnIterations"){ options.burnIterations = std::stoi(value);}
+		else if(arg == "--outputDir"){ options.outputDir = value;}
+		else if(arg == "--output"){ options.outputFile = value;}
+		else{
+			std::cout<<"ERROR -- unknown option "<<arg<<std::endl;
+			usage();
+			return 1;
+		}
+	}
+	for(size_t i = 0 ; i<options.workloads.size(); i++){
+		benchWorkload *workload = makeWorkload(options.workloads[i]);
+		if(!workload){
+			std::cout<<"ERROR -- unknown workload "<<options.workloads[i]<<std::endl;
+			return 1;
+		}
+		delete workload;
+	}
+	if(options.outputDir.back() != '/'){
+		options.outputDir+="/";
+	}
+	mkdir(options.outputDir.c_str(), 0755);
+
+	nlohmann::json report;
+	report["benchmark"] = "bayesship_bench";
+	report["scaling"] = (options.weak) ? "weak" : "strong";
+	report["hardwareThreads"] = std::thread::hardware_concurrency();
+	report["results"] = nlohmann::json::array();
+	for(size_t w = 0 ; w<options.workloads.size(); w++){
+		for(size_t t = 0 ; t<options.threads.size(); t++){
+			for(size_t e = 0 ; e<options.ensembleN.size(); e++){
+				for(size_t s = 0 ; s<options.ensembleSize.size(); s++){
+					for(size_t p = 0 ; p<options.threadPool.size(); p++){
+						benchConfig config;
+						config.workload = options.workloads[w];
+						config.threads = options.threads[t];
+						config.ensembleN = options.ensembleN[e];
+						if(options.weak){
+							config.ensembleN *= config.threads;
+						}
+						config.ensembleSize = options.ensembleSize[s];
+						config.threadPool = options.threadPool[p] != 0;
+						nlohmann::json result = runConfigIsolated(config, options);
+						std::cerr<<result.dump()<<std::endl;
+						report["results"].push_back(result);
+					}
+				}
+			}
+		}
+	}
+	if(options.outputFile.empty()){
+		std::cout<<report.dump(2)<<std::endl;
+	}
+	else{
+		std::ofstream outFile(options.outputFile);
+		outFile<<report.dump(2)<<std::endl;
+		outFile.close();
+	}
+	return 0;
+}
@@ -0,0 +1,358 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/dataUtilities.h>
+#include <bayesship/ThreadPool.h>
+#include <bayesship/proposalFunctions.h>
+#include "../../unit_tests/testSupport.h"
+#include "../../unit_tests/overhead/allocationCounter.h"
+
+/*! \file
+ *
+ * # Framework overhead micro-benchmarks
+ *
+ * Times the pieces of the sampler that run on every step -- stepMH, chainSwap, positionInfo::updatePosition, ThreadPool and ThreadPoolPair dispatch, and samplerData::extendSize -- with a likelihood and prior that cost nothing, so the numbers are the overhead the library itself adds.
+ *
+ * Every kernel reports ns/step and heap allocations/step (counted by allocationCounter, see unit_tests/overhead/allocationCounter.h).
+ *
+ * unit_tests/overhead/overhead_test.cpp gates the same kernels in the unit tests.
+ */
+
+//##############################################################
+// Kernels
+//##############################################################
+
+/*! \brief Result of one kernel*/
+struct kernelResult
+{
+	double nsPerStep=0;
+	double allocationsPerStep=0;
+	long long steps=0;
+};
+
+typedef std::chrono::steady_clock benchClock;
+
+double elapsedNS(benchClock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(benchClock::now() - start).count();
+}
+
+/*! \brief Memory budget for the stored chains -- long runs are shortened to fit*/
+static const double memoryBudget = 256.*1024*1024;
+
+int stepsInBudget(int maxDim, int chainN, int steps)
+{
+	double perStep = (double)maxDim*chainN*sizeof(double);
+	int fit = (int)(memoryBudget/perStep);
+	if(fit < steps){
+		steps = fit;
+	}
+	return std::max(steps, 2);
+}
+
+kernelResult benchStepMH(int maxDim, int chainN, int steps)
+{
+	steps = stepsInBudget(maxDim, chainN, steps);
+	overheadSampler fixture(maxDim, chainN, steps+1);
+	int n = fixture.sampler->ensembleN*fixture.sampler->ensembleSize;
+	/*One untimed step, so the proposals have a history and their first-call allocations aren't counted*/
+	for(int c = 0 ; c<n; c++){
+		fixture.sampler->stepMH(c, fixture.data);
+	}
+	allocationCounter allocations;
+	auto start = benchClock::now();
+	for(int s = 1 ; s<steps; s++){
+		for(int c = 0 ; c<n; c++){
+			fixture.sampler->stepMH(c, fixture.data);
+		}
+	}
+	kernelResult result;
+	result.steps = (long long)(steps-1)*n;
+	result.nsPerStep = elapsedNS(start)/result.steps;
+	result.allocationsPerStep = (double)allocations.count()/result.steps;
+	return result;
+}
+
+kernelResult benchChainSwap(int maxDim, int chainN, int swaps)
+{
+	overheadSampler fixture(maxDim, chainN, 2);
+	bayesship::bayesshipSampler *sampler = fixture.sampler;
+	int rounds = std::max(swaps/sampler->ensembleN, 1);
+	allocationCounter allocations;
+	auto start = benchClock::now();
+	for(int r = 0 ; r<rounds; r++){
+		for(int e = 0 ; e<sampler->ensembleN; e++){
+			sampler->chainSwap(sampler->chainIndex(e,0), sampler->chainIndex(e,1), fixture.data);
+		}
+	}
+	kernelResult result;
+	result.steps = (long long)rounds*sampler->ensembleN;
+	result.nsPerStep = elapsedNS(start)/result.steps;
+	result.allocationsPerStep = (double)allocations.count()/result.steps;
+	return result;
+}
+
+kernelResult benchUpdatePosition(int maxDim, int updates)
+{
+	bayesship::positionInfo a(maxDim, false);
+	bayesship::positionInfo b(maxDim, false);
+	for(int i = 0 ; i<maxDim; i++){
+		a.parameters[i] = i;
+		b.parameters[i] = -i;
+	}
+	updates = std::max(updates/maxDim, 100);
+	allocationCounter allocations;
+	auto start = benchClock::now();
+	for(int i = 0 ; i<updates; i++){
+		if(i%2 == 0){
+			a.updatePosition(&b);
+		}
+		else{
+			b.updatePosition(&a);
+		}
+	}
+	kernelResult result;
+	result.steps = updates;
+	result.nsPerStep = elapsedNS(start)/result.steps;
+	result.allocationsPerStep = (double)allocations.count()/result.steps;
+	return result;
+}
+
+/*! \brief Round trip through a ThreadPool -- chainN jobs are queued per round, and the round ends when every job has run
+ */
+kernelResult benchThreadPool(int chainN, int jobs, int threads)
+{
+	std::atomic<long long> done{0};
+	bayesship::ThreadPool<int> *pool = new bayesship::ThreadPool<int>(threads, [&](int thread, int job){done.fetch_add(1, std::memory_order_relaxed);});
+	int rounds = std::max(jobs/chainN, 1);
+	allocationCounter allocations;
+	auto start = benchClock::now();
+	for(int r = 0 ; r<rounds; r++){
+		for(int i = 0 ; i<chainN; i++){
+			pool->enqueue(i);
+		}
+		long long target = (long long)(r+1)*chainN;
+		while(done.load() < target){
+			std::this_thread::yield();
+		}
+	}
+	kernelResult result;
+	result.steps = (long long)rounds*chainN;
+	result.nsPerStep = elapsedNS(start)/result.steps;
+	result.allocationsPerStep = (double)allocations.count()/result.steps;
+	pool->stopPool();
+	delete pool;
+	return result;
+}
+
+/*! \brief Pairing through a bucketed ThreadPoolPair, set up the way the sampler sets up its swap pool (chains bucketed by temperature, pairs between neighbouring temperatures)
+ */
+kernelResult benchThreadPoolPair(int chainN, int jobs)
+{
+	int ensembleSize = 2;
+	int ensembleN = std::max(chainN/ensembleSize, 1);
+	chainN = ensembleN*ensembleSize;
+	std::atomic<long long> done{0};
+	bayesship::ThreadPoolPair<int> *pool = new bayesship::ThreadPoolPair<int>(1,
+		[&](int thread, int j, int k){done.fetch_add(2, std::memory_order_relaxed);},
+		[&](int j){return j/ensembleN;},
+		ensembleSize,
+		[&](int a, int b){return a != b;},
+		2
+	);
+	int rounds = std::max(jobs/chainN, 1);
+	allocationCounter allocations;
+	auto start = benchClock::now();
+	for(int r = 0 ; r<rounds; r++){
+		/*Alternate temperatures, so every job finds a partner*/
+		for(int e = 0 ; e<ensembleN; e++){
+			for(int b = 0 ; b<ensembleSize; b++){
+				pool->enqueue(e + b*ensembleN);
+			}
+		}
+		long long target = (long long)(r+1)*chainN;
+		while(done.load() < target){
+			std::this_thread::yield();
+		}
+	}
+	kernelResult result;
+	result.steps = (long long)rounds*chainN;
+	result.nsPerStep = elapsedNS(start)/result.steps;
+	result.allocationsPerStep = (double)allocations.count()/result.steps;
+	pool->stopPool();
+	delete pool;
+	return result;
+}
+
+/*! \brief Growing samplerData between batches -- reported per appended step, per chain
+ */
+kernelResult benchExtendSize(int maxDim, int chainN, int steps)
+{
+	int block = 64;
+	steps = stepsInBudget(maxDim, chainN, steps);
+	int calls = std::max(steps/block, 1);
+	int ensembleN = std::max(chainN/2, 1);
+	double betas[2*ensembleN];
+	for(int i = 0 ; i<2*ensembleN; i++){
+		betas[i] = (i < ensembleN) ? 1 : .5;
+	}
+	bayesship::samplerData *data = new bayesship::samplerData(maxDim, ensembleN, 2, block, 1, false, betas);
+	allocationCounter allocations;
+	auto start = benchClock::now();
+	for(int i = 0 ; i<calls; i++){
+		data->extendSize(block);
+	}
+	kernelResult result;
+	result.steps = (long long)calls*block*2*ensembleN;
+	result.nsPerStep = elapsedNS(start)/result.steps;
+	result.allocationsPerStep = (double)allocations.count()/result.steps;
+	delete data;
+	return result;
+}
+
+//##############################################################
+// Driver
+//##############################################################
+
+std::vector<int> splitIntList(std::string list)
+{
+	std::vector<int> items;
+	std::stringstream stream(list);
+	std::string item;
+	while(std::getline(stream, item, ',')){
+		if(!item.empty()){
+			items.push_back(std::stoi(item));
+		}
+	}
+	return items;
+}
+
+nlohmann::json toJSON(std::string kernel, int maxDim, int chainN, kernelResult result)
+{
+	nlohmann::json entry;
+	entry["kernel"] = kernel;
+	entry["maxDim"] = maxDim;
+	entry["chainN"] = chainN;
+	entry["steps"] = result.steps;
+	entry["nsPerStep"] = result.nsPerStep;
+	entry["allocationsPerStep"] = result.allocationsPerStep;
+	std::cerr<<kernel<<" maxDim "<<maxDim<<" chainN "<<chainN<<": "<<result.nsPerStep<<" ns/step, "<<result.allocationsPerStep<<" allocations/step"<<std::endl;
+	return entry;
+}
+
+void usage()
+{
+	std::cout<<"bayesship_microbench -- framework overhead with a zero cost likelihood"<<std::endl;
+	std::cout<<"Options (lists are comma separated):"<<std::endl;
+	std::cout<<"  --maxDim      dimensions to sweep (default 1,10,100,1000,10000)"<<std::endl;
+	std::cout<<"  --chainN      chain counts to sweep (default 2,10,100,1000,10000)"<<std::endl;
+	std::cout<<"  --fixedDim    dimension used while sweeping chainN (default 10)"<<std::endl;
+	std::cout<<"  --fixedChainN chain count used while sweeping maxDim (default 10)"<<std::endl;
+	std::cout<<"  --grid        sweep every (maxDim, chainN) pair instead of one axis at a time"<<std::endl;
+	std::cout<<"  --steps       steps per chain (default 1000, shortened to fit 256MB of chain storage)"<<std::endl;
+	std::cout<<"  --poolThreads worker threads for the ThreadPool kernel (default 2)"<<std::endl;
+	std::cout<<"  --output      JSON file for the results (default stdout)"<<std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<int> dims = {1,10,100,1000,10000};
+	std::vector<int> chains = {2,10,100,1000,10000};
+	int fixedDim = 10;
+	int fixedChainN = 10;
+	bool grid = false;
+	int steps = 1000;
+	int poolThreads = 2;
+	std::string outputFile = "";
+	for(int i = 1 ; i<argc; i++){
+		std::string arg(argv[i]);
+		if(arg == "--help" || arg == "-h"){
+			usage();
+			return 0;
+		}
+		else if(arg == "--grid"){
+			grid = true;
+			continue;
+		}
+		if(i+1 >= argc){
+			std::cout<<"ERROR -- missing value for "<<arg<<std::endl;
+			usage();
+			return 1;
+		}
+		std::string value(argv[++i]);
+		if(arg == "--maxDim"){ dims = splitIntList(value);}
+		else if(arg == "--chainN"){ chains = splitIntList(value);}
+		else if(arg == "--fixedDim"){ fixedDim = std::stoi(value);}
+		else if(arg == "--fixedChainN"){ fixedChainN = std::stoi(value);}
+		else if(arg == "--steps"){ steps = std::stoi(value);}
+		else if(arg == "--poolThreads"){ poolThreads = std::stoi(value);}
+		else if(arg == "--output"){ outputFile = value;}
+		else{
+			std::cout<<"ERROR -- unknown option "<<arg<<std::endl;
+			usage();
+			return 1;
+		}
+	}
+
+	/*(maxDim, chainN) pairs for the kernels that depend on both*/
+	std::vector<std::pair<int,int>> configs;
+	if(grid){
+		for(size_t d = 0 ; d<dims.size(); d++){
+			for(size_t c = 0 ; c<chains.size(); c++){
+				configs.push_back(std::pair<int,int>(dims[d], chains[c]));
+			}
+		}
+	}
+	else{
+		for(size_t d = 0 ; d<dims.size(); d++){
+			configs.push_back(std::pair<int,int>(dims[d], fixedChainN));
+		}
+		for(size_t c = 0 ; c<chains.size(); c++){
+			if(chains[c] != fixedChainN || std::find(dims.begin(), dims.end(), fixedDim) == dims.end()){
+				configs.push_back(std::pair<int,int>(fixedDim, chains[c]));
+			}
+		}
+	}
+
+	/*The samplers print setup messages -- keep stdout for the report*/
+	std::streambuf *coutBuffer = std::cout.rdbuf();
+	std::ostringstream discard;
+	std::cout.rdbuf(discard.rdbuf());
+
+	nlohmann::json report;
+	report["benchmark"] = "bayesship_microbench";
+	report["results"] = nlohmann::json::array();
+	for(size_t i = 0 ; i<configs.size(); i++){
+		int maxDim = configs[i].first;
+		int chainN = configs[i].second;
+		report["results"].push_back(toJSON("stepMH", maxDim, chainN, benchStepMH(maxDim, chainN, steps)));
+		report["results"].push_back(toJSON("chainSwap", maxDim, chainN, benchChainSwap(maxDim, chainN, 100*steps)));
+		report["results"].push_back(toJSON("extendSize", maxDim, chainN, benchExtendSize(maxDim, chainN, steps)));
+	}
+	for(size_t d = 0 ; d<dims.size(); d++){
+		report["results"].push_back(toJSON("updatePosition", dims[d], 1, benchUpdatePosition(dims[d], 1000*steps)));
+	}
+	for(size_t c = 0 ; c<chains.size(); c++){
+		report["results"].push_back(toJSON("ThreadPool", 0, chains[c], benchThreadPool(chains[c], 100*steps, poolThreads)));
+		report["results"].push_back(toJSON("ThreadPoolPair", 0, chains[c], benchThreadPoolPair(chains[c], 100*steps)));
+	}
+
+	std::cout.rdbuf(coutBuffer);
+	if(outputFile.empty()){
+		std::cout<<report.dump(2)<<std::endl;
+	}
+	else{
+		std::ofstream outFile(outputFile);
+		outFile<<report.dump(2)<<std::endl;
+		outFile.close();
+	}
+	return 0;
+}
@@ -6,40 +6,7 @@
 #include <bayesship/proposalFunctions.h>
 #include <limits.h>
 #include <math.h>
-
-class bimodal2DPrior: public bayesship::probabilityFn
-{
-public:
-	virtual double eval(bayesship::positionInfo *position, int chainID)
-	{
-		if(fabs(position->parameters[0]) > 4 ){
-			return -std::numeric_limits<double>::infinity();
-		}
-		else if(fabs(position->parameters[1]) > 4 ){
-			return -std::numeric_limits<double>::infinity();
-		}
-		return 0;
-
-	}
-
-};
-
-class bimodal2DLikelihood: public bayesship::probabilityFn
-{
-public:
-	virtual double eval(bayesship::positionInfo *position, int chainID)
-	{
-		//return 2;
-		double x = position->parameters[0];
-		double y = position->parameters[1];
-		double power1 = -x*x - (9. + 4 * x * x + 8 *y)*(9. + 4 * x * x + 8 *y);
-		double power2 = -8*x*x - 8*(y-2)*(y-2);
-		return log( 16. / 3. / M_PI *( exp(power1) + .5* exp(power2)));
-
-	}
-
-};
-
+#include "bimodal2D.h"
 
 int main(int argc, char *argv[])
 {
@@ -0,0 +1,46 @@
+#ifndef BIMODAL2D_H
+#define BIMODAL2D_H
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/utilities.h>
+#include <limits>
+#include <math.h>
+
+/*! \file
+ *
+ * # Target of the bimodal2D example -- two separated modes in two dimensions, with a flat prior on [-4,4]^2 (also used by benchmarks/src/bayesshipBench.cpp)
+ */
+
+class bimodal2DPrior: public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		if(fabs(position->parameters[0]) > 4 ){
+			return -std::numeric_limits<double>::infinity();
+		}
+		else if(fabs(position->parameters[1]) > 4 ){
+			return -std::numeric_limits<double>::infinity();
+		}
+		return 0;
+
+	}
+
+};
+
+class bimodal2DLikelihood: public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		//return 2;
+		double x = position->parameters[0];
+		double y = position->parameters[1];
+		double power1 = -x*x - (9. + 4 * x * x + 8 *y)*(9. + 4 * x * x + 8 *y);
+		double power2 = -8*x*x - 8*(y-2)*(y-2);
+		return log( 16. / 3. / M_PI *( exp(power1) + .5* exp(power2)));
+
+	}
+
+};
+
+#endif
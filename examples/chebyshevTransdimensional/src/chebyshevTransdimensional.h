@@ -0,0 +1,137 @@
+#ifndef CHEBYSHEVTRANSDIMENSIONAL_H
+#define CHEBYSHEVTRANSDIMENSIONAL_H
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/utilities.h>
+#include <limits>
+#include <math.h>
+#include <gsl/gsl_rng.h>
+
+/*! \file
+ *
+ * # Targets of the chebyshevTransdimensional example -- a Chebyshev series fit to noisy data
+ *
+ * chebyshevLikelihood samples the number of coefficients (RJ), chebyshevLikelihoodSingle fixes it to maxDim-1. The RJ target is also used by benchmarks/src/bayesshipBench.cpp
+ */
+
+struct trans_helper
+{
+	int N;
+	double dt;
+	double * data;
+	gsl_rng *r;
+};
+
+inline double Chebyshev_fn(int P, double *coeff, double x)
+{
+	double sum = 0 ;
+	for (int i = 0 ; i<P; i++){
+		sum += coeff[i] * std::cos( i * std::acos(x));
+	}
+	return sum;
+}
+
+class chebyshevLikelihoodSingle: public bayesship::probabilityFn
+{
+public:
+	trans_helper *h;
+	bayesship::bayesshipSampler *sampler;
+	virtual double eval(bayesship::positionInfo *param, int chainid)
+	{
+		//return 1;
+		//sigma first, always there
+		//start at 1 so there's always at least one coeff
+		double reconst_signal[h->N];
+		double dn =2. / ( h->N-1); 
+		for(int i = 0 ; i < h->N; i++){
+			reconst_signal[i] = Chebyshev_fn(sampler->maxDim-1, &(param->parameters[1]), -1 + i *dn );
+		}
+		
+		double ll = 0;
+		for (int i = 0 ; i<h->N; i++){
+			ll -= bayesship::powInt((h->data[i] - reconst_signal[i]),2) ;
+		}
+		ll /= ( 2. * param->parameters[0]*param->parameters[0]);
+		ll-= (h->N / 2.)*std::log(2. * M_PI * param->parameters[0]*param->parameters[0]);
+		
+		return ll;
+
+	}
+};
+
+class chebyshevPriorSingle: public bayesship::probabilityFn
+{
+public:
+	bayesship::bayesshipSampler *sampler;
+	virtual double eval(bayesship::positionInfo *param, int chainid)
+	{
+		double a = -std::numeric_limits<double>::infinity();
+		double prior=1;
+		if (param->parameters[0] < .01|| param->parameters[0] > 10){ return a;}
+		prior*= 1. /(10-.01); 	
+		for(int i = 1 ; i<sampler->maxDim; i++){
+			if (param->parameters[i] < -10|| param->parameters[i] > 10){ return a;}
+			prior*= 1. /(20); 	
+		}
+		return std::log(prior);
+		//return 1;
+
+	}
+};
+
+class chebyshevLikelihood: public bayesship::probabilityFn
+{
+public:
+	trans_helper *h;
+	bayesship::bayesshipSampler *sampler;
+	virtual double eval(bayesship::positionInfo *param, int chainid)
+	{
+		//return 1;
+		//sigma first, always there
+		//start at 1 so there's always at least one coeff
+		int p = 1;
+		for(int i = 2 ; i<sampler->maxDim; i++){
+			if(param->status[i] == 0){
+				break;
+			}
+			p+=1;
+		}
+		double reconst_signal[h->N];
+		double dn =2. / ( h->N-1); 
+		for(int i = 0 ; i < h->N; i++){
+			reconst_signal[i] = Chebyshev_fn(p, &(param->parameters[1]), -1 + i *dn );
+		}
+		
+		double ll = 0;
+		for (int i = 0 ; i<h->N; i++){
+			ll -= bayesship::powInt((h->data[i] - reconst_signal[i]),2) ;
+		}
+		ll /= ( 2. * param->parameters[0]*param->parameters[0]);
+		ll-= (h->N / 2.)*std::log(2. * M_PI * param->parameters[0]*param->parameters[0]);
+		
+		return ll;
+
+	}
+};
+
+class chebyshevPrior: public bayesship::probabilityFn
+{
+public:
+	bayesship::bayesshipSampler *sampler;
+	virtual double eval(bayesship::positionInfo *param, int chainid)
+	{
+		double a = -std::numeric_limits<double>::infinity();
+		double prior=1;
+		if (param->parameters[0] < .01|| param->parameters[0] > 10){ return a;}
+		prior*= 1. /(10-.01); 	
+		for(int i = 1 ; i<sampler->maxDim; i++){
+			if(param->status[i] !=0){
+				if (param->parameters[i] < -10|| param->parameters[i] > 10){ return a;}
+				prior*= 1. /(20); 	
+			}
+		}
+		return std::log(prior);
+		//return 1;
+	}
+};
+
+#endif
@@ -6,37 +6,14 @@
 #include <bayesship/proposalFunctions.h>
 #include <limits.h>
 #include <math.h>
+#include "gaussian1D.h"
 
 
-class uniformPrior: public bayesship::probabilityFn
-{
-public:
-	virtual double eval(bayesship::positionInfo *position, int chainID)
-	{
-		if(fabs(position->parameters[0]) > 10 ){
-			return -std::numeric_limits<double>::infinity();
-		}
-		return 0;
-
-	}
-};
-
-class gaussianLikelihood: public bayesship::probabilityFn
-{
-public:
-	virtual double eval(bayesship::positionInfo *position, int chainID)
-	{
-		//return 0;
-		return -.5 * (position->parameters[0]*position->parameters[0]);
-
-	}
-};
-
 int main(int argc, char *argv[])
 {
 	//bayesship::bayesshipSampler *sampler = new bayesship::bayesshipSampler(gaussianLikelihood,uniformPrior);
-	gaussianLikelihood *gl = new gaussianLikelihood();
-	uniformPrior *up = new uniformPrior();
+	gaussian1DLikelihood *gl = new gaussian1DLikelihood();
+	gaussian1DPrior *up = new gaussian1DPrior();
 	bayesship::bayesshipSampler *sampler = new bayesship::bayesshipSampler(gl,up);
 
 	sampler->maxDim = 1;
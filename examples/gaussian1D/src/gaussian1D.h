@@ -0,0 +1,37 @@
+#ifndef GAUSSIAN1D_H
+#define GAUSSIAN1D_H
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/utilities.h>
+#include <limits>
+#include <math.h>
+
+/*! \file
+ *
+ * # Target of the gaussian1D example -- a unit normal likelihood in one dimension, with a flat prior on [-10,10] (also used by benchmarks/src/bayesshipBench.cpp)
+ */
+
+class gaussian1DPrior: public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		if(fabs(position->parameters[0]) > 10 ){
+			return -std::numeric_limits<double>::infinity();
+		}
+		return 0;
+
+	}
+};
+
+class gaussian1DLikelihood: public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		//return 0;
+		return -.5 * (position->parameters[0]*position->parameters[0]);
+
+	}
+};
+
+#endif
@@ -6,56 +6,9 @@
 #include <bayesship/proposalFunctions.h>
 #include <limits.h>
 #include <math.h>
+#include "rosenbock.h"
 
 
-class uniformPrior: public bayesship::probabilityFn
-{
-public:
-	int maxDim;
-	double **maxBounds;
-	virtual double eval(bayesship::positionInfo *position, int chainID)
-	{
-		for(int i = 0 ; i<maxDim; i++)
-		{
-			if(position->parameters[i] < maxBounds[i][0] || position->parameters[i] > maxBounds[i][1]  ){
-				return -std::numeric_limits<double>::infinity();
-			}
-		}
-		return 0;
-
-	}
-};
-
-class rosenbockLikelihood: public bayesship::probabilityFn
-{
-public:
-	double a;
-	double mu;
-	int n1;
-	int n2;
-	int n;
-	double *b;
-	virtual double eval(bayesship::positionInfo *position, int chainID)
-	{
-		double *c = position->parameters;
-		double LL = 0;
-		LL-= a * bayesship::powInt(c[0] - mu,2)	;
-		for(int j = 0 ; j<n2; j++){
-			for(int i = 1 ; i<n1; i++){
-				if(i == 1){
-					LL -= b[(j)*(n1-1) + i]*bayesship::powInt(c[(j)*(n1-1) + i] - c[0]*c[0],2);
-				}
-				else{
-					LL -= b[(j)*(n1-1) + i]*bayesship::powInt(c[(j)*(n1-1) + i] - c[(j)*(n1-1) + i-1]*c[(j)*(n1-1) + i-1],2);
-
-				}
-			}
-		}
-		return LL;
-
-	}
-};
-
 int main(int argc, char *argv[])
 {
 
@@ -89,11 +42,12 @@ int main(int argc, char *argv[])
 
 	rosenbockLikelihood *rl = new rosenbockLikelihood();
 	rl->a = a;
+	rl->mu = mu;
 	rl->b = &b[0];
 	rl->n1 = n1;
 	rl->n2 = n2;
 	rl->n = n;
-	uniformPrior *up = new uniformPrior();
+	rosenbockPrior *up = new rosenbockPrior();
 	bayesship::bayesshipSampler *sampler = new bayesship::bayesshipSampler(rl,up);
 
 	sampler->maxDim = n;
@@ -0,0 +1,61 @@
+#ifndef ROSENBOCK_H
+#define ROSENBOCK_H
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/utilities.h>
+#include <limits>
+#include <math.h>
+
+/*! \file
+ *
+ * # Target of the rosenbock example -- the hybrid Rosenbrock density, with a flat prior inside maxBounds (also used by benchmarks/src/bayesshipBench.cpp)
+ */
+
+class rosenbockPrior: public bayesship::probabilityFn
+{
+public:
+	int maxDim;
+	double **maxBounds;
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		for(int i = 0 ; i<maxDim; i++)
+		{
+			if(position->parameters[i] < maxBounds[i][0] || position->parameters[i] > maxBounds[i][1]  ){
+				return -std::numeric_limits<double>::infinity();
+			}
+		}
+		return 0;
+
+	}
+};
+
+class rosenbockLikelihood: public bayesship::probabilityFn
+{
+public:
+	double a;
+	double mu;
+	int n1;
+	int n2;
+	int n;
+	double *b;
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		double *c = position->parameters;
+		double LL = 0;
+		LL-= a * bayesship::powInt(c[0] - mu,2)	;
+		for(int j = 0 ; j<n2; j++){
+			for(int i = 1 ; i<n1; i++){
+				if(i == 1){
+					LL -= b[(j)*(n1-1) + i]*bayesship::powInt(c[(j)*(n1-1) + i] - c[0]*c[0],2);
+				}
+				else{
+					LL -= b[(j)*(n1-1) + i]*bayesship::powInt(c[(j)*(n1-1) + i] - c[(j)*(n1-1) + i-1]*c[(j)*(n1-1) + i-1],2);
+
+				}
+			}
+		}
+		return LL;
+
+	}
+};
+
+#endif
@@ -5,10 +5,12 @@
 #include <functional>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <gsl/gsl_rng.h>
+#include "bayesship/threadAffinity.h"
 
 namespace bayesship{
 
@@ -153,6 +155,19 @@ public:
 		stop();
 	}
 
+	/*! \brief Pin the threads of the pool -- thread i is placed on affinity's CPU for i+threadOffset
+	 *
+	 * Takes effect the next time the pool is started. affinity must outlive the pool
+	 */
+	void setAffinity(
+		threadAffinity *affinity,/**< CPU assignment (nullptr to stop pinning)*/
+		int threadOffset=0/**< Offset into affinity's thread slots, so several pools can share one assignment without overlapping*/
+		)
+	{
+		this->affinity = affinity;
+		this->affinityOffset = threadOffset;
+	}
+
 	/*! \brief Returns the job at index ''i'' in the tasks array*/
 	jobtype taskFetch(int i){
 		{
@@ -162,6 +177,12 @@ public:
 	}
 	
 private:
+	/*! Optional CPU assignment for the threads*/
+	threadAffinity *affinity=nullptr;
+
+	/*! Offset into the affinity's thread slots*/
+	int affinityOffset=0;
+
 	/*! Internal flag  to randomize the selection of the jobs from the queue*/
 	bool randomizeJobsFlag = false;
 
@@ -185,7 +206,7 @@ private:
 
 	/*! Queue of jobs*/
 	//std::priority_queue<jobtype,std::vector<jobtype>, comparator> tasksQueue;
-	std::vector<jobtype> tasks;
+	std::deque<jobtype> tasks;
 	const gsl_rng_type * T;
   	gsl_rng * r=NULL;
 	
@@ -196,6 +217,9 @@ private:
 		for(auto i =0u; i<numThreads; i++)
 		{
 			Threads.emplace_back([=]{
+				if(affinity){
+					affinity->pinCurrentThread(i+affinityOffset);
+				}
 				while(true)
 				{
 					jobtype j;
@@ -284,6 +308,42 @@ public:
 			this->start(numThreads);
 		}
 	}
+
+	/*! \brief Constructor for bucketed pairing
+	 *
+	 * Waiting jobs are sorted into bucketN buckets by bucket_fn, and whether two jobs can pair is decided by their buckets alone (bucket_match). The partner buckets of every bucket are worked out once here, nearest first, so a new job is paired with the oldest job of the first partner bucket that has one waiting -- O(partner buckets), however many jobs are waiting.
+	 */
+	explicit ThreadPoolPair(std::size_t numThreads,
+		std::function<void(int,jobtype,jobtype)> work_fn,
+		std::function<int(jobtype)> bucket_fn,/**< Maps a job to its bucket, in [0,bucketN)*/
+		int bucketN,/**< Number of buckets*/
+		std::function<bool(int,int)> bucket_match,/**< Whether every job in the first bucket can pair with every job in the second*/
+		int bucketRadius,/**< Only buckets with |bucket_i - bucket_j| < bucketRadius can pair -- values <=0 allow any distance*/
+		bool initiatePool=true)
+	{
+		this->work_fn_internal = work_fn;
+		this->bucket_fn = bucket_fn;
+		this->numThreads_internal = numThreads;
+		this->buckets = std::vector<std::deque<jobtype>>(bucketN);
+		this->partnerBuckets = std::vector<std::vector<int>>(bucketN);
+		if(bucketRadius <= 0 || bucketRadius > bucketN){
+			bucketRadius = bucketN;
+		}
+		for(int a = 0 ; a<bucketN; a++){
+			for(int d = 0 ; d<bucketRadius; d++){
+				if(a-d >= 0 && bucket_match(a, a-d)){
+					partnerBuckets[a].push_back(a-d);
+				}
+				if(d > 0 && a+d < bucketN && bucket_match(a, a+d)){
+					partnerBuckets[a].push_back(a+d);
+				}
+			}
+		}
+
+		if(initiatePool){
+			this->start(numThreads);
+		}
+	}
 	
 	/*! \brief Destructor -- stops threads
 	 */
@@ -304,6 +364,10 @@ public:
 		jobtype job_id/**< Job ID to put in the workk queue*/
 	)
 	{
+		if(bucket_fn){
+			enqueueBucketed(job_id);
+			return;
+		}
 		{
 			//tasks.push_back(std::move(job_id));
 			std::unique_lock<std::mutex> lock{this->pairMutex};
@@ -346,6 +410,20 @@ public:
 
 	void flushPairQueue()
 	{
+		if(bucket_fn){
+			std::vector<jobtype> waiting;
+			{
+				std::unique_lock<std::mutex> lock{this->pairMutex};
+				for(size_t b = 0 ; b<buckets.size(); b++){
+					waiting.insert(waiting.end(), buckets[b].begin(), buckets[b].end());
+					buckets[b].clear();
+				}
+			}
+			for(size_t i = 0 ; i<waiting.size(); i++){
+				this->enqueue(waiting[i]);
+			}
+			return;
+		}
 		int size;
 		{
 			std::unique_lock<std::mutex> lock{this->pairMutex};
@@ -423,6 +501,19 @@ public:
 		stop();
 	}
 
+	/*! \brief Pin the threads of the pool -- thread i is placed on affinity's CPU for i+threadOffset
+	 *
+	 * Takes effect the next time the pool is started. affinity must outlive the pool
+	 */
+	void setAffinity(
+		threadAffinity *affinity,/**< CPU assignment (nullptr to stop pinning)*/
+		int threadOffset=0/**< Offset into affinity's thread slots, so several pools can share one assignment without overlapping*/
+		)
+	{
+		this->affinity = affinity;
+		this->affinityOffset = threadOffset;
+	}
+
 	/*! \brief Returns the job at index ''i'' in the tasks array*/
 	jobtype taskFetch(int i){
 		{
@@ -441,12 +532,55 @@ private:
 	std::function<bool(jobtype, jobtype)> pair_match;
 	std::function<void(int i , jobtype, jobtype)> work_fn_internal;
 
-	std::vector<jobPair> tasks;
+	std::deque<jobPair> tasks;
 	std::vector<jobtype> prePaired;
 
+	/*! Maps a job to its bucket -- empty unless the bucketed constructor was used*/
+	std::function<int(jobtype)> bucket_fn;
+	/*! Waiting jobs, sorted by bucket*/
+	std::vector<std::deque<jobtype>> buckets;
+	/*! Buckets each bucket can pair with, nearest first*/
+	std::vector<std::vector<int>> partnerBuckets;
+
+	/*! \brief Pairs job_id with the oldest job of its nearest partner bucket that has one waiting, or leaves it waiting in its own bucket
+	 */
+	void enqueueBucketed(jobtype job_id)
+	{
+		int bucket = bucket_fn(job_id);
+		jobtype job2;
+		{
+			std::unique_lock<std::mutex> lock{this->pairMutex};
+			const std::vector<int> &partners = partnerBuckets[bucket];
+			size_t i = 0;
+			while(i<partners.size() && buckets[partners[i]].empty()){
+				i++;
+			}
+			if(i == partners.size()){
+				buckets[bucket].push_back(job_id);
+				return;
+			}
+			job2 = buckets[partners[i]].front();
+			buckets[partners[i]].pop_front();
+		}
+		jobPair pair;
+		pair.job1 = job_id;	
+		pair.job2 = job2;	
+		{
+			std::unique_lock<std::mutex> lock{this->EventMutex};
+			tasks.push_back(pair);
+			this->EventVar.notify_one();
+		}
+	}
+
 	/*! Lock to prevent memory races*/
 	std::mutex pairMutex;
 
+	/*! Optional CPU assignment for the threads*/
+	threadAffinity *affinity=nullptr;
+
+	/*! Offset into the affinity's thread slots*/
+	int affinityOffset=0;
+
 	/*! Internal flag  to randomize the selection of the jobs from the queue*/
 	bool randomizeJobsFlag = false;
 
@@ -479,6 +613,9 @@ private:
 		for(auto i =0u; i<numThreads; i++)
 		{
 			this->Threads.emplace_back([=]{
+				if(this->affinity){
+					this->affinity->pinCurrentThread(i+this->affinityOffset);
+				}
 				while(true)
 				{
 					jobtype j,k;
@@ -542,5 +679,271 @@ private:
 	}
 };
 
+/*! \brief Class for a persistent team of threads that processes work in synchronized epochs
+ *
+ * Template parameters:
+ *
+ * jobtype defines a structure or class that represents a job or task
+ *
+ * Jobs are staged with enqueue, then runEpoch releases the whole batch to the team and blocks until every thread has crossed the barrier at the end of the epoch.
+ *
+ * The threads live until the object is destroyed (or stopPool is called), so the cost of dispatching a batch is one barrier crossing instead of launching and joining every thread.
+ */
+template<class jobtype=int>
+class ThreadPoolBarrier
+{
+public:
+
+	/*! \brief Constructor -- starts the team of threads, which wait for the first epoch
+	 */
+	explicit ThreadPoolBarrier(
+		std::size_t numThreads, /**< Number of threads to launch*/
+		std::function<void(int, jobtype)> work_fn,/**< Function to call for each job*/
+		bool initiatePool=true /**< Automatically begin the thread pool -- if false, the user must start the thread pool manually*/
+	)
+	{
+		work_fn_internal = work_fn;
+		numThreads_internal = numThreads;
+		if(numThreads_internal < 1){
+			numThreads_internal = 1;
+		}
+
+		if(initiatePool){
+			start(numThreads_internal);
+		}
+	}
+
+	/*! \brief Destructor -- stops threads
+	 */
+	~ThreadPoolBarrier()
+	{
+		if(activePool()){
+			stop();
+		}
+	}
+
+	/*! \brief Stages a job for the next epoch
+	 *
+	 * Jobs are not started until runEpoch is called
+	 */
+	void enqueue(
+		jobtype job/**< Job to add to the next epoch*/
+	)
+	{
+		std::unique_lock<std::mutex> lock{EventMutex};
+		tasks.push_back(job);
+	}
+
+	/*! \brief Releases all staged jobs to the team and blocks until they are all finished
+	 *
+	 * Jobs are handed out dynamically (first come, first served), and the staged list is cleared once the epoch completes
+	 */
+	void runEpoch()
+	{
+		std::unique_lock<std::mutex> lock{EventMutex};
+		if(tasks.empty()){
+			return;
+		}
+		if(Threads.empty()){
+			/*No team running -- fall back to the calling thread*/
+			for(size_t i = 0 ; i<tasks.size(); i++){
+				work_fn_internal(0, tasks[i]);
+			}
+			tasks.clear();
+			return;
+		}
+		nextTask = 0;
+		activeThreads = numThreads_internal;
+		epoch++;
+		EventVar.notify_all();
+		DoneVar.wait(lock,[=]{return activeThreads == 0; });
+		tasks.clear();
+	}
+
+	/*!\brief Get the number of threads being used by the thread pool
+	 */
+	int get_num_threads()
+	{
+		return numThreads_internal;
+	}
+
+	/*! \brief Returns true while the team of threads is running
+	 */
+	bool activePool()
+	{
+		std::unique_lock<std::mutex> lock{EventMutex};
+		return !Threads.empty();
+	}
+
+	/*! \brief Get the number of jobs staged for the next epoch
+	 */
+	int get_queue_length()
+	{
+		std::unique_lock<std::mutex> lock{EventMutex};
+		return tasks.size();
+	}
+
+	/*! \brief initiates the thread pool -- only necessary if initiatePool was set to false in constructor*/
+	void startPool(){
+		if(!activePool()){
+			start(numThreads_internal);
+		}
+	}
+	/*! \brief Stops the team -- any staged jobs are left for the next call to runEpoch*/
+	void stopPool(){
+		if(activePool()){
+			stop();
+		}
+	}
+
+	/*! \brief Pin the threads of the pool -- thread i is placed on affinity's CPU for i+threadOffset
+	 *
+	 * Takes effect the next time the pool is started. affinity must outlive the pool
+	 */
+	void setAffinity(
+		threadAffinity *affinity,/**< CPU assignment (nullptr to stop pinning)*/
+		int threadOffset=0/**< Offset into affinity's thread slots, so several pools can share one assignment without overlapping*/
+		)
+	{
+		this->affinity = affinity;
+		this->affinityOffset = threadOffset;
+	}
+
+	/*! \brief Hand out jobs statically instead of first come, first served -- thread i runs jobs i, i+numThreads, i+2*numThreads, ... of every epoch
+	 *
+	 * If the jobs are staged in the same order every epoch, each job (ie, chain) is always run by the same thread, so memory it touches stays local to that thread
+	 */
+	void setStaticSchedule(bool staticSchedule)
+	{
+		std::unique_lock<std::mutex> lock{EventMutex};
+		this->staticSchedule = staticSchedule;
+	}
+
+private:
+	/*! Vector for thread ids*/
+	std::vector<std::thread> Threads;
+
+	/*! Condition Variable to release the team at the start of an epoch*/
+	std::condition_variable EventVar;
+
+	/*! Condition Variable to wake the dispatching thread at the end of an epoch*/
+	std::condition_variable DoneVar;
+
+	/*! Lock to prevent memory races*/
+	std::mutex EventMutex;
+
+	/*! Boolean stop condition*/
+	bool stopping=false;
+
+	/*! Number of threads in pool*/
+	int numThreads_internal;
+
+	/*! Counter identifying the current epoch -- threads wake when it changes*/
+	unsigned long epoch = 0;
+
+	/*! Index of the next job to hand out in the current epoch*/
+	size_t nextTask = 0;
+
+	/*! Whether jobs are assigned to threads round-robin by index, rather than dynamically*/
+	bool staticSchedule = false;
+
+	/*! Optional CPU assignment for the threads*/
+	threadAffinity *affinity=nullptr;
+
+	/*! Offset into the affinity's thread slots*/
+	int affinityOffset=0;
+
+	/*! Number of threads that have not yet reached the barrier at the end of the epoch*/
+	int activeThreads = 0;
+
+	/*! Function for each thread to perform -- Takes arguments thread_id and jobtype job*/
+	std::function<void(int, jobtype)> work_fn_internal;
+
+	/*! Jobs for the current (or next) epoch*/
+	std::vector<jobtype> tasks;
+
+	/*! \brief Starts the team -- each thread sleeps until an epoch is released, works through the jobs, and checks in at the barrier
+	 */
+	void start(std::size_t numThreads)
+	{
+		unsigned long startEpoch;
+		{
+			std::unique_lock<std::mutex> lock{EventMutex};
+			startEpoch = epoch;
+		}
+		for(auto i =0u; i<numThreads; i++)
+		{
+			Threads.emplace_back([=]{
+				if(affinity){
+					affinity->pinCurrentThread(i+affinityOffset);
+				}
+				unsigned long seenEpoch = startEpoch;
+				while(true)
+				{
+					bool staticEpoch;
+					size_t taskN;
+					{
+						std::unique_lock<std::mutex> lock{EventMutex};
+						EventVar.wait(lock,[&]{return stopping || epoch != seenEpoch; });
+						if (stopping)
+							break;
+						seenEpoch = epoch;
+						staticEpoch = staticSchedule;
+						taskN = tasks.size();
+					}
+					if(staticEpoch){
+						/*The staged list can't change until every thread reaches the barrier*/
+						for(size_t k = i ; k<taskN; k+=numThreads){
+							work_fn_internal(i, tasks[k]);
+						}
+						std::unique_lock<std::mutex> lock{EventMutex};
+						activeThreads--;
+						if(activeThreads == 0){
+							DoneVar.notify_one();
+						}
+						continue;
+					}
+					while(true){
+						jobtype j;
+						{
+							std::unique_lock<std::mutex> lock{EventMutex};
+							if(nextTask >= tasks.size()){
+								activeThreads--;
+								if(activeThreads == 0){
+									DoneVar.notify_one();
+								}
+								break;
+							}
+							j = tasks[nextTask];
+							nextTask++;
+						}
+						work_fn_internal(i, j);
+					}
+				}
+			});
+		}
+	}
+	/*! \brief Stops the team
+	 *
+	 * Waits for all threads to end and joins them -- must not be called while an epoch is running
+	 */
+	void stop() noexcept
+	{
+		{
+			std::unique_lock<std::mutex> lock{EventMutex};
+			stopping = true;
+			EventVar.notify_all();
+		}
+		for(auto &thread: Threads){
+			thread.join();
+		}
+		{
+			std::unique_lock<std::mutex> lock{EventMutex};
+			Threads.clear();
+			stopping = false;
+		}
+	}
+};
+
 }
 #endif
@@ -0,0 +1,86 @@
+#ifndef AUTOCONFIGURE_H
+#define AUTOCONFIGURE_H
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for choosing a run configuration from a short pilot run
+ *
+ * The pilot (see bayesshipSampler::runAutoConfigure) measures what a step costs and how well the chains mix. A simple cost model then predicts the throughput of each candidate configuration, and the one with the best predicted ESS per wall-second is used for the real run.
+ *
+ * The model:
+ *
+ * Lockstep (threadPool false) -- each sweep costs ceil(chainN/threads) steps on the slowest thread (per-chain step time variations make some threads straggle), plus a barrier and the serial swap sweep.
+ *
+ * Thread pool -- threads-2 workers step chains independently (no stragglers), but every step pays for a trip through the queue, and the single swap thread can become the bottleneck.
+ *
+ * ensembleSize -- with a geometric ladder, -log(swap acceptance) scales like the square of the spacing in log(beta), so the pilot's acceptance predicts the smallest ladder that keeps adjacent acceptance above the target.
+ *
+ * ESS/s = (chain steps/s) / (ensembleSize * autocorrelation length), since only the cold chain of each ensemble is kept.
+ */
+
+/*! \brief What the pilot run measured*/
+struct pilotStatistics
+{
+	/*! Mean wall time of one step of one chain (proposal, prior, and likelihood) in seconds*/
+	double stepTime=0;
+	/*! Relative spread (standard deviation/mean) of the step time between chains -- drives the straggler cost of the lockstep loop*/
+	double stepTimeSpread=0;
+	/*! Wall time of one swap in seconds*/
+	double swapTime=0;
+	/*! Mean swap acceptance between adjacent temperatures*/
+	double swapAcceptance=0;
+	/*! Autocorrelation length of the cold chains in steps (0 if unknown, ie RJ)*/
+	double autocorrelation=0;
+	/*! ensembleSize used in the pilot*/
+	int ensembleSize=2;
+};
+
+/*! \brief What the configuration is allowed to change, and the resources available*/
+struct autoConfigureLimits
+{
+	/*! CPUs available to the process*/
+	int cores=1;
+	/*! Whether ensembleN and ensembleSize may be changed (false if the user sized anything by chainN -- proposals, beta schedule, initial ensemble, user parameters)*/
+	bool tuneEnsembles=true;
+	/*! Current ensembleN (used as is if tuneEnsembles is false)*/
+	int ensembleN=2;
+	/*! Current ensembleSize (used as is if tuneEnsembles is false)*/
+	int ensembleSize=5;
+	int maxDim=1;
+	bool RJ=false;
+	int iterations=0;
+	int burnIterations=0;
+	/*! Current batchSize -- kept unless the run doesn't fit in memoryBudget*/
+	int batchSize=0;
+	double swapProb=.2;
+	/*! Bytes of chain storage to allow per batch*/
+	double memoryBudget=1e9;
+	/*! Swap acceptance to aim for between adjacent temperatures*/
+	double targetAcceptance=.25;
+};
+
+/*! \brief Chosen configuration and its predicted performance*/
+struct runConfiguration
+{
+	int threads=1;
+	int ensembleN=1;
+	int ensembleSize=2;
+	int batchSize=0;
+	bool threadPool=false;
+	/*! Predicted steps per second, summed over every chain*/
+	double chainStepsPerSecond=0;
+	/*! Predicted effective samples per second (cold chains only) -- relative only if the autocorrelation is unknown*/
+	double essPerSecond=0;
+	/*! Predicted wall time for burn in plus the main run in seconds*/
+	double runtime=0;
+};
+
+double predictChainStepsPerSecond(pilotStatistics stats, int threads, int chainN, bool threadPool, double swapProb);
+int predictEnsembleSize(pilotStatistics stats, double targetAcceptance, int maxEnsembleSize=64);
+runConfiguration chooseConfiguration(pilotStatistics stats, autoConfigureLimits limits);
+int availableCores();
+
+}
+#endif
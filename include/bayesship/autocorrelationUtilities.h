@@ -2,6 +2,7 @@
 #define AUTOCORRELATIONUTILITIES_H
 #include "bayesship/utilities.h"
 #include <string>
+#include <functional>
 
 namespace bayesship{
 /*! \file 
@@ -10,20 +11,57 @@ namespace bayesship{
  *
  */
 
-/*! \brief Class to contain spectral method jobs
+/*! \brief Streaming autocorrelation estimate for one parameter of one chain, from batch means over batches of 2^k steps
+ *
+ * Batches of 2^k steps are built from pairs of batches of 2^(k-1) steps, so each new step costs O(1) amortized and the memory is fixed, however long the chain. The integrated autocorrelation time is b*var(batch means)/var(steps), maximized over the batch sizes b that have at least minBatches batches
+ */
+class batchMeansAC
+{
+public:
+	/*! Steps added so far*/
+	long long count=0;
+	void add(double x);
+	double integratedTime(int minBatches=32);
+private:
+	/*! Number of batch sizes tracked -- enough for 2^48 steps*/
+	static const int levels = 48;
+	/*! Completed batches of each size*/
+	long long batchN[levels]={};
+	/*! Running mean of the batch means of each size*/
+	double batchMean[levels]={};
+	/*! Running sum of squared deviations of the batch means of each size*/
+	double batchM2[levels]={};
+	/*! Sum of the first half of the batch of each size being built*/
+	double partialSum[levels]={};
+	/*! Whether the batch of each size being built has its first half*/
+	bool partialHalf[levels]={};
+	void addBatch(int level, double sum);
+};
+
+/*! \brief Reads one series (one parameter of one chain) straight from wherever the samples are stored
+ *
+ * Arguments are (series, start, length, buffer) -- copy steps [start, start+length) of the series into buffer
+ */
+typedef std::function<void(int, int, int, double*)> acSeriesReader;
+
+/*! \brief Class to contain spectral method jobs -- a block of series sharing one segment, transformed together with one batched real-to-complex plan
  */
 class threaded_ac_jobs_fft
 {
 public:
-	double **data;/*! Read only -- Data to use -- full chain*/
-	int *length;/*! Read only -- length of total data*/
-	int *start; /*! Read only -- start index*/
-	int *end;/*! Read only -- end index*/
-	int dimension;/*! Read only -- dimension being analyzed*/
-	fftw_outline *planforward;/*! fftw plan to use for spectral method*/
-	fftw_outline *planreverse;/*! fftw plan to use for spectral method*/
-	int *lag;/*! READ AND WRITE -- final lag */
-	double *target;/*! Read only -- target correlation*/
+	acSeriesReader *reader;/*! Read only -- reads the series from the sampler's storage*/
+	int firstSeries;/*! Read only -- first series in the block*/
+	int seriesN;/*! Read only -- number of series in the block*/
+	int transformN;/*! Read only -- number of series per transform (the block is transformed a few series at a time if it's too big to hold at once)*/
+	int start; /*! Read only -- start index*/
+	int end;/*! Read only -- end index*/
+	int paddedLength;/*! Read only -- length of the (zero padded) transform*/
+	fftw_plan planforward;/*! Read only -- batched r2c plan for transformN series of paddedLength, from the plan cache*/
+	fftw_plan planreverse;/*! Read only -- batched c2r plan for transformN series of paddedLength, from the plan cache*/
+	fftw_plan planforwardLast;/*! Read only -- batched r2c plan for the series left over in the last transform*/
+	fftw_plan planreverseLast;/*! Read only -- batched c2r plan for the series left over in the last transform*/
+	int **lags;/*! READ AND WRITE -- final lags, shape [series][segment]*/
+	int segment;/*! Read only -- segment being analyzed*/
 };
 /*! \brief Class to contain serial method jobs
  */
@@ -40,18 +78,17 @@ public:
 };
 /*! \brief comparator to sort ac-jobs
  *
- * Starts with the longest jobs, then works down the list
+ * Starts with the longest jobs, then works down the list -- ordered like std::less, so the longest job compares greatest
  */
 class comparator_ac_fft
 {
 public:
 	bool operator()(threaded_ac_jobs_fft t, threaded_ac_jobs_fft k)
 	{
-		int t_length = *t.end - *t.start;
-		int k_length = *k.end - *k.start;
-		//return false;
-		if(t_length<k_length){ return true;}
-		else{ return true;}
+		/*Cost of a block goes as seriesN*L*log(L) -- compare seriesN*L*/
+		long long t_length = (long long)t.seriesN*t.paddedLength;
+		long long k_length = (long long)k.seriesN*k.paddedLength;
+		return t_length < k_length;
 	}	
 };
 /*! \brief comparator to sort ac-jobs
@@ -65,9 +102,7 @@ public:
 	{
 		int t_length = *t.end - *t.start;
 		int k_length = *k.end - *k.start;
-		//return false;
-		if(t_length<k_length){ return true;}
-		else{ return true;}
+		return t_length < k_length;
 	}	
 };
 void auto_corr_from_data_batch(double ***data, /**<Input data */
@@ -81,6 +116,10 @@ void auto_corr_from_data_batch(double ***data, /**<Input data */
 			bool cumulative /**< Boolean to calculate the autocorrelation cumulatively*/
 			);
 void auto_corr_from_data(double **data, int length, int dimension, int **output, int num_segments,  double target_corr, int num_threads,bool cumulative);
+void auto_corr_from_reader(acSeriesReader reader, int seriesN, int length, int **output, int num_segments, double target_corr, int num_threads, bool cumulative, int blockSize=0);
+bool importACWisdom(std::string filename);
+bool exportACWisdom(std::string filename);
+void clearACPlans();
 void threaded_ac_spectral(int thread, threaded_ac_jobs_fft job);
 void threaded_ac_serial(int thread, threaded_ac_jobs_serial job);
 double auto_correlation_serial(double *arr, int length, int start, double target);
@@ -0,0 +1,48 @@
+#ifndef BATCHPIPELINE_H
+#define BATCHPIPELINE_H
+#include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for running work on a background thread, with a bounded number of tasks outstanding
+ *
+ * Used by the sampler to post-process a finished batch (ACs, evidence, output files) while the next batch is sampled (see bayesshipSampler::pipelineDepth)
+ */
+
+/*! \brief A single background worker that runs tasks in the order they're submitted
+ *
+ * At most maxOutstanding tasks are queued or running at once -- submit blocks until there's room, which bounds the memory held by the tasks (and how far the sampler can get ahead of its output)
+ */
+class batchPipeline
+{
+public:
+	explicit batchPipeline(int maxOutstanding=1);
+	~batchPipeline();
+	void submit(std::function<void()> task);
+	void wait();
+	int outstanding();
+private:
+	/*! Most tasks queued or running at once*/
+	int maxOutstanding;
+	/*! Tasks queued or running*/
+	int outstandingN=0;
+	/*! Set by the destructor -- the worker finishes the queue and exits*/
+	bool stopping=false;
+	std::deque<std::function<void()>> tasks;
+	std::mutex taskMutex;
+	/*! Signals the worker that there's a task (or it should stop)*/
+	std::condition_variable taskVar;
+	/*! Signals submit and wait that a task finished*/
+	std::condition_variable doneVar;
+	std::thread worker;
+	void run();
+};
+
+}
+#endif
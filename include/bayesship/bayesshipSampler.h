@@ -2,12 +2,18 @@
 #define BAYESSHIPSAMPLER_H
 
 #include "bayesship/dataUtilities.h"
+#include "bayesship/randomNumberUtilities.h"
+#include "bayesship/instrumentation.h"
+#include "bayesship/autoConfigure.h"
+#include "bayesship/batchPipeline.h"
 #include <string>
 #include <iostream>
 #include <functional>
 #include <gsl/gsl_rng.h>
 #include <limits>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <nlohmann/json.hpp>
 #include <bayesship/ThreadPool.h>
 
@@ -26,6 +32,7 @@ const double limitInf = - std::numeric_limits<double>::infinity();
 
 /*Must forwardd declare the class to use it in the declarations of the functions below*/
 class bayesshipSampler;
+struct sampleJob;
 //class proposal;
 
 class proposal
@@ -92,6 +99,16 @@ public:
 	probabilityFn(){};
 	virtual ~probabilityFn(){};
 	virtual double eval(positionInfo *position, int chainID) { return 0;}
+	/*! \brief Evaluates n positions at once -- out[i] is the value at positions[i] for chain chainIDs[i]
+	 *
+	 * Only used by the sampler when batchedSampling is set. The default just loops over eval, so it only needs to be overridden when the user can do better (BLAS, SIMD, GPU, etc) with the whole ensemble at once
+	 */
+	virtual void evalBatch(positionInfo **positions, const int *chainIDs, int n, double *out)
+	{
+		for(int i = 0 ; i<n; i++){
+			out[i] = eval(positions[i], chainIDs[i]);
+		}
+	}
 };
 
 
@@ -204,20 +221,36 @@ public:
 	bool writePriorData = true;
 	/*! Whether to store only the cold chains or the full ensemble -- Full ensemble produces much larger files*/
 	bool coldOnlyStorage=true;
+	/*! Steps of each chain kept in memory, older ones are spilled to outputDir+outputFileMoniker+"_spill.bin" -- needs batchSize > 0, and 0 (the default) keeps everything (see samplerData::spillHistory)*/
+	int maxResidentSteps=0;
+	/*! Store each state a chain visits once instead of once per step, so a rejected step only costs a pointer -- not with maxResidentSteps (see samplerData::runLength)*/
+	bool runLengthStorage=false;
 	/*! Number of threads to launch*/
 	int threads=1;
+	/*! How to pin the worker threads to CPUs, default affinityNone (see affinityPolicy and createStepPool)*/
+	affinityPolicy threadAffinityPolicy=affinityNone;
+	/*! CPUs to use with affinityList -- worker i is pinned to affinityCPUs[i % affinityCPUs.size()]*/
+	std::vector<int> affinityCPUs;
+	/*! Write latency histograms (p50/p99/max) of the main run to outputDir+outputFileMoniker+"_latency.txt" -- needs _INSTRUMENT at compile time*/
+	bool instrument=false;
+	/*! With instrument, only time one in every instrumentEvery events on each thread (default 1)*/
+	int instrumentEvery=1;
 	/*! Class containing all the information about the proposal functions used in the sampling*/
 	proposalData *proposalFns=nullptr;
 	/*! Output Destinations*/
 	std::string outputDir="";
 	/*! Output files base name*/
 	std::string outputFileMoniker="BayesShip";
+	/*! Write the checkpoint, chain output, and stat files (default true)*/
+	bool writeFiles=true;
 	/*! Likelihood function*/
 	//likelihoodFn likelihood;
 	probabilityFn *likelihood;
 	/*! Prior function*/
 	//likelihoodFn prior;
 	probabilityFn *prior;
+	/*! Optional cheap approximation to the likelihood, used to screen proposals before the full likelihood is evaluated (see surrogateScreen)*/
+	probabilityFn *surrogateLikelihood=nullptr;
 	/*! User Parameters -- These parameters are passed into the likelihood function and the prior function -- shape should be (void *)[chainN]*/
 	void **userParameters=nullptr;
 	/*! If a checkpoint file exists in the output directory, ignore it (true) or load it (false)*/
@@ -232,6 +265,32 @@ public:
 	int swapRadius = 3;
 	/*! Whether or not to check for temperature difference between chains before swapping: false means all chains can swap with all other temperatures, true means only certain temperatures can swap with other temperatures (see swapRadius) */
 	bool restrictSwapTemperatures = true;
+	/*! No thread pool only -- evaluate the whole ensemble's proposals with one probabilityFn::evalBatch call each for the prior and likelihood (see stepMHBatch)*/
+	bool batchedSampling = false;
+	/*! No thread pool only -- swap with the deterministic even-odd schedule instead of trying each adjacent pair with probability swapProb (see swapSweepEvenOdd)*/
+	bool deterministicEvenOddSwapping = false;
+	/*! After each exploration phase of the burn in, respace the temperatures so adjacent rungs have the same swap rejection rate (see respaceTemperatures)*/
+	bool optimizeLadder = false;
+	/*! Stop once the split R-hat of every parameter across the cold chains is at most targetRhat, eg 1.01 -- 0 (the default) turns it off (see convergenceMonitor::converged)*/
+	double targetRhat = 0;
+	/*! Stop once the multi-chain ESS of every parameter is at least targetESS (both must be met if targetRhat is also set) -- 0 (the default) turns it off*/
+	double targetESS = 0;
+	/*! Recompute the autocorrelation lengths over the whole history with the spectral method instead of the streaming batch means estimate (see samplerData::spectralACs)*/
+	bool spectralACs = false;
+	/*! Write the HDF5 output as one [chain][step][dim] dataset per quantity instead of one dataset per chain (see samplerData::stackedOutput)*/
+	bool stackedOutput = false;
+	/*! Stacked layout only -- write each state a chain visits once, with the step it was entered on (see samplerData::runLengthOutput)*/
+	bool runLengthOutput = false;
+	/*! Also write the chains as .npy files, prefixed outputDir+outputFileMoniker+"_output" (see samplerData::create_npy_dump)*/
+	bool npyOutput = false;
+	/*! Batches only -- number of batches that may wait to be post-processed on a background thread while sampling goes on, 0 (the default) post-processes each batch before sampling the next (see queueBatchPostProcessing)*/
+	int pipelineDepth = 0;
+	/*! Thread pool only -- each job advances its chain a geometric(swapProb) number of steps before attempting a swap (see sampleThreadedFunction)*/
+	bool multiStepJobs = false;
+	/*! Before sampling, pick threads, threadPool, ensembleN, ensembleSize, and batchSize from a short pilot run (see runAutoConfigure)*/
+	bool autoConfigure = false;
+	/*! Length of the auto-configure pilot in steps -- this many of burn in, then this many of sampling (default 2000)*/
+	int autoConfigureIterations = 2000;
 
 
 	/* Meta Data -- read in from Checkpoint File*/
@@ -279,17 +338,31 @@ public:
 	samplerData *priorData=nullptr;
 	samplerData *burnData=nullptr;
 
-	bool *waitingSample=nullptr;
+	/*! Whether each cold chain is still sampling in the thread pool loop -- shape [ensembleN]*/
 	bool *referenceStatus=nullptr;
-	std::mutex *waitingMutexes=nullptr;
 	std::mutex *statusMutex=nullptr;
+	/*! Signalled whenever a cold chain finishes in the thread pool loop*/
+	std::condition_variable *statusCondition=nullptr;
+	/*! True while the thread pool loop is running -- workers stop re-enqueueing chains once it's cleared*/
+	std::atomic<bool> asyncSampling{false};
+	/*! Persistent team of threads used to step the chains when threadPool is false -- lives for the duration of sample()*/
+	ThreadPoolBarrier<sampleJob> *stepPool=nullptr;
+	/*! CPU assignment for the worker threads -- nullptr unless threadAffinityPolicy is set*/
+	threadAffinity *affinity=nullptr;
+	/*! Latency histograms -- nullptr unless instrument is set*/
+	instrumentation *instruments=nullptr;
 	bool burnPeriod = false;
 	bool adjustTemps = false;
+	/*! Rung the next even-odd swap sweep starts from (0 or 1) -- see deterministicEvenOddSwapping*/
+	int swapPhase = 0;
 	/* Parameters for burn in temperature adjustment*/
 	double t0;
 	double nu=100;
 	double *A=nullptr;
+	/*! GSL random number generators for each chain (seeded with seed + 101*chainID) -- neither the sampler nor the built-in proposals draw from these (see rng), they're only kept for user proposals*/
 	gsl_rng **rvec=nullptr;
+	/*! Counter-based random numbers used for every draw the sampler and the built-in proposals make, keyed by (seed, chainID, step, purpose) so runs are reproducible regardless of thread scheduling*/
+	counterRNG *rng=nullptr;
 
 	
 		
@@ -318,12 +391,20 @@ public:
 	bool checkStatus();
 	void allocateMemory();
 	void deallocateMemory();
+	ThreadPoolBarrier<sampleJob> *createStepPool();
 	//bayesshipSampler(likelihoodFn likelihood, priorFn prior);
 	bayesshipSampler(probabilityFn *likelihood, probabilityFn *prior);
 	~bayesshipSampler();
 	void sample();
+	void runAutoConfigure();
 	void sampleLoop(int iterations,samplerData *data);
 	void stepMH(int chainID,samplerData *data);
+	int proposeStep(int chainID,samplerData *data, double *MHRatioCorrection);
+	void acceptStep(int chainID,samplerData *data, int randStep, double logPrior, double logLikelihood, double MHRatioCorrection, bool secondStage=false, double surrogateProposed=0, double uniformDraw=0);
+	bool surrogateScreen(int chainID,samplerData *data, double surrogateDifference, double logPrior, double MHRatioCorrection, double uniformDraw=0);
+	double currentSurrogate(int chainID, samplerData *data);
+	void stepMHBatch(samplerData *data);
+	void proposeBatchMember(int chainID,samplerData *data);
 	int getChainN();
 	double getBeta(int chainID);
 
@@ -332,6 +413,11 @@ public:
 	void assignInitialPosition(samplerData *data);
 
 	void chainSwap(int chainID1, int chainID2,samplerData *data);
+	void swapSweepEvenOdd(samplerData *data);
+	bool respaceTemperatures(samplerData *data, long long *startAccepts, long long *startRejects);
+	void reportEvidence(samplerData *data, evidenceSnapshot *snapshot=nullptr);
+	void queueBatchPostProcessing(samplerData *data, batchPipeline *pipeline, bool createOutput);
+	void writeOutput(samplerData *data, std::string prefix, bool create);
 	void adjustTemperatures(int t);
 	int chainIndex(int ensemble, int betaN);
 	int betaN(int chainID);
@@ -367,6 +453,20 @@ private:
 	bool internalPriorRanges=false;
 	bool internalInitialPositionEnsemble=false;
 
+	/* Work buffers for batched sampling -- shape [chainN]*/
+	positionInfo **batchPositions=nullptr;
+	int *batchChainIDs=nullptr;
+	int *batchProposalIDs=nullptr;
+	double *batchLogPrior=nullptr;
+	double *batchLogLikelihood=nullptr;
+	double *batchLogLikelihoodPacked=nullptr;
+	double *batchCorrections=nullptr;
+	positionInfo **batchCurrentPositions=nullptr;
+	double *batchSurrogateProposed=nullptr;
+	double *batchSurrogatePacked=nullptr;
+	int *batchUncachedIDs=nullptr;
+	double *batchUniforms=nullptr;
+
 };
 
 //void to_json(nlohmann::json& j, const bayesshipSampler& s);
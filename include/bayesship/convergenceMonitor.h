@@ -0,0 +1,58 @@
+#ifndef CONVERGENCEMONITOR_H
+#define CONVERGENCEMONITOR_H
+#include "bayesship/dataUtilities.h"
+#include <vector>
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for monitoring the convergence of the cold chains while sampling
+ *
+ * Implements the rank-normalized split R-hat and the multi-chain (bulk) ESS of Vehtari et al (2021), computed across the cold chains of every ensemble.
+ *
+ * The monitor keeps its own copy of the cold chains, fed once per batch. To bound the memory, each chain keeps at most maxDraws draws -- once it fills up, every other draw is dropped and only every thin-th step is kept from then on. The ESS of the thinned chains is a (slightly conservative) estimate of the ESS of the full chains.
+ */
+
+void rankNormalize(double *values, int n, double *z);
+double splitRhat(double **chains, int chainN, int length);
+double multiChainESS(double **chains, int chainN, int length);
+
+/*! \brief Streaming split R-hat and multi-chain ESS for the cold chains -- fixed dimension runs only
+ */
+class convergenceMonitor
+{
+public:
+	/*! Number of chains being monitored (ensembleN)*/
+	int chainN;
+	/*! Dimension of the parameter space*/
+	int dimension;
+	/*! Most draws kept per chain before thinning*/
+	int maxDraws;
+	/*! Only every thin-th step of each chain is kept*/
+	int thin=1;
+	/*! Largest (over the parameters) split R-hat at the last update*/
+	double rhat=0;
+	/*! Smallest (over the parameters) multi-chain ESS at the last update*/
+	double ess=0;
+	/*! Split R-hat of each parameter at the last update -- shape [dimension]*/
+	double *rhats=nullptr;
+	/*! Multi-chain ESS of each parameter at the last update -- shape [dimension]*/
+	double *esss=nullptr;
+
+	convergenceMonitor(int chainN, int dimension, int maxDraws=4096);
+	~convergenceMonitor();
+	void update(samplerData *data);
+	bool converged(double targetRhat, double targetESS);
+private:
+	/*! Kept draws -- shape [chainN][dimension][kept draws]*/
+	std::vector<double> **draws=nullptr;
+	/*! Next step of each chain to read from the samplerData -- shape [chainN]*/
+	int *nextStep=nullptr;
+	/*! Steps of each chain seen so far (kept or not) -- shape [chainN]*/
+	long long *stepsSeen=nullptr;
+	void thinDraws();
+};
+
+}
+#endif
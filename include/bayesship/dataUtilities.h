@@ -2,6 +2,8 @@
 #define DATAUTILITIES_H
 #include <string>
 #include <vector>
+#include "bayesship/ThreadPool.h"
+#include "bayesship/npyOutput.h"
 
 namespace bayesship{
 
@@ -17,9 +19,28 @@ struct dump_file_struct{
 	std::string filename;
 	bool trimmed;
 	bool coldOnly;
+	bool stacked=false;
+	bool runLength=false;
 	int *fileTrimLengths=NULL;
 };
 
+/*! \brief Open .npy output of one run (see samplerData::create_npy_dump) -- one file per chain and quantity, kept mapped so appends just copy the new steps in
+ */
+struct npy_dump_struct{
+	std::string prefix;
+	bool coldOnly;
+	/*! First step of each chain in the files (the trim length, or 0) -- shape [chains]*/
+	int *fileStartSteps=NULL;
+	/*! Shape [steps][maxDim] per chain*/
+	std::vector<npyArrayFile *> parameters;
+	/*! Shape [steps][2] per chain*/
+	std::vector<npyArrayFile *> ll_lp;
+	/*! RJ only -- shape [steps][maxDim] per chain*/
+	std::vector<npyArrayFile *> status;
+	/*! RJ only -- shape [steps][1] per chain*/
+	std::vector<npyArrayFile *> model_status;
+};
+
 void readCSVFile(std::string filename, double **output, int rows,int cols );
 void readCSVFile(std::string filename, double *output);
 void readCSVFile(std::string filename, int **output, int rows,int cols );
@@ -48,6 +69,8 @@ public:
 	int countActiveDimensions();
 	/*! Boolean for RJ or not*/
 	bool RJ=false;
+	/*! Whether parameters and status belong to this object (false for views into samplerData storage)*/
+	bool ownsMemory=true;
 	
 	positionInfo(int dimension, bool RJ=false)	
 	{
@@ -59,7 +82,25 @@ public:
 		}
 		
 	}
+	/*! \brief Empty position -- must be pointed at memory with setView before use*/
+	positionInfo()
+	{
+		this->dimension = 0;
+		this->ownsMemory = false;
+	}
+	/*! \brief Point this position at memory owned by someone else (parameters and status must hold dimension elements -- status may be null if not RJ)*/
+	void setView(int dimension, bool RJ, double *parameters, int *status)
+	{
+		this->dimension = dimension;
+		this->RJ = RJ;
+		this->parameters = parameters;
+		this->status = status;
+		this->ownsMemory = false;
+	}
 	~positionInfo(){
+		if(!ownsMemory){
+			return;
+		}
 		if(parameters){
 			delete [] parameters;
 			parameters = nullptr;
@@ -77,6 +118,54 @@ public:
 	}
 };
 
+/*! \brief Contiguous block of storage for one chain -- segmentSteps rows of maxDim parameters (and status for RJ), 64 byte aligned
+ */
+struct storageSegment{
+	/*! Parameters -- shape [segmentSteps][maxDim]*/
+	double *parameters=nullptr;
+	/*! Status (RJ only) -- shape [segmentSteps][maxDim]*/
+	int *status=nullptr;
+	/*! Non-owning positionInfo for each row -- shape [segmentSteps]*/
+	positionInfo *views=nullptr;
+	/*! Whether the segment has been handed to the background writer*/
+	bool spillQueued=false;
+	/*! Whether the segment only lives in the spill file (memory released)*/
+	bool spilled=false;
+	/*! Byte offset of the segment in the spill file*/
+	long long spillOffset=-1;
+};
+
+class samplerData;
+class batchMeansAC;
+
+/*! \brief Copy of the running evidence accumulators of every chain (see samplerData::accumulateLikelihood), so the evidence can be calculated while the chains keep sampling
+ */
+struct evidenceSnapshot{
+	std::vector<long long> likelihoodN;
+	std::vector<double> likelihoodMean;
+	std::vector<double> likelihoodM2;
+	std::vector<double> steppingStoneLogSum;
+	std::vector<double> steppingStoneLogSum2;
+	/*! Integrated autocorrelation time of the log likelihood of each chain*/
+	std::vector<double> likelihoodTau;
+};
+
+/*! \brief Job for the background thread writing old segments to the spill file
+ *
+ * Holds the segment's buffers rather than its index -- segments keep being appended (extendSize) while the writer runs, which can move the storageSegment entries but not the buffers they point to
+ */
+struct spillJob{
+	samplerData *data;
+	/*! Parameters of the segment -- shape [segmentSteps][maxDim]*/
+	double *parameters;
+	/*! Status of the segment (RJ only)*/
+	int *status;
+	/*! Views of the segment (RJ only, for the model IDs)*/
+	positionInfo *views;
+	/*! Byte offset of the segment in the spill file*/
+	long long offset;
+};
+
 /*! Class containing all the data about a sampling run 
  *
  * Includes the output chain positions, statistics about the proposal functions, and statistics about swapping
@@ -95,22 +184,73 @@ public:
 	bool RJ;
 	int *trimLengths=NULL;
 	int chunk_steps = 1000;
+	/*! Number of steps in each storage segment -- fixed at construction, at most 4096 and fewer only for wide rows (see the constructor)*/
+	int segmentSteps = 4096;
 	double *betas=nullptr;
+	/*! Total time (seconds) spent in each proposal -- shape [chainN][proposalFnN] (the stat file reports the mean per call)*/
 	double **proposalTimes = nullptr;
+	/*! Total time (seconds) spent evaluating the likelihood -- shape [chainN]*/
 	double *likelihoodTimes = nullptr;
+	/*! Total time (seconds) spent evaluating the prior -- shape [chainN]*/
 	double *priorTimes = nullptr;
+	/*! Number of likelihood evaluations -- shape [chainN]*/
 	int *likelihoodEvals = nullptr;
+	/*! Array counting the proposals rejected by the surrogate in the first stage of delayed acceptance (the full likelihood is never evaluated for these) -- shape [chainN]*/
+	int *surrogateRejectN = nullptr;
 	bool calculatedEvidence=false;
+	/*! Thermodynamic integration estimate of the log evidence (see calculateEvidence)*/
 	double evidence;
+	/*! Error in evidence, from the batch means variances of integratedLikelihoods*/
 	double evidenceError;
+	/*! Error in evidence from resampling the ensembles (0 with a single ensemble)*/
+	double evidenceBootstrapError=0;
+	/*! Stepping-stone estimate of the log evidence, over the same ladder*/
+	double steppingStoneEvidence;
+	/*! Error in steppingStoneEvidence, from batch means*/
+	double steppingStoneEvidenceError;
+	/*! Error in steppingStoneEvidence from resampling the ensembles (0 with a single ensemble)*/
+	double steppingStoneBootstrapError=0;
+	/*! Mean log likelihood of each rung, ordered from the hottest to the coldest -- shape [ensembleSize]*/
 	double *integratedLikelihoods=nullptr;
+	/*! Variance of each entry of integratedLikelihoods, corrected for autocorrelation -- shape [ensembleSize]*/
+	double *integratedLikelihoodVariances=nullptr;
+	/*! Number of bootstrap replicates used for evidenceBootstrapError and steppingStoneBootstrapError*/
+	int bootstrapReplicates = 200;
+	/*! Steps folded into the evidence accumulators of each chain (see accumulateLikelihood) -- shape [chainN]*/
+	long long *likelihoodN=nullptr;
+	/*! Running (Welford) mean of the log likelihood of each chain -- shape [chainN]*/
+	double *likelihoodMean=nullptr;
+	/*! Running sum of squared deviations of the log likelihood of each chain from likelihoodMean -- shape [chainN]*/
+	double *likelihoodM2=nullptr;
+	/*! Largest log likelihood folded into the accumulators of each chain -- shape [chainN]*/
+	double *likelihoodMax=nullptr;
+	/*! Running log(sum(exp(dBeta*logL))) of each chain, where dBeta is the step up to the next colder rung (unused for the coldest rung) -- shape [chainN]*/
+	double *steppingStoneLogSum=nullptr;
+	/*! Running log(sum(exp(2*dBeta*logL))) of each chain, for the stepping-stone error -- shape [chainN]*/
+	double *steppingStoneLogSum2=nullptr;
 	//int *chain_lengths=NULL;
 
 
-	/*! All positions for sampler (ptrs) -- shape [chainN][iterations]*/
+	/*! All positions for sampler (ptrs) -- shape [chainN][iterations]
+	 *
+	 * These are views into contiguous segments of storage (see storageSegment), owned by samplerData -- without runLength, positions[i][j] points at row j of chain i's storage. They may change under a reader: with runLength they are repointed every step, and spillHistory sets them to nullptr once their segment is written out. Proposals and other readers shouldn't cache them -- read steps through getPosition (or positionBlock for runs of steps), and only dereference positions[i][j] right away for a step that is resident (see firstResidentStep)
+	 *
+	 * With runLength, the rows hold states instead of steps, and positions[i][j] points at the row of the state chain i was in at step j (only set up to the proposal step, currentStepID[i]+1). Steps that repeat a state share its row, so only the proposal row may be written through positions -- use restartChain to put a state anywhere else*/
 	positionInfo ***positions=nullptr;
+	/*! Whether each state is stored once (see positions), so a rejected step costs a pointer instead of a copy of the row -- set at construction. At typical acceptance rates this cuts the memory of the history several times over. Can't be combined with spilling (see spillHistory)*/
+	bool runLength=false;
+	/*! runLength only -- number of rows (states) stored for each chain. Row stateN[i] is the proposal row of chain i -- shape [chainN]*/
+	int *stateN=nullptr;
 	/*! Array storing the current position for each sampler in the positions array -- shape [chainN]*/
 	int *currentStepID =nullptr;
+	/*! Chain whose storage holds the current state of each chain, or -1 if it's the chain's own current step -- shape [chainN]
+	 *
+	 * An accepted swap only exchanges these (see swapCurrent), so no position data moves. The chain's own row for the step keeps the state from before the swap, and the next step reads the swapped state from here (see currentPosition)*/
+	int *swapSourceChainID=nullptr;
+	/*! Step of swapSourceChainID holding the current state of each chain (unused if swapSourceChainID is -1) -- shape [chainN]*/
+	int *swapSourceStepID=nullptr;
+	/*! Surrogate likelihood (see bayesshipSampler::surrogateLikelihood) at the current state of each chain, or NaN if it hasn't been evaluated there yet. Swapped along with the states (see swapCurrent) -- shape [chainN]*/
+	double *currentSurrogate=nullptr;
 	/*! Array containing all the likelihood values for each position in positions -- shape [chainN][iterations]*/
 	double **likelihoodVals=nullptr;
 	/*! Array containing all the prior values for each position in positions -- shape [chainN][iterations]*/
@@ -124,30 +264,162 @@ public:
 	/*! Array counting the successful number of swaps between chains-- shape [chainN][chainN]*/
 	int **swapAccepts=nullptr;
 
+	/*! Replica held by each chain -- replicas follow the accepted swaps, so a replica's path through the rungs can be traced -- shape [chainN]*/
+	int *replicaIDs=nullptr;
+	/*! Direction of each replica: 1 if it last visited the coldest rung, -1 if it last visited the hottest, 0 if neither yet -- shape [chainN] (indexed by replica)*/
+	int *replicaDirection=nullptr;
+	/*! Step at which each replica arrived at the coldest rung to start its current round trip (-1 if it hasn't yet) -- shape [chainN] (indexed by replica)*/
+	int *replicaTripStart=nullptr;
+	/*! Completed round trips (coldest rung to hottest and back) for each replica -- shape [chainN] (indexed by replica)*/
+	int *roundTrips=nullptr;
+	/*! Total steps taken by the completed round trips of each replica -- shape [chainN] (indexed by replica)*/
+	long long *roundTripSteps=nullptr;
+
+	/*! If set, the output, updateACs, and countIndependentSamples only read the steps before these instead of up to currentStepID -- shape [chainN]. Lets a finished batch be post-processed while the next one is sampled (see bayesshipSampler::pipelineDepth)*/
+	int *endStepIDs=nullptr;
+
 	/*! Array containing autocorrelation lengths for each chain and dimension -- shape [chainN][dimension]*/
 	int **acs=nullptr;
 	/*! Array containing max autocorrelation lengths for each chain (maxed over dimension) -- shape [chainN]*/
 	int *maxACs = nullptr;
+	/*! Have updateACs recompute the acs over the whole history with the (batched, plan cached) spectral method, instead of the streaming batch means estimate -- exact, but each call costs O(steps log steps)*/
+	bool spectralACs = false;
+	/*! Have create_data_dump and append_to_data_dump write the stacked layout -- one [chain][step][dim] dataset per quantity under /MCMC_OUTPUT (PARAMETERS, LOGL_LOGP, and for RJ, STATUS and MODEL_STATUS) instead of one dataset per chain, deflated (see outputDeflateLevel and outputShuffle) and chunked by outputChunkBytes. Chains start at MCMC_METADATA/CHAIN START STEPS and hold MCMC_METADATA/CHAIN LENGTHS steps (the rest of the row is fill). Off by default, so older readers of the per chain layout keep working -- python/bayesshippy/mcmcRoutines.py reads both*/
+	bool stackedOutput = false;
+	/*! Stacked layout only -- target size (bytes) of one chunk, which holds a run of steps of a single chain*/
+	int outputChunkBytes = 1<<20;
+	/*! Stacked layout only -- deflate level (1-9) of the output, or 0 for no compression*/
+	int outputDeflateLevel = 6;
+	/*! Stacked layout only -- byte shuffle the output before deflating it. Off by default: every rejected step repeats the whole row before it, and deflate only finds those repeats in unshuffled rows (shuffled output came out about 40% larger on a test run)*/
+	bool outputShuffle = false;
+	/*! Stacked layout only -- write each state a chain visits once, instead of once per step. A rejected proposal repeats the state before it, so at typical acceptance rates most steps are repeats. The rows of PARAMETERS, LOGL_LOGP, STATUS, and MODEL_STATUS are then states, MCMC_OUTPUT/STATE START STEPS holds the step (counted from the chain's start step) each state is entered on, and MCMC_METADATA/CHAIN STATES the number of states of each chain -- state k of a chain lasts until the next state starts, or until CHAIN LENGTHS for the last one. Consecutive steps are merged if they match bit for bit, so expanding the states gives back the chain exactly*/
+	bool runLengthOutput = false;
 
-	samplerData(int maxDim, int ensembleN, int ensembleSize, int iterations, int proposalFnN,bool RJ ,double *betas);
+	samplerData(int maxDim, int ensembleN, int ensembleSize, int iterations, int proposalFnN,bool RJ ,double *betas, bool runLength=false);
 	~samplerData();
 	void writeStatFile(std::string filename);
+	void writeStatFile(std::ostream &outFile);
 	void updateACs(int threads);
 	int countIndependentSamples();
 	void extendSize(int additionalIterations);
-	double *** convertToPrimitivePointer();
+	double *** convertToPrimitivePointer(int startStep=0);
 	void deallocatePrimitivePointer(double ***newPointer);
 	int create_data_dump(bool cold_only,bool trim,std::string filename);
 	int append_to_data_dump(std::string filename);
+	int create_npy_dump(bool cold_only, bool trim, std::string prefix);
+	int append_to_npy_dump(std::string prefix);
 	void set_trim(int trim);
 	void updateBetas(double *betas);
-	void calculateEvidence();
+	void calculateEvidence(int threads=1, evidenceSnapshot *snapshot=nullptr);
+	void snapshotEvidence(evidenceSnapshot *snapshot);
+	void coldLikelihoodSummary(double *mean, double *max);
+	void accumulateLikelihood(int chainID);
+	void recordSwap(int chainID1, int chainID2);
+	double *parameterBlock(int chainID, int step, int *rows);
+	int *statusBlock(int chainID, int step, int *rows);
+	positionInfo *positionBlock(int chainID, int step, int *rows);
+	void enableSpilling(std::string filename, int maxResidentSteps);
+	void spillHistory();
+	void writeSpilledSegment(const spillJob &job);
+	int firstResidentStep(int chainID);
+	/*! \brief Current state of chainID -- the row it swapped into if it swapped since its last step, else positions[chainID][currentStepID[chainID]]*/
+	positionInfo *currentPosition(int chainID)
+	{
+		if(swapSourceChainID[chainID] < 0){
+			return positions[chainID][currentStepID[chainID]];
+		}
+		return positions[swapSourceChainID[chainID]][swapSourceStepID[chainID]];
+	}
+	/*! \brief Log likelihood of the current state of chainID (see currentPosition)*/
+	double currentLikelihood(int chainID)
+	{
+		if(swapSourceChainID[chainID] < 0){
+			return likelihoodVals[chainID][currentStepID[chainID]];
+		}
+		return likelihoodVals[swapSourceChainID[chainID]][swapSourceStepID[chainID]];
+	}
+	/*! \brief Log prior of the current state of chainID (see currentPosition)*/
+	double currentPrior(int chainID)
+	{
+		if(swapSourceChainID[chainID] < 0){
+			return priorVals[chainID][currentStepID[chainID]];
+		}
+		return priorVals[swapSourceChainID[chainID]][swapSourceStepID[chainID]];
+	}
+	/*! \brief Move chainID to step, with its own row there as the current state (drops any swap redirection)*/
+	void setCurrentStep(int chainID, int step)
+	{
+		currentStepID[chainID] = step;
+		swapSourceChainID[chainID] = -1;
+		if(runLength){
+			prepareProposalRow(chainID);
+		}
+	}
+	/*! \brief Keep the proposal written to the next step of chainID as a new state (the chain still has to be moved there with setCurrentStep)*/
+	void acceptProposal(int chainID)
+	{
+		if(runLength){
+			stateN[chainID]++;
+		}
+	}
+	void rejectProposal(int chainID);
+	void restartChain(int chainID, int step, positionInfo *state, double logLikelihood, double logPrior);
+	void swapCurrent(int chainID1, int chainID2);
+	void settleSwaps(int *chainIDs=nullptr, int n=0);
+	/*! \brief Position of chainID at step -- same as positions[chainID][step], except spilled history is transparently read back from disk
+	 *
+	 * A spilled step is served from a segment the calling thread already paged in (see positionBlock), or else read on its own. Spilled positions live in a small cache owned by the calling thread (so readers on different threads never disturb each other), and the returned pointer is only good until the same thread has read a few more spilled steps or blocks*/
+	positionInfo *getPosition(int chainID, int step)
+	{
+		if(!spilling || !segments[chainID][step/segmentSteps].spilled){
+			return positions[chainID][step];
+		}
+		return spilledPosition(chainID, step);
+	}
+
+	/*! Number of segments each thread keeps paged in by the block readers*/
+	static const int spillCacheSegments = 4;
+	/*! Number of single rows each thread keeps read back by getPosition*/
+	static const int spillCacheRows = 8;
 
 private:
+	/*! Storage segments for each chain -- shape [chainN][segments]*/
+	std::vector<storageSegment> *segments=nullptr;
+	/*! Allocated length of positions, likelihoodVals, and priorVals for each chain (grows by doubling)*/
+	int capacity=0;
+	void appendSegment(int chainID);
+	void reserveSteps(int steps);
+	positionInfo *stateRow(int chainID, int row);
+	int rowOf(int chainID, positionInfo *position);
+	void prepareProposalRow(int chainID);
+
+	/*! Streaming autocorrelation estimates of the log likelihood of every chain, for the evidence errors -- shape [chainN]*/
+	batchMeansAC *likelihoodACs=nullptr;
+	/*! Streaming autocorrelation estimates for the cold chains (see updateACs) -- shape [ensembleN][maxDim]*/
+	batchMeansAC **acEstimators=nullptr;
+	/*! Next step of each cold chain to feed to acEstimators -- shape [ensembleN]*/
+	int *acNextStep=nullptr;
+	/*! Whether old history is being spilled to disk*/
+	bool spilling=false;
+	/*! Number of steps per chain to keep in memory when spilling*/
+	int maxResidentSteps=0;
+	std::string spillFilename;
+	int spillFile=-1;
+	long long spillFileSize=0;
+	/*! Background writer for the spill file*/
+	ThreadPool<spillJob> *spillPool=nullptr;
+	/*! Identifies this object's spill file in the per thread caches (unique over the process)*/
+	long long spillID=-1;
+	positionInfo *pageIn(int chainID, int segmentID);
+	positionInfo *spilledPosition(int chainID, int step);
 	int *file_trim_lengths =NULL;
 	bool trimmed_file=false;
 	std::vector<dump_file_struct *> dump_files;
 	std::vector<std::string> dump_file_names;
+	int write_stacked_dump(int file_id, bool create);
+	std::vector<npy_dump_struct *> npy_dumps;
+	void closeNpyDump(npy_dump_struct *dump);
+	int writeNpyManifest(npy_dump_struct *dump);
 };
 }
 #endif
@@ -0,0 +1,197 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for the hot-path instrumentation of the sampler
+ *
+ * Latencies are recorded in per-thread, cache-line aligned histograms, so the threads never write to shared memory while sampling. The histograms are merged when they're written out.
+ *
+ * Compiled in with _INSTRUMENT (CMake option INSTRUMENTATION) -- without it, eventTimer is empty and every call compiles away. When compiled in, it is still off unless bayesshipSampler::instrument is set.
+ */
+
+/*! \brief Events timed by the instrumentation*/
+enum instrumentEvent{
+	eventPropose=0,/**< Proposal function*/
+	eventPrior=1,/**< Prior evaluation*/
+	eventLikelihood=2,/**< Likelihood evaluation*/
+	eventSwap=3,/**< Swap between chains*/
+	eventQueueWait=4,/**< Time a chain's job spent waiting in a thread pool queue*/
+	eventN=5/**< Number of events*/
+};
+
+/*! \brief Nanoseconds on the steady clock -- monotonic, and cheap to read (vDSO)
+ */
+inline int64_t instrumentClock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*! \brief Log-linear (HDR style) latency histogram in nanoseconds
+ *
+ * Each power of 2 is split into subBuckets linear buckets, so any recorded value is known to about 1/subBuckets (~6%) relative precision, from 1 ns to hours, in a fixed amount of memory
+ */
+class latencyHistogram
+{
+public:
+	/*! log2 of the number of linear buckets per power of 2*/
+	static const int subBucketBits = 4;
+	static const int subBuckets = 1<<subBucketBits;
+	static const int bucketN = 64*subBuckets;
+	uint64_t counts[bucketN];
+	uint64_t count=0;
+	int64_t total=0;
+	int64_t max=0;
+
+	latencyHistogram();
+	/*! \brief Add one value (nanoseconds)*/
+	inline void record(int64_t value)
+	{
+		if(value < 0){
+			value = 0;
+		}
+		counts[bucket(value)]++;
+		count++;
+		total+=value;
+		if(value > max){
+			max = value;
+		}
+	}
+	void reset();
+	void merge(const latencyHistogram &other);
+	int64_t percentile(double p);
+	double mean();
+private:
+	static int bucket(int64_t value);
+	static int64_t bucketValue(int bucket);
+};
+
+/*! \brief Histograms owned by a single thread -- aligned so two threads never share a cache line*/
+struct alignas(64) threadInstruments{
+	latencyHistogram histograms[eventN];
+	/*! Number of sampling decisions made by this thread (used for sampling every Nth event)*/
+	uint64_t ticks=0;
+};
+
+/*! \brief Collection of per-thread histograms for one sampler
+ *
+ * Each thread registers itself the first time it records anything, and afterwards only touches its own threadInstruments
+ */
+class instrumentation
+{
+public:
+	/*! Runtime switch -- nothing is recorded while false*/
+	bool enabled=true;
+	/*! Only time one in every sampleEvery events (per thread) -- 1 times every event*/
+	int sampleEvery=1;
+
+	instrumentation(int sampleEvery=1);
+	~instrumentation();
+	threadInstruments *local();
+	/*! \brief Whether this thread should time its next event
+	 */
+	inline bool sampleNext()
+	{
+		if(!enabled){
+			return false;
+		}
+		if(sampleEvery <= 1){
+			return true;
+		}
+		return (local()->ticks++ % sampleEvery) == 0;
+	}
+	/*! \brief Record a latency measured elsewhere (nanoseconds)*/
+	inline void record(instrumentEvent event, int64_t value)
+	{
+		local()->histograms[event].record(value);
+	}
+	latencyHistogram merged(instrumentEvent event);
+	void reset();
+	void writeStatFile(std::string filename);
+private:
+	/*! Unique ID of this object, so a thread's cached slot can't be confused with one from an old object at the same address*/
+	uint64_t instanceID;
+	std::mutex registerMutex;
+	std::vector<threadInstruments *> threadSlots;
+};
+
+/*! \brief Record an event that was already timed (if instrumentation is compiled in, enabled, and this event is sampled)
+ */
+inline void instrumentRecord(instrumentation *instruments, instrumentEvent event, int64_t value)
+{
+#ifdef _INSTRUMENT
+	if(instruments && instruments->sampleNext()){
+		instruments->record(event, value);
+	}
+#endif
+}
+
+/*! \brief Time stamp for an event that finishes on another thread (ie, a job waiting in a queue) -- 0 if the event isn't timed
+ */
+inline int64_t instrumentStamp(instrumentation *instruments)
+{
+#ifdef _INSTRUMENT
+	if(instruments && instruments->sampleNext()){
+		return instrumentClock();
+	}
+#endif
+	return 0;
+}
+
+/*! \brief Record the time since stamp (from instrumentStamp) -- does nothing if stamp is 0
+ */
+inline void instrumentSince(instrumentation *instruments, instrumentEvent event, int64_t stamp)
+{
+#ifdef _INSTRUMENT
+	if(instruments && stamp != 0){
+		instruments->record(event, instrumentClock() - stamp);
+	}
+#endif
+}
+
+/*! \brief Scoped timer for one event -- starts on construction and records on stop (or destruction)
+ *
+ * Does nothing if instruments is nullptr, instrumentation is disabled, or this event isn't sampled
+ */
+class eventTimer
+{
+public:
+#ifdef _INSTRUMENT
+	eventTimer(instrumentation *instruments, instrumentEvent event)
+	{
+		this->event = event;
+		if(instruments && instruments->sampleNext()){
+			this->instruments = instruments;
+			start = instrumentClock();
+		}
+	}
+	~eventTimer()
+	{
+		stop();
+	}
+	inline void stop()
+	{
+		if(instruments){
+			instruments->record(event, instrumentClock() - start);
+			instruments = nullptr;
+		}
+	}
+private:
+	instrumentation *instruments=nullptr;
+	instrumentEvent event;
+	int64_t start=0;
+#else
+	eventTimer(instrumentation *instruments, instrumentEvent event){}
+	inline void stop(){}
+#endif
+};
+
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef NPYOUTPUT_H
+#define NPYOUTPUT_H
+#include <string>
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for streaming chains into NumPy .npy files
+ *
+ * Needs nothing beyond POSIX, so the chains are written even without HDF5 (see bayesshipSampler::npyOutput and samplerData::create_npy_dump)
+ */
+
+/*! \brief A 2D .npy file -- shape [rows][width] -- that grows as rows are added, written through a shared memory map
+ *
+ * The file is preallocated and doubled in size as it fills, and the header always holds the rows committed so far, so numpy.load(filename, mmap_mode='r') maps it with no parsing, even while it's still being written. The spare capacity is cut off when the file is closed
+ */
+class npyArrayFile
+{
+public:
+	npyArrayFile(std::string filename, char kind, int itemSize, int width, long long initialRows=4096);
+	~npyArrayFile();
+	bool good();
+	void *reserve(long long newRows);
+	void commit(long long newRows);
+	void append(const void *values, long long newRows);
+	void close();
+	/*! Rows committed so far*/
+	long long rows=0;
+	/*! Elements per row*/
+	int width;
+	/*! Bytes per row*/
+	size_t rowBytes;
+	/*! Bytes before the first row -- the header is padded to a fixed size, so it can be rewritten in place as the file grows*/
+	static const int headerBytes = 128;
+private:
+	std::string filename;
+	/*! NumPy type string (eg, <f8)*/
+	std::string descr;
+	int fd=-1;
+	char *map=nullptr;
+	/*! Rows the file has room for*/
+	long long capacity=0;
+	void writeHeader();
+	bool grow(long long neededRows);
+};
+
+}
+#endif
@@ -158,8 +158,6 @@ public:
 class gaussianProposal: public proposal
 {
 public:
-	/*! Vector of random number generators*/
-	gsl_rng **r=nullptr;
 	/*! Number of chains*/
 	int chainN;
 	/*! Maximum dimension of the space*/
@@ -0,0 +1,79 @@
+#ifndef RANDOMNUMBERUTILITIES_H
+#define RANDOMNUMBERUTILITIES_H
+#include <stdint.h>
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for the counter-based random number generators used by the sampler
+ *
+ * Every draw is a pure function of (seed, chainID, step, purpose), built on Philox4x32-10. The sequence a chain sees does not depend on how the threads interleave work, and one purpose (say, the proposal) drawing more or fewer numbers never shifts the numbers another purpose (say, the MH acceptance) sees.
+ */
+
+/*! \brief Independent sub-streams for each step of each chain*/
+enum rngPurpose{
+	rngProposalChoice=0,/**< Choosing which proposal to use*/
+	rngProposal=1,/**< Draws made inside the proposal*/
+	rngAccept=2,/**< MH acceptance*/
+	rngSurrogate=3,/**< First stage of delayed acceptance*/
+	rngSwap=4,/**< Swapping between temperatures*/
+	rngSwapInterval=5,/**< Steps between swaps for multi-step jobs*/
+	rngPurposeN=6/**< Number of purposes*/
+};
+
+void philox4x32(const uint32_t *counter, const uint32_t *key, uint32_t *output);
+
+/*! \brief Single stream of random numbers for one (chain, step, purpose)
+ *
+ * Consecutive draws walk through the Philox blocks for that key/counter, 4 words at a time -- uniformBlock and normalBlock generate many blocks at once. Not thread safe -- each stream belongs to one chain
+ */
+class rngStream
+{
+public:
+	rngStream();
+	void setKey(uint64_t seed);
+	void reset(uint64_t step, uint32_t streamID, uint32_t purpose);
+	double uniform();
+	double gaussian(double sigma=1);
+	unsigned int geometric(double p);
+	void uniformBlock(double *output, int n);
+	void normalBlock(double *output, int n, double sigma=1);
+private:
+	friend class counterRNG;
+	uint32_t key[2];
+	uint32_t counter[4];
+	uint32_t buffer[4];
+	/*! Next unused word in buffer (4 means the buffer is empty)*/
+	int bufferPos=4;
+	double spareGaussian=0;
+	bool hasSpareGaussian=false;
+	void nextBlock();
+};
+
+/*! \brief Collection of counter-based streams for every chain in the ensemble
+ *
+ * Each chain has a step counter that is incremented once per MH step with beginStep, which resets every purpose stream for that chain
+ */
+class counterRNG
+{
+public:
+	/*! Number of steps taken by each chain -- shape [streamN]*/
+	uint64_t *steps=nullptr;
+
+	counterRNG(int streamN, uint64_t seed);
+	~counterRNG();
+	void beginStep(int chainID);
+	void setStep(int chainID, uint64_t step);
+	rngStream *stream(int chainID, int purpose);
+	double uniform(int chainID, int purpose);
+	double gaussian(int chainID, int purpose, double sigma=1);
+	void uniformBlock(const int *chainIDs, int n, int purpose, double *output);
+private:
+	int streamN;
+	uint64_t seed;
+	rngStream **streams=nullptr;
+};
+
+}
+#endif
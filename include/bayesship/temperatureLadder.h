@@ -0,0 +1,27 @@
+#ifndef TEMPERATURELADDER_H
+#define TEMPERATURELADDER_H
+#include "bayesship/dataUtilities.h"
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for tuning the temperature ladder from the swap statistics of a run
+ *
+ * The swap rejection rate between adjacent rungs k and k+1 estimates the local communication barrier, and their sum over the ladder is the global barrier Lambda. A replica's round trip (coldest rung to hottest and back) takes roughly 2(1+Lambda) swap sweeps with the even-odd schedule (see bayesshipSampler::deterministicEvenOddSwapping) once the rejection is the same for every pair, so:
+ *
+ * respaceLadder moves the intermediate temperatures so every pair has the same rejection rate
+ *
+ * suggestEnsembleSize gives the smallest ladder that keeps the (equalized) rejection rate under a target
+ *
+ * These work on any samplerData -- a pilot run, the burn in, or the main run
+ */
+
+void ladderSwapCounts(samplerData *data, long long *accepts, long long *rejects);
+void ladderRejectionRates(samplerData *data, double *rejection);
+double communicationBarrier(double *rejection, int pairs);
+bool respaceLadder(double *betaSchedule, double *rejection, int ensembleSize, double *newBetaSchedule);
+int suggestEnsembleSize(double barrier, double targetRejection=.5);
+
+}
+#endif
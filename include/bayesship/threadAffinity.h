@@ -0,0 +1,47 @@
+#ifndef THREADAFFINITY_H
+#define THREADAFFINITY_H
+#include <vector>
+
+namespace bayesship{
+
+/*! \file
+ *
+ * # Header file for pinning worker threads to CPUs
+ *
+ * On Linux, threads are pinned with sched_setaffinity. The NUMA layout is read from libnuma if the library was compiled in with _NUMA, and from /sys/devices/system/node otherwise. On other platforms pinning is a no-op.
+ */
+
+/*! \brief How worker threads are placed on the CPUs available to the process*/
+enum affinityPolicy{
+	affinityNone=0,/**< Threads are not pinned (the operating system schedules them)*/
+	affinityCompact=1,/**< Thread i gets the i-th available CPU, filling one NUMA domain before moving to the next*/
+	affinityScatter=2,/**< Threads are dealt round-robin across NUMA domains*/
+	affinityList=3/**< Thread i gets cpuList[i % cpuList.size()]*/
+};
+
+/*! \brief Maps worker thread IDs to CPUs and NUMA domains
+ *
+ * Only CPUs in the process's current affinity mask (e.g. restricted by taskset or a batch scheduler) are used for the compact and scatter policies
+ */
+class threadAffinity
+{
+public:
+	threadAffinity(affinityPolicy policy, std::vector<int> cpuList=std::vector<int>());
+	int cpuForThread(int threadID);
+	int nodeForThread(int threadID);
+	int nodeOfCPU(int cpu);
+	bool pinCurrentThread(int threadID);
+	/*! \brief Number of NUMA domains covering the available CPUs*/
+	int getNodeN(){return nodeN;}
+	affinityPolicy getPolicy(){return policy;}
+private:
+	affinityPolicy policy;
+	/*! CPUs in the order threads are assigned to them*/
+	std::vector<int> cpuOrder;
+	/*! NUMA domain of each entry of cpuOrder*/
+	std::vector<int> nodeOrder;
+	int nodeN=1;
+};
+
+}
+#endif
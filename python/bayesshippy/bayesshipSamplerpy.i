@@ -3,6 +3,7 @@
 #include "bayesship/bayesshipSampler.h"
 #include "bayesship/dataUtilities.h"
 #include "bayesship/utilities.h"
+#include "bayesship/threadAffinity.h"
 %}
 
 %include "carrays.i"
@@ -15,5 +16,6 @@
 
 %include "bayesship/dataUtilities.h"
 %include "bayesship/utilities.h"
+%include "bayesship/threadAffinity.h"
 %include "bayesship/bayesshipSampler.h"
 
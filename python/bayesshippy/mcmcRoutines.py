@@ -1,3 +1,5 @@
+import json
+import os
 import numpy as np
 import matplotlib.pyplot as plt
 import h5py
@@ -11,6 +13,46 @@ from scipy.integrate import quad
 
 
 
+def readChain(outputFile, quantity, chainID):
+    """Steps of one chain in a BayesShip output file, in either layout
+
+    quantity is "PARAMETERS", "LOGL_LOGP", "STATUS", or "MODEL_STATUS". The
+    stacked layout (bayesshipSampler::stackedOutput) keeps each quantity as
+    one [chain][step][width] dataset, with the steps of each chain in
+    MCMC_METADATA/CHAIN LENGTHS. With run length output, the rows are the
+    states of each chain, and each is repeated from its STATE START STEPS
+    entry up to the next one. The per chain layout keeps one "CHAIN i"
+    dataset per chain.
+    """
+    output = outputFile["MCMC_OUTPUT"]
+    if isinstance(output.get("PARAMETERS"), h5py.Dataset):
+        length = int(outputFile["MCMC_METADATA"]["CHAIN LENGTHS"][chainID])
+        if "STATE START STEPS" in output:
+            states = int(outputFile["MCMC_METADATA"]["CHAIN STATES"][chainID])
+            starts = output["STATE START STEPS"][chainID, :states, 0]
+            repeats = np.diff(np.append(starts, length))
+            return np.repeat(output[quantity][chainID, :states], repeats, axis=0)
+        return output[quantity][chainID, :length]
+    if quantity == "PARAMETERS":
+        return output["CHAIN {}".format(chainID)]
+    return output[quantity]["CHAIN {}".format(chainID)]
+
+
+def readNpyOutput(prefix):
+    """Manifest and chains of .npy output (bayesshipSampler::npyOutput)
+
+    prefix is the path without the suffix, eg outputDir+outputFileMoniker+"_output".
+    Returns the manifest (betas, trim lengths, start steps, AC values, and the
+    evidence) as a dict, with each entry of its "files" replaced by the list
+    of arrays (one per chain), memory mapped rather than read.
+    """
+    with open(prefix + "_manifest.json") as manifestFile:
+        manifest = json.load(manifestFile)
+    directory = os.path.dirname(prefix)
+    for quantity, names in manifest["files"].items():
+        manifest["files"][quantity] = [np.load(os.path.join(directory, name), mmap_mode='r') for name in names]
+    return manifest
+
 class MCMCOutput:
     filename = ""
     outputFile = None
@@ -102,15 +144,15 @@ class MCMCOutput:
             thin_local = np.amax(self.ACVals[chainIDs[0]][:])
 
         self.selectedData = None
-        data = self.outputFile["MCMC_OUTPUT"]["CHAIN {}".format(chainIDs[0])][trim_local::thin_local]
-        logl = self.outputFile["MCMC_OUTPUT/LOGL_LOGP"]["CHAIN {}".format(chainIDs[0])][trim_local::thin_local,0]
-        logp = self.outputFile["MCMC_OUTPUT/LOGL_LOGP"]["CHAIN {}".format(chainIDs[0])][trim_local::thin_local,1]
+        data = readChain(self.outputFile, "PARAMETERS", chainIDs[0])[trim_local::thin_local]
+        logl = readChain(self.outputFile, "LOGL_LOGP", chainIDs[0])[trim_local::thin_local,0]
+        logp = readChain(self.outputFile, "LOGL_LOGP", chainIDs[0])[trim_local::thin_local,1]
         status = None
         model_status = None
         if self.RJ:
-            status = self.outputFile["MCMC_OUTPUT/STATUS"]["CHAIN {}".format(chainIDs[0])][trim_local::thin_local]
+            status = readChain(self.outputFile, "STATUS", chainIDs[0])[trim_local::thin_local]
             if "MCMC_OUTPUT/MODEL_STATUS" in self.outputFile.keys():
-                model_status = self.outputFile["MCMC_OUTPUT/MODEL_STATUS"]["CHAIN {}".format(chainIDs[0])][trim_local::thin_local]
+                model_status = readChain(self.outputFile, "MODEL_STATUS", chainIDs[0])[trim_local::thin_local]
         for x in chainIDs[1:]:
             if trim is None and betaID ==0 and not self.RJ:
                 trim_local = self.trimLengths[x]
@@ -119,13 +161,13 @@ class MCMCOutput:
                 #print(thin_local)
             if thin_local == 0:
                 thin_local=1
-            data = np.insert(data,-1, self.outputFile["MCMC_OUTPUT"]["CHAIN {}".format(x)][trim_local::thin_local],axis=0)
-            logl = np.insert(logl,-1, self.outputFile["MCMC_OUTPUT/LOGL_LOGP"]["CHAIN {}".format(x)][trim_local::thin_local,0],axis=0)
-            logp = np.insert(logp,-1, self.outputFile["MCMC_OUTPUT/LOGL_LOGP"]["CHAIN {}".format(x)][trim_local::thin_local,1],axis=0)
+            data = np.insert(data,-1, readChain(self.outputFile, "PARAMETERS", x)[trim_local::thin_local],axis=0)
+            logl = np.insert(logl,-1, readChain(self.outputFile, "LOGL_LOGP", x)[trim_local::thin_local,0],axis=0)
+            logp = np.insert(logp,-1, readChain(self.outputFile, "LOGL_LOGP", x)[trim_local::thin_local,1],axis=0)
             if self.RJ:
-                status = np.insert(status,-1, self.outputFile["MCMC_OUTPUT/STATUS"]["CHAIN {}".format(x)][trim_local::thin_local],axis=0)
+                status = np.insert(status,-1, readChain(self.outputFile, "STATUS", x)[trim_local::thin_local],axis=0)
                 if "MCMC_OUTPUT/MODEL_STATUS" in self.outputFile.keys():
-                    model_status = np.insert(model_status,-1, self.outputFile["MCMC_OUTPUT/MODEL_STATUS"]["CHAIN {}".format(x)][trim_local::thin_local],axis=0)
+                    model_status = np.insert(model_status,-1, readChain(self.outputFile, "MODEL_STATUS", x)[trim_local::thin_local],axis=0)
 
         if sizeCap is not None:
             if data.shape[0] > sizeCap:
@@ -167,7 +209,7 @@ def gelmanRubinStatistic(dataObjs):
         chains.append([])
         for j, c in enumerate(chainIDs[i]):
             trim, thin = int(d.trimLengths[c]), int(np.amax(d.ACVals[c]))
-            chains[-1].append(d.outputFile["MCMC_OUTPUT"]["CHAIN {}".format(c)][trim::thin])
+            chains[-1].append(readChain(d.outputFile, "PARAMETERS", c)[trim::thin])
             lengths[i,j] = len(chains[-1][-1])
     minLength = int(np.amin(lengths))
     dim = len(chains[0][0][0])
@@ -220,16 +262,16 @@ def RJMCMC_unpack_file(filename,betaID=0):
     #     print("This file doesn't have chains hotter than Beta=1!")
     #     return None, None, None
     chains_N = len(chains)
-    data = f["MCMC_OUTPUT"]["CHAIN {}".format(chainIDs[0])]
-    status = f["MCMC_OUTPUT/STATUS"]["CHAIN {}".format(chainIDs[0])]
+    data = readChain(f, "PARAMETERS", chainIDs[0])
+    status = readChain(f, "STATUS", chainIDs[0])
     for x in chainIDs[1:]:
-        data = np.insert(data,-1, f["MCMC_OUTPUT"]["CHAIN {}".format(x)],axis=0)
-        status = np.insert(status,-1, f["MCMC_OUTPUT/STATUS"]["CHAIN {}".format(x)],axis=0)
+        data = np.insert(data,-1, readChain(f, "PARAMETERS", x),axis=0)
+        status = np.insert(status,-1, readChain(f, "STATUS", x),axis=0)
     model_status = []
     if "MCMC_OUTPUT/MODEL_STATUS" in f.keys():
-        model_status = f["MCMC_OUTPUT/MODEL_STATUS"]["CHAIN {}".format(chainIDs[0])]
+        model_status = readChain(f, "MODEL_STATUS", chainIDs[0])
         for x in chainIDs[1:]:
-            model_status = np.insert(model_status,-1, f["MCMC_OUTPUT/MODEL_STATUS"]["CHAIN {}".format(x)],axis=0)
+            model_status = np.insert(model_status,-1, readChain(f, "MODEL_STATUS", x),axis=0)
     return data, status,model_status
 
 def MCMC_unpack_file(filename,betaID=0, trim=None, thin=None):
@@ -269,7 +311,7 @@ def MCMC_unpack_file(filename,betaID=0, trim=None, thin=None):
         thin_local = np.amax(f["MCMC_METADATA"]["AC VALUES"][chainIDs[0]][:])
     if thin_local == 0 :
         thin_local=1
-    data = f["MCMC_OUTPUT"]["CHAIN {}".format(chainIDs[0])][trim_local::thin_local]
+    data = readChain(f, "PARAMETERS", chainIDs[0])[trim_local::thin_local]
     for x in chainIDs[1:]:
         if trim is None and betaID ==0:
             trim_local = f["MCMC_METADATA"]["SUGGESTED TRIM LENGTHS"][x]
@@ -277,7 +319,7 @@ def MCMC_unpack_file(filename,betaID=0, trim=None, thin=None):
             thin_local = np.amax(f["MCMC_METADATA"]["AC VALUES"][x][:])
         if thin_local == 0:
             thin_local=1
-        data = np.insert(data,-1, f["MCMC_OUTPUT"]["CHAIN {}".format(x)][trim_local::thin_local],axis=0)
+        data = np.insert(data,-1, readChain(f, "PARAMETERS", x)[trim_local::thin_local],axis=0)
     return data
 
 
@@ -141,12 +141,12 @@ void fisherProposal::propose(positionInfo *currentPosition, positionInfo *propos
 		
 	}
 
-	int randDim = (int)(gsl_rng_uniform(sampler->rvec[chainID])*maxDim);	
+	int randDim = (int)(sampler->rng->uniform(chainID, rngProposal)*maxDim);	
 	//Adding 1e-10 to soften the effect of broadening gaussian step based on Temperature dependence -- beta==0 is problematic
 	double scaling = std::abs(FisherEigenVals[chainID][randDim]); 
 	if(scaling <10. ){scaling = 10.;}
 	scaling *=(sampler->betas[chainID]+1e-5);
-	double randGauss = gsl_ran_gaussian(sampler->rvec[chainID], 1./std::sqrt(scaling));	
+	double randGauss = sampler->rng->gaussian(chainID, rngProposal, 1./std::sqrt(scaling));	
 	if(proposedPosition->RJ){
 		for(int i = 0 ; i<maxDim; i++){
 			if(proposedPosition->status[i] == 1){
@@ -65,9 +65,24 @@ bool GMMProposal::train(int chainID)
 {
 	int samples  = stepNumber[chainID];
 	arma::mat data(maxDim, samples, arma::fill::zeros);
-	for(int i = 0 ; i<samples; i++){
-		for(int j = 0 ; j<maxDim; j++){
-			data.at(j, i) = sampler->activeData->positions[chainID][i]->parameters[j];
+	int stride = sampler->activeData->maxDim;
+	int i = 0;
+	if(sampler->activeData->runLength){
+		/*Repeated states share a row, so there are no long blocks -- read the steps one at a time*/
+		for( ; i<samples; i++){
+			double *parameters = sampler->activeData->positions[chainID][i]->parameters;
+			for(int j = 0 ; j<maxDim; j++){
+				data.at(j, i) = parameters[j];
+			}
+		}
+	}
+	while(i < samples){
+		int rows;
+		double *parameters = sampler->activeData->parameterBlock(chainID, i, &rows);
+		for(int k = 0 ; k<rows && i<samples; k++, i++){
+			for(int j = 0 ; j<maxDim; j++){
+				data.at(j, i) = parameters[k*stride + j];
+			}
 		}
 	}
 	bool status = models[chainID].learn(data, gaussians, arma::maha_dist, arma::random_subset, km_iter, em_iter, var_floor, false);
@@ -100,7 +115,7 @@ void GMMProposal::propose(positionInfo *current, positionInfo *proposed, int cha
 	if(!primed[chainID] ){
 		return;
 	}
-	double beta = gsl_rng_uniform(sampler->rvec[chainID]);
+	double beta = sampler->rng->uniform(chainID, rngProposal);
 	int blockID = 0 ;
 	for(int i = 0 ; i<blocks.size(); i++){
 		if (beta < blockProbBoundaries[i]){
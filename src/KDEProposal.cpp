@@ -3,7 +3,6 @@
 #include <vector>
 #include <random>
 #include <algorithm>
-#include <chrono>
 #include <gsl/gsl_matrix_double.h>
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_errno.h>
@@ -476,9 +475,11 @@ int KDEProposal::trainKDE(int chainID)
 	}
 	//std::random_device rd;
 	//std::mt19937 g(rd());
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-	std::mt19937 g(seed);
-	std::shuffle(trainingIDs[chainID].begin(),trainingIDs[chainID].end(), g);	
+	//Fisher-Yates shuffle with the chain's proposal stream, so training is reproducible
+	for(int i = stepNumber[chainID]-1 ; i>0; i--){
+		int swapID = (int)(sampler->rng->uniform(chainID, rngProposal)*(i+1));
+		std::swap(trainingIDs[chainID][i], trainingIDs[chainID][swapID]);
+	}
 	trainingIDs[chainID].resize(samples);
 
 	//Allocate random number
@@ -590,7 +591,7 @@ void KDEProposal::propose(positionInfo *currentPosition, positionInfo *proposedP
 		//Update storage	
 		for(int i = 0 ; i<positionUpdates;i++){
 			lastUpdatePositionID[chainID]+=updateInterval;
-			storedSamples[chainID][stepNumber[chainID]]->updatePosition(data->positions[chainID][lastUpdatePositionID[chainID] ]);
+			storedSamples[chainID][stepNumber[chainID]]->updatePosition(data->getPosition(chainID, lastUpdatePositionID[chainID]));
 			stepNumber[chainID]+=1;
 			//std::cout<<lastUpdatePositionID[chainID]<<" "<<currentStep<<" "<<chainID<<std::endl;
 		}
@@ -616,7 +617,7 @@ void KDEProposal::propose(positionInfo *currentPosition, positionInfo *proposedP
 	//int sampleID = gsl_rng_uniform(sampler->rvec[chainID])*stepNumber[chainID];
 	//positionInfo *samplePosition = storedSamples[chainID][sampleID];
 
-	int sampleID = trainingIDs[chainID][(int)(gsl_rng_uniform(sampler->rvec[chainID])*trainingIDs[chainID].size())];
+	int sampleID = trainingIDs[chainID][(int)(sampler->rng->uniform(chainID, rngProposal)*trainingIDs[chainID].size())];
 	positionInfo *samplePosition = storedSamples[chainID][sampleID];
 
 	double **cov = new double*[sampler->maxDim];
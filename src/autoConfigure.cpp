@@ -0,0 +1,320 @@
+#include "bayesship/autoConfigure.h"
+#include "bayesship/bayesshipSampler.h"
+#include "bayesship/dataUtilities.h"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <math.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/*! \file
+ *
+ * # Source file for choosing a run configuration from a short pilot run
+ */
+
+namespace bayesship{
+
+/*! Cost of one epoch of the lockstep barrier (seconds) -- from bayesship_microbench*/
+static const double barrierOverhead = 1e-5;
+/*! Cost of one trip through a thread pool queue (seconds) -- from bayesship_microbench*/
+static const double queueOverhead = 2e-6;
+
+/*! \brief Predicted steps per second (summed over every chain) for one configuration -- 0 if the configuration isn't valid
+ */
+double predictChainStepsPerSecond(
+	pilotStatistics stats,/**< Pilot measurements*/
+	int threads,/**< Threads to use*/
+	int chainN,/**< Total number of chains*/
+	bool threadPool,/**< Thread pool (true) or lockstep (false)*/
+	double swapProb/**< Probability of a swap per step*/
+	)
+{
+	if(chainN < 1 || threads < 1 || stats.stepTime <= 0){
+		return 0;
+	}
+	if(!threadPool){
+		int activeThreads = std::min(threads, chainN);
+		int stepsPerThread = (chainN + activeThreads - 1)/activeThreads;
+		double sweep = stepsPerThread*stats.stepTime;
+		if(activeThreads > 1){
+			/*The sweep waits for the slowest thread -- the expected maximum of activeThreads sums of stepsPerThread steps*/
+			sweep += stats.stepTimeSpread*stats.stepTime*sqrt((double)stepsPerThread)*sqrt(2.*log((double)activeThreads));
+			sweep += barrierOverhead;
+		}
+		sweep += chainN*swapProb*stats.swapTime;
+		return chainN/sweep;
+	}
+	if(threads < 3){
+		return 0;
+	}
+	int workers = std::min(threads-2, chainN);
+	double stepRate = workers/(stats.stepTime + queueOverhead);
+	double swapRate = (swapProb > 0) ? 1./(swapProb*(stats.swapTime + queueOverhead)) : stepRate;
+	return std::min(stepRate, swapRate);
+}
+
+/*! \brief Smallest ensembleSize that keeps the swap acceptance between adjacent temperatures above targetAcceptance
+ *
+ * -log(acceptance) scales like the square of the spacing of the (geometric) ladder, which is 1/(ensembleSize-1)
+ */
+int predictEnsembleSize(
+	pilotStatistics stats,/**< Pilot measurements*/
+	double targetAcceptance,/**< Acceptance to aim for*/
+	int maxEnsembleSize/**< Largest ladder to consider*/
+	)
+{
+	double acceptance = std::min(std::max(stats.swapAcceptance, 1e-3), .999);
+	int pilotGaps = std::max(stats.ensembleSize-1, 1);
+	for(int size = 2 ; size<=maxEnsembleSize; size++){
+		double ratio = (double)pilotGaps/(size-1);
+		double predicted = exp(log(acceptance)*ratio*ratio);
+		if(predicted >= targetAcceptance){
+			return size;
+		}
+	}
+	return maxEnsembleSize;
+}
+
+/*! \brief Pick the configuration with the best predicted ESS per wall-second
+ *
+ * Configurations within 2% of the best are considered equal, and the smallest number of chains (then lockstep over thread pool) wins, since it uses the least memory
+ */
+runConfiguration chooseConfiguration(
+	pilotStatistics stats,/**< Pilot measurements*/
+	autoConfigureLimits limits/**< What can change, and the resources available*/
+	)
+{
+	int cores = std::max(limits.cores, 1);
+	double autocorrelation = (stats.autocorrelation > 0) ? stats.autocorrelation : 1;
+	int ensembleSize = limits.ensembleSize;
+	int minEnsembleN = limits.ensembleN;
+	int maxEnsembleN = limits.ensembleN;
+	if(limits.tuneEnsembles){
+		ensembleSize = predictEnsembleSize(stats, limits.targetAcceptance);
+		minEnsembleN = 1;
+		/*Past a few chains per core, the throughput doesn't improve*/
+		maxEnsembleN = std::max(limits.ensembleN, (4*cores + ensembleSize - 1)/ensembleSize);
+	}
+
+	std::vector<runConfiguration> candidates;
+	double bestESS = 0;
+	for(int ensembleN = minEnsembleN ; ensembleN<=maxEnsembleN; ensembleN++){
+		for(int pool = 0 ; pool<2; pool++){
+			int chainN = ensembleN*ensembleSize;
+			runConfiguration config;
+			config.threadPool = (pool == 1);
+			config.threads = (config.threadPool) ? std::min(cores, chainN+2) : std::min(cores, chainN);
+			config.ensembleN = ensembleN;
+			config.ensembleSize = ensembleSize;
+			config.chainStepsPerSecond = predictChainStepsPerSecond(stats, config.threads, chainN, config.threadPool, limits.swapProb);
+			if(config.chainStepsPerSecond <= 0){
+				continue;
+			}
+			config.essPerSecond = config.chainStepsPerSecond/(ensembleSize*autocorrelation);
+			config.runtime = (double)(limits.iterations + limits.burnIterations)*chainN/config.chainStepsPerSecond;
+			candidates.push_back(config);
+			bestESS = std::max(bestESS, config.essPerSecond);
+		}
+	}
+	runConfiguration chosen;
+	chosen.ensembleN = limits.ensembleN;
+	chosen.ensembleSize = limits.ensembleSize;
+	for(size_t i = 0 ; i<candidates.size(); i++){
+		if(candidates[i].essPerSecond >= .98*bestESS){
+			chosen = candidates[i];
+			break;
+		}
+	}
+
+	/*Batch the run if all the steps wouldn't fit in memory at once*/
+	int chainN = chosen.ensembleN*chosen.ensembleSize;
+	double bytesPerStep = chainN*(limits.maxDim*(sizeof(double) + ((limits.RJ) ? sizeof(int) : 0)) + 64.);
+	chosen.batchSize = limits.batchSize;
+	if(limits.iterations*bytesPerStep > limits.memoryBudget){
+		chosen.batchSize = std::min(std::max((int)(limits.memoryBudget/bytesPerStep), 100), limits.iterations);
+	}
+	return chosen;
+}
+
+/*! \brief Number of CPUs the process may run on
+ */
+int availableCores()
+{
+#ifdef __linux__
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	if(sched_getaffinity(0, sizeof(mask), &mask) == 0){
+		int count = CPU_COUNT(&mask);
+		if(count > 0){
+			return count;
+		}
+	}
+#endif
+	int count = (int)std::thread::hardware_concurrency();
+	return (count > 0) ? count : 1;
+}
+
+//##########################################################
+//##########################################################
+
+/*! \brief Run a short pilot, and set threads, threadPool, ensembleN, ensembleSize, and batchSize from its measurements
+ *
+ * The values are chosen to maximize the predicted ESS per wall-second on the available CPUs (see chooseConfiguration), and are printed with the predicted runtime
+ *
+ * The pilot is a single ensemble stepped by one thread (so the step times aren't disturbed by other threads), with autoConfigureIterations steps of burn in (to tune the temperatures) and autoConfigureIterations steps of sampling. It uses the default proposals, and doesn't write any files (see writeFiles).
+ *
+ * ensembleN and ensembleSize are only changed if nothing the user supplied is sized by the number of chains (proposalFns, betaSchedule, initialPositionEnsemble, userParameters)
+ */
+void bayesshipSampler::runAutoConfigure()
+{
+	std::cout<<"Auto-configure -- pilot run of "<<autoConfigureIterations<<" steps"<<std::endl;
+	bayesshipSampler *pilot = new bayesshipSampler(likelihood, prior);
+	pilot->maxDim = maxDim;
+	pilot->minDim = minDim;
+	pilot->RJ = RJ;
+	pilot->surrogateLikelihood = surrogateLikelihood;
+	pilot->seed = seed;
+	pilot->swapProb = swapProb;
+	pilot->swapRadius = swapRadius;
+	pilot->restrictSwapTemperatures = restrictSwapTemperatures;
+	pilot->randomizeSwapping = randomizeSwapping;
+	pilot->averageDynamics = averageDynamics;
+	pilot->ensembleN = 1;
+	pilot->ensembleSize = std::max(ensembleSize, 2);
+	if(ensembleSize >= 2){
+		pilot->betaSchedule = betaSchedule;
+	}
+	pilot->threads = 1;
+	pilot->threadPool = false;
+	pilot->iterations = autoConfigureIterations;
+	pilot->burnIterations = autoConfigureIterations;
+	pilot->priorIterations = 0;
+	pilot->writePriorData = false;
+	pilot->ignoreExistingCheckpoint = true;
+	pilot->writeFiles = false;
+	/*Pilot chain k is rung k of the first ensemble, which is chainIndex(0,k) of the run -- hand it that chain's entries (the last rung's, for a pilot rung the run doesn't have)*/
+	int pilotRungs = pilot->ensembleSize;
+	positionInfo **pilotInitialPositions = nullptr;
+	void **pilotUserParameters = nullptr;
+	if(initialPositionEnsemble){
+		pilotInitialPositions = new positionInfo*[pilotRungs];
+	}
+	if(userParameters){
+		pilotUserParameters = new void*[pilotRungs];
+	}
+	for(int k = 0 ; k<pilotRungs; k++){
+		int chainID = chainIndex(0, std::min(k, ensembleSize-1));
+		if(initialPositionEnsemble){
+			pilotInitialPositions[k] = initialPositionEnsemble[chainID];
+		}
+		if(userParameters){
+			pilotUserParameters[k] = userParameters[chainID];
+		}
+	}
+	pilot->initialPosition = initialPosition;
+	pilot->initialPositionEnsemble = pilotInitialPositions;
+	if(userParameters){
+		pilot->userParameters = pilotUserParameters;
+	}
+	pilot->sample();
+
+	pilotStatistics stats;
+	stats.ensembleSize = pilot->ensembleSize;
+	samplerData *pilotData = pilot->data;
+	int pilotChainN = pilot->chainN;
+	std::vector<double> chainStepTimes;
+	for(int i = 0 ; i<pilotChainN; i++){
+		double steps = 0;
+		double time = pilotData->priorTimes[i] + pilotData->likelihoodTimes[i];
+		for(int j = 0 ; j<pilot->proposalFns->proposalN; j++){
+			steps += pilotData->successN[i][j] + pilotData->rejectN[i][j];
+			time += pilotData->proposalTimes[i][j];
+		}
+		if(steps > 0){
+			chainStepTimes.push_back(time/steps);
+		}
+	}
+	double mean = 0;
+	for(size_t i = 0 ; i<chainStepTimes.size(); i++){
+		mean += chainStepTimes[i];
+	}
+	mean /= std::max((int)chainStepTimes.size(), 1);
+	double variance = 0;
+	for(size_t i = 0 ; i<chainStepTimes.size(); i++){
+		variance += (chainStepTimes[i]-mean)*(chainStepTimes[i]-mean);
+	}
+	variance /= std::max((int)chainStepTimes.size(), 1);
+	stats.stepTime = mean;
+	stats.stepTimeSpread = (mean > 0) ? sqrt(variance)/mean : 0;
+	long long accepts = 0;
+	long long attempts = 0;
+	for(int i = 0 ; i<pilot->ensembleSize-1; i++){
+		int chainID1 = pilot->chainIndex(0,i);
+		int chainID2 = pilot->chainIndex(0,i+1);
+		accepts += pilotData->swapAccepts[chainID1][chainID2];
+		attempts += pilotData->swapAccepts[chainID1][chainID2] + pilotData->swapRejects[chainID1][chainID2];
+	}
+	stats.swapAcceptance = (attempts > 0) ? (double)accepts/attempts : 0;
+	stats.autocorrelation = (!RJ) ? pilotData->maxACs[0] : 0;
+	/*Time the swaps on the pilot's final states, after the counts above are read. An accepted swap only redirects the chains (see samplerData::swapCurrent), so this is the serial cost per swap the model needs -- the state is copied into the chain's own rows by its next step, which stepTime already covers*/
+	int swapTrials = 10000;
+	int64_t swapStart = instrumentClock();
+	for(int i = 0 ; i<swapTrials; i++){
+		int rung = i%(pilot->ensembleSize-1);
+		pilot->chainSwap(pilot->chainIndex(0,rung), pilot->chainIndex(0,rung+1), pilotData);
+	}
+	stats.swapTime = (instrumentClock() - swapStart)*1e-9/swapTrials;
+
+	/*Hand back what was borrowed -- anything the pilot allocated itself is released with it*/
+	pilot->initialPosition = nullptr;
+	pilot->initialPositionEnsemble = nullptr;
+	if(pilotInitialPositions){
+		delete [] pilotInitialPositions;
+	}
+	if(pilotUserParameters){
+		pilot->userParameters = nullptr;
+		delete [] pilotUserParameters;
+	}
+	if(betaSchedule && ensembleSize >= 2){
+		pilot->betaSchedule = nullptr;
+	}
+	delete pilot;
+
+	autoConfigureLimits limits;
+	limits.cores = availableCores();
+	limits.tuneEnsembles = !proposalFns && !betaSchedule && !initialPositionEnsemble && !userParameters;
+	limits.ensembleN = ensembleN;
+	limits.ensembleSize = ensembleSize;
+	limits.maxDim = maxDim;
+	limits.RJ = RJ;
+	limits.iterations = iterations;
+	if(independentSamples > 0){
+		limits.iterations = (int)(independentSamples*std::max(stats.autocorrelation, 1.));
+	}
+	limits.burnIterations = burnIterations;
+	limits.batchSize = batchSize;
+	limits.swapProb = swapProb;
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long pageSize = sysconf(_SC_PAGE_SIZE);
+	if(pages > 0 && pageSize > 0){
+		limits.memoryBudget = .25*pages*(double)pageSize;
+	}
+	runConfiguration config = chooseConfiguration(stats, limits);
+
+	std::cout<<"Auto-configure -- step time "<<stats.stepTime<<" s (spread "<<stats.stepTimeSpread<<"), swap time "<<stats.swapTime<<" s, adjacent swap acceptance "<<stats.swapAcceptance<<" at ensembleSize "<<stats.ensembleSize<<", autocorrelation "<<stats.autocorrelation<<std::endl;
+	if(!limits.tuneEnsembles){
+		std::cout<<"Auto-configure -- keeping ensembleN and ensembleSize (user supplied proposals, beta schedule, initial ensemble, or user parameters are sized by the number of chains)"<<std::endl;
+	}
+	threads = config.threads;
+	threadPool = config.threadPool;
+	ensembleN = config.ensembleN;
+	ensembleSize = config.ensembleSize;
+	batchSize = config.batchSize;
+	std::cout<<"Auto-configure -- threads "<<threads<<", threadPool "<<threadPool<<", ensembleN "<<ensembleN<<", ensembleSize "<<ensembleSize<<", batchSize "<<batchSize<<std::endl;
+	std::cout<<"Auto-configure -- predicted "<<config.chainStepsPerSecond<<" steps/s, "<<config.essPerSecond<<" ESS/s, runtime "<<config.runtime<<" s"<<std::endl;
+}
+
+}
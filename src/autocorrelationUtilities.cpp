@@ -5,6 +5,10 @@
 #include <iostream>
 #include <math.h>
 #include <cmath>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <mutex>
 
 namespace bayesship{
 
@@ -40,6 +44,59 @@ namespace bayesship{
  * ...
  */
 
+/*! \brief Add the next step of the chain
+ */
+void batchMeansAC::add(double x)
+{
+	count++;
+	addBatch(0, x);
+}
+
+/*! \brief Record a finished batch of 2^level steps with the given sum, and pair it up into a batch of the next size
+ */
+void batchMeansAC::addBatch(int level, double sum)
+{
+	while(level < levels){
+		double mean = sum/std::ldexp(1., level);
+		batchN[level]++;
+		double delta = mean - batchMean[level];
+		batchMean[level] += delta/batchN[level];
+		batchM2[level] += delta*(mean - batchMean[level]);
+		if(level+1 == levels){
+			return;
+		}
+		if(!partialHalf[level+1]){
+			partialSum[level+1] = sum;
+			partialHalf[level+1] = true;
+			return;
+		}
+		sum += partialSum[level+1];
+		partialHalf[level+1] = false;
+		level++;
+	}
+}
+
+/*! \brief Integrated autocorrelation time (in steps) -- at least 1
+ */
+double batchMeansAC::integratedTime(
+	int minBatches/**< Fewest batches needed to use a batch size*/
+	)
+{
+	if(batchN[0] < 2 || batchM2[0] <= 0){
+		return 1;
+	}
+	double variance = batchM2[0]/(batchN[0]-1);
+	double tau = 1;
+	for(int level = 1 ; level<levels; level++){
+		if(batchN[level] < minBatches || batchN[level] < 2){
+			break;
+		}
+		double batchVariance = batchM2[level]/(batchN[level]-1);
+		tau = std::max(tau, std::ldexp(1., level)*batchVariance/variance);
+	}
+	return tau;
+}
+
 /*! \brief Calculates the autocorrelation length for a set of data for a number of segments for each dimension -- completely host code, utilitizes FFTW3 for longer chuncks of the chains -- Batch version for multiple chains at a time
  *
  * Takes in the data from a sampler, shape data[chain_N][N_steps][dimension]
@@ -77,34 +134,19 @@ void auto_corr_from_data_batch(double ***data, /**<Input data */
 			bool cumulative /**< Boolean to calculate the autocorrelation cumulatively*/
 			)
 {
-	int temp_dim = dimension*chain_N;
-	int **temp_output = allocate_2D_array_int(temp_dim, num_segments);
-	double **temp_data = new double*[length];
-	for(int i = 0 ; i<length; i++){
-		temp_data[i] = new double[temp_dim];
-		for(int j = 0 ; j<temp_dim; j++){
-			int chain_number = j/dimension;
-			int step_number = j%dimension;
-			temp_data[i][j] = data[chain_number][i][step_number];
-		}
+	int seriesN = dimension*chain_N;
+	int *output_rows[seriesN];
+	for(int i = 0 ; i<seriesN; i++){
+		output_rows[i] = output[i/dimension][i%dimension];
 	}
-	
-	auto_corr_from_data(temp_data,length,temp_dim, temp_output, num_segments, target_corr, num_threads, cumulative);
-	
-	for(int i = 0 ; i<temp_dim; i++){
-		int chain_number = i/dimension;
-		int dim_number = i%dimension;
-		for(int j = 0 ; j<num_segments; j++){
-			output[chain_number][dim_number][j]=temp_output[i][j];
+	acSeriesReader reader = [data, dimension](int series, int start, int length, double *buffer){
+		double **chain = data[series/dimension];
+		int dim = series%dimension;
+		for(int i = 0 ; i<length; i++){
+			buffer[i] = chain[start+i][dim];
 		}
-	}
-	//Clean up	
-	for(int i = 0 ; i<length; i++){
-		delete [] temp_data[i];	
-	}
-	delete [] temp_data;	
-	deallocate_2D_array(temp_output,temp_dim);
-
+	};
+	auto_corr_from_reader(reader, seriesN, length, output_rows, num_segments, target_corr, num_threads, cumulative);
 }
 /*! \brief Calculates the autocorrelation length for a set of data for a number of segments for each dimension -- completely host code, utilitizes FFTW3 for longer chuncks of the chains
  *
@@ -142,114 +184,189 @@ void auto_corr_from_data(double **data, /**<Input data */
 			bool cumulative /**< Boolean to calculate the autocorrelation cumulatively*/
 			)
 {
-	//transpose data
-	double **data_transpose = allocate_2D_array(dimension, length);
-	for(int i =0; i<dimension; i++){
-		for(int j = 0; j <length; j++){
-			data_transpose[i][j] = data[j][i];
+	acSeriesReader reader = [data](int series, int start, int length, double *buffer){
+		for(int i = 0 ; i<length; i++){
+			buffer[i] = data[start+i][series];
 		}
+	};
+	auto_corr_from_reader(reader, dimension, length, output, num_segments, target_corr, num_threads, cumulative);
+}
+
+/*! \brief Cache of batched r2c/c2r plans, keyed by (padded length, number of series)
+ *
+ * The FFTW planner isn't thread safe, so plans are only made behind planMutex. Executing a cached plan on new (fftw_malloc'd) arrays with fftw_execute_dft_r2c/c2r is thread safe
+ */
+static std::mutex planMutex;
+static std::map<std::pair<int,int>, std::pair<fftw_plan, fftw_plan>> planCache;
+
+/*! \brief Fetch (or measure and cache) the forward and reverse plans for howmany series of length L, laid out back to back
+ */
+static void cachedACPlans(int L, int howmany, fftw_plan *forward, fftw_plan *reverse)
+{
+	std::lock_guard<std::mutex> lock(planMutex);
+	std::pair<int,int> key(L, howmany);
+	auto plans = planCache.find(key);
+	if(plans == planCache.end()){
+		int C = L/2+1;
+		/*FFTW_MEASURE overwrites the arrays, so plan on scratch arrays*/
+		double *in = (double *)fftw_malloc(sizeof(double)*L*howmany);
+		fftw_complex *out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex)*C*howmany);
+		fftw_plan f = fftw_plan_many_dft_r2c(1, &L, howmany, in, NULL, 1, L, out, NULL, 1, C, FFTW_MEASURE);
+		fftw_plan r = fftw_plan_many_dft_c2r(1, &L, howmany, out, NULL, 1, C, in, NULL, 1, L, FFTW_MEASURE);
+		fftw_free(in);
+		fftw_free(out);
+		plans = planCache.insert(std::make_pair(key, std::make_pair(f, r))).first;
 	}
-	
+	*forward = plans->second.first;
+	*reverse = plans->second.second;
+}
+
+/*! \brief Load FFTW wisdom (eg, saved by a previous run next to its checkpoint), so cached plans don't have to be measured again
+ *
+ * Returns false if the file doesn't exist or can't be read
+ */
+bool importACWisdom(std::string filename)
+{
+	std::lock_guard<std::mutex> lock(planMutex);
+	return fftw_import_wisdom_from_filename(filename.c_str()) != 0;
+}
+
+/*! \brief Save the FFTW wisdom accumulated so far
+ */
+bool exportACWisdom(std::string filename)
+{
+	std::lock_guard<std::mutex> lock(planMutex);
+	return fftw_export_wisdom_to_filename(filename.c_str()) != 0;
+}
+
+/*! \brief Destroy all the cached autocorrelation plans
+ */
+void clearACPlans()
+{
+	std::lock_guard<std::mutex> lock(planMutex);
+	for(auto &plans : planCache){
+		fftw_destroy_plan(plans.second.first);
+		fftw_destroy_plan(plans.second.second);
+	}
+	planCache.clear();
+}
+
+/*! \brief Calculates the autocorrelation length for a number of segments of a set of series, read directly from the sampler's storage by reader -- the engine behind auto_corr_from_data and auto_corr_from_data_batch
+ *
+ * Outputs the integrated autocorrelation time (windowed, following EMCEE) -- shape output[seriesN][num_segments]
+ *
+ * The series are only ever copied into the (zero padded) FFT input, and series sharing a segment are transformed in blocks of blockSize with one batched real-to-complex plan from the plan cache. Blocks are handed to the threads longest first. blockSize=0 splits the series evenly over the threads. A block too big to hold at once (~64MB) is transformed a few series at a time, but still by one thread -- so series in one block are always read by the same thread, and a reader can rely on blocks of whole chains
+ */
+void auto_corr_from_reader(acSeriesReader reader, /**< Reads the series from storage*/
+			int seriesN, /**< Number of series*/
+			int length, /**< length of input data*/
+			int **output, /**<[out] array that stores the auto-corr lengths -- shape [seriesN][num_segments]*/
+			int num_segments, /**< number of segements to compute the auto-corr length*/
+			double target_corr, /**< Autocorrelation for which the autocorrelation length is defined (only used for segments too short for the spectral method)*/
+			int num_threads, /**< Total number of threads to use*/
+			bool cumulative, /**< Boolean to calculate the autocorrelation cumulatively*/
+			int blockSize /**< Series per transform (0 to split evenly over the threads)*/
+			)
+{
 	int step = length/(num_segments);
-	int lengths[num_segments];
-	int startids[num_segments];
-	int endids[num_segments];
-	int fftw_lengths[num_segments];
-	fftw_outline *plans_forward= (fftw_outline *)malloc(sizeof(fftw_outline)*num_segments);
-	fftw_outline *plans_reverse= (fftw_outline *)malloc(sizeof(fftw_outline)*num_segments);
-	threaded_ac_jobs_serial jobs_s[num_segments*dimension];
-	threaded_ac_jobs_fft jobs_f[num_segments*dimension];
-	for(int i =0 ; i<num_segments; i++){
-		if(cumulative){
-			lengths[i] = (i+1)*step;
-			startids[i] = 0;
-			endids[i] = lengths[i];
-		}
-		else{
-			lengths[i] = step;
-			startids[i] = (i)*step;
-			endids[i] = (i+1)*step;
-		}
+	if(blockSize <= 0){
+		blockSize = std::max((seriesN + num_threads - 1)/num_threads, 1);
 	}
-	{	
-		{
-			ThreadPool<threaded_ac_jobs_serial,comparator_ac_serial> serial_jobs(num_threads,threaded_ac_serial,false);
-			for(int j =0 ; j<dimension; j++){
-				for(int i =0 ; i< num_segments; i++)
-				{
-					if(lengths[i]<=MAX_SERIAL){
-						jobs_s[j*num_segments + i].data = data_transpose;
-						jobs_s[j*num_segments + i].length = &lengths[i];
-						jobs_s[j*num_segments + i].target = &target_corr;		
-						jobs_s[j*num_segments + i].dimension = j;		
-						jobs_s[j*num_segments + i].start = &startids[i];		
-						jobs_s[j*num_segments + i].end = &endids[i];
-						jobs_s[j*num_segments + i].lag = &output[j][i];
-						serial_jobs.enqueue(jobs_s[j*num_segments + i]);
-					}
-				}
+	std::vector<threaded_ac_jobs_fft> jobs;
+	for(int i =0 ; i<num_segments; i++){
+		int start = cumulative ? 0 : i*step;
+		int end = (i+1)*step;
+		int segmentLength = end-start;
+		if(segmentLength<=MAX_SERIAL){
+			double buffer[MAX_SERIAL+1];
+			for(int j = 0 ; j<seriesN; j++){
+				reader(j, start, segmentLength, buffer);
+				output[j][i] = auto_correlation_serial(buffer, segmentLength, 0, target_corr);
 			}
-			serial_jobs.startPool();
-			serial_jobs.stopPool();
-			for(int i =0 ; i<num_segments; i++){
-				if(lengths[i]>MAX_SERIAL){
-					fftw_lengths[i] = 2*pow(2, std::ceil(std::log2(lengths[i])));	
-					allocate_FFTW_mem_forward(&plans_forward[i],fftw_lengths[i]);
-					allocate_FFTW_mem_reverse(&plans_reverse[i],fftw_lengths[i]);
-				}
-			}	
+			continue;
 		}
-
-		ThreadPool<threaded_ac_jobs_fft,comparator_ac_fft> fftw_jobs(num_threads,threaded_ac_spectral,false);
-		for(int j =0 ; j<dimension; j++){
-			for(int i =0 ; i< num_segments; i++)
-			{
-				if(lengths[i]>MAX_SERIAL){
-					jobs_f[j*num_segments + i].data = data_transpose;
-					jobs_f[j*num_segments + i].length = &lengths[i];
-					jobs_f[j*num_segments + i].target = &target_corr;		
-					jobs_f[j*num_segments + i].dimension = j;		
-					jobs_f[j*num_segments + i].start = &startids[i];		
-					jobs_f[j*num_segments + i].end =&endids[i];
-					jobs_f[j*num_segments + i].lag = &output[j][i];
-					jobs_f[j*num_segments + i].planforward = &plans_forward[i];
-					jobs_f[j*num_segments + i].planreverse = &plans_reverse[i];
-					fftw_jobs.enqueue(jobs_f[j*num_segments + i]);
-				}
-			}
+		int L = 2*pow(2, std::ceil(std::log2(segmentLength)));
+		/*Keep each transform's buffers to ~64MB -- the blocks themselves stay whole*/
+		int transformCap = std::max((1<<23)/L, 1);
+		for(int j = 0 ; j<seriesN; j+=blockSize){
+			threaded_ac_jobs_fft job;
+			job.reader = &reader;
+			job.firstSeries = j;
+			job.seriesN = std::min(blockSize, seriesN-j);
+			int transforms = (job.seriesN + transformCap - 1)/transformCap;
+			job.transformN = (job.seriesN + transforms - 1)/transforms;
+			job.start = start;
+			job.end = end;
+			job.paddedLength = L;
+			job.lags = output;
+			job.segment = i;
+			cachedACPlans(L, job.transformN, &job.planforward, &job.planreverse);
+			cachedACPlans(L, job.seriesN - (transforms-1)*job.transformN, &job.planforwardLast, &job.planreverseLast);
+			jobs.push_back(job);
 		}
-		fftw_jobs.startPool();
-		fftw_jobs.stopPool();
 	}
-	for(int i =0 ; i<num_segments; i++){
-		if(lengths[i]>MAX_SERIAL){
-			deallocate_FFTW_mem(&plans_forward[i]);
-			deallocate_FFTW_mem(&plans_reverse[i]);
-		}
-	}	
-	free(plans_forward);
-	free(plans_reverse);
-	deallocate_2D_array(data_transpose,dimension);
+	/*The pool runs jobs in the order they're queued, so queue the longest first*/
+	std::stable_sort(jobs.rbegin(), jobs.rend(), comparator_ac_fft());
+	ThreadPool<threaded_ac_jobs_fft,comparator_ac_fft> fftw_jobs(num_threads,threaded_ac_spectral,false);
+	for(size_t i = 0 ; i<jobs.size(); i++){
+		fftw_jobs.enqueue(jobs[i]);
+	}
+	fftw_jobs.startPool();
+	fftw_jobs.stopPool();
 }
 
 /*! \brief Internal routine to calculate an spectral autocorrelation job
  *
  * Allows for a more efficient use of the threadPool class
+ *
+ * Each series is read into its row of the padded input, and the rows go through one forward (r2c) and one reverse (c2r) transform transformN series at a time. The power spectrum is real, so the reverse transform works on half the spectrum
  */
 void threaded_ac_spectral(int thread, threaded_ac_jobs_fft job)
 {
-	//double *ac = (double *)malloc(sizeof(double)*(*job.length));	
-	//auto_correlation_spectral(job.data[job.dimension], *job.length, *job.start,ac, job.planforward, job.planreverse);
-	//for(int i =0; i<*job.length; i++){
-	//	if(ac[i]<*job.target){
-	//		*job.lag = i;
-	//		break;
-	//	}	
-	//}
-	//free(ac);
-	double ac;
-	auto_correlation_spectral_windowed(job.data[job.dimension], *job.length, *job.start,&ac, job.planforward, job.planreverse);
-	*job.lag =int(ac);
+	int c = 5;
+	int L = job.paddedLength;
+	int C = L/2+1;
+	int length = job.end - job.start;
+	double *in = (double *)fftw_malloc(sizeof(double)*L*job.transformN);
+	fftw_complex *out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex)*C*job.transformN);
+	double *taus = new double[length];
+	for(int first = 0 ; first<job.seriesN; first+=job.transformN){
+		int seriesN = std::min(job.transformN, job.seriesN - first);
+		bool last = first + job.transformN >= job.seriesN;
+		for(int j = 0 ; j<seriesN; j++){
+			double *row = &in[j*L];
+			(*job.reader)(job.firstSeries+first+j, job.start, length, row);
+			double mean;
+			mean_list(row, length, &mean);
+			for(int i = 0 ; i<length; i++){
+				row[i] -= mean;
+			}
+			for(int i = length ; i<L; i++){
+				row[i] = 0;
+			}
+		}
+		fftw_execute_dft_r2c((last) ? job.planforwardLast : job.planforward, in, out);
+		for(int i = 0 ; i<C*seriesN; i++){
+			out[i][0] = out[i][0]*out[i][0]+out[i][1]*out[i][1];
+			out[i][1] = 0;
+		}
+		fftw_execute_dft_c2r((last) ? job.planreverseLast : job.planreverse, out, in);
+		for(int j = 0 ; j<seriesN; j++){
+			double *row = &in[j*L];
+			double norm_factor = row[0];
+			double sum = 0;
+			for(int i = 0 ; i<length; i++){
+				/*A constant series has no autocorrelation to speak of*/
+				sum += (norm_factor > 0) ? row[i]/norm_factor : (i == 0);
+				taus[i] = 2.0*sum - 1.0;
+			}
+			int window = autocorrelation_window(taus, c, length);
+			job.lags[job.firstSeries+first+j][job.segment] = int(taus[window]);
+		}
+	}
+	delete [] taus;
+	fftw_free(in);
+	fftw_free(out);
 }
 /*! \brief Internal routine to calculate a serial autocorrelation job
  *
@@ -0,0 +1,86 @@
+#include "bayesship/batchPipeline.h"
+#include <algorithm>
+
+/*! \file
+ *
+ * # Source file for the bounded background pipeline
+ */
+
+namespace bayesship{
+
+/*! \brief Constructor -- starts the worker
+ */
+batchPipeline::batchPipeline(
+	int maxOutstanding/**< Most tasks queued or running at once (at least 1)*/
+	)
+{
+	this->maxOutstanding = std::max(maxOutstanding, 1);
+	worker = std::thread(&batchPipeline::run, this);
+}
+
+/*! \brief Destructor -- finishes every submitted task, then stops the worker
+ */
+batchPipeline::~batchPipeline()
+{
+	{
+		std::unique_lock<std::mutex> lock{taskMutex};
+		stopping = true;
+	}
+	taskVar.notify_all();
+	worker.join();
+}
+
+/*! \brief Queue a task for the worker -- blocks while maxOutstanding tasks are already queued or running
+ */
+void batchPipeline::submit(
+	std::function<void()> task/**< Work to do -- anything it reads must not change until it has run*/
+	)
+{
+	std::unique_lock<std::mutex> lock{taskMutex};
+	doneVar.wait(lock, [=]{return outstandingN < maxOutstanding;});
+	tasks.push_back(task);
+	outstandingN++;
+	taskVar.notify_one();
+}
+
+/*! \brief Block until every submitted task has finished
+ */
+void batchPipeline::wait()
+{
+	std::unique_lock<std::mutex> lock{taskMutex};
+	doneVar.wait(lock, [=]{return outstandingN == 0;});
+}
+
+/*! \brief Number of tasks queued or running
+ */
+int batchPipeline::outstanding()
+{
+	std::unique_lock<std::mutex> lock{taskMutex};
+	return outstandingN;
+}
+
+/*! \brief Worker loop -- runs the tasks one at a time, in order
+ */
+void batchPipeline::run()
+{
+	while(true){
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock{taskMutex};
+			taskVar.wait(lock, [=]{return stopping || !tasks.empty();});
+			if(stopping && tasks.empty()){
+				break;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+		{
+			std::unique_lock<std::mutex> lock{taskMutex};
+			outstandingN--;
+		}
+		doneVar.notify_all();
+	}
+}
+
+}
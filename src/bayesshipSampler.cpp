@@ -5,9 +5,14 @@
 #include "bayesship/ThreadPool.h"
 #include "bayesship/proposalFunctions.h"
 #include "bayesship/standardPriors.h"
+#include "bayesship/temperatureLadder.h"
+#include "bayesship/convergenceMonitor.h"
 #include <cmath>
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
 #include <gsl/gsl_randist.h>
 #include <nlohmann/json.hpp>
 
@@ -28,22 +33,7 @@ namespace bayesship{
  */
 
 
-/*! \brief Structure to package swap ``jobs'' for sampling
- *
- * Packages up a job to queue up a chain for swapping
- *
- * See ThreadPool.h to see how this relates to parallel processing, and see the bayesShip.cpp for the implementation of this structure
- */
-struct swapJob
-{
-	/*! Chain ID to be swapped*/
-	int chainID;
-	/*! samplerData for the sampler storing current data for chainID*/
-	samplerData *data;
-	/*! The sampler being currently run*/
-	bayesshipSampler *sampler;
-
-};
+struct swapJob;
 
 /*! \brief Structure to package sample jobs for sampling
  *
@@ -62,6 +52,37 @@ struct sampleJob
 	int chainID;
 	/*! Pool for swapping -- The sampler periodically passes the chain on to be swapped after steping with Metropolis-Hastings*/
 	ThreadPoolPair<swapJob> *swapPool;
+	/*! Pool for sampling -- The worker that finishes a job re-enqueues the chain here*/
+	ThreadPool<sampleJob> *samplePool;
+	/*! Step ID at which the chain is finished (cold chains) or rewound (hot chains)*/
+	int finalStepID;
+	/*! Step ID hot chains are rewound to once they reach finalStepID*/
+	int initialStepID;
+	/*! Batched stepping only -- only make the proposal for chainID (see bayesshipSampler::stepMHBatch)*/
+	bool proposeOnly=false;
+	/*! Even-odd swap sweeps only -- swap chainID with this chain instead of stepping it (see bayesshipSampler::swapSweepEvenOdd)*/
+	int swapPartner=-1;
+	/*! Time the job was queued, if its wait is being timed (see instrumentStamp)*/
+	int64_t enqueueTime=0;
+
+};
+
+/*! \brief Structure to package swap ``jobs'' for sampling
+ *
+ * Packages up a job to queue up a chain for swapping
+ *
+ * See ThreadPool.h to see how this relates to parallel processing, and see the bayesShip.cpp for the implementation of this structure
+ */
+struct swapJob
+{
+	/*! Chain ID to be swapped*/
+	int chainID;
+	/*! samplerData for the sampler storing current data for chainID*/
+	samplerData *data;
+	/*! The sampler being currently run*/
+	bayesshipSampler *sampler;
+	/*! Sample job to resume once the swap is finished*/
+	sampleJob resume;
 
 };
 
@@ -75,7 +96,9 @@ struct sampleJob
 void sampleThreadedFunctionNoSwap(int threadID, sampleJob job);
 void sampleThreadedFunction(int threadID, sampleJob job);
 void swapThreadedFunction(int threadID, swapJob job1, swapJob job2);
-bool swapPairFunction( swapJob job1, swapJob job2);
+bool swapPairFunction(bayesshipSampler *sampler, int bucket1, int bucket2);
+int swapBucketFunction( swapJob job);
+void rescheduleChain(sampleJob job);
 
 
 
@@ -151,47 +174,110 @@ void bayesshipSampler::sample()
 	gsl_error_handler_t *oldHandler = gsl_set_error_handler_off();
 	double start = omp_get_wtime();
   		
+	bool resuming = checkDirExist(outputDir+outputFileMoniker+"_checkpoint.json") && !ignoreExistingCheckpoint;
+	/*A checkpoint fixes the configuration, so there's nothing to tune*/
+	if(autoConfigure && !resuming){
+		runAutoConfigure();
+	}
 	/* Overwrite data with checkpoint file if it exists.
  * 		Need memory allocated first
  */
-	if( checkDirExist(outputDir+outputFileMoniker+"_checkpoint.json") && !ignoreExistingCheckpoint){
+	if(resuming){
 		loadCheckpoint();
 	}
 	else{
 		allocateMemory();
 	}
 
+	if(instrument && !instruments){
+#ifdef _INSTRUMENT
+		instruments = new instrumentation(instrumentEvery);
+#else
+		std::cout<<"WARNING -- instrument requested, but BayesShip was compiled without _INSTRUMENT"<<std::endl;
+#endif
+	}
+	if(deterministicEvenOddSwapping && threadPool){
+		std::cout<<"WARNING -- deterministicEvenOddSwapping needs synchronized sweeps, so the thread pool loop keeps swapping stochastically"<<std::endl;
+	}
+
+	/*The stopping rule is checked between batches, so make sure there are some*/
+	convergenceMonitor *monitor = nullptr;
+	if(targetRhat > 0 || targetESS > 0){
+		if(RJ){
+			std::cout<<"WARNING -- targetRhat and targetESS are only available for fixed dimension runs"<<std::endl;
+		}
+		else{
+			monitor = new convergenceMonitor(ensembleN, maxDim);
+			if(independentSamples == 0 && batchSize == 0){
+				batchSize = std::max(iterations/20, 100);
+				std::cout<<"Convergence targets set -- sampling in batches of "<<batchSize<<std::endl;
+			}
+		}
+	}
+
+	/*Post-processing overlaps the next batch only when the number of batches is fixed up front*/
+	batchPipeline *pipeline = nullptr;
+	if(pipelineDepth > 0){
+		if(independentSamples != 0){
+			std::cout<<"WARNING -- pipelineDepth is ignored when sampling to independentSamples, since each batch's ACs decide whether to sample another"<<std::endl;
+		}
+		else if(batchSize > 0 && batchSize < iterations){
+			pipeline = new batchPipeline(pipelineDepth);
+			if(maxResidentSteps > 0 && maxResidentSteps < batchSize){
+				std::cout<<"WARNING -- maxResidentSteps is smaller than batchSize, so batches may be spilled before the pipeline writes them out"<<std::endl;
+			}
+		}
+	}
+
+	/*One team of threads for stepping the chains, shared by the prior, burn-in and main phases*/
+	if(!stepPool){
+		stepPool = createStepPool();
+	}
+
 	/*Checks: 
  * 		Threads must be larger than 3 for Thread Pool
  */
 	if(independentSamples != 0){
 		if(batchSize != 0){
-			data = new samplerData(maxDim, ensembleN,ensembleSize, batchSize, proposalFns->proposalN, RJ,betas);
+			data = new samplerData(maxDim, ensembleN,ensembleSize, batchSize, proposalFns->proposalN, RJ,betas, runLengthStorage);
 		}
 		else{
-			data = new samplerData(maxDim, ensembleN,ensembleSize, independentSamples, proposalFns->proposalN, RJ,betas);
+			data = new samplerData(maxDim, ensembleN,ensembleSize, independentSamples, proposalFns->proposalN, RJ,betas, runLengthStorage);
 		}
 	}
 	else{
 		if( ( iterations < batchSize && batchSize > 0 ) || batchSize == 0  ){
-			data = new samplerData(maxDim, ensembleN,ensembleSize, iterations, proposalFns->proposalN, RJ,betas);
+			data = new samplerData(maxDim, ensembleN,ensembleSize, iterations, proposalFns->proposalN, RJ,betas, runLengthStorage);
 		}
 		else{
-			data = new samplerData(maxDim, ensembleN,ensembleSize, batchSize, proposalFns->proposalN, RJ,betas);
+			data = new samplerData(maxDim, ensembleN,ensembleSize, batchSize, proposalFns->proposalN, RJ,betas, runLengthStorage);
 		}
 	}
+	data->spectralACs = spectralACs;
+	data->stackedOutput = stackedOutput;
+	data->runLengthOutput = runLengthOutput;
+	/*The FFTW wisdom is saved with the checkpoint, so the next run doesn't measure the plans again*/
+	if(spectralACs){
+		importACWisdom(outputDir+outputFileMoniker+"_fftw_wisdom.dat");
+	}
 	
 	if(priorIterations >0 && priorRanges){
 		//likelihoodFn tempL = likelihood;
 		probabilityFn *tempL = likelihood;
 		likelihood = prior;
+		/*The surrogate approximates the likelihood, not the prior*/
+		probabilityFn *tempS = surrogateLikelihood;
+		surrogateLikelihood = nullptr;
 
 		//prior = uniformPrior;
 		uniformPrior *tempprior = new uniformPrior();
 		tempprior->sampler = this;
 		prior = tempprior;
 
-		priorData = new samplerData(maxDim, ensembleN,ensembleSize, priorIterations, proposalFns->proposalN, RJ,betas);
+		priorData = new samplerData(maxDim, ensembleN,ensembleSize, priorIterations, proposalFns->proposalN, RJ,betas, runLengthStorage);
+		priorData->spectralACs = spectralACs;
+		priorData->stackedOutput = stackedOutput;
+		priorData->runLengthOutput = runLengthOutput;
 		if(burnPriorIterations >0){
 			std::cout<<"Burning in for prior"<<std::endl;
 			
@@ -200,7 +286,9 @@ void bayesshipSampler::sample()
 			burnPeriod=true;
 			adjustTemps=false;
 
-			burnData = new samplerData(maxDim, ensembleN,ensembleSize, burnPriorIterations, proposalFns->proposalN, RJ,betas);
+			burnData = new samplerData(maxDim, ensembleN,ensembleSize, burnPriorIterations, proposalFns->proposalN, RJ,betas, runLengthStorage);
+			burnData->stackedOutput = stackedOutput;
+			burnData->runLengthOutput = runLengthOutput;
 			assignInitialPosition(burnData);
 			
 			isolateEnsemblesInternal = isolateEnsemblesBurn;
@@ -236,9 +324,9 @@ void bayesshipSampler::sample()
 
 
 			for(int i = 0 ; i<chainN; i++){
-				priorData->positions[i][0]->updatePosition(burnData->positions[i][burnData->currentStepID[i]]);
-				priorData->likelihoodVals[i][0] = burnData->likelihoodVals[i][burnData->currentStepID[i]];
-				priorData->priorVals[i][0] = burnData->priorVals[i][burnData->currentStepID[i]];
+				priorData->positions[i][0]->updatePosition(burnData->currentPosition(i));
+				priorData->likelihoodVals[i][0] = burnData->currentLikelihood(i);
+				priorData->priorVals[i][0] = burnData->currentPrior(i);
 			}
 			
 			
@@ -255,17 +343,20 @@ void bayesshipSampler::sample()
 		sampleLoop(priorIterations,priorData);
 
 		priorData->updateACs(threads);
-		priorData->writeStatFile(outputDir+outputFileMoniker+"Prior_stat.txt");
-		for(int i = 0 ; i<proposalFns->proposalN; i++){
-				proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
+		if(writeFiles){
+			priorData->writeStatFile(outputDir+outputFileMoniker+"Prior_stat.txt");
+			for(int i = 0 ; i<proposalFns->proposalN; i++){
+					proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
+			}
 		}
 
 		delete tempprior;
 		prior = likelihood;
 		likelihood = tempL;
+		surrogateLikelihood = tempS;
 		
 		if(writePriorData){
-			priorData->create_data_dump(coldOnlyStorage, true, outputDir+outputFileMoniker+"Prior_output.hdf5");
+			writeOutput(priorData, outputDir+outputFileMoniker+"Prior", true);
 			
 		}
 		
@@ -282,7 +373,9 @@ void bayesshipSampler::sample()
 		randomizeSwapping = false;
 		t0 = burnIterations /8.;
 
-		burnData = new samplerData(maxDim, ensembleN,ensembleSize, burnIterations, proposalFns->proposalN, RJ,betas);
+		burnData = new samplerData(maxDim, ensembleN,ensembleSize, burnIterations, proposalFns->proposalN, RJ,betas, runLengthStorage);
+		burnData->stackedOutput = stackedOutput;
+		burnData->runLengthOutput = runLengthOutput;
 		if(priorData){
 		//if(false){
 			std::cout<<"Using Prior values for initial points for burn-in"<<std::endl;
@@ -291,12 +384,12 @@ void bayesshipSampler::sample()
 			#pragma omp parallel for
 			#endif
 			for(int i = 0 ; i<chainN; i++){
-				burnData->positions[i][0]->updatePosition(priorData->positions[i][priorData->currentStepID[i]]);
+				burnData->positions[i][0]->updatePosition(priorData->currentPosition(i));
 				//burnData->likelihoodVals[i][0] = likelihood(burnData->positions[i][0],i, this,userParameters[i]);
 				burnData->likelihoodVals[i][0] = likelihood->eval(burnData->positions[i][0],i);
 				//burnData->priorVals[i][0] = prior(burnData->positions[i][0],i, this,userParameters[i]);
 				burnData->priorVals[i][0] = prior->eval(burnData->positions[i][0],i);
-				burnData->currentStepID[i] = 0;
+				burnData->setCurrentStep(i, 0);
 			}
 			std::cout<<"Finished calculating likelihood at initial Position"<<std::endl;
 
@@ -396,8 +489,17 @@ void bayesshipSampler::sample()
 
 
 
+			/*Only the swaps at the averaged temperatures are used to respace the ladder*/
+			long long startAccepts[ensembleSize];
+			long long startRejects[ensembleSize];
+			ladderSwapCounts(burnData, startAccepts, startRejects);
+
 			std::cout<<"Exploring"<<std::endl;
 			sampleLoop(burnIterations/4,burnData);
+
+			if(optimizeLadder){
+				respaceTemperatures(burnData, startAccepts, startRejects);
+			}
 		}
 		burnPeriod=false;
 		swapProb=saveSwapProb;
@@ -406,16 +508,15 @@ void bayesshipSampler::sample()
 				std::cout<<"Temp: "<<i<<": "<<betas[chainIndex(0,i)]<<std::endl;
 		}
 		std::cout<<"Writing Burn Data"<<std::endl;
-		burnData->create_data_dump(coldOnlyStorage, true, outputDir+outputFileMoniker+"Burn_output.hdf5");
+		writeOutput(burnData, outputDir+outputFileMoniker+"Burn", true);
 
 
 
 		for(int i = 0 ; i<chainN; i++){
-			int currentStep = burnData->currentStepID[i];
-			data->positions[i][0]->updatePosition(burnData->positions[i][currentStep]);
-			data->likelihoodVals[i][0] = burnData->likelihoodVals[i][currentStep];
-			data->priorVals[i][0] = burnData->priorVals[i][currentStep];
-			data->currentStepID[i] = 0;
+			data->positions[i][0]->updatePosition(burnData->currentPosition(i));
+			data->likelihoodVals[i][0] = burnData->currentLikelihood(i);
+			data->priorVals[i][0] = burnData->currentPrior(i);
+			data->setCurrentStep(i, 0);
 		}
 		
 		
@@ -431,12 +532,12 @@ void bayesshipSampler::sample()
 		#pragma omp parallel for
 		#endif
 		for(int i = 0 ; i<chainN; i++){
-			data->positions[i][0]->updatePosition(priorData->positions[i][priorData->currentStepID[i]]);
+			data->positions[i][0]->updatePosition(priorData->currentPosition(i));
 			//burnData->likelihoodVals[i][0] = likelihood(burnData->positions[i][0],i, this,userParameters[i]);
 			data->likelihoodVals[i][0] = likelihood->eval(data->positions[i][0],i);
 			//burnData->priorVals[i][0] = prior(burnData->positions[i][0],i, this,userParameters[i]);
 			data->priorVals[i][0] = prior->eval(data->positions[i][0],i);
-			data->currentStepID[i] = 0;
+			data->setCurrentStep(i, 0);
 		}
 		std::cout<<"Finished calculating likelihood at initial Position"<<std::endl;
 
@@ -448,6 +549,13 @@ void bayesshipSampler::sample()
 
 	isolateEnsemblesInternal = isolateEnsembles;
 	data->updateBetas(betas);	
+	if(maxResidentSteps > 0){
+		data->enableSpilling(outputDir+outputFileMoniker+"_spill.bin", maxResidentSteps);
+	}
+	/*Latencies are only reported for the main run*/
+	if(instruments){
+		instruments->reset();
+	}
 	if(independentSamples == 0){
 		if( ( iterations < batchSize && batchSize > 0 ) || batchSize == 0  ){
 			sampleLoop(iterations,data);
@@ -456,15 +564,17 @@ void bayesshipSampler::sample()
 				data->updateACs(threads);
 				int independentSamples = data->countIndependentSamples();
 				std::cout<<"Independent samples per chain: "<<independentSamples<<std::endl;
-				data->calculateEvidence();
-				std::cout<<"Current ln Evidence: "<<data->evidence<<std::endl;
 			}
-			#ifdef _HDF5
-			data->create_data_dump(coldOnlyStorage, true, outputDir+outputFileMoniker+"_output.hdf5");
-			#endif
-			data->writeStatFile(outputDir+outputFileMoniker+"_stat.txt");
-			for(int i = 0 ; i<proposalFns->proposalN; i++){
-					proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
+			reportEvidence(data);
+			writeOutput(data, outputDir+outputFileMoniker, true);
+			if(writeFiles){
+				data->writeStatFile(outputDir+outputFileMoniker+"_stat.txt");
+				if(instruments){
+					instruments->writeStatFile(outputDir+outputFileMoniker+"_latency.txt");
+				}
+				for(int i = 0 ; i<proposalFns->proposalN; i++){
+						proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
+				}
 			}
 		}
 		else  {
@@ -476,59 +586,67 @@ void bayesshipSampler::sample()
 				sampleLoop(batchSize,data);
 				writeCheckpoint(data);
 				currentSamples+=batchSize;
-	
-				if(!RJ){
-					data->updateACs(threads);
-					currentIndependentSamples = data->countIndependentSamples();
-					AC = 0;
-					for(int i = 0 ; i<data->ensembleN; i++){
-						AC += data->maxACs[i];
-					}
-					AC /= data->ensembleN;
-					data->calculateEvidence();
-					std::cout<<"Current ln Evidence: "<<data->evidence<<std::endl;
-				}
-	
 
-				#ifdef _HDF5
-				if(!initializedData){
-					data->create_data_dump(coldOnlyStorage, true, outputDir+outputFileMoniker+"_output.hdf5");
+				if(pipeline){
+					if(currentSamples<iterations){
+						int furthestStep = *std::max_element(data->currentStepID, data->currentStepID+chainN);
+						if(data->iterations < furthestStep + batchSize){
+							/*Storage is only restructured when no batch is being post-processed -- allocate pipelineDepth batches at a time*/
+							pipeline->wait();
+							data->spillHistory();
+							data->extendSize(pipelineDepth*(batchSize-1));
+						}
+					}
+					queueBatchPostProcessing(data, pipeline, !initializedData);
 					initializedData = true;
 				}
 				else{
-					data->append_to_data_dump(outputDir+outputFileMoniker+"_output.hdf5");
+					if(!RJ){
+						data->updateACs(threads);
+						currentIndependentSamples = data->countIndependentSamples();
+						AC = 0;
+						for(int i = 0 ; i<data->ensembleN; i++){
+							AC += data->maxACs[i];
+						}
+						AC /= data->ensembleN;
+					}
+					reportEvidence(data);
+	
 
+					writeOutput(data, outputDir+outputFileMoniker, !initializedData);
+					initializedData = true;
+					if(writeFiles){
+						data->writeStatFile(outputDir+outputFileMoniker+"_stat.txt");
+					}
 				}
-				#endif
-				data->writeStatFile(outputDir+outputFileMoniker+"_stat.txt");
-				for(int i = 0 ; i<proposalFns->proposalN; i++){
-						proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
-				}
-
-				double Lmean = 0;
-				double Lmax = data->likelihoodVals[0][0];
-				int samples=0;
-
-				for(int i = 0 ; i<ensembleN; i++){
-					int maxSteps = data->currentStepID[i];
-	
-					for(int j = 0 ; j<maxSteps;j++){
-						Lmean += data->likelihoodVals[i][j];
-						if(data->likelihoodVals[i][j]>Lmax){
-							Lmax = data->likelihoodVals[i][j];
-						}
-						samples++;
+				if(writeFiles){
+					if(instruments){
+						instruments->writeStatFile(outputDir+outputFileMoniker+"_latency.txt");
+					}
+					for(int i = 0 ; i<proposalFns->proposalN; i++){
+							proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
 					}
 				}
-				Lmean /= samples;
 
-				if(!RJ){
+				double Lmean, Lmax;
+				data->coldLikelihoodSummary(&Lmean, &Lmax);
+
+				if(!RJ && !pipeline){
 					std::cout<<"Current independent samples per chain / Average AC: "<<currentIndependentSamples<<" / "<<AC <<std::endl;
 				}
 				std::cout<<"Mean Log Likelihood / Max Log Likelihood: "<<Lmean<<" / "<<Lmax <<std::endl;
 				printProgress( (double) currentSamples/iterations);
 				std::cout<<std::endl;
-				if(currentSamples<iterations){
+				if(monitor){
+					monitor->update(data);
+					std::cout<<"Split R-hat / Multi-chain ESS: "<<monitor->rhat<<" / "<<monitor->ess<<std::endl;
+					if(monitor->converged(targetRhat, targetESS)){
+						std::cout<<"Convergence targets met -- stopping after "<<currentSamples<<" steps"<<std::endl;
+						break;
+					}
+				}
+				if(currentSamples<iterations && !pipeline){
+					data->spillHistory();
 					data->extendSize(batchSize-1);
 				}
 			}
@@ -546,8 +664,7 @@ void bayesshipSampler::sample()
 		while(currentIndependentSamples < independentSamples){
 
 			sampleLoop(batchSize,data);
-			data->calculateEvidence();
-			std::cout<<"Current ln Evidence: "<<data->evidence<<std::endl;
+			reportEvidence(data);
 			writeCheckpoint(data);
 	
 			data->updateACs(threads);
@@ -559,42 +676,33 @@ void bayesshipSampler::sample()
 			AC /= data->ensembleN;
 	
 
-			#ifdef _HDF5
-			if(!initializedData){
-				data->create_data_dump(coldOnlyStorage, true, outputDir+outputFileMoniker+"_output.hdf5");
-				initializedData = true;
-			}
-			else{
-				data->append_to_data_dump(outputDir+outputFileMoniker+"_output.hdf5");
-
-			}
-			#endif
-			data->writeStatFile(outputDir+outputFileMoniker+"_stat.txt");
-			for(int i = 0 ; i<proposalFns->proposalN; i++){
-					proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
-			}
-
-			double Lmean = 0;
-			double Lmax = data->likelihoodVals[0][0];
-			int samples=0;
-
-			for(int i = 0 ; i<ensembleN; i++){
-				int maxSteps = data->currentStepID[i];
-	
-				for(int j = 0 ; j<maxSteps;j++){
-					Lmean += data->likelihoodVals[i][j];
-					if(data->likelihoodVals[i][j]>Lmax){
-						Lmax = data->likelihoodVals[i][j];
-					}
-					samples++;
+			writeOutput(data, outputDir+outputFileMoniker, !initializedData);
+			initializedData = true;
+			if(writeFiles){
+				data->writeStatFile(outputDir+outputFileMoniker+"_stat.txt");
+				if(instruments){
+					instruments->writeStatFile(outputDir+outputFileMoniker+"_latency.txt");
+				}
+				for(int i = 0 ; i<proposalFns->proposalN; i++){
+						proposalFns->proposals[i]->writeStatFile(outputDir, outputFileMoniker);
 				}
 			}
-			Lmean /= samples;
+
+			double Lmean, Lmax;
+			data->coldLikelihoodSummary(&Lmean, &Lmax);
 
 			std::cout<<"Current independent samples per chain / Average AC: "<<currentIndependentSamples<<" / "<<AC <<std::endl;
 			std::cout<<"Mean Log Likelihood / Max Log Likelihood: "<<Lmean<<" / "<<Lmax <<std::endl;
 			printProgress( (double) currentIndependentSamples/independentSamples);
 			std::cout<<std::endl;
+			if(monitor){
+				monitor->update(data);
+				std::cout<<"Split R-hat / Multi-chain ESS: "<<monitor->rhat<<" / "<<monitor->ess<<std::endl;
+				if(monitor->converged(targetRhat, targetESS)){
+					std::cout<<"Convergence targets met -- stopping after "<<data->currentStepID[0]+1<<" steps"<<std::endl;
+					break;
+				}
+			}
 			if(currentIndependentSamples<independentSamples){
 				double meanAC;
 				mean_list(data->maxACs,ensembleN,&meanAC);
@@ -607,13 +715,24 @@ void bayesshipSampler::sample()
 						batchSize/=2;
 					}
 				}
+				data->spillHistory();
 				data->extendSize(batchSize-1);
 			}
 			
 		}
 
 	}
+	if(pipeline){
+		/*Finishes the batches still being post-processed*/
+		delete pipeline;
+	}
+	if(monitor){
+		delete monitor;
+	}
 		
+	delete stepPool;
+	stepPool = nullptr;
+
 	gsl_set_error_handler(oldHandler);
 
 	std::cout<<"Total sampling time (seconds): "<<(double)(-start + omp_get_wtime())<<std::endl;
@@ -682,6 +801,9 @@ void bayesshipSampler::allocateMemory( )
 			gsl_rng_set(rvec[i],seed+i*101);
 		}	
 	}
+	if(!rng){
+		rng = new counterRNG(chainN, (uint64_t)seed);
+	}
 	if(!userParameters){
 		internalUserParameters=true;
 		userParameters = new void*[chainN];
@@ -692,24 +814,32 @@ void bayesshipSampler::allocateMemory( )
 			A[i] = 0;
 		}
 	}
-	if(!waitingSample){
-		waitingSample = new bool[chainN];
-		for(int i = 0 ; i<chainN; i++){
-			waitingSample[i] = true;
-		}
-	}
 	if(!referenceStatus){
 		referenceStatus = new bool[ensembleN];
 		for(int i = 0 ; i<ensembleN; i++){
 			referenceStatus[i] = true;
 		}
 	}
-	if(!waitingMutexes){
-		waitingMutexes = new std::mutex[chainN];
-	}
 	if(!statusMutex){
 		statusMutex = new std::mutex;
 	}
+	if(!statusCondition){
+		statusCondition = new std::condition_variable;
+	}
+	if(!batchPositions){
+		batchPositions = new positionInfo*[chainN];
+		batchChainIDs = new int[chainN];
+		batchProposalIDs = new int[chainN];
+		batchLogPrior = new double[chainN];
+		batchLogLikelihood = new double[chainN];
+		batchLogLikelihoodPacked = new double[chainN];
+		batchCorrections = new double[chainN];
+		batchCurrentPositions = new positionInfo*[chainN];
+		batchSurrogateProposed = new double[chainN];
+		batchSurrogatePacked = new double[chainN];
+		batchUncachedIDs = new int[chainN];
+		batchUniforms = new double[chainN];
+	}
 	
 }
 /*! \brief helper to return the beta parameter for the chain at index chainID
@@ -748,6 +878,10 @@ void bayesshipSampler::deallocateMemory()
 		delete [] rvec;	
 		rvec = nullptr;
 	}
+	if(rng){
+		delete rng;
+		rng = nullptr;
+	}
 	if(data){
 		delete data;
 		data = nullptr;
@@ -768,22 +902,45 @@ void bayesshipSampler::deallocateMemory()
 		delete [] A;
 		A = nullptr;		
 	}
-	if(waitingSample){
-		delete [] waitingSample;
-		waitingSample = nullptr;		
-	}
 	if(referenceStatus){
 		delete [] referenceStatus;
 		referenceStatus = nullptr;		
 	}
-	if(waitingMutexes){
-		delete [] waitingMutexes;
-		waitingMutexes = nullptr;		
-	}
 	if(statusMutex){
 		delete statusMutex;
 		statusMutex = nullptr;		
 	}
+	if(statusCondition){
+		delete statusCondition;
+		statusCondition = nullptr;		
+	}
+	if(batchPositions){
+		delete [] batchPositions;
+		delete [] batchChainIDs;
+		delete [] batchProposalIDs;
+		delete [] batchLogPrior;
+		delete [] batchLogLikelihood;
+		delete [] batchLogLikelihoodPacked;
+		delete [] batchCorrections;
+		delete [] batchCurrentPositions;
+		delete [] batchSurrogateProposed;
+		delete [] batchSurrogatePacked;
+		delete [] batchUncachedIDs;
+		delete [] batchUniforms;
+		batchPositions = nullptr;		
+	}
+	if(stepPool){
+		delete stepPool;
+		stepPool = nullptr;		
+	}
+	if(affinity){
+		delete affinity;
+		affinity = nullptr;
+	}
+	if(instruments){
+		delete instruments;
+		instruments = nullptr;
+	}
 	if(priorRanges && internalPriorRanges){
 		for(int i = 0 ; i<maxDim; i++){
 			delete [] priorRanges[i];
@@ -808,6 +965,24 @@ bayesshipSampler::~bayesshipSampler()
 	deallocateMemory();
 }
 
+/*! \brief Create the team of threads that steps the chains in the lockstep loop
+ *
+ * If threadAffinityPolicy is set, the threads are pinned and the chains are scheduled statically, so chain i is always stepped by thread i % threads, and its history is first touched (and allocated) in that thread's NUMA domain
+ */
+ThreadPoolBarrier<sampleJob> *bayesshipSampler::createStepPool()
+{
+	if(!affinity && threadAffinityPolicy != affinityNone){
+		affinity = new threadAffinity(threadAffinityPolicy, affinityCPUs);
+	}
+	ThreadPoolBarrier<sampleJob> *pool = new ThreadPoolBarrier<sampleJob>(threads, sampleThreadedFunctionNoSwap, false);
+	if(affinity){
+		pool->setAffinity(affinity);
+		pool->setStaticSchedule(true);
+	}
+	pool->startPool();
+	return pool;
+}
+
 /*! \brief Actually initiates the sampler loop to run ``iterations'' steps
  *
  * Will either use OpenMP loop or the custom thread pool implementation
@@ -816,167 +991,139 @@ void bayesshipSampler::sampleLoop(int samples,samplerData *data)
 {
 	setActiveData(data);	
 	if(!threadPool){
-		ThreadPool<sampleJob> *samplePool = new ThreadPool<sampleJob>(threads, sampleThreadedFunctionNoSwap,false);
-		//#ifdef _OPENMP
-		//#pragma omp parallel
-		//#endif
+		/*If called outside of sample(), there's no persistent team yet, so make one for this loop*/
+		bool localPool = false;
+		if(!stepPool){
+			stepPool = createStepPool();
+			localPool = true;
+		}
 		for(int i=0; i<samples-1; i++){
-			//#ifdef _OPENMP
-			//#pragma omp parallel for schedule(dynamic)
-			////#pragma omp for schedule(dynamic)
-			//#endif
-			//for(int chain = 0 ; chain<chainN; chain++){
-			//	stepMH(chain,data);
-			//}	
 
-			samplePool->startPool();
-
-			for(int chain = 0 ; chain<chainN; chain++){
-				sampleJob job;
-				job.sampler = this;
-				job.chainID = chain;
-				job.data = data;
-				samplePool->enqueue(job);	
-			}	
-			samplePool->stopPool();
-			//for(int chain = 0 ; chain<chainN; chain++){
-			//	std::cout<<data->currentStepID[chain]<<std::endl;
-			//}
+			if(batchedSampling){
+				stepMHBatch(data);
+			}
+			else{
+				for(int chain = 0 ; chain<chainN; chain++){
+					sampleJob job;
+					job.sampler = this;
+					job.chainID = chain;
+					job.data = data;
+					job.enqueueTime = instrumentStamp(instruments);
+					stepPool->enqueue(job);	
+				}	
+				/*Every chain takes one step, and the team waits at the barrier before swapping*/
+				stepPool->runEpoch();
+			}
 
-			
-			//#ifdef _OPENMP
-			//#pragma omp single
-			//#endif
-			if(!adjustTemps)
-			{
+			if(adjustTemps){
+				continue;
+			}
+			if(deterministicEvenOddSwapping){
+				/*Each pair is tried every other sweep, so sweep 2*swapProb times per step -- spread over the steps by taking the sweeps due up to this step, less those due up to the last one*/
+				if(swapProb > 0 && ensembleSize > 1){
+					long step = data->currentStepID[0];
+					int sweeps = (int)(std::floor(2*swapProb*step) - std::floor(2*swapProb*(step-1)));
+					for(int i = 0 ; i<sweeps; i++){
+						swapSweepEvenOdd(data);
+					}
+				}
+			}
+			else{
 				for(int j = 0 ; j<ensembleN; j++){
 					for(int k = 0 ; k<ensembleSize-1; k++){
-						double prob = gsl_rng_uniform(rvec[chainIndex(j,k)]);
+						double prob = rng->uniform(chainIndex(j,k), rngSwap);
 						if(prob<swapProb){
 							int ensembleIndex2 = j;
 							if(randomizeSwapping)
 							{
-								ensembleIndex2 = (int)(gsl_rng_uniform(rvec[chainIndex(j,k)])*ensembleN);			
+								ensembleIndex2 = (int)(rng->uniform(chainIndex(j,k), rngSwap)*ensembleN);			
 							}
 							chainSwap(chainIndex(j,k),chainIndex(ensembleIndex2,k+1),data);
 						}
 					}
 				}
-				//if(adjustTemps){
-				//	adjustTemperatures(i);
-				//}
 			}
 	
 		}
-		if(samplePool){
-			delete samplePool;
+		if(localPool){
+			delete stepPool;
+			stepPool = nullptr;
 		}
 	}
 	else{
 		//the chain at 0 should always be cold, and therefore always start with the largest possible size
 		int totalFinalSamples = samples +data->currentStepID[0]-1;
-		int *initialStepIDs = new int[chainN];
-		for(int i = 0 ; i<chainN; i++){
-			initialStepIDs[i] = data->currentStepID[i];
-		}
 		
 		ThreadPool<sampleJob> *samplePool = new ThreadPool<sampleJob>(threads-2, sampleThreadedFunction,false);
-		ThreadPoolPair<swapJob> *swapPool = new ThreadPoolPair<swapJob>(1, swapThreadedFunction,swapPairFunction,false);
-		//samplePool->randomizeJobs() ;
-		//swapPool->randomizeJobs() ;
-
-		//samplePool->startPool();
-		//swapPool->startPool();
-
+		/*Swap candidates are bucketed by rung (and ensemble, if isolated), and a partner is taken from the front of the nearest bucket that can swap with the candidate's*/
+		int bucketN = isolateEnsemblesInternal ? chainN : ensembleSize;
+		int bucketRadius = restrictSwapTemperatures ? swapRadius : ensembleSize;
+		ThreadPoolPair<swapJob> *swapPool = new ThreadPoolPair<swapJob>(1, swapThreadedFunction, swapBucketFunction, bucketN,
+			[this](int bucket1, int bucket2){return swapPairFunction(this, bucket1, bucket2);},
+			bucketRadius, false);
+
+		/*Chains here run at their own pace and hot chains start over, so nothing is left reading from another chain's rows*/
+		data->settleSwaps();
+
+		//Reset reference counters -- just precautionary
+		{
+			std::unique_lock<std::mutex> lock{*statusMutex};
+			for(int i = 0 ; i<ensembleN; i++){
+				referenceStatus[i] = true;
+			}
+		}
+		asyncSampling = true;
 
+		if(affinity){
+			samplePool->setAffinity(affinity);
+			swapPool->setAffinity(affinity, threads-2);
+		}
 		samplePool->startPool();
 		swapPool->startPool();
 
-		//Reset reference counters and waiting flags -- just precautionary
-		for(int i = 0 ; i<ensembleN; i++){
-			referenceStatus[i] = true;
-		}
+		/*Hand every chain to the pool once -- from here on, the worker that finishes a job re-enqueues the chain*/
 		for(int i = 0 ; i<chainN; i++){
-			waitingSample[i] = true;
+			sampleJob job;
+			job.sampler = this;
+			job.chainID = i;
+			job.data = data;
+			job.swapPool = swapPool;
+			job.samplePool = samplePool;
+			job.finalStepID = totalFinalSamples;
+			job.initialStepID = data->currentStepID[i];
+			rescheduleChain(job);
 		}
 
-		while(checkStatus()){
-			for(int i = 0 ; i<chainN; i++){
-				bool chainWaitingSample ; 
-				{
-					std::unique_lock<std::mutex> lock{waitingMutexes[i]};
-					chainWaitingSample = waitingSample[i];
-				}
-				if(chainWaitingSample){
-
-					if(data->currentStepID[i] < totalFinalSamples){
-						sampleJob job;
-						job.sampler = this;
-						job.chainID = i;
-						job.data = data;
-						job.swapPool = swapPool;
-						{
-							std::unique_lock<std::mutex> lock{waitingMutexes[i]};
-							waitingSample[i]=false;
-						}
-						samplePool->enqueue(job);	
-					}	
-					else{
-				
-						if(i < ensembleN){
-							
-							{
-								std::unique_lock<std::mutex> lock{*statusMutex};
-								referenceStatus[i] = false;
-							}
-							{
-								std::unique_lock<std::mutex> lock{waitingMutexes[i]};
-								waitingSample[i]=false;
-							}
-						}
-						else{
-							
-							//std::cout<<"Resetting Chain "<<i<<std::endl;
-							int currentID = data->currentStepID[i];
-							int initialID = initialStepIDs[i];
-							data->positions[i][initialID]->updatePosition(data->positions[i][currentID]);
-							data->likelihoodVals[i][initialID] = data->likelihoodVals[i][currentID];
-							data->priorVals[i][initialID] = data->priorVals[i][currentID];
-							data->currentStepID[i] = initialID;	
-
-							//Keep stepping
-							sampleJob job;
-							job.sampler = this;
-							job.chainID = i;
-							job.data = data;
-							job.swapPool = swapPool;
-
-							{
-								std::unique_lock<std::mutex> lock{waitingMutexes[i]};
-								waitingSample[i]=false;
-							}
-							samplePool->enqueue(job);	
-
-						}
+		/*Sleep until every cold chain has finished*/
+		{
+			std::unique_lock<std::mutex> lock{*statusMutex};
+			statusCondition->wait(lock, [=]{
+				for(int i = 0 ; i<ensembleN; i++){
+					if(referenceStatus[i]){
+						return false;
 					}
 				}
-			}
+				return true;
+			});
 		}
+		/*Hot chains are still cycling -- stop rescheduling and drain the pools*/
+		asyncSampling = false;
 		samplePool->stopPool();
 		swapPool->stopPool();
-		//Reset reference counters and waiting flags
-		for(int i = 0 ; i<ensembleN; i++){
-			referenceStatus[i] = true;
-		}
-		for(int i = 0 ; i<chainN; i++){
-			waitingSample[i] = true;
+		data->settleSwaps();
+
+		//Reset reference counters
+		{
+			std::unique_lock<std::mutex> lock{*statusMutex};
+			for(int i = 0 ; i<ensembleN; i++){
+				referenceStatus[i] = true;
+			}
 		}
 
 		//for(int i = 0 ; i<chainN; i++){
 		//	std::cout<<i<<" "<<data->currentStepID[i]<<std::endl;
 		//}
 
-		delete [] initialStepIDs;
 		delete samplePool;
 		delete swapPool;
 	}
@@ -1003,6 +1150,15 @@ bool bayesshipSampler::checkStatus()
 }
 void sampleThreadedFunctionNoSwap(int threadID, sampleJob job)
 {
+	instrumentSince(job.sampler->instruments, eventQueueWait, job.enqueueTime);
+	if(job.swapPartner >= 0){
+		job.sampler->chainSwap(job.chainID,job.swapPartner,job.data);
+		return;
+	}
+	if(job.proposeOnly){
+		job.sampler->proposeBatchMember(job.chainID,job.data);
+		return;
+	}
 	job.sampler->stepMH(job.chainID,job.data);
 	//job.data->currentStepID[job.chainID] ++;
 	//job.data->positions[job.chainID][job.data->currentStepID[job.chainID]]->updatePosition(job.data->positions[job.chainID][job.data->currentStepID[job.chainID-1]]);
@@ -1012,63 +1168,145 @@ void sampleThreadedFunctionNoSwap(int threadID, sampleJob job)
 	return;
 }
 
+/*! \brief Thread pool job -- steps the chain, then offers it for a swap or puts it back in the queue
+ *
+ * With multiStepJobs, a job advances its chain a geometric(swapProb) number of steps before the swap attempt. That's the distribution testing swapProb after every step gives, so the swap statistics are unchanged, with far less queue traffic for cheap likelihoods
+ */
 void sampleThreadedFunction(int threadID, sampleJob job)
 {
-	job.sampler->stepMH(job.chainID,job.data);
-	//job.data->currentStepID[job.chainID] ++;
-	//job.data->positions[job.chainID][job.data->currentStepID[job.chainID]]->updatePosition(job.data->positions[job.chainID][job.data->currentStepID[job.chainID-1]]);
+	bayesshipSampler *sampler = job.sampler;
+	/*Sampling has finished -- just drain the queue*/
+	if(!sampler->asyncSampling){
+		return;
+	}
+	instrumentSince(sampler->instruments, eventQueueWait, job.enqueueTime);
+	bool attemptSwap = false;
+	//A single rung has no partners to swap with
+	bool canSwap = sampler->swapProb > 0 && sampler->ensembleSize > 1;
+	if(sampler->multiStepJobs){
+		/*Draw the number of steps until the next swap attempt -- testing swapProb after every step gives the same (geometric) distribution*/
+		int remaining = job.finalStepID - job.data->currentStepID[job.chainID];
+		int steps = remaining;
+		if(canSwap){
+			steps = (int)sampler->rng->stream(job.chainID, rngSwapInterval)->geometric(sampler->swapProb);
+		}
+		/*If the chain hits its final step first, it's rescheduled without swapping, and a fresh interval is drawn afterwards*/
+		if(steps > remaining){
+			steps = remaining;
+		}
+		else{
+			attemptSwap = canSwap;
+		}
+		if(steps < 1){
+			steps = 1;
+		}
+		for(int i = 0 ; i<steps; i++){
+			sampler->stepMH(job.chainID,job.data);
+			if(!sampler->asyncSampling){
+				return;
+			}
+		}
+	}
+	else{
+		sampler->stepMH(job.chainID,job.data);
+		//job.data->currentStepID[job.chainID] ++;
+		//job.data->positions[job.chainID][job.data->currentStepID[job.chainID]]->updatePosition(job.data->positions[job.chainID][job.data->currentStepID[job.chainID-1]]);
 
+		double prob = sampler->rng->uniform(job.chainID, rngSwap);
+		attemptSwap = prob < sampler->swapProb && canSwap;
+	}
 
-	double prob = gsl_rng_uniform(job.sampler->rvec[job.chainID]);
 	//If attempting swap
-	if(prob< job.sampler->swapProb){
+	if(attemptSwap){
 		swapJob j;
 		j.sampler = job.sampler;
 		j.data = job.data;
 		j.chainID = job.chainID;
+		j.resume = job;
 		job.swapPool->enqueue(j);
 	}
 	//If just returning to sample
 	else{
-		std::unique_lock<std::mutex> lock{job.sampler->waitingMutexes[job.chainID]};
-		job.sampler->waitingSample[job.chainID]=true;
-
+		rescheduleChain(job);
 	}
 	
 	return;
 }
+
+/*! \brief Decides what happens to a chain once a sample or swap job is finished with it
+ *
+ * Cold chains that have reached their final step are retired (and the sampler is notified), hot chains that have reached their final step are rewound to their initial step, and all others go back into the sample pool
+ */
+void rescheduleChain(sampleJob job)
+{
+	bayesshipSampler *sampler = job.sampler;
+	if(!sampler->asyncSampling){
+		return;
+	}
+	int i = job.chainID;
+	samplerData *data = job.data;
+	if(data->currentStepID[i] >= job.finalStepID){
+		if(i < sampler->ensembleN){
+			{
+				std::unique_lock<std::mutex> lock{*(sampler->statusMutex)};
+				sampler->referenceStatus[i] = false;
+			}
+			sampler->statusCondition->notify_all();
+			return;
+		}
+		//std::cout<<"Resetting Chain "<<i<<std::endl;
+		int initialID = job.initialStepID;
+		data->restartChain(i, initialID, data->currentPosition(i), data->currentLikelihood(i), data->currentPrior(i));
+	}
+	//Keep stepping
+	job.enqueueTime = instrumentStamp(sampler->instruments);
+	job.samplePool->enqueue(job);
+	return;
+}
+
 void swapThreadedFunction(int threadID, swapJob job1, swapJob job2)
 {
+	if(!job1.sampler->asyncSampling){
+		return;
+	}
 	int j = job1.chainID;
 	int k = job2.chainID;
 	job1.sampler->chainSwap(j,k,job1.data);
-	{
-		std::unique_lock<std::mutex> lock{job1.sampler->waitingMutexes[job1.chainID]};
-		job1.sampler->waitingSample[job1.chainID]=true;
-	}
-	{
-		std::unique_lock<std::mutex> lock{job2.sampler->waitingMutexes[job2.chainID]};
-		job2.sampler->waitingSample[job2.chainID]=true;
-	}
+	/*A chain that's done is about to stop (cold) or start over and rewrite its rows (hot) -- its partner can't be left reading from them. That includes a chain that can finish with its next job, since its partner may still be waiting in the queue by then -- one step short, or any distance with multiStepJobs (a job can run all the way to finalStepID)*/
+	bool multiStep = job1.sampler->multiStepJobs;
+	if(multiStep || job1.data->currentStepID[j]+1 >= job1.resume.finalStepID || job1.data->currentStepID[k]+1 >= job2.resume.finalStepID){
+		int pair[2] = {j, k};
+		job1.data->settleSwaps(pair, 2);
+	}
+	rescheduleChain(job1.resume);
+	rescheduleChain(job2.resume);
 	return;
 }
-bool swapPairFunction( swapJob job1, swapJob job2)
+
+/*! \brief Bucket used to pair swap candidates -- the rung of the temperature ladder, or ensemble*ensembleSize + rung if the ensembles are isolated
+ */
+int swapBucketFunction( swapJob job)
 {
-	int i =  job1.sampler->betaN(job1.chainID);
-	int j =  job2.sampler->betaN(job2.chainID);
-	int k =  job1.sampler->ensembleID(job1.chainID);
-	int l =  job2.sampler->ensembleID(job2.chainID);
-	int diffRung = fabs(i-j);
-	int diffLadder = fabs(k-l);
-	if( (diffRung < job1.sampler->swapRadius && diffRung >0) || !job1.sampler->restrictSwapTemperatures){
-		if(!job1.sampler->getCurrentIsolateEnsemblesInternal()){
-			return true;
-		}
-		else if(diffLadder ==0){
-			return true;
-		}
+	bayesshipSampler *sampler = job.sampler;
+	int rung = sampler->betaN(job.chainID);
+	if(sampler->getCurrentIsolateEnsemblesInternal()){
+		return sampler->ensembleID(job.chainID)*sampler->ensembleSize + rung;
+	}
+	return rung;
+}
+
+/*! \brief Whether chains in bucket1 can swap with chains in bucket2 (see swapBucketFunction) -- different rungs less than swapRadius apart (any rungs without restrictSwapTemperatures), in the same ensemble if the ensembles are isolated
+ */
+bool swapPairFunction(bayesshipSampler *sampler, int bucket1, int bucket2)
+{
+	if(bucket1/sampler->ensembleSize != bucket2/sampler->ensembleSize){
+		return false;
+	}
+	if(!sampler->restrictSwapTemperatures){
+		return true;
 	}
-	return false;
+	int diffRung = abs(bucket1 - bucket2);
+	return diffRung < sampler->swapRadius && diffRung > 0;
 }
 
 bool bayesshipSampler::getCurrentIsolateEnsemblesInternal()
@@ -1078,16 +1316,16 @@ bool bayesshipSampler::getCurrentIsolateEnsemblesInternal()
 }
 
 /*! \brief Swaps two chains in the ensemble identified by chainID1 and chainID2
+ *
+ * An accepted swap only exchanges which rows the two chains read their current states from (see samplerData::swapCurrent) -- O(1), and no position data moves
  */
 
 void bayesshipSampler::chainSwap(int chainID1, int chainID2,samplerData *data)
 {
+	eventTimer timer(instruments, eventSwap);
 
-	int currentStep1 = data->currentStepID[chainID1];
-	int currentStep2 = data->currentStepID[chainID2];
-	//double likelihood1 = positions[chainID1][currentStepID[chainID1]
-	double likelihood1 = data->likelihoodVals[chainID1][currentStep1];
-	double likelihood2 = data->likelihoodVals[chainID2][currentStep2];
+	double likelihood1 = data->currentLikelihood(chainID1);
+	double likelihood2 = data->currentLikelihood(chainID2);
 	double beta1 = betas[chainID1];
 	double beta2 = betas[chainID2];
 
@@ -1100,7 +1338,7 @@ void bayesshipSampler::chainSwap(int chainID1, int chainID2,samplerData *data)
 	//double ratio = (likelihood1 - likelihood2)*beta2 - (likelihood1 - likelihood2)*beta1;
 	double ratio = (likelihood1 - likelihood2)*(beta2-beta1);
 		
-	double alpha = gsl_rng_uniform(rvec[chainID1]) ;
+	double alpha = rng->uniform(chainID1, rngSwap) ;
 
 	if(exp(ratio) < alpha){
 		data->swapRejects[chainID1][chainID2]++;
@@ -1131,23 +1369,181 @@ void bayesshipSampler::chainSwap(int chainID1, int chainID2,samplerData *data)
 
 		data->swapAccepts[chainID1][chainID2]++;
 		data->swapAccepts[chainID2][chainID1]++;
+		data->recordSwap(chainID1, chainID2);
+		data->swapCurrent(chainID1, chainID2);
+	}
+
+	return;
+}
 
-		positionInfo *temp = new positionInfo(maxDim, RJ);
-		temp->updatePosition(data->positions[chainID1][currentStep1]);
-		data->positions[chainID1][currentStep1]->updatePosition(data->positions[chainID2][currentStep2]);
-		data->positions[chainID2][currentStep2]->updatePosition(temp);
-		delete temp;
+/*! \brief One sweep of the deterministic even-odd swap schedule -- tries every pair of adjacent rungs starting from swapPhase, then flips swapPhase for the next sweep
+ *
+ * The pairs don't share any chains, so they're handed to the stepping threads as one epoch. With randomizeSwapping, the partners in rung k+1 are a random permutation of the ensembles, which keeps the pairs disjoint
+ *
+ * Sweeps alternate between the pairs (0,1),(2,3),... and (1,2),(3,4),..., and the lockstep loop runs 2*swapProb sweeps per step, so each pair is tried swapProb times per step, as with the stochastic schedule. The schedule is non-reversible -- replicas travel the ladder ballistically, so round trips scale linearly (rather than quadratically) with ensembleSize
+ */
+void bayesshipSampler::swapSweepEvenOdd(samplerData *data)
+{
+	int firstRung = swapPhase;
+	swapPhase = 1 - swapPhase;
+	int partners[ensembleN];
+	int pairs = 0;
+	for(int k = firstRung ; k<ensembleSize-1; k+=2){
+		for(int j = 0 ; j<ensembleN; j++){
+			partners[j] = j;
+		}
+		if(randomizeSwapping){
+			for(int j = ensembleN-1 ; j>0; j--){
+				int l = std::min((int)(rng->uniform(chainIndex(j,k), rngSwap)*(j+1)), j);
+				std::swap(partners[j], partners[l]);
+			}
+		}
+		for(int j = 0 ; j<ensembleN; j++){
+			if(stepPool && stepPool->get_num_threads() > 1){
+				sampleJob job;
+				job.sampler = this;
+				job.chainID = chainIndex(j,k);
+				job.swapPartner = chainIndex(partners[j],k+1);
+				job.data = data;
+				job.enqueueTime = instrumentStamp(instruments);
+				stepPool->enqueue(job);
+				pairs++;
+			}
+			else{
+				chainSwap(chainIndex(j,k),chainIndex(partners[j],k+1),data);
+			}
+		}
+	}
+	if(pairs > 0){
+		stepPool->runEpoch();
+	}
+}
 
-		data->likelihoodVals[chainID1][currentStep1] = likelihood2;
-		data->likelihoodVals[chainID2][currentStep2] = likelihood1;
+/*! \brief Post-process the batch just sampled into data (ACs, evidence, and the output and stat files) on the pipeline, while the next batch is sampled
+ *
+ * Everything the post-processing reads that sampling keeps changing is snapshotted here: the last step of each chain, the evidence accumulators, and the stat file. The steps before the last don't change, and storage is only restructured when the pipeline is empty (see sample()) -- so it's allocated pipelineDepth batches at a time, and history is only spilled between batches that find the pipeline empty (maxResidentSteps should be at least batchSize). Spilled history (the spectral ACs read all of it) is paged into caches owned by each reading thread, so the pipeline and the proposals reading the same chains on the sampling threads don't share any cache state
+ */
+void bayesshipSampler::queueBatchPostProcessing(
+	samplerData *data,/**< Data the batch was sampled into*/
+	batchPipeline *pipeline,/**< Pipeline to queue on*/
+	bool createOutput/**< Whether to create the output file (first batch) instead of appending to it*/
+	)
+{
+	std::vector<int> endSteps(data->currentStepID, data->currentStepID+chainN);
+	std::shared_ptr<evidenceSnapshot> evidence(new evidenceSnapshot);
+	data->snapshotEvidence(evidence.get());
+	std::ostringstream stats;
+	data->writeStatFile(stats);
+	std::string statText = stats.str();
+	std::string outputPrefix = outputDir+outputFileMoniker;
+	pipeline->submit([=]() mutable {
+		data->endStepIDs = endSteps.data();
+		if(!RJ){
+			data->updateACs(threads);
+			double AC = 0;
+			for(int i = 0 ; i<data->ensembleN; i++){
+				AC += data->maxACs[i];
+			}
+			AC /= data->ensembleN;
+			std::cout<<"Current independent samples per chain / Average AC: "<<data->countIndependentSamples()<<" / "<<AC <<std::endl;
+		}
+		reportEvidence(data, evidence.get());
+		writeOutput(data, outputPrefix, createOutput);
+		if(writeFiles){
+			std::ofstream statFile(outputPrefix+"_stat.txt");
+			statFile<<statText;
+		}
+		data->endStepIDs = nullptr;
+	});
+}
 
+/*! \brief Write (create==true) or append to the chain output of data -- prefix+"_output.hdf5" when built with HDF5, and the .npy files prefix+"_output_*" (see samplerData::create_npy_dump) if npyOutput is set or there's no HDF5. Nothing is written if writeFiles is false
+ */
+void bayesshipSampler::writeOutput(
+	samplerData *data,/**< Data to write*/
+	std::string prefix,/**< Path and name prefix of the output*/
+	bool create/**< Whether to create the output (first write) instead of appending to it*/
+	)
+{
+	if(!writeFiles){
+		return;
+	}
+	#ifdef _HDF5
+	if(create){
+		data->create_data_dump(coldOnlyStorage, true, prefix+"_output.hdf5");
+	}
+	else{
+		data->append_to_data_dump(prefix+"_output.hdf5");
+	}
+	if(!npyOutput){
+		return;
+	}
+	#endif
+	if(create){
+		data->create_npy_dump(coldOnlyStorage, true, prefix+"_output");
+	}
+	else{
+		data->append_to_npy_dump(prefix+"_output");
+	}
+}
 
-		double tempPrior = data->priorVals[chainID1][currentStep1];
-		data->priorVals[chainID1][currentStep1] = data->priorVals[chainID2][currentStep2];
-		data->priorVals[chainID2][currentStep2] = tempPrior;
+/*! \brief Update the evidence estimates from the running accumulators of data (see samplerData::calculateEvidence) and print them -- works for RJ runs too
+ */
+void bayesshipSampler::reportEvidence(
+	samplerData *data,/**< Data to calculate the evidence for*/
+	evidenceSnapshot *snapshot/**< Accumulators to use (see samplerData::snapshotEvidence) -- nullptr to use the live ones*/
+	)
+{
+	data->calculateEvidence(threads, snapshot);
+	if(data->calculatedEvidence){
+		std::cout<<"Current ln Evidence: "<<data->evidence<<" +/- "<<data->evidenceError;
+		std::cout<<" (stepping stone: "<<data->steppingStoneEvidence<<" +/- "<<data->steppingStoneEvidenceError<<")"<<std::endl;
 	}
+}
 
-	return;
+/*! \brief Respace the temperatures so every pair of adjacent rungs has the same swap rejection rate (see temperatureLadder.h), using the swaps made since the counts startAccepts/startRejects were taken
+ *
+ * Every ensemble gets the same ladder. The communication barrier and the smallest ensembleSize that would do are printed. Returns false if the ladder was left alone
+ *
+ * Only called with optimizeLadder -- round trips and barriers are written to the stat file either way
+ */
+bool bayesshipSampler::respaceTemperatures(
+	samplerData *data,/**< Data with the swap statistics*/
+	long long *startAccepts,/**< Swap counts from ladderSwapCounts at the start of the period -- shape [ensembleSize-1]*/
+	long long *startRejects/**< Swap counts from ladderSwapCounts at the start of the period -- shape [ensembleSize-1]*/
+	)
+{
+	int pairs = ensembleSize-1;
+	if(pairs < 2){
+		return false;
+	}
+	long long accepts[pairs];
+	long long rejects[pairs];
+	ladderSwapCounts(data, accepts, rejects);
+	double rejection[pairs];
+	for(int k = 0 ; k<pairs; k++){
+		long long acc = accepts[k]-startAccepts[k];
+		long long rej = rejects[k]-startRejects[k];
+		rejection[k] = (acc+rej > 0) ? (double)rej/(acc+rej) : -1;
+	}
+	double barrier = communicationBarrier(rejection, pairs);
+	std::cout<<"Communication barrier: "<<barrier<<" -- suggested ensembleSize: "<<suggestEnsembleSize(barrier)<<std::endl;
+
+	double schedule[ensembleSize];
+	for(int k = 0 ; k<ensembleSize; k++){
+		schedule[k] = betas[chainIndex(0,k)];
+	}
+	if(!respaceLadder(schedule, rejection, ensembleSize, schedule)){
+		std::cout<<"WARNING -- not enough swaps to respace the temperatures"<<std::endl;
+		return false;
+	}
+	for(int j = 0 ; j<ensembleN; j++){
+		for(int k = 0 ; k<ensembleSize; k++){
+			betas[chainIndex(j,k)] = schedule[k];
+		}
+	}
+	data->updateBetas(betas);
+	return true;
 }
 
 double PTDynamicalTimescale(double t0, double nu, int t){
@@ -1228,85 +1624,294 @@ void bayesshipSampler::stepMH(
 	samplerData *data
 	)
 {
-	int currentStep = data->currentStepID[chainID];
 	int proposalStep = data->currentStepID[chainID]+1;
 	
-	/*Choose a random proposal*/
-	double beta = (gsl_rng_uniform(rvec[chainID]));
-	int randStep = 0;
-	double runningSum = 0;
-	for(int i = 1 ; i<proposalFns->proposalN; i++){
-		runningSum+=proposalFns->proposalProb[chainID][i-1];
-		double upper = runningSum + proposalFns->proposalProb[chainID][i];
-		double lower = runningSum ;
-			
-		if(beta > lower && beta < upper){
-			randStep = i;
-		}
-	}
 	double MHRatioCorrection = 0;
-	/*Perform the proposal*/
-	double start = omp_get_wtime();	
-	proposalFns->proposals[randStep]->propose(data->positions[chainID][currentStep], data->positions[chainID][proposalStep],chainID,  randStep,&MHRatioCorrection);
-	double time = omp_get_wtime() - start;
-	data->proposalTimes[chainID][randStep] *= (data->rejectN[chainID][randStep] +data->successN[chainID][randStep] );
-	data->proposalTimes[chainID][randStep] += time;
-	data->proposalTimes[chainID][randStep] /= (data->rejectN[chainID][randStep] +data->successN[chainID][randStep]+1 );
-	
+	int randStep = proposeStep(chainID, data, &MHRatioCorrection);
 
 	/*Calculate log of the prior values*/
-	start = omp_get_wtime();	
+	int64_t start = instrumentClock();	
 	//double logPrior = prior(data->positions[chainID][proposalStep], chainID, this,userParameters[chainID]);
 	double logPrior = prior->eval(data->positions[chainID][proposalStep], chainID);
-	time = omp_get_wtime() - start;
-	data->priorTimes[chainID] *= (data->currentStepID[chainID] );
-	data->priorTimes[chainID] += time;
-	data->priorTimes[chainID] /= (data->currentStepID[chainID] + 1);
+	int64_t time = instrumentClock() - start;
+	data->priorTimes[chainID] += time*1e-9;
+	instrumentRecord(instruments, eventPrior, time);
 	/*If rejected outright, exitA*/
 	if(logPrior == limitInf){
-		data->positions[chainID][proposalStep]->updatePosition(data->positions[chainID][currentStep]);
-		data->likelihoodVals[chainID][proposalStep] = data->likelihoodVals[chainID][currentStep];
-		data->priorVals[chainID][proposalStep] = data->priorVals[chainID][currentStep];
-		data->rejectN[chainID][randStep]++;
-		data->currentStepID[chainID] +=1;
+		acceptStep(chainID, data, randStep, logPrior, limitInf, MHRatioCorrection);
 		return;
 	}
+	/*Delayed acceptance -- screen with the surrogate before paying for the likelihood (the surrogate at the current state is cached, so this is one evaluation)*/
+	double surrogateProposed = 0;
+	if(surrogateLikelihood){
+		surrogateProposed = surrogateLikelihood->eval(data->positions[chainID][proposalStep], chainID);
+		double surrogateDifference = surrogateProposed - currentSurrogate(chainID, data);
+		if(!surrogateScreen(chainID, data, surrogateDifference, logPrior, MHRatioCorrection)){
+			acceptStep(chainID, data, randStep, limitInf, limitInf, MHRatioCorrection);
+			return;
+		}
+	}
 	/*Calculate likelihood valeu*/
-	start = omp_get_wtime();	
+	start = instrumentClock();	
 	//double logLikelihood = likelihood(data->positions[chainID][proposalStep], chainID, this,userParameters[chainID]);
 	double logLikelihood = likelihood->eval(data->positions[chainID][proposalStep], chainID);
-	time = omp_get_wtime() - start;
-	data->likelihoodTimes[chainID] *= (data->likelihoodEvals[chainID] );
-	data->likelihoodTimes[chainID] += time;
+	time = instrumentClock() - start;
+	data->likelihoodTimes[chainID] += time*1e-9;
 	data->likelihoodEvals[chainID]++;
-	data->likelihoodTimes[chainID] /= (data->likelihoodEvals[chainID]) ;
+	instrumentRecord(instruments, eventLikelihood, time);
 	
-	
-	/*Calculate the MH ratio*/
+	acceptStep(chainID, data, randStep, logPrior, logLikelihood, MHRatioCorrection, surrogateLikelihood != nullptr, surrogateProposed);
+	return;
+}
+
+/*! \brief Surrogate likelihood at the current state of chainID -- evaluated only if it isn't cached in samplerData::currentSurrogate yet (the first step, or after a restart)
+ */
+double bayesshipSampler::currentSurrogate(
+	int chainID,/**< ID of the chain*/
+	samplerData *data
+	)
+{
+	if(std::isnan(data->currentSurrogate[chainID])){
+		data->currentSurrogate[chainID] = surrogateLikelihood->eval(data->currentPosition(chainID), chainID);
+	}
+	return data->currentSurrogate[chainID];
+}
+
+/*! \brief First stage of delayed acceptance -- Metropolis-Hastings test for chainID with the surrogate in place of the likelihood
+ *
+ * Returns true if the proposal survives and should be evaluated with the full likelihood. Rejections are counted in samplerData::surrogateRejectN
+ *
+ * This is delayed acceptance: the second stage (acceptStep) corrects for the surrogate, so the target distribution is unchanged, and only the proposals that survive cost a full likelihood evaluation. The surrogate at each chain's current state is cached (samplerData::currentSurrogate), so a step costs one surrogate evaluation
+ */
+bool bayesshipSampler::surrogateScreen(
+	int chainID,/**< ID of the chain to iterate*/
+	samplerData *data,
+	double surrogateDifference,/**< Surrogate at the proposed position minus the surrogate at the current position*/
+	double logPrior,/**< Log prior of the proposed position*/
+	double MHRatioCorrection,/**< Correction to the MH ratio from the proposal*/
+	double uniformDraw/**< The chain's rngSurrogate draw, if it was already made (see counterRNG::uniformBlock) -- 0 draws it here*/
+	)
+{
 	double MHRatio = 
-		(logLikelihood - data->likelihoodVals[chainID][currentStep]) * betas[chainID]
-		+logPrior - data->priorVals[chainID][currentStep] 
+		surrogateDifference * betas[chainID]
+		+logPrior - data->currentPrior(chainID) 
 		+ MHRatioCorrection;
+	double prob = log((uniformDraw > 0) ? uniformDraw : rng->uniform(chainID, rngSurrogate));
+	if(MHRatio < prob){
+		data->surrogateRejectN[chainID]++;
+		return false;
+	}
+	return true;
+}
+
+/*! \brief First half of a Metropolis-Hastings step -- chooses a proposal and writes the proposed position into the next step of chainID
+ *
+ * Returns the index of the proposal used
+ */
+int bayesshipSampler::proposeStep(
+	int chainID,/**< ID of the chain to iterate*/
+	samplerData *data,
+	double *MHRatioCorrection/**< [out] Correction to the MH ratio from the proposal*/
+	)
+{
+	int proposalStep = data->currentStepID[chainID]+1;
+	
+	/*Every draw for this step comes from fresh streams keyed by the chain's step counter*/
+	rng->beginStep(chainID);
+
+	/*Choose a random proposal*/
+	double beta = rng->uniform(chainID, rngProposalChoice);
+	int randStep = 0;
+	double runningSum = 0;
+	for(int i = 1 ; i<proposalFns->proposalN; i++){
+		runningSum+=proposalFns->proposalProb[chainID][i-1];
+		double upper = runningSum + proposalFns->proposalProb[chainID][i];
+		double lower = runningSum ;
+			
+		if(beta > lower && beta < upper){
+			randStep = i;
+		}
+	}
+	*MHRatioCorrection = 0;
+	/*Perform the proposal*/
+	int64_t start = instrumentClock();	
+	proposalFns->proposals[randStep]->propose(data->currentPosition(chainID), data->positions[chainID][proposalStep],chainID,  randStep,MHRatioCorrection);
+	int64_t time = instrumentClock() - start;
+	data->proposalTimes[chainID][randStep] += time*1e-9;
+	instrumentRecord(instruments, eventPropose, time);
+	return randStep;
+}
 
-	/*Random number representing probability*/
-	double prob = log(gsl_rng_uniform(rvec[chainID]));
+/*! \brief Second half of a Metropolis-Hastings step -- accepts or rejects the proposed position in the next step of chainID and advances the chain
+ *
+ * A prior value of limitInf rejects outright (logLikelihood is ignored)
+ *
+ * For the second stage of delayed acceptance, the prior and proposal terms were already used in the first stage, so only the likelihood ratio divided by the surrogate ratio is tested
+ */
+void bayesshipSampler::acceptStep(
+	int chainID,/**< ID of the chain to iterate*/
+	samplerData *data,
+	int randStep,/**< Index of the proposal that was used*/
+	double logPrior,/**< Log prior of the proposed position*/
+	double logLikelihood,/**< Log likelihood of the proposed position*/
+	double MHRatioCorrection,/**< Correction to the MH ratio from the proposal*/
+	bool secondStage,/**< Whether this is the second stage of delayed acceptance*/
+	double surrogateProposed,/**< Second stage only -- surrogate at the proposed position (cached in samplerData::currentSurrogate if it's accepted)*/
+	double uniformDraw/**< The chain's rngAccept draw, if it was already made (see counterRNG::uniformBlock) -- 0 draws it here*/
+	)
+{
+	int proposalStep = data->currentStepID[chainID]+1;
+	double currentLikelihood = data->currentLikelihood(chainID);
+	double currentPrior = data->currentPrior(chainID);
+
+	bool accept = false;
+	if(logPrior != limitInf){
+		/*Calculate the MH ratio*/
+		double MHRatio ;
+		if(secondStage){
+			MHRatio = 
+				(logLikelihood - currentLikelihood - (surrogateProposed - data->currentSurrogate[chainID])) * betas[chainID];
+		}
+		else{
+			MHRatio = 
+				(logLikelihood - currentLikelihood) * betas[chainID]
+				+logPrior - currentPrior 
+				+ MHRatioCorrection;
+		}
+
+		/*Random number representing probability*/
+		double prob = log((uniformDraw > 0) ? uniformDraw : rng->uniform(chainID, rngAccept));
+		accept = !(MHRatio < prob);
+	}
 	/*Reject or accept the step*/
-	if(MHRatio < prob){
+	if(!accept){
 		//reject
-		data->positions[chainID][proposalStep]->updatePosition(data->positions[chainID][currentStep]);
-		data->likelihoodVals[chainID][proposalStep] = data->likelihoodVals[chainID][currentStep];
-		data->priorVals[chainID][proposalStep] = data->priorVals[chainID][currentStep];
+		data->rejectProposal(chainID);
+		data->likelihoodVals[chainID][proposalStep] = currentLikelihood;
+		data->priorVals[chainID][proposalStep] = currentPrior;
 		data->rejectN[chainID][randStep]++;
 		
 	}
 	else{
 		//accept
+		data->acceptProposal(chainID);
+		if(secondStage){
+			data->currentSurrogate[chainID] = surrogateProposed;
+		}
 		data->likelihoodVals[chainID][proposalStep] = logLikelihood;
 		data->priorVals[chainID][proposalStep] = logPrior ;
 		data->successN[chainID][randStep]++;
 	}
 	
-	data->currentStepID[chainID] +=1;
+	data->accumulateLikelihood(chainID);
+	data->setCurrentStep(chainID, proposalStep);
+	return;
+}
+
+/*! \brief Proposal half of a batched step for chainID -- the proposal index and MH correction are stored in the batch buffers
+ */
+void bayesshipSampler::proposeBatchMember(int chainID, samplerData *data)
+{
+	batchProposalIDs[chainID] = proposeStep(chainID, data, &batchCorrections[chainID]);
+	return;
+}
+
+/*! \brief Steps every chain once in lockstep, with one batched prior call and one batched likelihood call for the whole ensemble
+ *
+ * Proposals are made in parallel on the persistent team, the priors and likelihoods are evaluated with probabilityFn::evalBatch, and the accept/reject pass runs over all chains
+ */
+void bayesshipSampler::stepMHBatch(samplerData *data)
+{
+	/*Propose for every chain*/
+	for(int chain = 0 ; chain<chainN; chain++){
+		sampleJob job;
+		job.sampler = this;
+		job.chainID = chain;
+		job.data = data;
+		job.proposeOnly = true;
+		stepPool->enqueue(job);	
+	}	
+	stepPool->runEpoch();
+
+	/*Batched prior for every proposal*/
+	for(int chain = 0 ; chain<chainN; chain++){
+		batchPositions[chain] = data->positions[chain][data->currentStepID[chain]+1];
+		batchChainIDs[chain] = chain;
+	}
+	int64_t start = instrumentClock();	
+	prior->evalBatch(batchPositions, batchChainIDs, chainN, batchLogPrior);
+	int64_t time = instrumentClock() - start;
+	/*The histograms see the latency of the whole batched call*/
+	instrumentRecord(instruments, eventPrior, time);
+
+	/*Batched likelihood for the proposals that survive the prior*/
+	int n = 0;
+	for(int chain = 0 ; chain<chainN; chain++){
+		data->priorTimes[chain] += time*1e-9/chainN;
+		batchLogLikelihood[chain] = limitInf;
+		if(batchLogPrior[chain] != limitInf){
+			batchPositions[n] = data->positions[chain][data->currentStepID[chain]+1];
+			batchChainIDs[n] = chain;
+			n++;
+		}
+	}
+
+	/*Delayed acceptance -- batched surrogate, then drop the proposals rejected in the first stage*/
+	if(surrogateLikelihood && n > 0){
+		/*The surrogate at the current states is cached (see samplerData::currentSurrogate) -- only chains that just started need it*/
+		int uncached = 0;
+		for(int i = 0 ; i<n; i++){
+			int chain = batchChainIDs[i];
+			if(std::isnan(data->currentSurrogate[chain])){
+				batchCurrentPositions[uncached] = data->currentPosition(chain);
+				batchUncachedIDs[uncached] = chain;
+				uncached++;
+			}
+		}
+		if(uncached > 0){
+			surrogateLikelihood->evalBatch(batchCurrentPositions, batchUncachedIDs, uncached, batchSurrogatePacked);
+			for(int i = 0 ; i<uncached; i++){
+				data->currentSurrogate[batchUncachedIDs[i]] = batchSurrogatePacked[i];
+			}
+		}
+		surrogateLikelihood->evalBatch(batchPositions, batchChainIDs, n, batchSurrogatePacked);
+		rng->uniformBlock(batchChainIDs, n, rngSurrogate, batchUniforms);
+		int survivors = 0;
+		for(int i = 0 ; i<n; i++){
+			int chain = batchChainIDs[i];
+			batchSurrogateProposed[chain] = batchSurrogatePacked[i];
+			if(surrogateScreen(chain, data, batchSurrogateProposed[chain] - data->currentSurrogate[chain], batchLogPrior[chain], batchCorrections[chain], batchUniforms[i])){
+				batchPositions[survivors] = batchPositions[i];
+				batchChainIDs[survivors] = chain;
+				survivors++;
+			}
+			else{
+				batchLogPrior[chain] = limitInf;
+			}
+		}
+		n = survivors;
+	}
+	if(n > 0){
+		start = instrumentClock();	
+		likelihood->evalBatch(batchPositions, batchChainIDs, n, batchLogLikelihoodPacked);
+		time = instrumentClock() - start;
+		instrumentRecord(instruments, eventLikelihood, time);
+		for(int i = 0 ; i<n; i++){
+			int chain = batchChainIDs[i];
+			batchLogLikelihood[chain] = batchLogLikelihoodPacked[i];
+			data->likelihoodTimes[chain] += time*1e-9/n;
+			data->likelihoodEvals[chain]++;
+		}
+	}
+
+	/*Accept/reject pass over every chain -- the acceptance draws are made for the whole ensemble at once (a chain that skips the test doesn't shift any other stream)*/
+	for(int chain = 0 ; chain<chainN; chain++){
+		batchChainIDs[chain] = chain;
+	}
+	rng->uniformBlock(batchChainIDs, chainN, rngAccept, batchUniforms);
+	for(int chain = 0 ; chain<chainN; chain++){
+		acceptStep(chain, data, batchProposalIDs[chain], batchLogPrior[chain], batchLogLikelihood[chain], batchCorrections[chain], surrogateLikelihood != nullptr, batchSurrogateProposed[chain], batchUniforms[chain]);
+	}
 	return;
 }
 
@@ -1365,14 +1970,14 @@ int bayesshipSampler::chainIndex(int ensemble, int betaN){
  *
  * Use the deallocation method to properly deallocate the memory of the returned pointer.
  */
-double *** samplerData::convertToPrimitivePointer()
+double *** samplerData::convertToPrimitivePointer(int startStep/**< First step to include (steps before this may have been spilled to disk)*/)
 {
 	double*** newPointer  = new double**[chainN];
 	for(int i = 0 ; i<chainN; i++){
-		newPointer[i] = new double*[currentStepID[i]+1];
-		for(int j = 0 ; j<currentStepID[i]+1; j++){	
+		newPointer[i] = new double*[currentStepID[i]+1-startStep];
+		for(int j = startStep ; j<currentStepID[i]+1; j++){	
 	
-			newPointer[i][j] = positions[i][j]->parameters;
+			newPointer[i][j-startStep] = positions[i][j]->parameters;
 		}
 	}
 	return newPointer;
@@ -1586,6 +2191,9 @@ proposalData::~proposalData()
 
 void bayesshipSampler::writeCheckpoint(samplerData *data)
 {
+	if(!writeFiles){
+		return;
+	}
 	std::string outputFile(outputDir+outputFileMoniker+"_checkpoint.json");
 	std::cout<<"Writing Checkpoint File: "<<outputFile<<std::endl;
 	//nlohmann::json j;	
@@ -1609,6 +2217,7 @@ void bayesshipSampler::writeCheckpoint(samplerData *data)
 	j["randomizeSwapping"] = this->randomizeSwapping;
 	j["betaSchedule"] = std::vector<double>(this->betaSchedule, this->betaSchedule + this->ensembleSize);
 	j["betas"] = std::vector<double>(this->betas, this->betas + this->chainN);
+	j["rngSteps"] = std::vector<uint64_t>(this->rng->steps, this->rng->steps + this->chainN);
 	if(this->priorRanges){
 		for(int i = 0 ; i<this->maxDim; i++){
 			j["priorRanges"]["Dim "+std::to_string(i)] 
@@ -1616,13 +2225,13 @@ void bayesshipSampler::writeCheckpoint(samplerData *data)
 		}
 	}
 	for(int i = 0 ; i<this->chainN; i++){
-		int finalPos = data->currentStepID[i];
+		positionInfo *finalPosition = data->currentPosition(i);
 		j["finalPosition"]["Parameters"]["Chain "+std::to_string(i)] 
-			= std::vector<double>(data->positions[i][finalPos]->parameters,data->positions[i][finalPos]->parameters + this->maxDim);
+			= std::vector<double>(finalPosition->parameters,finalPosition->parameters + this->maxDim);
 		if(this->RJ){
 			j["finalPosition"]["Status"]["Chain "+std::to_string(i)] 
-				= std::vector<double>(data->positions[i][finalPos]->status,data->positions[i][finalPos]->status + this->maxDim);
-			j["finalPosition"]["Model ID"]["Chain "+std::to_string(i)] = data->positions[i][finalPos]->modelID;
+				= std::vector<double>(finalPosition->status,finalPosition->status + this->maxDim);
+			j["finalPosition"]["Model ID"]["Chain "+std::to_string(i)] = finalPosition->modelID;
 		}
 	}
 
@@ -1632,6 +2241,9 @@ void bayesshipSampler::writeCheckpoint(samplerData *data)
 	for(int i = 0 ; i<proposalFns->proposalN; i++){
 			proposalFns->proposals[i]->writeCheckpoint(outputDir, outputFileMoniker);
 	}
+	if(spectralACs){
+		exportACWisdom(outputDir+outputFileMoniker+"_fftw_wisdom.dat");
+	}
 	
 
 	return;
@@ -1715,6 +2327,14 @@ void bayesshipSampler::loadCheckpoint()
 			}
 		}
 	}
+	/*Pick up the random number streams where they left off*/
+	if(j.contains(std::string("rngSteps")) ){
+		std::vector<uint64_t> rngStepsTemp;
+		j.at("rngSteps").get_to(rngStepsTemp);	
+		for(int i = 0  ;i<chainN; i++){
+			rng->setStep(i, rngStepsTemp[i]);
+		}
+	}
 	for(int i = 0 ; i<proposalFns->proposalN; i++){
 			proposalFns->proposals[i]->loadCheckpoint(outputDir, outputFileMoniker);
 	}
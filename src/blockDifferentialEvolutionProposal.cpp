@@ -39,7 +39,7 @@ void blockDifferentialEvolutionProposal::propose(positionInfo *currentPosition,
 	proposedPosition->updatePosition(currentPosition);
 
 
-	double beta = gsl_rng_uniform(sampler->rvec[chainID]);
+	double beta = sampler->rng->uniform(chainID, rngProposal);
 	int blockID = 0 ;
 	for(int i = 0 ; i<blocks.size(); i++){
 		if (beta < blockProbBoundaries[i]){
@@ -58,44 +58,44 @@ void blockDifferentialEvolutionProposal::propose(positionInfo *currentPosition,
 	if(sampler->burnPeriod || !sampler->burnData){
 	//if(true){
 		int id1, id2=-1 ;
-		id1 = (int) (gsl_rng_uniform(sampler->rvec[chainID])*currentStep);
+		id1 = (int) (sampler->rng->uniform(chainID, rngProposal)*currentStep);
 		do{
-			id2 = (int) (gsl_rng_uniform(sampler->rvec[chainID])*currentStep);
+			id2 = (int) (sampler->rng->uniform(chainID, rngProposal)*currentStep);
 		}while(id1 ==id2)	;
-		historyPosition1 = data->positions[chainID][id1];
-		historyPosition2 = data->positions[chainID][id2];
+		historyPosition1 = data->getPosition(chainID, id1);
+		historyPosition2 = data->getPosition(chainID, id2);
 	}
 	else{
 		int burnIterations = sampler->burnData->currentStepID[chainID];
 		int id1, id2=-1 ;
-		id1 = (int)(gsl_rng_uniform(sampler->rvec[chainID])*(currentStep+burnIterations));
+		id1 = (int)(sampler->rng->uniform(chainID, rngProposal)*(currentStep+burnIterations));
 		do{
-			id2 = (int)(gsl_rng_uniform(sampler->rvec[chainID])*(currentStep+burnIterations));
+			id2 = (int)(sampler->rng->uniform(chainID, rngProposal)*(currentStep+burnIterations));
 		}while(id1 ==id2)	;
 		if(id1 >= burnIterations){
-			historyPosition1 = data->positions[chainID][id1-burnIterations];
+			historyPosition1 = data->getPosition(chainID, id1-burnIterations);
 		}
 		else {
-			historyPosition1 = sampler->burnData->positions[chainID][id1];
+			historyPosition1 = sampler->burnData->getPosition(chainID, id1);
 
 		}
 		if(id2 >= burnIterations){
-			historyPosition2 = data->positions[chainID][id2-burnIterations];
+			historyPosition2 = data->getPosition(chainID, id2-burnIterations);
 		}
 		else {
-			historyPosition2 = sampler->burnData->positions[chainID][id2];
+			historyPosition2 = sampler->burnData->getPosition(chainID, id2);
 
 		}
 
 	}
 
 	//double stepWidth = 1;
-	double  alpha = gsl_rng_uniform(sampler->rvec[chainID]);
+	double  alpha = sampler->rng->uniform(chainID, rngProposal);
 	double gamma = 1;
 	if( alpha < .9){
 		//gamma = gsl_ran_gaussian(sampler->rvec[chainID],2.38/std::sqrt(2.*blocks[blockID].size()));
 		//gamma = gsl_ran_gaussian(sampler->rvec[chainID],2.38/std::sqrt(2.*sampler->maxDim));
-		gamma = gsl_ran_gaussian(sampler->rvec[chainID],1)*2.38/std::sqrt(2.*sampler->maxDim);
+		gamma = sampler->rng->gaussian(chainID, rngProposal, 1)*2.38/std::sqrt(2.*sampler->maxDim);
 	}
 	for(int i = 0 ; i<blocks[blockID].size(); i++){
 		int paramID = blocks[blockID][i];
@@ -157,7 +157,7 @@ void blockFisherProposal::propose(positionInfo *currentPosition, positionInfo *p
 	
 	//Pick random block
 	//int alpha = (int)(gsl_rng_uniform(sampler->rvec[chainID])*blocks.size());
-	double beta = gsl_rng_uniform(sampler->rvec[chainID]);
+	double beta = sampler->rng->uniform(chainID, rngProposal);
 	int alpha = 0 ;
 	for(int i = 0 ; i<blocks.size(); i++){
 		if (beta < blockProbBoundaries[i]){
@@ -208,12 +208,12 @@ void blockFisherProposal::propose(positionInfo *currentPosition, positionInfo *p
 		
 	}
 
-	int randDim = (int)(gsl_rng_uniform(sampler->rvec[chainID])*blocks[alpha].size());	
+	int randDim = (int)(sampler->rng->uniform(chainID, rngProposal)*blocks[alpha].size());	
 	//Adding 1e-10 to soften the effect of broadening gaussian step based on Temperature dependence -- beta==0 is problematic
 	double scaling = std::abs(FisherEigenVals[chainID][alpha][randDim]); 
 	if(scaling <10. ){scaling = 10.;}
 	scaling *=(sampler->betas[chainID]+1e-5);
-	double randGauss = gsl_ran_gaussian(sampler->rvec[chainID], 1./std::sqrt(scaling));	
+	double randGauss = sampler->rng->gaussian(chainID, rngProposal, 1./std::sqrt(scaling));	
 	if(proposedPosition->RJ){
 		for(int i = 0 ; i<blocks[alpha].size(); i++){
 			if(proposedPosition->status[blocks[alpha][i]]){
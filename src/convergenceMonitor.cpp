@@ -0,0 +1,321 @@
+#include "bayesship/convergenceMonitor.h"
+#include <gsl/gsl_cdf.h>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+/*! \file
+ *
+ * # Source file for monitoring the convergence of the cold chains while sampling
+ */
+
+namespace bayesship{
+
+/*! \brief Replace values with their normal scores -- z = Phi^-1((rank - 3/8)/(n + 1/4)), with ties given their average rank
+ */
+void rankNormalize(
+	double *values,/**< Values to transform -- shape [n]*/
+	int n,/**< Number of values*/
+	double *z/**< [out] Normal scores -- shape [n] (may be the same array as values)*/
+	)
+{
+	std::vector<int> order(n);
+	for(int i = 0 ; i<n; i++){
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b){return values[a] < values[b];});
+	std::vector<double> ranks(n);
+	int i = 0;
+	while(i<n){
+		int j = i;
+		while(j+1<n && values[order[j+1]] == values[order[i]]){
+			j++;
+		}
+		double rank = .5*(i+j) + 1;
+		for(int k = i ; k<=j; k++){
+			ranks[order[k]] = rank;
+		}
+		i = j+1;
+	}
+	for(int k = 0 ; k<n; k++){
+		z[k] = gsl_cdf_ugaussian_Pinv((ranks[k] - .375)/(n + .25));
+	}
+}
+
+/*! \brief Split each chain in half (dropping the middle draw if the length is odd), and pool the halves into one array -- shape [2*chainN][length/2]
+ */
+static std::vector<double> splitChains(double **chains, int chainN, int length)
+{
+	int half = length/2;
+	std::vector<double> split(2*chainN*half);
+	for(int i = 0 ; i<chainN; i++){
+		for(int j = 0 ; j<half; j++){
+			split[(2*i)*half + j] = chains[i][j];
+			split[(2*i+1)*half + j] = chains[i][length-half+j];
+		}
+	}
+	return split;
+}
+
+/*! \brief Between and within chain variances of a set of chains (pooled in one array) -- returns the within chain variance W, and sets varPlus to the marginal posterior variance estimate
+ */
+static double chainVariances(double *values, int chainN, int length, double *means, double *varPlus)
+{
+	double W = 0;
+	double grandMean = 0;
+	for(int i = 0 ; i<chainN; i++){
+		double mean = 0;
+		for(int j = 0 ; j<length; j++){
+			mean += values[i*length+j];
+		}
+		mean /= length;
+		double var = 0;
+		for(int j = 0 ; j<length; j++){
+			double d = values[i*length+j] - mean;
+			var += d*d;
+		}
+		W += var/(length-1);
+		means[i] = mean;
+		grandMean += mean;
+	}
+	W /= chainN;
+	grandMean /= chainN;
+	double B = 0;
+	if(chainN > 1){
+		for(int i = 0 ; i<chainN; i++){
+			B += (means[i]-grandMean)*(means[i]-grandMean);
+		}
+		B *= (double)length/(chainN-1);
+	}
+	*varPlus = (double)(length-1)/length*W + B/length;
+	return W;
+}
+
+static double rhatOfSplit(double *values, int chainN, int length)
+{
+	double means[chainN];
+	double varPlus;
+	double W = chainVariances(values, chainN, length, means, &varPlus);
+	if(W <= 0){
+		return std::numeric_limits<double>::infinity();
+	}
+	return sqrt(varPlus/W);
+}
+
+/*! \brief Rank-normalized split R-hat -- the larger of the bulk and folded (tail) values
+ *
+ * Returns infinity if the chains are too short (fewer than 4 draws each)
+ */
+double splitRhat(
+	double **chains,/**< Draws of one parameter -- shape [chainN][length]*/
+	int chainN,/**< Number of chains*/
+	int length/**< Draws per chain*/
+	)
+{
+	if(length < 4 || chainN < 1){
+		return std::numeric_limits<double>::infinity();
+	}
+	int half = length/2;
+	std::vector<double> split = splitChains(chains, chainN, length);
+	int n = split.size();
+
+	std::vector<double> folded(split);
+	std::vector<double> sorted(split);
+	std::nth_element(sorted.begin(), sorted.begin()+n/2, sorted.end());
+	double median = sorted[n/2];
+	for(int i = 0 ; i<n; i++){
+		folded[i] = fabs(folded[i] - median);
+	}
+
+	rankNormalize(split.data(), n, split.data());
+	rankNormalize(folded.data(), n, folded.data());
+	double bulk = rhatOfSplit(split.data(), 2*chainN, half);
+	double tail = rhatOfSplit(folded.data(), 2*chainN, half);
+	return std::max(bulk, tail);
+}
+
+/*! \brief Rank-normalized (bulk) multi-chain effective sample size, using Geyer's initial monotone sequence to truncate the autocorrelation sum
+ *
+ * Returns 0 if the chains are too short (fewer than 4 draws each)
+ */
+double multiChainESS(
+	double **chains,/**< Draws of one parameter -- shape [chainN][length]*/
+	int chainN,/**< Number of chains*/
+	int length/**< Draws per chain*/
+	)
+{
+	if(length < 4 || chainN < 1){
+		return 0;
+	}
+	int half = length/2;
+	int splitN = 2*chainN;
+	std::vector<double> split = splitChains(chains, chainN, length);
+	int n = split.size();
+	rankNormalize(split.data(), n, split.data());
+
+	double means[splitN];
+	double varPlus;
+	double W = chainVariances(split.data(), splitN, half, means, &varPlus);
+	if(W <= 0 || varPlus <= 0){
+		return 0;
+	}
+
+	/*Autocorrelation at lag t, combined over the chains*/
+	auto rho = [&](int t){
+		double acov = 0;
+		for(int i = 0 ; i<splitN; i++){
+			double *x = &split[i*half];
+			double sum = 0;
+			for(int j = 0 ; j<half-t; j++){
+				sum += (x[j]-means[i])*(x[j+t]-means[i]);
+			}
+			acov += sum/half;
+		}
+		acov /= splitN;
+		return 1. - (W - acov)/varPlus;
+	};
+
+	double sum = 0;
+	double previous = std::numeric_limits<double>::infinity();
+	for(int t = 0 ; t+1<half; t+=2){
+		double pair = ((t == 0) ? 1. : rho(t)) + rho(t+1);
+		if(pair <= 0){
+			break;
+		}
+		pair = std::min(pair, previous);
+		sum += pair;
+		previous = pair;
+	}
+	double tau = std::max(-1. + 2.*sum, 1./log10((double)n));
+	return n/tau;
+}
+
+//##########################################################
+//##########################################################
+
+/*! \brief Constructor -- nothing is kept until the first update
+ */
+convergenceMonitor::convergenceMonitor(
+	int chainN,/**< Number of chains to monitor (the cold chain of each ensemble)*/
+	int dimension,/**< Dimension of the parameter space*/
+	int maxDraws/**< Most draws to keep per chain*/
+	)
+{
+	this->chainN = chainN;
+	this->dimension = dimension;
+	this->maxDraws = std::max(maxDraws, 16);
+	draws = new std::vector<double>*[chainN];
+	nextStep = new int[chainN];
+	stepsSeen = new long long[chainN];
+	for(int i = 0 ; i<chainN; i++){
+		draws[i] = new std::vector<double>[dimension];
+		nextStep[i] = 0;
+		stepsSeen[i] = 0;
+	}
+	rhats = new double[dimension];
+	esss = new double[dimension];
+	for(int i = 0 ; i<dimension; i++){
+		rhats[i] = std::numeric_limits<double>::infinity();
+		esss[i] = 0;
+	}
+	rhat = std::numeric_limits<double>::infinity();
+}
+
+convergenceMonitor::~convergenceMonitor()
+{
+	for(int i = 0 ; i<chainN; i++){
+		delete [] draws[i];
+	}
+	delete [] draws;
+	delete [] nextStep;
+	delete [] stepsSeen;
+	delete [] rhats;
+	delete [] esss;
+}
+
+/*! \brief Drop every other kept draw, and keep half as many steps from here on
+ */
+void convergenceMonitor::thinDraws()
+{
+	for(int i = 0 ; i<chainN; i++){
+		for(int d = 0 ; d<dimension; d++){
+			std::vector<double> &x = draws[i][d];
+			size_t kept = 0;
+			for(size_t j = 0 ; j<x.size(); j+=2){
+				x[kept++] = x[j];
+			}
+			x.resize(kept);
+		}
+	}
+	thin *= 2;
+}
+
+/*! \brief Read the steps the cold chains have taken since the last update, and recompute rhat and ess
+ *
+ * The cold chain of ensemble i is chain i of data (see bayesshipSampler::chainIndex)
+ */
+void convergenceMonitor::update(
+	samplerData *data/**< Data being sampled into*/
+	)
+{
+	for(int i = 0 ; i<chainN; i++){
+		int current = data->currentStepID[i];
+		/*The data was restarted (ie, a new samplerData) -- read it from the beginning*/
+		if(current < nextStep[i] - 1){
+			nextStep[i] = 0;
+		}
+		for(int step = nextStep[i] ; step<=current; step++){
+			if(stepsSeen[i] % thin == 0){
+				positionInfo *position = data->getPosition(i, step);
+				for(int d = 0 ; d<dimension; d++){
+					draws[i][d].push_back(position->parameters[d]);
+				}
+				if((int)draws[i][0].size() >= maxDraws){
+					thinDraws();
+				}
+			}
+			stepsSeen[i]++;
+		}
+		nextStep[i] = current+1;
+	}
+
+	int length = draws[0][0].size();
+	for(int i = 1 ; i<chainN; i++){
+		length = std::min(length, (int)draws[i][0].size());
+	}
+	rhat = 0;
+	ess = std::numeric_limits<double>::infinity();
+	double *chains[chainN];
+	for(int d = 0 ; d<dimension; d++){
+		for(int i = 0 ; i<chainN; i++){
+			chains[i] = draws[i][d].data();
+		}
+		rhats[d] = splitRhat(chains, chainN, length);
+		esss[d] = multiChainESS(chains, chainN, length);
+		rhat = std::max(rhat, rhats[d]);
+		ess = std::min(ess, esss[d]);
+	}
+}
+
+/*! \brief Whether the last update met the targets -- a target <= 0 is ignored, and at least one target must be set
+ *
+ * The sampler checks after each batch (bayesshipSampler::targetRhat and targetESS), so the output is already written when it stops. If no batchSize is set, the run is split into batches of iterations/20 (at least 100)
+ */
+bool convergenceMonitor::converged(
+	double targetRhat,/**< Largest acceptable split R-hat*/
+	double targetESS/**< Smallest acceptable multi-chain ESS*/
+	)
+{
+	if(targetRhat <= 0 && targetESS <= 0){
+		return false;
+	}
+	if(targetRhat > 0 && !(rhat <= targetRhat)){
+		return false;
+	}
+	if(targetESS > 0 && !(ess >= targetESS)){
+		return false;
+	}
+	return true;
+}
+
+}
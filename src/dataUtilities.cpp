@@ -1,12 +1,25 @@
 #include "bayesship/dataUtilities.h"
 #include "bayesship/autocorrelationUtilities.h"
 #include "bayesship/utilities.h"
+#include "bayesship/temperatureLadder.h"
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <gsl/gsl_spline.h>
 #include <gsl/gsl_integration.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <stdio.h>
+#include <nlohmann/json.hpp>
 
 #ifdef _HDF5
 #include <H5Cpp.h>
@@ -270,14 +283,9 @@ void positionInfo::updatePosition(positionInfo *newPosition)
 	if(newPosition->dimension != dimension){
 		errorMessage("The dimensions do not match for two position objects!",2);
 	}
-	for(int i = 0 ; i<dimension; i++){
-		parameters[i] = newPosition->parameters[i];
-		
-	}
+	memcpy(parameters, newPosition->parameters, dimension*sizeof(double));
 	if( newPosition->status){
-		for(int i = 0 ; i<dimension; i++){
-			status[i] = newPosition->status[i];
-		}
+		memcpy(status, newPosition->status, dimension*sizeof(int));
 		modelID = newPosition->modelID;
 	}
 }
@@ -307,36 +315,27 @@ double integration_helper(double beta, void *params)
 	return likelihood;
 }
 
-void samplerData::calculateEvidence()
+/*! \brief log(exp(a) + exp(b)), without overflowing
+ */
+static double logAddExp(double a, double b)
 {
-	//double integratedLikelihoods[this->ensembleSize];
-	double betasLocal[this->ensembleSize];
-	for(int i = 0 ; i<ensembleSize; i++){
-
-		//For the integration, we have to reverse the order (ie, 0 -> 1 not 1 -> 0, which is how they're naturally stored)
-		int index = ensembleSize -1 -i;
-
-		integratedLikelihoods[index] = 0 ;
-		double norm = 0 ;
-		int chainIndex;
-		for(int j = 0 ; j<ensembleN; j++){
-			chainIndex = j + i*ensembleN;
-			for(int k = 0 ;k<currentStepID[chainIndex]; k++){
-				integratedLikelihoods[index]+=likelihoodVals[chainIndex][k];
-			}
-			norm+=currentStepID[chainIndex];
-		}		
-		integratedLikelihoods[index]/=norm;
-		betasLocal[index] = betas[chainIndex];
+	if(a == -std::numeric_limits<double>::infinity()){
+		return b;
 	}
-	//for(int i = 0 ; i<ensembleSize; i++){
-	//	std::cout<<betasLocal[i]<<" "<<integratedLikelihoods[i]<<std::endl;
-	//}
-
+	if(b == -std::numeric_limits<double>::infinity()){
+		return a;
+	}
+	return std::max(a,b) + log1p(exp(-fabs(a-b)));
+}
 
+/*! \brief Integrate the mean log likelihoods over beta (ascending) with a spline -- returns the GSL error code
+ */
+static int integrateLikelihoods(double *betasLocal, double *means, int n, double *result)
+{
 	gsl_interp_accel *acc = gsl_interp_accel_alloc();	
-	gsl_spline *spline = gsl_spline_alloc(gsl_interp_cspline, ensembleSize);
-	gsl_spline_init(spline, betasLocal, integratedLikelihoods, ensembleSize);
+	/*A cubic spline needs at least 3 rungs*/
+	gsl_spline *spline = gsl_spline_alloc(n>2 ? gsl_interp_cspline : gsl_interp_linear, n);
+	gsl_spline_init(spline, betasLocal, means, n);
 
 	helper_params params;
 	params.a = acc;
@@ -349,26 +348,228 @@ void samplerData::calculateEvidence()
 	gsl_integration_workspace *w = gsl_integration_workspace_alloc(5000);
 
 	double error;
-	//int errorcode = gsl_integration_qags(&F, betasLocal[0],betasLocal[ensembleSize-1],0,1e-7,5000,w, &evidence, &evidenceError);
-	int errorcode = gsl_integration_qag(&F, betasLocal[0],betasLocal[ensembleSize-1],0,1e-5,5000,6,w, &evidence, &evidenceError);
+	int errorcode = gsl_integration_qag(&F, betasLocal[0],betasLocal[n-1],0,1e-5,5000,6,w, result, &error);
 	gsl_integration_workspace_free(w);
 	gsl_spline_free(spline);
 	gsl_interp_accel_free(acc);
+	return errorcode;
+}
+
+/*! \brief Fold the current step of chainID into the running evidence accumulators
+ *
+ * Called by the sampler as the chain moves on from the step, so the accumulators see steps 0 through currentStepID-1 of every batch -- the same rows that are written out (a swap at the step doesn't change the chain's own row, see swapCurrent). The cost per step is O(1), and calculateEvidence only touches the accumulators
+ */
+void samplerData::accumulateLikelihood(int chainID)
+{
+	double logL = likelihoodVals[chainID][currentStepID[chainID]];
+	long long n = ++likelihoodN[chainID];
+	double delta = logL - likelihoodMean[chainID];
+	likelihoodMean[chainID] += delta/n;
+	likelihoodM2[chainID] += delta*(logL - likelihoodMean[chainID]);
+	likelihoodMax[chainID] = std::max(likelihoodMax[chainID], logL);
+	likelihoodACs[chainID].add(logL);
+	/*The next colder rung of the same ensemble is chainID - ensembleN*/
+	if(chainID >= ensembleN){
+		double x = (betas[chainID-ensembleN] - betas[chainID])*logL;
+		steppingStoneLogSum[chainID] = logAddExp(steppingStoneLogSum[chainID], x);
+		steppingStoneLogSum2[chainID] = logAddExp(steppingStoneLogSum2[chainID], 2*x);
+	}
+}
+
+/*! \brief Calculate the log evidence from the running accumulators of every chain (see accumulateLikelihood) -- O(chainN), however long the run
+ *
+ * Works from snapshot if given (see snapshotEvidence), else from a fresh snapshot of the accumulators
+ *
+ * evidence is the thermodynamic integral of the mean log likelihood of each rung (pooled over ensembles) over beta, and steppingStoneEvidence is the product over adjacent rungs of the mean of L^(dBeta) under the hotter rung. Both span the ladder, from the hottest beta to 1.
+ *
+ * evidenceError and steppingStoneEvidenceError propagate the variance of each rung's mean, inflated by the integrated autocorrelation time of its log likelihood (batch means), through trapezoid weights and the delta method respectively. With more than one ensemble, the ensembles are also resampled bootstrapReplicates times (the replicates run in parallel over threads) for evidenceBootstrapError and steppingStoneBootstrapError
+ */
+void samplerData::calculateEvidence(int threads, evidenceSnapshot *snapshot)
+{
+	if(!likelihoodN || ensembleSize < 2){
+		return;
+	}
+	evidenceSnapshot localSnapshot;
+	if(!snapshot){
+		snapshotEvidence(&localSnapshot);
+		snapshot = &localSnapshot;
+	}
+	std::vector<long long> &likelihoodN = snapshot->likelihoodN;
+	std::vector<double> &likelihoodMean = snapshot->likelihoodMean;
+	std::vector<double> &likelihoodM2 = snapshot->likelihoodM2;
+	std::vector<double> &steppingStoneLogSum = snapshot->steppingStoneLogSum;
+	std::vector<double> &steppingStoneLogSum2 = snapshot->steppingStoneLogSum2;
+	double betasLocal[this->ensembleSize];
+	for(int i = 0 ; i<ensembleSize; i++){
+		//For the integration, we have to reverse the order (ie, 0 -> 1 not 1 -> 0, which is how they're naturally stored)
+		betasLocal[ensembleSize-1-i] = betas[i*ensembleN];
+	}
+	/*Pool the accumulators of the given ensembles (repeats allowed) rung by rung -- false if a rung has no steps yet*/
+	auto poolRungs = [&](int *ensembles, double *means, double *ssTerms){
+		for(int i = 0 ; i<ensembleSize; i++){
+			int index = ensembleSize -1 -i;
+			double norm = 0;
+			double sum = 0;
+			double logSum = -std::numeric_limits<double>::infinity();
+			for(int j = 0 ; j<ensembleN; j++){
+				int chainIndex = ensembles[j] + i*ensembleN;
+				norm += likelihoodN[chainIndex];
+				sum += likelihoodN[chainIndex]*likelihoodMean[chainIndex];
+				logSum = logAddExp(logSum, steppingStoneLogSum[chainIndex]);
+			}
+			if(norm == 0){
+				return false;
+			}
+			means[index] = sum/norm;
+			ssTerms[index] = logSum - log(norm);
+		}
+		return true;
+	};
+	auto steppingStone = [&](double *ssTerms){
+		double total = 0;
+		/*The coldest rung has no colder neighbor*/
+		for(int index = 0 ; index<ensembleSize-1; index++){
+			total += ssTerms[index];
+		}
+		return total;
+	};
+
+	int ensembles[ensembleN];
+	for(int j = 0 ; j<ensembleN; j++){
+		ensembles[j] = j;
+	}
+	double ssTerms[ensembleSize];
+	if(!poolRungs(ensembles, integratedLikelihoods, ssTerms)){
+		return;
+	}
+	int errorcode = integrateLikelihoods(betasLocal, integratedLikelihoods, ensembleSize, &evidence);
 	if (errorcode !=0){
 		std::cout<<"GSL integration error code for evidence calculation (Evidence will not be calculated): "<<errorcode<<std::endl;
 		return;
 	}
+	steppingStoneEvidence = steppingStone(ssTerms);
+
+	/*Batch means errors*/
+	double tiVariance = 0;
+	double ssVariance = 0;
+	for(int i = 0 ; i<ensembleSize; i++){
+		int index = ensembleSize -1 -i;
+		double norm = 0;
+		double M2 = 0;
+		double tau = 0;
+		double logSum = -std::numeric_limits<double>::infinity();
+		double logSum2 = -std::numeric_limits<double>::infinity();
+		for(int j = 0 ; j<ensembleN; j++){
+			int chainIndex = j + i*ensembleN;
+			double offset = likelihoodMean[chainIndex] - integratedLikelihoods[index];
+			norm += likelihoodN[chainIndex];
+			M2 += likelihoodM2[chainIndex] + likelihoodN[chainIndex]*offset*offset;
+			tau += likelihoodN[chainIndex]*snapshot->likelihoodTau[chainIndex];
+			logSum = logAddExp(logSum, steppingStoneLogSum[chainIndex]);
+			logSum2 = logAddExp(logSum2, steppingStoneLogSum2[chainIndex]);
+		}
+		tau /= norm;
+		integratedLikelihoodVariances[index] = (norm > 1) ? M2/(norm-1)*tau/norm : 0;
+
+		double lower = betasLocal[std::max(index-1,0)];
+		double upper = betasLocal[std::min(index+1,ensembleSize-1)];
+		double weight = .5*(upper - lower);
+		tiVariance += weight*weight*integratedLikelihoodVariances[index];
+		if(index < ensembleSize-1){
+			/*var(w)/mean(w)^2 for w = exp(dBeta*logL)*/
+			double relativeVariance = std::max(exp(log(norm) + logSum2 - 2*logSum) - 1, 0.);
+			ssVariance += relativeVariance*tau/norm;
+		}
+	}
+	evidenceError = sqrt(tiVariance);
+	steppingStoneEvidenceError = sqrt(ssVariance);
+
+	/*Bootstrap over ensembles*/
+	evidenceBootstrapError = 0;
+	steppingStoneBootstrapError = 0;
+	if(ensembleN > 1 && bootstrapReplicates > 1){
+		std::vector<double> tiReplicates(bootstrapReplicates);
+		std::vector<double> ssReplicates(bootstrapReplicates);
+		std::vector<int> valid(bootstrapReplicates);
+		#pragma omp parallel for num_threads(std::max(threads,1))
+		for(int b = 0 ; b<bootstrapReplicates; b++){
+			std::mt19937 gen(b);
+			std::uniform_int_distribution<int> pick(0, ensembleN-1);
+			int resampled[ensembleN];
+			for(int j = 0 ; j<ensembleN; j++){
+				resampled[j] = pick(gen);
+			}
+			double means[ensembleSize];
+			double terms[ensembleSize];
+			valid[b] = poolRungs(resampled, means, terms) 
+				&& integrateLikelihoods(betasLocal, means, ensembleSize, &tiReplicates[b]) == 0;
+			ssReplicates[b] = steppingStone(terms);
+		}
+		double tiMean = 0, tiM2 = 0, ssMean = 0, ssM2 = 0;
+		int count = 0;
+		for(int b = 0 ; b<bootstrapReplicates; b++){
+			if(!valid[b]){
+				continue;
+			}
+			count++;
+			double delta = tiReplicates[b] - tiMean;
+			tiMean += delta/count;
+			tiM2 += delta*(tiReplicates[b] - tiMean);
+			delta = ssReplicates[b] - ssMean;
+			ssMean += delta/count;
+			ssM2 += delta*(ssReplicates[b] - ssMean);
+		}
+		if(count > 1){
+			evidenceBootstrapError = sqrt(tiM2/(count-1));
+			steppingStoneBootstrapError = sqrt(ssM2/(count-1));
+		}
+	}
 
 	calculatedEvidence = true;
 	return;
-	
+}
+
+/*! \brief Copy the evidence accumulators of every chain, for calculateEvidence -- O(chainN)
+ */
+void samplerData::snapshotEvidence(evidenceSnapshot *snapshot)
+{
+	snapshot->likelihoodN.assign(likelihoodN, likelihoodN+chainN);
+	snapshot->likelihoodMean.assign(likelihoodMean, likelihoodMean+chainN);
+	snapshot->likelihoodM2.assign(likelihoodM2, likelihoodM2+chainN);
+	snapshot->steppingStoneLogSum.assign(steppingStoneLogSum, steppingStoneLogSum+chainN);
+	snapshot->steppingStoneLogSum2.assign(steppingStoneLogSum2, steppingStoneLogSum2+chainN);
+	snapshot->likelihoodTau.resize(chainN);
+	for(int i = 0 ; i<chainN; i++){
+		snapshot->likelihoodTau[i] = likelihoodACs[i].integratedTime();
+	}
+}
 
+/*! \brief Mean and max of the log likelihood of the cold chains, over the steps folded into the evidence accumulators -- O(ensembleN)
+ */
+void samplerData::coldLikelihoodSummary(double *mean, double *max)
+{
+	double sum = 0;
+	double norm = 0;
+	*max = -std::numeric_limits<double>::infinity();
+	for(int i = 0 ; i<ensembleN; i++){
+		sum += likelihoodN[i]*likelihoodMean[i];
+		norm += likelihoodN[i];
+		*max = std::max(*max, likelihoodMax[i]);
+	}
+	*mean = (norm > 0) ? sum/norm : 0;
 }
 
 void samplerData::writeStatFile(std::string filename)
 {
 	std::ofstream outFile;
 	outFile.open(filename);
+	writeStatFile(outFile);
+}
+
+/*! \brief Write the stat file contents to a stream -- eg, a std::ostringstream, to snapshot the statistics while the chains keep sampling
+ */
+void samplerData::writeStatFile(std::ostream &outFile)
+{
 	outFile<<"Proposal Attempts [chain #][proposal #, Total steps]"<<std::endl;
 	for(int i = 0 ; i<chainN; i++){
 		int total = 0;
@@ -409,10 +610,16 @@ void samplerData::writeStatFile(std::string filename)
 	for(int i = 0 ; i<proposalFnN; i++){
 		timeAve[i] = 0;
 	}
+	/*Steps taken by each chain (every step evaluates the prior once)*/
+	int steps[chainN];
 	for(int i = 0 ; i<chainN; i++){
+		steps[i] = 0;
 		for(int j = 0 ; j<proposalFnN; j++){
-			outFile<< proposalTimes[i][j]<<", ";
-			timeAve[j]+=proposalTimes[i][j];
+			int calls = successN[i][j]+rejectN[i][j];
+			steps[i]+=calls;
+			double time = (calls > 0) ? proposalTimes[i][j]/calls : 0;
+			outFile<< time<<", ";
+			timeAve[j]+=time;
 		}
 		outFile<<std::endl;
 	}
@@ -429,10 +636,12 @@ void samplerData::writeStatFile(std::string filename)
 	double timeAveL=0;
 	double timeAveP=0;
 	for(int i = 0 ; i<chainN; i++){
-		outFile<< priorTimes[i]<<", ";
-		outFile<< likelihoodTimes[i];
-		timeAveL+=likelihoodTimes[i];
-		timeAveP+=priorTimes[i];
+		double timeP = (steps[i] > 0) ? priorTimes[i]/steps[i] : 0;
+		double timeL = (likelihoodEvals[i] > 0) ? likelihoodTimes[i]/likelihoodEvals[i] : 0;
+		outFile<< timeP<<", ";
+		outFile<< timeL;
+		timeAveL+=timeL;
+		timeAveP+=timeP;
 		outFile<<std::endl;
 	}
 	outFile<<std::endl;
@@ -442,6 +651,24 @@ void samplerData::writeStatFile(std::string filename)
 	outFile<<std::endl;
 	outFile<<std::endl;
 
+	int surrogateRejectTotal = 0;
+	for(int i = 0 ; i<chainN; i++){
+		surrogateRejectTotal+=surrogateRejectN[i];
+	}
+	if(surrogateRejectTotal > 0){
+		outFile<<"Delayed Acceptance [chain #][First stage rejections, Likelihood evaluations, First stage rejection fraction]"<<std::endl;
+		for(int i = 0 ; i<chainN; i++){
+			int screened = surrogateRejectN[i] + likelihoodEvals[i];
+			double rate = 0;
+			if(screened > 0){
+				rate = (double)surrogateRejectN[i] / screened;
+			}
+			outFile<< surrogateRejectN[i]<<", "<<likelihoodEvals[i]<<", "<<rate;
+			outFile<<std::endl;
+		}
+		outFile<<std::endl;
+	}
+
 	outFile<<"Swap Acceptance Fractions [chain #][chain #]"<<std::endl;
 	double swapAve[chainN];
 	double swapAveUp[chainN];
@@ -508,6 +735,39 @@ void samplerData::writeStatFile(std::string filename)
 	}
 	outFile<<std::endl;
 
+	if(ensembleSize > 1){
+		outFile<<"Round Trips [replica #][Round trips, Mean round trip time (steps)]"<<std::endl;
+		int tripTotal = 0;
+		long long tripStepTotal = 0;
+		for(int i = 0 ; i<chainN; i++){
+			double meanTrip = (roundTrips[i] > 0) ? (double)roundTripSteps[i]/roundTrips[i] : 0;
+			outFile<<roundTrips[i]<<", "<<meanTrip<<std::endl;
+			tripTotal+=roundTrips[i];
+			tripStepTotal+=roundTripSteps[i];
+		}
+		outFile<<std::endl;
+		outFile<<"Round Trip Totals [Round trips, Mean round trip time (steps)]"<<std::endl;
+		outFile<<tripTotal<<", "<<((tripTotal > 0) ? (double)tripStepTotal/tripTotal : 0)<<std::endl;
+		outFile<<std::endl;
+
+		int pairs = ensembleSize-1;
+		double rejection[pairs];
+		ladderRejectionRates(this, rejection);
+		outFile<<"Communication Barrier [rung pair #][Beta_k, Beta_k+1, Rejection, Cumulative barrier]"<<std::endl;
+		double cumulative = 0;
+		for(int k = 0 ; k<pairs; k++){
+			if(rejection[k] > 0){
+				cumulative+=rejection[k];
+			}
+			outFile<<betas[k*ensembleN]<<", "<<betas[(k+1)*ensembleN]<<", "<<rejection[k]<<", "<<cumulative<<std::endl;
+		}
+		outFile<<std::endl;
+		double barrier = communicationBarrier(rejection, pairs);
+		outFile<<"Global Barrier ||| Suggested ensembleSize"<<std::endl;
+		outFile<<barrier<<" ||| "<<suggestEnsembleSize(barrier)<<std::endl;
+		outFile<<std::endl;
+	}
+
 	//outFile<<"Swap Averages"<<std::endl;
 	//for(int i = 0 ; i<chainN; i++){
 	//	outFile<<swapAve[i]/aveCounts[i]<<", ";
@@ -537,90 +797,688 @@ void samplerData::writeStatFile(std::string filename)
 	//}
 	//outFile<<std::endl;
 
-	outFile.close();
 }
 
+/*! \brief Follow the replicas through an accepted swap between chainID1 and chainID2, and count the round trips completed
+ *
+ * A round trip starts when a replica leaves the coldest rung, and ends once it's back after visiting the hottest. The two chains must not be touched by another thread at the same time (true for both the swap thread and the even-odd sweeps)
+ */
+void samplerData::recordSwap(int chainID1, int chainID2)
+{
+	std::swap(replicaIDs[chainID1], replicaIDs[chainID2]);
+	int chains[2] = {chainID1, chainID2};
+	for(int i = 0 ; i<2; i++){
+		int replica = replicaIDs[chains[i]];
+		int rung = chains[i]/ensembleN;
+		int step = currentStepID[chains[i]];
+		if(rung == 0){
+			if(replicaDirection[replica] == -1 && replicaTripStart[replica] >= 0){
+				roundTrips[replica]++;
+				roundTripSteps[replica]+= step - replicaTripStart[replica];
+			}
+			if(replicaDirection[replica] != 1){
+				replicaTripStart[replica] = step;
+			}
+			replicaDirection[replica] = 1;
+		}
+		else if(rung == ensembleSize-1){
+			replicaDirection[replica] = -1;
+		}
+	}
+}
+
+/*! \brief Exchange the current states of chainID1 and chainID2 -- O(1), only the redirections (swapSourceChainID and swapSourceStepID) and the cached surrogate values (currentSurrogate) change
+ *
+ * Each chain's own row at its current step keeps the state from before the swap, which is what's recorded for that step. The next step of each chain reads the swapped state through currentPosition, currentLikelihood, and currentPrior
+ */
+void samplerData::swapCurrent(int chainID1, int chainID2)
+{
+	int sourceChain1 = (swapSourceChainID[chainID1] < 0) ? chainID1 : swapSourceChainID[chainID1];
+	int sourceStep1 = (swapSourceChainID[chainID1] < 0) ? currentStepID[chainID1] : swapSourceStepID[chainID1];
+	int sourceChain2 = (swapSourceChainID[chainID2] < 0) ? chainID2 : swapSourceChainID[chainID2];
+	int sourceStep2 = (swapSourceChainID[chainID2] < 0) ? currentStepID[chainID2] : swapSourceStepID[chainID2];
+	/*A state that comes back to its own row needs no redirection*/
+	bool home1 = sourceChain2 == chainID1 && sourceStep2 == currentStepID[chainID1];
+	bool home2 = sourceChain1 == chainID2 && sourceStep1 == currentStepID[chainID2];
+	swapSourceChainID[chainID1] = home1 ? -1 : sourceChain2;
+	swapSourceStepID[chainID1] = sourceStep2;
+	swapSourceChainID[chainID2] = home2 ? -1 : sourceChain1;
+	swapSourceStepID[chainID2] = sourceStep1;
+	std::swap(currentSurrogate[chainID1], currentSurrogate[chainID2]);
+}
+
+/*! \brief Copy the swapped current states of chainIDs (every chain if null) into their own rows, and drop the redirections
+ *
+ * Needed before a chain's rows can be rewritten while another chain may still read its current state from them (the thread pool sampler restarting hot chains, or stopping cold ones). chainIDs must include every chain redirected into one of their rows
+ */
+void samplerData::settleSwaps(
+	int *chainIDs,/**< Chains to settle -- nullptr for every chain*/
+	int n/**< Number of chainIDs*/
+	)
+{
+	if(!chainIDs){
+		n = chainN;
+	}
+	std::vector<int> redirected;
+	for(int i = 0 ; i<n; i++){
+		int chainID = chainIDs ? chainIDs[i] : i;
+		if(swapSourceChainID[chainID] >= 0){
+			redirected.push_back(chainID);
+		}
+	}
+	if(redirected.size() == 0){
+		return;
+	}
+	/*Gather everything first -- the states can be in each other's rows*/
+	std::vector<positionInfo *> states(redirected.size());
+	std::vector<double> likelihoods(redirected.size());
+	std::vector<double> priors(redirected.size());
+	for(size_t i = 0 ; i<redirected.size(); i++){
+		states[i] = new positionInfo(maxDim, RJ);
+		states[i]->updatePosition(currentPosition(redirected[i]));
+		likelihoods[i] = currentLikelihood(redirected[i]);
+		priors[i] = currentPrior(redirected[i]);
+	}
+	for(size_t i = 0 ; i<redirected.size(); i++){
+		int chainID = redirected[i];
+		int step = currentStepID[chainID];
+		if(runLength){
+			/*The chain's row may be shared with its earlier steps, so the state gets a new one*/
+			positions[chainID][step] = stateRow(chainID, stateN[chainID]++);
+		}
+		positions[chainID][step]->updatePosition(states[i]);
+		likelihoodVals[chainID][step] = likelihoods[i];
+		priorVals[chainID][step] = priors[i];
+		setCurrentStep(chainID, step);
+		delete states[i];
+	}
+}
+
+/*! \brief Extend the storage by additionalIterations steps for each chain
+ *
+ * New segments are appended, so none of the existing history is copied (only the pointer tables and likelihood/prior columns are reallocated, and those grow by doubling)
+ */
 void samplerData::extendSize(int additionalIterations)
 {
 	int newSize = additionalIterations+iterations;
-	positionInfo ***tempPositions = new positionInfo**[chainN];
+	reserveSteps(newSize);
 	for(int i = 0 ; i<chainN; i++){
-		tempPositions[i] = new positionInfo*[newSize];
-		for(int j = 0 ;j<newSize; j++){
-			tempPositions[i][j] = new positionInfo(maxDim,RJ);
+		if(runLength){
+			/*Rows are added as states are, so only the proposal row has to be set up*/
+			prepareProposalRow(i);
+			continue;
+		}
+		while((int)segments[i].size()*segmentSteps < newSize){
+			appendSegment(i);
 		}
 	}
-	//###########################
+	iterations= newSize;
+	return;
+}
+
+/*! \brief Make sure the pointer tables and likelihood/prior columns can hold at least steps steps for each chain
+ *
+ * The capacity is always a multiple of segmentSteps
+ */
+void samplerData::reserveSteps(int steps)
+{
+	if(steps <= capacity){
+		return;
+	}
+	int newCapacity = 2*capacity;
+	if(newCapacity < steps){
+		newCapacity = steps;
+	}
+	newCapacity = ((newCapacity + segmentSteps -1 )/segmentSteps)*segmentSteps;
 	for(int i = 0 ; i<chainN; i++){
-		for(int j = 0 ;j<=currentStepID[i]; j++){
-			tempPositions[i][j]->updatePosition(positions[i][j]);	
+		positionInfo **tempPositions = new positionInfo*[newCapacity];
+		double *tempLL = new double[newCapacity];
+		double *tempLP = new double[newCapacity];
+		if(capacity > 0){
+			memcpy(tempPositions, positions[i], capacity*sizeof(positionInfo *));
+			memcpy(tempLL, likelihoodVals[i], capacity*sizeof(double));
+			memcpy(tempLP, priorVals[i], capacity*sizeof(double));
+			delete [] positions[i];
+			delete [] likelihoodVals[i];
+			delete [] priorVals[i];
 		}
+		positions[i] = tempPositions;
+		likelihoodVals[i] = tempLL;
+		priorVals[i] = tempLP;
 	}
-	//###########################
-	for(int j = 0 ; j<chainN; j++){
-		for(int i = 0 ; i<iterations; i++){
-			delete positions[j][i];
+	capacity = newCapacity;
+	return;
+}
+
+/*! \brief Add a segment of segmentSteps steps (or states, with runLength) to the end of chainID's storage
+ */
+void samplerData::appendSegment(int chainID)
+{
+	storageSegment segment;
+	void *block = nullptr;
+	if(posix_memalign(&block, 64, segmentSteps*maxDim*sizeof(double)) != 0){
+		errorMessage("Could not allocate storage segment",2);
+	}
+	segment.parameters = (double *)block;
+	if(RJ){
+		if(posix_memalign(&block, 64, segmentSteps*maxDim*sizeof(int)) != 0){
+			errorMessage("Could not allocate storage segment",2);
+		}
+		segment.status = (int *)block;
+	}
+	/*One spare view at the end, so no row of another segment ever looks like it follows on from this one's last row (see positionBlock)*/
+	segment.views = new positionInfo[segmentSteps+1];
+	int firstStep = segments[chainID].size()*segmentSteps;
+	for(int j = 0 ; j<segmentSteps; j++){
+		segment.views[j].setView(maxDim, RJ, segment.parameters + j*maxDim, (RJ) ? segment.status + j*maxDim : nullptr);
+		if(!runLength){
+			positions[chainID][firstStep+j] = &segment.views[j];
+		}
+	}
+	segments[chainID].push_back(segment);
+	return;
+}
+
+/*! \brief runLength only -- row (state) row of chainID, adding segments if it doesn't exist yet
+ *
+ * Only the thread stepping chainID may add its rows
+ */
+positionInfo *samplerData::stateRow(int chainID, int row)
+{
+	while((int)segments[chainID].size()*segmentSteps <= row){
+		appendSegment(chainID);
+	}
+	return &segments[chainID][row/segmentSteps].views[row%segmentSteps];
+}
+
+/*! \brief runLength only -- index of the row of chainID that position points at
+ */
+int samplerData::rowOf(int chainID, positionInfo *position)
+{
+	for(int i = 0 ; i<(int)segments[chainID].size(); i++){
+		positionInfo *views = segments[chainID][i].views;
+		if(position >= views && position < views + segmentSteps){
+			return i*segmentSteps + (position - views);
 		}
-		delete [] positions[j];
 	}
-	delete [] positions;
+	return -1;
+}
 
-	positions = tempPositions;	
+/*! \brief runLength only -- point the step after the current one of chainID at its proposal row (row stateN[chainID])
+ */
+void samplerData::prepareProposalRow(int chainID)
+{
+	int step = currentStepID[chainID]+1;
+	if(step < capacity){
+		positions[chainID][step] = stateRow(chainID, stateN[chainID]);
+	}
+}
 
-	//###########################
+/*! \brief Make the next step of chainID a repeat of its current state (a rejected proposal -- the chain still has to be moved there with setCurrentStep)
+ *
+ * With runLength this only points the step at the current state's row, unless the current state is in another chain's storage (see swapSourceChainID)
+ */
+void samplerData::rejectProposal(int chainID)
+{
+	int step = currentStepID[chainID];
+	if(!runLength){
+		positions[chainID][step+1]->updatePosition(currentPosition(chainID));
+		return;
+	}
+	if(swapSourceChainID[chainID] >= 0){
+		positions[chainID][step+1]->updatePosition(currentPosition(chainID));
+		stateN[chainID]++;
+		return;
+	}
+	positions[chainID][step+1] = positions[chainID][step];
+}
 
-	double **tempLL = new double*[chainN];
-	double **tempLP = new double*[chainN];
-	for(int i = 0 ; i<chainN; i++){
-		tempLL[i] = new double[newSize];
-		tempLP[i] = new double[newSize];
-		for(int j = 0 ; j<=currentStepID[i];j++){
-			tempLL[i][j]= likelihoodVals[i][j];
-			tempLP[i][j]= priorVals[i][j];
+/*! \brief Start chainID over from state at step, dropping everything after it (state is copied, so it may be one of the chain's own positions)
+ *
+ * With runLength, the rows of the dropped steps are reused, so no other chain may still be redirected into them (see settleSwaps)
+ */
+void samplerData::restartChain(
+	int chainID,/**< Chain to restart*/
+	int step,/**< Step the chain restarts on*/
+	positionInfo *state,/**< State to restart from*/
+	double logLikelihood,/**< Log likelihood of state*/
+	double logPrior/**< Log prior of state*/
+	)
+{
+	if(!runLength){
+		positions[chainID][step]->updatePosition(state);
+	}
+	else{
+		positionInfo temp(maxDim, RJ);
+		temp.updatePosition(state);
+		stateN[chainID] = (step > 0) ? rowOf(chainID, positions[chainID][step-1])+1 : 0;
+		positions[chainID][step] = stateRow(chainID, stateN[chainID]++);
+		positions[chainID][step]->updatePosition(&temp);
+	}
+	likelihoodVals[chainID][step] = logLikelihood;
+	priorVals[chainID][step] = logPrior;
+	currentSurrogate[chainID] = std::numeric_limits<double>::quiet_NaN();
+	setCurrentStep(chainID, step);
+}
+
+/*! \brief Zero-copy access to the parameters of chainID starting at step -- rows is set to the number of contiguous steps ([rows][maxDim]) available at the returned pointer
+ */
+double *samplerData::parameterBlock(int chainID, int step, int *rows)
+{
+	return positionBlock(chainID, step, rows)->parameters;
+}
+
+/*! \brief Zero-copy access to the status of chainID starting at step (RJ only) -- rows is set to the number of contiguous steps ([rows][maxDim]) available at the returned pointer
+ */
+int *samplerData::statusBlock(int chainID, int step, int *rows)
+{
+	return positionBlock(chainID, step, rows)->status;
+}
+
+/*! \brief Positions of chainID starting at step, for reading long stretches of history -- rows is set to the number of consecutive steps available at the returned pointer (the parameters and status of those steps are contiguous as well)
+ *
+ * Spilled history is read back a whole segment at a time into the calling thread's cache, which holds spillCacheSegments segments. With runLength, the block ends at the first repeated state (or the end of the chain's history)
+ */
+positionInfo *samplerData::positionBlock(int chainID, int step, int *rows)
+{
+	if(runLength){
+		int lastStep = endStepIDs ? endStepIDs[chainID] : currentStepID[chainID]+1;
+		positionInfo *first = positions[chainID][step];
+		*rows = 1;
+		while(step + *rows < lastStep && positions[chainID][step + *rows] == first + *rows){
+			(*rows)++;
 		}
+		return first;
+	}
+	int row = step%segmentSteps;
+	*rows = segmentSteps - row;
+	if(spilling && segments[chainID][step/segmentSteps].spilled){
+		return pageIn(chainID, step/segmentSteps) + row;
+	}
+	return &segments[chainID][step/segmentSteps].views[row];
+}
+
+static void spillThreadedFunction(int threadID, spillJob job)
+{
+	job.data->writeSpilledSegment(job);
+}
+
+/*! \brief Keep at most (roughly) maxResidentSteps steps per chain in memory -- older segments are written to filename by a background thread and released
+ *
+ * Only the parameters and status are spilled -- the likelihood and prior columns stay in memory. Spilled history can still be read with getPosition, positionBlock, parameterBlock, and statusBlock (but not directly through positions)
+ */
+void samplerData::enableSpilling(
+	std::string filename,/**< Scratch file for the spilled segments (removed when this object is destroyed)*/
+	int maxResidentSteps/**< Number of recent steps per chain that always stay in memory*/
+	)
+{
+	if(spilling){
+		return;
+	}
+	if(runLength){
+		std::cout<<"WARNING -- Spilling isn't supported with run length storage -- keeping all history in memory"<<std::endl;
+		return;
+	}
+	spillFile = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(spillFile < 0){
+		std::cout<<"ERROR -- Could not open spill file "<<filename<<" -- keeping all history in memory"<<std::endl;
+		return;
+	}
+	this->spillFilename = filename;
+	this->maxResidentSteps = maxResidentSteps;
+	static std::atomic<long long> spillIDs(0);
+	this->spillID = spillIDs++;
+	spillPool = new ThreadPool<spillJob>(1, spillThreadedFunction);
+	spilling = true;
+}
+
+/*! \brief Hand segments older than the resident window to the background writer, and release the segments it has finished writing
+ *
+ * Segments are released one call after they're queued, so nothing is freed while it might still be in use. Must not be called while the chains are stepping
+ *
+ * The sampler calls this between batches when bayesshipSampler::maxResidentSteps is set, so the writing overlaps the next batch. Spilled steps are read back by getPosition when a proposal needs them
+ */
+void samplerData::spillHistory()
+{
+	if(!spilling){
+		return;
 	}
+	/*Wait for the outstanding writes*/
+	spillPool->stopPool();
 	for(int i = 0 ; i<chainN; i++){
-		delete [] likelihoodVals[i];
+		for(size_t j = 0 ; j<segments[i].size(); j++){
+			storageSegment *segment = &segments[i][j];
+			if(segment->spillQueued && !segment->spilled){
+				free(segment->parameters);
+				free(segment->status);
+				delete [] segment->views;
+				segment->parameters = nullptr;
+				segment->status = nullptr;
+				segment->views = nullptr;
+				for(int k = 0 ; k<segmentSteps; k++){
+					positions[i][j*segmentSteps + k] = nullptr;
+				}
+				segment->spilled = true;
+			}
+		}
+	}
+	long long segmentBytes = (long long)segmentSteps*maxDim*sizeof(double);
+	if(RJ){
+		segmentBytes += (long long)segmentSteps*(maxDim+1)*sizeof(int);
 	}
-	delete [] likelihoodVals;
 	for(int i = 0 ; i<chainN; i++){
-		delete [] priorVals[i];
+		int segmentLimit = (currentStepID[i] - maxResidentSteps)/segmentSteps;
+		for(int j = 0 ; j<segmentLimit && j<(int)segments[i].size(); j++){
+			if(!segments[i][j].spillQueued){
+				segments[i][j].spillQueued = true;
+				segments[i][j].spillOffset = spillFileSize;
+				spillFileSize += segmentBytes;
+				spillJob job;
+				job.data = this;
+				job.parameters = segments[i][j].parameters;
+				job.status = segments[i][j].status;
+				job.views = segments[i][j].views;
+				job.offset = segments[i][j].spillOffset;
+				spillPool->enqueue(job);
+			}
+		}
 	}
-	delete [] priorVals;
-	likelihoodVals = tempLL;
-	priorVals = tempLP;
+	spillPool->startPool();
+}
 
-	iterations= newSize;
-	return;
+/*! \brief Write a queued segment to the spill file (called by the background writer)
+ *
+ * Only touches the buffers in job, which aren't released until the writer has been stopped (spillHistory), so the chains' segment tables can grow in the meantime
+ */
+void samplerData::writeSpilledSegment(
+	const spillJob &job/**< Segment to write*/
+	)
+{
+	size_t parameterBytes = (size_t)segmentSteps*maxDim*sizeof(double);
+	if(pwrite(spillFile, job.parameters, parameterBytes, job.offset) != (ssize_t)parameterBytes){
+		std::cout<<"ERROR -- Failed writing to spill file "<<spillFilename<<std::endl;
+	}
+	if(RJ){
+		size_t statusBytes = (size_t)segmentSteps*maxDim*sizeof(int);
+		if(pwrite(spillFile, job.status, statusBytes, job.offset + parameterBytes) != (ssize_t)statusBytes){
+			std::cout<<"ERROR -- Failed writing to spill file "<<spillFilename<<std::endl;
+		}
+		int *modelIDs = new int[segmentSteps];
+		for(int j = 0 ; j<segmentSteps; j++){
+			modelIDs[j] = job.views[j].modelID;
+		}
+		if(pwrite(spillFile, modelIDs, segmentSteps*sizeof(int), job.offset + parameterBytes + statusBytes) != (ssize_t)(segmentSteps*sizeof(int))){
+			std::cout<<"ERROR -- Failed writing to spill file "<<spillFilename<<std::endl;
+		}
+		delete [] modelIDs;
+	}
+}
+
+const int samplerData::spillCacheSegments;
+const int samplerData::spillCacheRows;
+
+/*! \brief Segment of a chain that has been read back from a spill file
+ */
+struct spillCacheSlot{
+	/*! samplerData::spillID of the data the segment belongs to (-1 if empty)*/
+	long long spillID=-1;
+	int chainID=-1;
+	int segmentID=-1;
+	std::vector<double> parameters;
+	std::vector<int> status;
+	std::vector<positionInfo> views;
+	/*! Counter value at the last access, for least-recently-used eviction*/
+	unsigned long lastUse=0;
+};
+
+/*! \brief Single step of a chain that has been read back from a spill file
+ */
+struct spillRowSlot{
+	/*! samplerData::spillID of the data the step belongs to (-1 if empty)*/
+	long long spillID=-1;
+	int chainID=-1;
+	int step=-1;
+	std::vector<double> parameters;
+	std::vector<int> status;
+	positionInfo view;
+	/*! Counter value at the last access, for least-recently-used eviction*/
+	unsigned long lastUse=0;
+};
+
+/*! \brief History read back from spill files by one thread
+ *
+ * Every thread gets its own, so the sampling threads, the output pipeline, and the autocorrelation threads can all read spilled history at once without locking -- the spill file itself is never written once a segment is marked spilled
+ */
+struct spillThreadCache{
+	spillCacheSlot segments[samplerData::spillCacheSegments];
+	spillRowSlot rows[samplerData::spillCacheRows];
+	unsigned long counter=0;
+	/*! Last step read on its own, to catch readers going through the history in order*/
+	long long lastSpillID=-1;
+	int lastChainID=-1;
+	int lastStep=-1;
+};
+static thread_local spillThreadCache threadSpillCache;
+
+/*! \brief Read a spilled segment of chainID back into the calling thread's cache (evicting the least recently used segment if necessary) -- returns the positions of its rows
+ */
+positionInfo *samplerData::pageIn(int chainID, int segmentID)
+{
+	spillThreadCache *cache = &threadSpillCache;
+	cache->counter++;
+	spillCacheSlot *slot = &cache->segments[0];
+	for(int i = 0 ; i<spillCacheSegments; i++){
+		spillCacheSlot *candidate = &cache->segments[i];
+		if(candidate->spillID == spillID && candidate->chainID == chainID && candidate->segmentID == segmentID){
+			candidate->lastUse = cache->counter;
+			return candidate->views.data();
+		}
+		if(candidate->lastUse < slot->lastUse){
+			slot = candidate;
+		}
+	}
+	if((int)slot->views.size() != segmentSteps || (int)slot->parameters.size() != segmentSteps*maxDim || (RJ && slot->status.size() != slot->parameters.size())){
+		slot->parameters.resize(segmentSteps*maxDim);
+		slot->status.resize((RJ) ? segmentSteps*maxDim : 0);
+		slot->views.resize(segmentSteps);
+	}
+	for(int j = 0 ; j<segmentSteps; j++){
+		slot->views[j].setView(maxDim, RJ, slot->parameters.data() + j*maxDim, (RJ) ? slot->status.data() + j*maxDim : nullptr);
+	}
+	storageSegment *segment = &segments[chainID][segmentID];
+	size_t parameterBytes = (size_t)segmentSteps*maxDim*sizeof(double);
+	if(pread(spillFile, slot->parameters.data(), parameterBytes, segment->spillOffset) != (ssize_t)parameterBytes){
+		std::cout<<"ERROR -- Failed reading from spill file "<<spillFilename<<std::endl;
+	}
+	if(RJ){
+		size_t statusBytes = (size_t)segmentSteps*maxDim*sizeof(int);
+		if(pread(spillFile, slot->status.data(), statusBytes, segment->spillOffset + parameterBytes) != (ssize_t)statusBytes){
+			std::cout<<"ERROR -- Failed reading from spill file "<<spillFilename<<std::endl;
+		}
+		int modelIDs[segmentSteps];
+		if(pread(spillFile, modelIDs, segmentSteps*sizeof(int), segment->spillOffset + parameterBytes + statusBytes) != (ssize_t)(segmentSteps*sizeof(int))){
+			std::cout<<"ERROR -- Failed reading from spill file "<<spillFilename<<std::endl;
+		}
+		for(int j = 0 ; j<segmentSteps; j++){
+			slot->views[j].modelID = modelIDs[j];
+		}
+	}
+	slot->spillID = spillID;
+	slot->chainID = chainID;
+	slot->segmentID = segmentID;
+	slot->lastUse = cache->counter;
+	return slot->views.data();
+}
+
+/*! \brief Read back a single spilled step of chainID (see getPosition)
+ *
+ * Random access into the history (differential evolution, etc) touches about one step per segment, so only that row is read from the spill file -- unless the calling thread already has the whole segment paged in, or is reading the history in order
+ */
+positionInfo *samplerData::spilledPosition(int chainID, int step)
+{
+	spillThreadCache *cache = &threadSpillCache;
+	int segmentID = step/segmentSteps;
+	for(int i = 0 ; i<spillCacheSegments; i++){
+		spillCacheSlot *slot = &cache->segments[i];
+		if(slot->spillID == spillID && slot->chainID == chainID && slot->segmentID == segmentID){
+			return &slot->views[step%segmentSteps];
+		}
+	}
+	/*Reading through the history step by step -- page in the whole segment instead*/
+	bool sequential = cache->lastSpillID == spillID && cache->lastChainID == chainID && cache->lastStep == step-1;
+	cache->lastSpillID = spillID;
+	cache->lastChainID = chainID;
+	cache->lastStep = step;
+	if(sequential){
+		return pageIn(chainID, segmentID) + step%segmentSteps;
+	}
+	cache->counter++;
+	spillRowSlot *slot = &cache->rows[0];
+	for(int i = 0 ; i<spillCacheRows; i++){
+		spillRowSlot *candidate = &cache->rows[i];
+		if(candidate->spillID == spillID && candidate->chainID == chainID && candidate->step == step){
+			candidate->lastUse = cache->counter;
+			return &candidate->view;
+		}
+		if(candidate->lastUse < slot->lastUse){
+			slot = candidate;
+		}
+	}
+	slot->parameters.resize(maxDim);
+	slot->status.resize((RJ) ? maxDim : 0);
+	slot->view.setView(maxDim, RJ, slot->parameters.data(), (RJ) ? slot->status.data() : nullptr);
+
+	/*Same layout as writeSpilledSegment*/
+	long long offset = segments[chainID][segmentID].spillOffset;
+	int row = step%segmentSteps;
+	size_t parameterBytes = (size_t)segmentSteps*maxDim*sizeof(double);
+	size_t rowBytes = maxDim*sizeof(double);
+	if(pread(spillFile, slot->parameters.data(), rowBytes, offset + row*rowBytes) != (ssize_t)rowBytes){
+		std::cout<<"ERROR -- Failed reading from spill file "<<spillFilename<<std::endl;
+	}
+	if(RJ){
+		size_t statusBytes = (size_t)segmentSteps*maxDim*sizeof(int);
+		size_t statusRowBytes = maxDim*sizeof(int);
+		if(pread(spillFile, slot->status.data(), statusRowBytes, offset + parameterBytes + row*statusRowBytes) != (ssize_t)statusRowBytes){
+			std::cout<<"ERROR -- Failed reading from spill file "<<spillFilename<<std::endl;
+		}
+		if(pread(spillFile, &slot->view.modelID, sizeof(int), offset + parameterBytes + statusBytes + row*sizeof(int)) != (ssize_t)sizeof(int)){
+			std::cout<<"ERROR -- Failed reading from spill file "<<spillFilename<<std::endl;
+		}
+	}
+	slot->spillID = spillID;
+	slot->chainID = chainID;
+	slot->step = step;
+	slot->lastUse = cache->counter;
+	return &slot->view;
+}
+
+/*! \brief First step of chainID that is still resident in memory (0 if nothing has been spilled)
+ */
+int samplerData::firstResidentStep(int chainID)
+{
+	if(!spilling){
+		return 0;
+	}
+	int step = 0;
+	for(size_t j = 0 ; j<segments[chainID].size(); j++){
+		if(!segments[chainID][j].spilled){
+			break;
+		}
+		step+=segmentSteps;
+	}
+	return step;
 }
 
 int samplerData::countIndependentSamples()
 {
 	int samples = 0 ;
 	for(int i= 0 ; i<ensembleN; i++){
+		int steps = endStepIDs ? endStepIDs[i] : currentStepID[i]+1;
 		if(maxACs[i] != 0){
-			samples+= (currentStepID[i]+1)/(maxACs[i]);
+			samples+= steps/(maxACs[i]);
 		}
 	}
 	return samples/ensembleN;
 }
 
+/*! \brief Update acs and maxACs with the steps the cold chains have taken since the last call
+ *
+ * Each parameter of each cold chain is tracked with batch means (see batchMeansAC), so a call costs O(new steps * maxDim) however long the run is, and the whole history is used even if it's been spilled. acs keeps its definition -- the integrated autocorrelation time, as from the (windowed) spectral estimate of auto_corr_from_data. threads is unused, since the update is cheap enough to run serially
+ *
+ * If spectralACs, the whole history is run through auto_corr_from_reader instead, read in place (a segment at a time, see positionBlock) one cold chain per block over threads
+ */
 void samplerData::updateACs(int threads){
-	double ***acDataPointer = convertToPrimitivePointer();
-	int ***ac = allocate_3D_array_int(ensembleN, maxDim,1);
-	auto_corr_from_data_batch(acDataPointer,currentStepID[0],maxDim,ensembleN,ac, 1,.01,threads, true);
+	/*The step at endStepIDs is still the current state of a chain that's sampling the next batch (settleSwaps can rewrite it), so stop before it*/
+	std::vector<int> lastSteps(ensembleN);
 	for(int i = 0 ; i<ensembleN; i++){
-		maxACs[i] = ac[i][0][0];
-		for(int j = 0 ; j<maxDim; j++){
-			acs[i][j] = ac[i][j][0];
-			if(ac[i][j][0] > maxACs[i]){
-				maxACs[i] = ac[i][j][0];
+		lastSteps[i] = endStepIDs ? endStepIDs[i]-1 : currentStepID[i];
+	}
+	if(spectralACs){
+		int length = lastSteps[0]+1;
+		for(int i = 1 ; i<ensembleN; i++){
+			length = std::min(length, lastSteps[i]+1);
+		}
+		if(length < 1){
+			return;
+		}
+		/*Blocks are whole chains, so each chain is read by one pool thread and its spilled segments are only paged into that thread's cache*/
+		acSeriesReader reader = [this](int series, int start, int length, double *buffer){
+			int chainID = series/maxDim;
+			int dim = series%maxDim;
+			int i = 0;
+			while(i < length){
+				int rows;
+				double *block = parameterBlock(chainID, start+i, &rows);
+				for(int k = 0 ; k<rows && i<length; k++, i++){
+					buffer[i] = block[k*maxDim + dim];
+				}
+			}
+		};
+		int *output[ensembleN*maxDim];
+		for(int i = 0 ; i<ensembleN*maxDim; i++){
+			output[i] = &acs[i/maxDim][i%maxDim];
+		}
+		auto_corr_from_reader(reader, ensembleN*maxDim, length, output, 1, .01, threads, true, maxDim);
+		for(int i = 0 ; i<ensembleN; i++){
+			maxACs[i] = 0;
+			for(int j = 0 ; j<maxDim; j++){
+				if(acs[i][j] > maxACs[i]){
+					maxACs[i] = acs[i][j];
+				}
 			}
 		}
+		return;
+	}
+	if(!acEstimators){
+		acEstimators = new batchMeansAC*[ensembleN];
+		acNextStep = new int[ensembleN];
+		for(int i = 0 ; i<ensembleN; i++){
+			acEstimators[i] = new batchMeansAC[maxDim];
+			acNextStep[i] = 0;
+		}
+	}
+	for(int i = 0 ; i<ensembleN; i++){
+		int step = acNextStep[i];
+		while(step <= lastSteps[i]){
+			int rows;
+			double *parameters = parameterBlock(i, step, &rows);
+			for(int k = 0 ; k<rows && step<=lastSteps[i]; k++, step++){
+				for(int j = 0 ; j<maxDim; j++){
+					acEstimators[i][j].add(parameters[k*maxDim + j]);
+				}
+			}
+		}
+		acNextStep[i] = std::max(acNextStep[i], lastSteps[i]+1);
 
+		maxACs[i] = 0;
+		for(int j = 0 ; j<maxDim; j++){
+			acs[i][j] = (int)acEstimators[i][j].integratedTime();
+			if(acs[i][j] > maxACs[i]){
+				maxACs[i] = acs[i][j];
+			}
+		}
 	}
-	deallocate_3D_array(ac,ensembleN,maxDim);
-	deallocatePrimitivePointer(acDataPointer);
 	return;
 }
 
@@ -632,9 +1490,10 @@ void samplerData::updateBetas(double *betas)
 	return;
 }
 
-samplerData::samplerData(int maxDim, int ensembleN,int ensembleSize, int iterations , int proposalFnN, bool RJ, double *betas)
+samplerData::samplerData(int maxDim, int ensembleN,int ensembleSize, int iterations , int proposalFnN, bool RJ, double *betas, bool runLength)
 {
 	this->maxDim = maxDim;
+	this->runLength = runLength;
 	this->chainN = ensembleN*ensembleSize;
 	this->ensembleN = ensembleN;
 	this->ensembleSize = ensembleSize;
@@ -664,6 +1523,13 @@ samplerData::samplerData(int maxDim, int ensembleN,int ensembleSize, int iterati
 			this->likelihoodEvals[j] = 0;
 		}
 		
+	}
+	if(!this->surrogateRejectN){	
+		this->surrogateRejectN = new int[chainN];
+		for(int j =0 ; j<chainN; j++){
+			this->surrogateRejectN[j] = 0;
+		}
+		
 	}
 	if(!this->integratedLikelihoods){	
 		this->integratedLikelihoods = new double[ensembleSize];
@@ -681,31 +1547,40 @@ samplerData::samplerData(int maxDim, int ensembleN,int ensembleSize, int iterati
 	}
 	if(!currentStepID){
 		currentStepID = new int[chainN];
+		swapSourceChainID = new int[chainN];
+		swapSourceStepID = new int[chainN];
+		currentSurrogate = new double[chainN];
 		for(int i =0 ; i<chainN; i++){
 			currentStepID[i] = 0;
+			swapSourceChainID[i] = -1;
+			swapSourceStepID[i] = 0;
+			currentSurrogate[i] = std::numeric_limits<double>::quiet_NaN();
 		}
 	}
 	
 	if(!positions){
+		/*Wide rows get shorter segments (about 1 MiB of parameters each), but never shorter than 64 steps -- the size doesn't depend on iterations, so runs that start small and grow batch by batch (extendSize) still allocate whole segments*/
+		int rowSteps = (1<<20)/(maxDim*sizeof(double));
+		segmentSteps = std::min(segmentSteps, std::max(rowSteps, 64));
+		segments = new std::vector<storageSegment>[chainN];
 		positions = new positionInfo**[chainN];
-		for(int i = 0 ; i<chainN; i++){
-			positions[i] = new positionInfo*[iterations];
-			for(int j = 0 ;j<iterations; j++){
-				positions[i][j] = new positionInfo(maxDim,RJ);
-			}
-		}
-	}
-	
-	if(!likelihoodVals){
 		likelihoodVals = new double*[chainN];		
-		for(int i= 0 ; i<chainN; i++){
-			likelihoodVals[i] = new double[iterations];
-		}
-	}
-	if(!priorVals){
 		priorVals = new double*[chainN];		
-		for(int i= 0 ; i<chainN; i++){
-			priorVals[i] = new double[iterations];
+		reserveSteps(iterations);
+		if(runLength){
+			stateN = new int[chainN];
+		}
+		for(int i = 0 ; i<chainN; i++){
+			if(runLength){
+				/*Rows are added as states are -- just the first state and the proposal row to start with*/
+				positions[i][0] = stateRow(i, 0);
+				stateN[i] = 1;
+				prepareProposalRow(i);
+				continue;
+			}
+			while((int)segments[i].size()*segmentSteps < iterations){
+				appendSegment(i);
+			}
 		}
 	}
 
@@ -747,6 +1622,50 @@ samplerData::samplerData(int maxDim, int ensembleN,int ensembleSize, int iterati
 			}
 		}
 	}
+	if(!likelihoodN){
+		likelihoodN = new long long[chainN];
+		likelihoodMean = new double[chainN];
+		likelihoodM2 = new double[chainN];
+		likelihoodMax = new double[chainN];
+		steppingStoneLogSum = new double[chainN];
+		steppingStoneLogSum2 = new double[chainN];
+		likelihoodACs = new batchMeansAC[chainN];
+		for(int i = 0 ; i<chainN; i++){
+			likelihoodN[i] = 0;
+			likelihoodMean[i] = 0;
+			likelihoodM2[i] = 0;
+			likelihoodMax[i] = -std::numeric_limits<double>::infinity();
+			steppingStoneLogSum[i] = -std::numeric_limits<double>::infinity();
+			steppingStoneLogSum2[i] = -std::numeric_limits<double>::infinity();
+		}
+		integratedLikelihoodVariances = new double[ensembleSize];
+		for(int j =0 ; j<ensembleSize; j++){
+			integratedLikelihoodVariances[j] = 0;
+		}
+	}
+	if(!replicaIDs){
+		/*Every replica starts in its own chain, and the ones on the ends of the ladder start with a direction*/
+		replicaIDs = new int[chainN];
+		replicaDirection = new int[chainN];
+		replicaTripStart = new int[chainN];
+		roundTrips = new int[chainN];
+		roundTripSteps = new long long[chainN];
+		for(int i = 0 ; i<chainN; i++){
+			int rung = i/ensembleN;
+			replicaIDs[i] = i;
+			replicaDirection[i] = 0;
+			replicaTripStart[i] = -1;
+			roundTrips[i] = 0;
+			roundTripSteps[i] = 0;
+			if(rung == 0){
+				replicaDirection[i] = 1;
+				replicaTripStart[i] = 0;
+			}
+			else if(rung == ensembleSize-1){
+				replicaDirection[i] = -1;
+			}
+		}
+	}
 	if(!acs){
 		acs = new int*[ensembleN];
 		for(int i = 0 ; i<ensembleN; i++){
@@ -777,6 +1696,20 @@ samplerData::samplerData(int maxDim, int ensembleN,int ensembleSize, int iterati
 }
 samplerData::~samplerData()
 {
+	if(spillPool){
+		spillPool->stopPool();
+		delete spillPool;
+		spillPool = nullptr;
+	}
+	if(spillFile >= 0){
+		close(spillFile);
+		unlink(spillFilename.c_str());
+		spillFile = -1;
+	}
+	if(stateN){
+		delete [] stateN;
+		stateN = nullptr;
+	}
 	if(proposalTimes){
 		for(int i = 0 ; i<chainN; i++){
 			delete [] proposalTimes[i];
@@ -788,6 +1721,24 @@ samplerData::~samplerData()
 		delete [] integratedLikelihoods;
 		integratedLikelihoods = nullptr;
 	}
+	if(likelihoodN){
+		delete [] likelihoodN;
+		delete [] likelihoodMean;
+		delete [] likelihoodM2;
+		delete [] likelihoodMax;
+		delete [] steppingStoneLogSum;
+		delete [] steppingStoneLogSum2;
+		delete [] likelihoodACs;
+		delete [] integratedLikelihoodVariances;
+		likelihoodN = nullptr;
+		likelihoodMean = nullptr;
+		likelihoodM2 = nullptr;
+		likelihoodMax = nullptr;
+		steppingStoneLogSum = nullptr;
+		steppingStoneLogSum2 = nullptr;
+		likelihoodACs = nullptr;
+		integratedLikelihoodVariances = nullptr;
+	}
 	if(likelihoodTimes){
 		delete [] likelihoodTimes;
 		likelihoodTimes = nullptr;
@@ -796,6 +1747,10 @@ samplerData::~samplerData()
 		delete [] likelihoodEvals;
 		likelihoodEvals = nullptr;
 	}
+	if(surrogateRejectN){
+		delete [] surrogateRejectN;
+		surrogateRejectN = nullptr;
+	}
 	if(priorTimes){
 		delete [] priorTimes;
 		priorTimes = nullptr;
@@ -803,17 +1758,31 @@ samplerData::~samplerData()
 	if(currentStepID){
 		delete [] currentStepID;
 		currentStepID=nullptr;
+		delete [] swapSourceChainID;
+		swapSourceChainID=nullptr;
+		delete [] swapSourceStepID;
+		swapSourceStepID=nullptr;
+		delete [] currentSurrogate;
+		currentSurrogate=nullptr;
 	}
 	if(positions){
 		for(int j = 0 ; j<chainN; j++){
-			for(int i = 0 ; i<iterations; i++){
-				delete positions[j][i];
-			}
 			delete [] positions[j];
 		}
 		delete [] positions;
 		positions = nullptr;
 	}
+	if(segments){
+		for(int j = 0 ; j<chainN; j++){
+			for(size_t i = 0 ; i<segments[j].size(); i++){
+				free(segments[j][i].parameters);
+				free(segments[j][i].status);
+				delete [] segments[j][i].views;
+			}
+		}
+		delete [] segments;
+		segments = nullptr;
+	}
 	if(likelihoodVals){
 		for(int i = 0 ; i<chainN; i++){
 			delete [] likelihoodVals[i];
@@ -858,6 +1827,35 @@ samplerData::~samplerData()
 		delete [] swapRejects;
 		swapRejects=nullptr;
 	}
+	if(acEstimators){
+		for(int i = 0 ; i<ensembleN; i++){
+			delete [] acEstimators[i];
+		}
+		delete [] acEstimators;
+		acEstimators = nullptr;
+		delete [] acNextStep;
+		acNextStep = nullptr;
+	}
+	if(replicaIDs){
+		delete [] replicaIDs;
+		replicaIDs = nullptr;
+	}
+	if(replicaDirection){
+		delete [] replicaDirection;
+		replicaDirection = nullptr;
+	}
+	if(replicaTripStart){
+		delete [] replicaTripStart;
+		replicaTripStart = nullptr;
+	}
+	if(roundTrips){
+		delete [] roundTrips;
+		roundTrips = nullptr;
+	}
+	if(roundTripSteps){
+		delete [] roundTripSteps;
+		roundTripSteps = nullptr;
+	}
 	if(acs){
 		for(int i = 0 ; i<ensembleN; i++){
 			delete [] acs[i];
@@ -878,6 +1876,10 @@ samplerData::~samplerData()
 			delete dump_files[i];
 		}
 	}
+	for(size_t i = 0 ; i<npy_dumps.size(); i++){
+		closeNpyDump(npy_dumps[i]);
+	}
+	npy_dumps.clear();
 	if(trimLengths){
 		delete [] trimLengths;
 		trimLengths = nullptr;
@@ -894,9 +1896,670 @@ void samplerData::set_trim(int trim){
 	}
 }
 
+/*! \brief Copy the model IDs of steps [beginStep, beginStep+count) of chainID into modelIDs, a block at a time (see samplerData::positionBlock)
+ */
+static void copyModelIDs(samplerData *data, int chainID, int beginStep, int count, int *modelIDs)
+{
+	int j = 0;
+	while(j < count){
+		int rows;
+		positionInfo *block = data->positionBlock(chainID, beginStep+j, &rows);
+		for(int k = 0 ; k<rows && j<count; k++, j++){
+			modelIDs[j] = block[k].modelID;
+		}
+	}
+}
+
+/*! \brief Append steps [beginStep, endStep) of chainID to its files in dump
+ */
+static void appendNpyChain(samplerData *data, npy_dump_struct *dump, int chainID, int beginStep, int endStep)
+{
+	int count = endStep - beginStep;
+	if(data->runLength){
+		/*Repeated steps share a row -- copy them out one step at a time*/
+		int maxDim = data->maxDim;
+		double *parameters = (double *)dump->parameters[chainID]->reserve(count);
+		int *status = (data->RJ) ? (int *)dump->status[chainID]->reserve(count) : nullptr;
+		for(int j = 0 ; j<count; j++){
+			positionInfo *position = data->positions[chainID][beginStep+j];
+			if(parameters){
+				memcpy(parameters + j*maxDim, position->parameters, maxDim*sizeof(double));
+			}
+			if(status){
+				memcpy(status + j*maxDim, position->status, maxDim*sizeof(int));
+			}
+		}
+		if(parameters){
+			dump->parameters[chainID]->commit(count);
+		}
+		if(status){
+			dump->status[chainID]->commit(count);
+		}
+	}
+	int step = (data->runLength) ? endStep : beginStep;
+	while(step < endStep){
+		int rows;
+		double *parameters = data->parameterBlock(chainID, step, &rows);
+		rows = std::min(rows, endStep - step);
+		dump->parameters[chainID]->append(parameters, rows);
+		if(data->RJ){
+			int statusRows;
+			dump->status[chainID]->append(data->statusBlock(chainID, step, &statusRows), rows);
+		}
+		step += rows;
+	}
+	double *ll_lp = (double *)dump->ll_lp[chainID]->reserve(count);
+	if(ll_lp){
+		for(int j = 0 ; j<count; j++){
+			ll_lp[2*j] = data->likelihoodVals[chainID][beginStep+j];
+			ll_lp[2*j+1] = data->priorVals[chainID][beginStep+j];
+		}
+		dump->ll_lp[chainID]->commit(count);
+	}
+	if(data->RJ){
+		int *modelIDs = (int *)dump->model_status[chainID]->reserve(count);
+		if(modelIDs){
+			copyModelIDs(data, chainID, beginStep, count, modelIDs);
+			dump->model_status[chainID]->commit(count);
+		}
+	}
+}
+
+/*! \brief Write the chains to .npy files -- the output for builds without HDF5, or when bayesshipSampler::npyOutput is set
+ *
+ * Chain i goes to prefix_chain<i>.npy ([steps][maxDim] doubles) and prefix_chain<i>_logl_logp.npy ([steps][2]), and for RJ, prefix_chain<i>_status.npy ([steps][maxDim] ints) and prefix_chain<i>_model_status.npy ([steps][1]). The files stay mapped, so append_to_npy_dump only copies the new steps in, and each can be opened at any point with numpy.load(file, mmap_mode='r'). Everything else (betas, trim lengths, acs, the evidence) goes in prefix_manifest.json (see writeNpyManifest)
+ *
+ * Creating a dump with the prefix of an open one starts it over
+ */
+int samplerData::create_npy_dump(
+	bool cold_only,/**< Only write the cold chains*/
+	bool trim,/**< Start each chain at its trim length*/
+	std::string prefix/**< Path and name prefix of the files*/
+	)
+{
+	/*Everything is written up to (not including) the last step*/
+	int *lastSteps = endStepIDs ? endStepIDs : currentStepID;
+	for(size_t i = 0 ; i<npy_dumps.size(); i++){
+		if(npy_dumps[i]->prefix == prefix){
+			closeNpyDump(npy_dumps[i]);
+			npy_dumps.erase(npy_dumps.begin()+i);
+			break;
+		}
+	}
+	npy_dump_struct *dump = new npy_dump_struct;
+	dump->prefix = prefix;
+	dump->coldOnly = cold_only;
+	int chains = cold_only ? ensembleN : chainN;
+	dump->fileStartSteps = new int[chains];
+	bool good = true;
+	for(int i = 0 ; i<chains; i++){
+		dump->fileStartSteps[i] = trim ? trimLengths[i] : 0;
+		long long rows = std::max(lastSteps[i] - dump->fileStartSteps[i], 1);
+		std::string chainPrefix = prefix+"_chain"+std::to_string(i);
+		dump->parameters.push_back(new npyArrayFile(chainPrefix+".npy", 'f', sizeof(double), maxDim, rows));
+		dump->ll_lp.push_back(new npyArrayFile(chainPrefix+"_logl_logp.npy", 'f', sizeof(double), 2, rows));
+		good = good && dump->parameters[i]->good() && dump->ll_lp[i]->good();
+		if(RJ){
+			dump->status.push_back(new npyArrayFile(chainPrefix+"_status.npy", 'i', sizeof(int), maxDim, rows));
+			dump->model_status.push_back(new npyArrayFile(chainPrefix+"_model_status.npy", 'i', sizeof(int), 1, rows));
+			good = good && dump->status[i]->good() && dump->model_status[i]->good();
+		}
+	}
+	npy_dumps.push_back(dump);
+	if(!good){
+		return -1;
+	}
+	for(int i = 0 ; i<chains; i++){
+		if(lastSteps[i] > dump->fileStartSteps[i]){
+			appendNpyChain(this, dump, i, dump->fileStartSteps[i], lastSteps[i]);
+		}
+	}
+	return writeNpyManifest(dump);
+}
+
+/*! \brief Append the steps taken since the last write to the .npy dump with this prefix (see create_npy_dump)
+ */
+int samplerData::append_to_npy_dump(
+	std::string prefix/**< Path and name prefix of the files*/
+	)
+{
+	int *lastSteps = endStepIDs ? endStepIDs : currentStepID;
+	npy_dump_struct *dump = nullptr;
+	for(size_t i = 0 ; i<npy_dumps.size(); i++){
+		if(npy_dumps[i]->prefix == prefix){
+			dump = npy_dumps[i];
+		}
+	}
+	if(!dump){
+		std::cout<<"ERROR -- No npy output open with prefix "<<prefix<<std::endl;
+		return -1;
+	}
+	int chains = dump->coldOnly ? ensembleN : chainN;
+	for(int i = 0 ; i<chains; i++){
+		int beginStep = dump->fileStartSteps[i] + dump->parameters[i]->rows;
+		if(lastSteps[i] > beginStep){
+			appendNpyChain(this, dump, i, beginStep, lastSteps[i]);
+		}
+	}
+	return writeNpyManifest(dump);
+}
+
+/*! \brief Write prefix_manifest.json for dump -- everything but the chains themselves
+ *
+ * Written to a temporary file and renamed over the old one, so a reader never sees half a manifest
+ */
+int samplerData::writeNpyManifest(npy_dump_struct *dump)
+{
+	int chains = dump->coldOnly ? ensembleN : chainN;
+	nlohmann::json j;
+	j["maxDim"] = maxDim;
+	j["ensembleN"] = ensembleN;
+	j["ensembleSize"] = ensembleSize;
+	j["RJ"] = RJ;
+	j["coldOnly"] = dump->coldOnly;
+	j["chainBetas"] = std::vector<double>(betas, betas + chainN);
+	j["suggestedTrimLengths"] = std::vector<int>(trimLengths, trimLengths + chainN);
+	j["chainStartSteps"] = std::vector<int>(dump->fileStartSteps, dump->fileStartSteps + chains);
+	std::vector<long long> lengths(chains);
+	for(int i = 0 ; i<chains; i++){
+		std::string chainPrefix = dump->prefix+"_chain"+std::to_string(i);
+		std::string name = chainPrefix.substr(chainPrefix.find_last_of('/')+1);
+		lengths[i] = dump->parameters[i]->rows;
+		j["files"]["parameters"].push_back(name+".npy");
+		j["files"]["logl_logp"].push_back(name+"_logl_logp.npy");
+		if(RJ){
+			j["files"]["status"].push_back(name+"_status.npy");
+			j["files"]["model_status"].push_back(name+"_model_status.npy");
+		}
+	}
+	j["chainLengths"] = lengths;
+	if(acs){
+		for(int i = 0 ; i<ensembleN; i++){
+			j["acValues"].push_back(std::vector<int>(acs[i], acs[i] + maxDim));
+		}
+	}
+	if(calculatedEvidence){
+		j["integratedLikelihoods"] = std::vector<double>(integratedLikelihoods, integratedLikelihoods + ensembleSize);
+		j["integratedLikelihoodVariances"] = std::vector<double>(integratedLikelihoodVariances, integratedLikelihoodVariances + ensembleSize);
+		j["evidence"] = evidence;
+		j["evidenceError"] = evidenceError;
+		j["evidenceBootstrapError"] = evidenceBootstrapError;
+		j["steppingStoneEvidence"] = steppingStoneEvidence;
+		j["steppingStoneEvidenceError"] = steppingStoneEvidenceError;
+		j["steppingStoneBootstrapError"] = steppingStoneBootstrapError;
+	}
+	std::string filename = dump->prefix+"_manifest.json";
+	{
+		std::ofstream fileOut(filename+".tmp");
+		fileOut << j.dump(1, '\t');
+		if(!fileOut.good()){
+			std::cout<<"ERROR -- Could not write "<<filename<<std::endl;
+			return -1;
+		}
+	}
+	if(rename((filename+".tmp").c_str(), filename.c_str()) != 0){
+		std::cout<<"ERROR -- Could not write "<<filename<<std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+/*! \brief Close (and trim) the files of dump, and free it
+ */
+void samplerData::closeNpyDump(npy_dump_struct *dump)
+{
+	for(size_t i = 0 ; i<dump->parameters.size(); i++){
+		delete dump->parameters[i];
+		delete dump->ll_lp[i];
+	}
+	for(size_t i = 0 ; i<dump->status.size(); i++){
+		delete dump->status[i];
+		delete dump->model_status[i];
+	}
+	delete [] dump->fileStartSteps;
+	delete dump;
+}
+
+
 #ifdef _HDF5
+/*! \brief Write a 1D double dataset to group, creating it if it doesn't exist yet
+ */
+static void writeMetaDoubles(H5::Group &group, std::string name, double *values, int n)
+{
+	H5::DataSet *dataset;
+	if(H5Lexists(group.getId(), name.c_str(), H5P_DEFAULT) > 0){
+		dataset = new H5::DataSet(group.openDataSet(name));
+	}
+	else{
+		hsize_t dims[1];
+		dims[0] = n;
+		H5::DataSpace dataspace(1,dims);
+		dataset = new H5::DataSet(group.createDataSet(name, H5::PredType::NATIVE_DOUBLE, dataspace));
+	}
+	dataset->write(values, H5::PredType::NATIVE_DOUBLE);	
+	delete dataset;
+}
+
+/*! \brief Write the evidence estimates, their errors, and the mean log likelihood of each rung to the metadata group
+ */
+static void writeEvidenceMetadata(samplerData *data, H5::Group &group)
+{
+	writeMetaDoubles(group, "INTEGRATED LIKELIHOODS", data->integratedLikelihoods, data->ensembleSize);
+	writeMetaDoubles(group, "INTEGRATED LIKELIHOOD VARIANCES", data->integratedLikelihoodVariances, data->ensembleSize);
+	writeMetaDoubles(group, "EVIDENCE", &data->evidence, 1);
+	writeMetaDoubles(group, "EVIDENCE ERROR", &data->evidenceError, 1);
+	writeMetaDoubles(group, "EVIDENCE BOOTSTRAP ERROR", &data->evidenceBootstrapError, 1);
+	writeMetaDoubles(group, "STEPPING STONE EVIDENCE", &data->steppingStoneEvidence, 1);
+	writeMetaDoubles(group, "STEPPING STONE EVIDENCE ERROR", &data->steppingStoneEvidenceError, 1);
+	writeMetaDoubles(group, "STEPPING STONE BOOTSTRAP ERROR", &data->steppingStoneBootstrapError, 1);
+}
+
+/*! \brief Write a 1D (or, if cols > 1, 2D) int dataset to group, creating it if it doesn't exist yet
+ */
+static void writeMetaInts(H5::Group &group, std::string name, int *values, int rows, int cols=1)
+{
+	H5::DataSet *dataset;
+	if(H5Lexists(group.getId(), name.c_str(), H5P_DEFAULT) > 0){
+		dataset = new H5::DataSet(group.openDataSet(name));
+	}
+	else{
+		hsize_t dims[2];
+		dims[0] = rows;
+		dims[1] = cols;
+		H5::DataSpace dataspace((cols > 1) ? 2 : 1,dims);
+		dataset = new H5::DataSet(group.createDataSet(name, H5::PredType::NATIVE_INT, dataspace));
+	}
+	dataset->write(values, H5::PredType::NATIVE_INT);	
+	delete dataset;
+}
+
+/*! \brief Write steps [beginStep, endStep) of chainID straight from the storage segments into rows [fileOffset, fileOffset + endStep-beginStep) of dataset, one hyperslab per segment
+ *
+ * Writes the parameters, or the status if status is true. If slot is set, dataset is a stacked [chain][step][maxDim] dataset and the rows are those of chain slot
+ */
+static void writeChainSegments(samplerData *data, H5::DataSet *dataset, int chainID, int beginStep, int endStep, hsize_t fileOffset, bool status, int slot=-1)
+{
+	H5::DataSpace fileSpace = dataset->getSpace();
+	std::vector<double> parameterRows;
+	std::vector<int> statusRows;
+	int step = beginStep;
+	while(step < endStep){
+		int rows;
+		void *block;
+		if(data->runLength){
+			/*Repeated steps share a row, so copy up to a segment's worth of steps out instead of writing a run at a time*/
+			rows = std::min(data->segmentSteps, endStep - step);
+			int maxDim = data->maxDim;
+			if(status){
+				statusRows.resize(rows*maxDim);
+				for(int k = 0 ; k<rows; k++){
+					memcpy(&statusRows[k*maxDim], data->positions[chainID][step+k]->status, maxDim*sizeof(int));
+				}
+				block = statusRows.data();
+			}
+			else{
+				parameterRows.resize(rows*maxDim);
+				for(int k = 0 ; k<rows; k++){
+					memcpy(&parameterRows[k*maxDim], data->positions[chainID][step+k]->parameters, maxDim*sizeof(double));
+				}
+				block = parameterRows.data();
+			}
+		}
+		else if(status){
+			block = data->statusBlock(chainID, step, &rows);
+		}
+		else{
+			block = data->parameterBlock(chainID, step, &rows);
+		}
+		if(rows > endStep - step){
+			rows = endStep - step;
+		}
+		hsize_t count[3] = {(hsize_t)rows, (hsize_t)data->maxDim, 0};
+		hsize_t offset[3] = {fileOffset + (hsize_t)(step - beginStep), 0, 0};
+		H5::DataSpace memSpace(2, count);
+		if(slot >= 0){
+			hsize_t stackedCount[3] = {1, count[0], count[1]};
+			hsize_t stackedOffset[3] = {(hsize_t)slot, offset[0], 0};
+			fileSpace.selectHyperslab(H5S_SELECT_SET, stackedCount, stackedOffset);
+		}
+		else{
+			fileSpace.selectHyperslab(H5S_SELECT_SET, count, offset);
+		}
+		if(status){
+			dataset->write(block, H5::PredType::NATIVE_INT, memSpace, fileSpace);
+		}
+		else{
+			dataset->write(block, H5::PredType::NATIVE_DOUBLE, memSpace, fileSpace);
+		}
+		step+=rows;
+	}
+}
+
+/*! \brief Write count values of one column of chain slot's rows [fileOffset, fileOffset+count) of a stacked [chain][step][width] dataset, straight from values
+ */
+static void writeStackedColumn(H5::DataSet *dataset, const void *values, const H5::PredType &type, int slot, hsize_t fileOffset, int count, int column)
+{
+	H5::DataSpace fileSpace = dataset->getSpace();
+	hsize_t counts[3] = {1, (hsize_t)count, 1};
+	hsize_t offset[3] = {(hsize_t)slot, fileOffset, (hsize_t)column};
+	fileSpace.selectHyperslab(H5S_SELECT_SET, counts, offset);
+	hsize_t memCount[1] = {(hsize_t)count};
+	H5::DataSpace memSpace(1, memCount);
+	dataset->write(values, type, memSpace, fileSpace);
+}
+
+/*! \brief Create an empty stacked [chains][step][width] dataset -- extendible in steps, chunked one chain by about data->outputChunkBytes, and filtered with deflate at data->outputDeflateLevel (after the shuffle filter, if data->outputShuffle)
+ */
+static void createStackedDataSet(samplerData *data, H5::Group &group, std::string name, int chains, int width, const H5::PredType &type, const void *fill)
+{
+	hsize_t dims[3] = {(hsize_t)chains, 0, (hsize_t)width};
+	hsize_t maxDims[3] = {(hsize_t)chains, H5S_UNLIMITED, (hsize_t)width};
+	H5::DataSpace dataspace(3, dims, maxDims);
+	hsize_t chunkSteps = data->outputChunkBytes/(width*type.getSize());
+	hsize_t chunk[3] = {1, std::max(chunkSteps, (hsize_t)1), (hsize_t)width};
+	H5::DSetCreatPropList plist;
+	plist.setChunk(3, chunk);
+	plist.setFillValue(type, fill);
+	if(data->outputShuffle){
+		plist.setShuffle();
+	}
+	if(data->outputDeflateLevel > 0){
+		plist.setDeflate(data->outputDeflateLevel);
+	}
+	group.createDataSet(name, type, dataspace, plist);
+}
+
+/*! \brief Open a stacked dataset and extend it to steps, with a chunk cache big enough that a chunk filled by several segment writes is only compressed once
+ */
+static H5::DataSet *openStackedDataSet(samplerData *data, H5::Group &group, std::string name, int chains, hsize_t steps, int width)
+{
+	H5::DSetAccPropList dapl;
+	dapl.setChunkCache(521, 4*(size_t)data->outputChunkBytes, 1);
+	H5::DataSet *dataset = new H5::DataSet(group.openDataSet(name, dapl));
+	hsize_t dims[3] = {(hsize_t)chains, steps, (hsize_t)width};
+	dataset->extend(dims);
+	return dataset;
+}
+
+/*! \brief Write rows [fileOffset, fileOffset+rows) of chain slot of a stacked [chain][step][width] dataset from a contiguous [rows][width] buffer
+ */
+static void writeStackedRows(H5::DataSet *dataset, const void *values, const H5::PredType &type, int slot, hsize_t fileOffset, int rows, int width)
+{
+	H5::DataSpace fileSpace = dataset->getSpace();
+	hsize_t counts[3] = {1, (hsize_t)rows, (hsize_t)width};
+	hsize_t offset[3] = {(hsize_t)slot, fileOffset, 0};
+	fileSpace.selectHyperslab(H5S_SELECT_SET, counts, offset);
+	hsize_t memCount[2] = {(hsize_t)rows, (hsize_t)width};
+	H5::DataSpace memSpace(2, memCount);
+	dataset->write(values, type, memSpace, fileSpace);
+}
+
+/*! \brief Whether position (step of chainID) is the same state as the step before it -- ie, the step before was kept because the proposal was rejected
+ *
+ * Compared bit for bit, so an expanded run length file reproduces the chain exactly
+ */
+static bool repeatsPreviousStep(samplerData *data, int chainID, int step, positionInfo *position)
+{
+	if(memcmp(&data->likelihoodVals[chainID][step], &data->likelihoodVals[chainID][step-1], sizeof(double)) != 0 
+		|| memcmp(&data->priorVals[chainID][step], &data->priorVals[chainID][step-1], sizeof(double)) != 0){
+		return false;
+	}
+	/*The step before is in the segment this thread paged in last (or the one before it), so reading it never evicts position*/
+	positionInfo *previous = data->getPosition(chainID, step-1);
+	if(memcmp(position->parameters, previous->parameters, data->maxDim*sizeof(double)) != 0){
+		return false;
+	}
+	if(data->RJ){
+		return position->modelID == previous->modelID && memcmp(position->status, previous->status, data->maxDim*sizeof(int)) == 0;
+	}
+	return true;
+}
+
+/*! \brief Run length output (see runLengthOutput) -- write the states that chain slot of a stacked dump file enters in steps [beginStep, endStep), and the (file) step each state starts on
+ *
+ * states is the number of states of the chain already in the file (updated), and extent the number of state rows the datasets hold (grown as needed). States are gathered and written a segment's worth at a time
+ */
+static void writeChainStates(samplerData *data, H5::DataSet **datasets, int chains, int slot, int beginStep, int endStep, int fileStartStep, int *states, hsize_t *extent)
+{
+	H5::DataSet *parameters = datasets[0];
+	H5::DataSet *ll_lp = datasets[1];
+	H5::DataSet *stateSteps = datasets[2];
+	H5::DataSet *status = datasets[3];
+	H5::DataSet *model_status = datasets[4];
+	int maxDim = data->maxDim;
+	std::vector<double> parameterRows;
+	std::vector<double> ll_lpRows;
+	std::vector<int> stepRows;
+	std::vector<int> statusRows;
+	std::vector<int> modelIDs;
+	auto flush = [&](){
+		int rows = stepRows.size();
+		if(rows == 0){
+			return;
+		}
+		if(*states + rows > (int)*extent){
+			*extent = *states + rows;
+			hsize_t dims[3] = {(hsize_t)chains, *extent, (hsize_t)maxDim};
+			parameters->extend(dims);
+			if(data->RJ){
+				status->extend(dims);
+			}
+			dims[2] = 2;
+			ll_lp->extend(dims);
+			dims[2] = 1;
+			stateSteps->extend(dims);
+			if(data->RJ){
+				model_status->extend(dims);
+			}
+		}
+		writeStackedRows(parameters, parameterRows.data(), H5::PredType::NATIVE_DOUBLE, slot, *states, rows, maxDim);
+		writeStackedRows(ll_lp, ll_lpRows.data(), H5::PredType::NATIVE_DOUBLE, slot, *states, rows, 2);
+		writeStackedRows(stateSteps, stepRows.data(), H5::PredType::NATIVE_INT, slot, *states, rows, 1);
+		if(data->RJ){
+			writeStackedRows(status, statusRows.data(), H5::PredType::NATIVE_INT, slot, *states, rows, maxDim);
+			writeStackedRows(model_status, modelIDs.data(), H5::PredType::NATIVE_INT, slot, *states, rows, 1);
+		}
+		*states += rows;
+		parameterRows.clear();
+		ll_lpRows.clear();
+		stepRows.clear();
+		statusRows.clear();
+		modelIDs.clear();
+	};
+	int rows = 0;
+	positionInfo *block = nullptr;
+	for(int step = beginStep ; step<endStep; step++, rows--, block++){
+		if(rows == 0){
+			block = data->positionBlock(slot, step, &rows);
+		}
+		positionInfo *position = block;
+		if(step > fileStartStep && repeatsPreviousStep(data, slot, step, position)){
+			continue;
+		}
+		parameterRows.insert(parameterRows.end(), position->parameters, position->parameters+maxDim);
+		ll_lpRows.push_back(data->likelihoodVals[slot][step]);
+		ll_lpRows.push_back(data->priorVals[slot][step]);
+		stepRows.push_back(step - fileStartStep);
+		if(data->RJ){
+			statusRows.insert(statusRows.end(), position->status, position->status+maxDim);
+			modelIDs.push_back(position->modelID);
+		}
+		if((int)stepRows.size() >= data->segmentSteps){
+			flush();
+		}
+	}
+	flush();
+}
+
+/*! \brief Create (create=true) or add the latest steps to a dump file in the stacked layout (see stackedOutput)
+ *
+ * Each quantity is a single [chain][step][width] dataset, so an append opens a handful of datasets instead of several per chain. The parameters and status are written with one hyperslab per storage segment, and the log likelihood and log prior columns straight from likelihoodVals and priorVals -- nothing is staged through a copy of the chain, except the model IDs
+ *
+ * With run length output, the rows are the states of each chain instead of its steps (see writeChainStates)
+ */
+int samplerData::write_stacked_dump(int file_id, bool create)
+{
+	/*Everything is written up to (not including) the last step*/
+	int *lastSteps = endStepIDs ? endStepIDs : currentStepID;
+	dump_file_struct *dump = dump_files[file_id];
+	int chains = dump->coldOnly ? ensembleN : chainN;
+	std::vector<int> startSteps(chains, 0);
+	if(dump->trimmed){
+		for(int i = 0 ; i<chains; i++){
+			startSteps[i] = dump->fileTrimLengths[i];
+		}
+	}
+	try{
+		/*The last chunk of each chain is rewritten (compressed to a new size) by every append, so keep track of the free space across appends so it's reused*/
+		H5::FileCreatPropList fcpl;
+		fcpl.setFileSpaceStrategy(H5F_FSPACE_STRATEGY_FSM_AGGR, true, 1);
+		H5::H5File file(dump_file_names[file_id], create ? H5F_ACC_TRUNC : H5F_ACC_RDWR, fcpl);
+		H5::Group output_group;
+		H5::Group meta_group;
+		/*Steps (and, for run length output, states) of each chain already in the file*/
+		std::vector<int> written(chains, 0);
+		std::vector<int> states(chains, 0);
+		if(create){
+			output_group = file.createGroup("/MCMC_OUTPUT");
+			meta_group = file.createGroup("/MCMC_METADATA");
+			double doubleFill = std::numeric_limits<double>::quiet_NaN();
+			int intFill = 0;
+			createStackedDataSet(this, output_group, "PARAMETERS", chains, maxDim, H5::PredType::NATIVE_DOUBLE, &doubleFill);
+			createStackedDataSet(this, output_group, "LOGL_LOGP", chains, 2, H5::PredType::NATIVE_DOUBLE, &doubleFill);
+			if(RJ){
+				createStackedDataSet(this, output_group, "STATUS", chains, maxDim, H5::PredType::NATIVE_INT, &intFill);
+				createStackedDataSet(this, output_group, "MODEL_STATUS", chains, 1, H5::PredType::NATIVE_INT, &intFill);
+			}
+			if(dump->runLength){
+				createStackedDataSet(this, output_group, "STATE START STEPS", chains, 1, H5::PredType::NATIVE_INT, &intFill);
+			}
+			writeMetaInts(meta_group, "CHAIN START STEPS", startSteps.data(), chains);
+		}
+		else{
+			output_group = file.openGroup("/MCMC_OUTPUT");
+			meta_group = file.openGroup("/MCMC_METADATA");
+			H5::DataSet lengths = meta_group.openDataSet("CHAIN LENGTHS");
+			lengths.read(written.data(), H5::PredType::NATIVE_INT);
+			if(dump->runLength){
+				H5::DataSet stateCounts = meta_group.openDataSet("CHAIN STATES");
+				stateCounts.read(states.data(), H5::PredType::NATIVE_INT);
+			}
+		}
+		std::vector<int> lengths(chains);
+		hsize_t steps = 0;
+		for(int i = 0 ; i<chains; i++){
+			lengths[i] = std::max(lastSteps[i] - startSteps[i], written[i]);
+			steps = std::max(steps, (hsize_t)lengths[i]);
+		}
+		/*Rows of the datasets -- steps, or (run length output) the states already written, grown as states are added*/
+		hsize_t rows = steps;
+		if(dump->runLength){
+			rows = *std::max_element(states.begin(), states.end());
+		}
+
+		H5::DataSet *dataset = openStackedDataSet(this, output_group, "PARAMETERS", chains, rows, maxDim);
+		H5::DataSet *dataset_ll_lp = openStackedDataSet(this, output_group, "LOGL_LOGP", chains, rows, 2);
+		H5::DataSet *dataset_status = nullptr;
+		H5::DataSet *dataset_model_status = nullptr;
+		H5::DataSet *dataset_state_steps = nullptr;
+		if(RJ){
+			dataset_status = openStackedDataSet(this, output_group, "STATUS", chains, rows, maxDim);
+			dataset_model_status = openStackedDataSet(this, output_group, "MODEL_STATUS", chains, rows, 1);
+		}
+		if(dump->runLength){
+			dataset_state_steps = openStackedDataSet(this, output_group, "STATE START STEPS", chains, rows, 1);
+		}
+		H5::DataSet *stateDatasets[5] = {dataset, dataset_ll_lp, dataset_state_steps, dataset_status, dataset_model_status};
+		std::vector<int> modelIDs;
+		for(int i = 0 ; i<chains; i++){
+			int beginStep = startSteps[i] + written[i];
+			int endStep = startSteps[i] + lengths[i];
+			int count = endStep - beginStep;
+			if(count <= 0){
+				continue;
+			}
+			if(dump->runLength){
+				writeChainStates(this, stateDatasets, chains, i, beginStep, endStep, startSteps[i], &states[i], &rows);
+				continue;
+			}
+			writeChainSegments(this, dataset, i, beginStep, endStep, written[i], false, i);
+			writeStackedColumn(dataset_ll_lp, likelihoodVals[i]+beginStep, H5::PredType::NATIVE_DOUBLE, i, written[i], count, 0);
+			writeStackedColumn(dataset_ll_lp, priorVals[i]+beginStep, H5::PredType::NATIVE_DOUBLE, i, written[i], count, 1);
+			if(RJ){
+				writeChainSegments(this, dataset_status, i, beginStep, endStep, written[i], true, i);
+				modelIDs.resize(count);
+				copyModelIDs(this, i, beginStep, count, modelIDs.data());
+				writeStackedColumn(dataset_model_status, modelIDs.data(), H5::PredType::NATIVE_INT, i, written[i], count, 0);
+			}
+		}
+		delete dataset;
+		delete dataset_ll_lp;
+		if(RJ){
+			delete dataset_status;
+			delete dataset_model_status;
+		}
+		if(dump->runLength){
+			delete dataset_state_steps;
+			writeMetaInts(meta_group, "CHAIN STATES", states.data(), chains);
+		}
+
+		writeMetaInts(meta_group, "CHAIN LENGTHS", lengths.data(), chains);
+		writeMetaDoubles(meta_group, "CHAIN BETAS", betas, chainN);
+		if(create || !dump->trimmed){
+			writeMetaInts(meta_group, "SUGGESTED TRIM LENGTHS", trimLengths, chainN);
+		}
+		if(calculatedEvidence){
+			writeEvidenceMetadata(this, meta_group);
+		}
+		if(acs){
+			std::vector<int> acBuffer(ensembleN*maxDim);
+			for(int i  = 0 ; i<ensembleN; i++){
+				for(int j = 0 ; j<maxDim ; j++){
+					acBuffer[i*maxDim +j ] = acs[i][j];
+				}
+			}
+			writeMetaInts(meta_group, "AC VALUES", acBuffer.data(), ensembleN, maxDim);
+		}
+		output_group.close();
+		meta_group.close();
+	}
+	catch( H5::FileIException error )
+	{
+		error.printErrorStack();
+		return -1;
+	}
+	catch( H5::GroupIException error )
+	{
+		error.printErrorStack();
+		return -1;
+	}
+	catch( H5::DataSetIException error )
+	{
+		error.printErrorStack();
+	   	return -1;
+	}
+	catch( H5::DataSpaceIException error )
+	{
+		error.printErrorStack();
+	   	return -1;
+	}
+	catch( H5::DataTypeIException error )
+	{
+		error.printErrorStack();
+	   	return -1;
+	}
+	catch( H5::PropListIException error )
+	{
+		error.printErrorStack();
+	   	return -1;
+	}
+	return 0;
+}
+
 int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename)
 {
+	/*Everything is written up to (not including) the last step*/
+	int *lastSteps = endStepIDs ? endStepIDs : currentStepID;
 	int file_id = 0;
 	bool found = false;
 	if(dump_files.size() != 0){
@@ -925,6 +2588,11 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 	else{
 		dump_files[file_id]->trimmed = false;
 	}
+	dump_files[file_id]->stacked = stackedOutput;
+	dump_files[file_id]->runLength = stackedOutput && runLengthOutput;
+	if(stackedOutput){
+		return write_stacked_dump(file_id, true);
+	}
 	try{
 		std::string FILE_NAME(filename);
 		int chains;
@@ -954,9 +2622,7 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 			model_status_group = H5::Group(file.createGroup("/MCMC_OUTPUT/MODEL_STATUS"));
 		}
 		H5::Group meta_group(file.createGroup("/MCMC_METADATA"));
-		double *temp_buffer=NULL;
 		double *temp_ll_lp_buffer=NULL;
-		int *temp_status_buffer=NULL;
 		int *temp_model_status_buffer=NULL;
 		H5::DataSpace *dataspace=NULL ;
 		H5::DataSpace *dataspace_ll_lp=NULL ;
@@ -984,16 +2650,16 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 			hsize_t dims_status[RANK];
 			//hsize_t dims_model_status[RANK];
 			if(trim){
-				dims[0]= currentStepID[ids[i]]-trimLengths[ids[i]];
-				dims_ll_lp[0]= currentStepID[ids[i]]-trimLengths[ids[i]];
-				dims_status[0]= currentStepID[ids[i]]-trimLengths[ids[i]];
-				//dims_model_status[0]= currentStepID[ids[i]]-trimLengths[ids[i]];
+				dims[0]= lastSteps[ids[i]]-trimLengths[ids[i]];
+				dims_ll_lp[0]= lastSteps[ids[i]]-trimLengths[ids[i]];
+				dims_status[0]= lastSteps[ids[i]]-trimLengths[ids[i]];
+				//dims_model_status[0]= lastSteps[ids[i]]-trimLengths[ids[i]];
 			}
 			else{
-				dims[0]= currentStepID[ids[i]];
-				dims_ll_lp[0]= currentStepID[ids[i]];
-				dims_status[0]= currentStepID[ids[i]];
-				//dims_model_status[0]= currentStepID[ids[i]];
+				dims[0]= lastSteps[ids[i]];
+				dims_ll_lp[0]= lastSteps[ids[i]];
+				dims_status[0]= lastSteps[ids[i]];
+				//dims_model_status[0]= lastSteps[ids[i]];
 			}
 			dims[1]= maxDim;
 			dims_ll_lp[1]= 2;
@@ -1039,30 +2705,17 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 
 			}
 
-			temp_buffer = new double[ int(dims[0]*dims[1]) ];
 			temp_ll_lp_buffer = new double[ int(dims_ll_lp[0]*dims_ll_lp[1]) ];
 			int beginning_id=0;
 			if(trim){ beginning_id =trimLengths[ids[i]];}
-			for(int j = 0 ; j<currentStepID[ids[i]] - beginning_id; j++){
-				for(int k = 0 ; k<maxDim; k++){
-					temp_buffer[j*maxDim +k] = positions[ids[i]][j+beginning_id]->parameters[k];	
-				}
+			for(int j = 0 ; j<lastSteps[ids[i]] - beginning_id; j++){
 				temp_ll_lp_buffer[j*2]=likelihoodVals[ids[i]][j+beginning_id];
 				temp_ll_lp_buffer[j*2+1]=priorVals[ids[i]][j+beginning_id];
 			}
-			dataset->write(temp_buffer, H5::PredType::NATIVE_DOUBLE);
+			writeChainSegments(this, dataset, ids[i], beginning_id, lastSteps[ids[i]], 0, false);
 			dataset_ll_lp->write(temp_ll_lp_buffer, H5::PredType::NATIVE_DOUBLE);
 			if(RJ){
-				temp_status_buffer = new int[ int(dims_status[0]*dims_status[1]) ];
-				int beginning_id=0;
-				if(trim){ beginning_id =trimLengths[ids[i]];}
-				for(int j = 0 ; j<currentStepID[ids[i]] - beginning_id; j++){
-					for(int k = 0 ; k<maxDim; k++){
-						temp_status_buffer[j*maxDim +k] = positions[ids[i]][j+beginning_id]->status[k];	
-					}
-				}
-				dataset_status->write(temp_status_buffer, H5::PredType::NATIVE_INT);
-
+				writeChainSegments(this, dataset_status, ids[i], beginning_id, lastSteps[ids[i]], 0, true);
 			}
 			//Cleanup
 			delete dataset;
@@ -1071,17 +2724,12 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 			delete dataspace_ll_lp;
 			delete plist;
 			delete plist_ll_lp;
-			delete [] temp_buffer;
 			delete [] temp_ll_lp_buffer;
-			temp_buffer = NULL;
 			temp_ll_lp_buffer = NULL;
 			if(RJ){
 				delete dataset_status;
 				delete dataspace_status;
 				delete plist_status;
-				delete [] temp_status_buffer;
-				temp_status_buffer = NULL;
-
 			}
 			
 			//TODO -- this section can't be right.. 
@@ -1089,10 +2737,10 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 				int RANK=2;
 				hsize_t dims_model_status[RANK];
 				if(trim){
-					dims_model_status[0]= currentStepID[ids[i]]-trimLengths[ids[i]];
+					dims_model_status[0]= lastSteps[ids[i]]-trimLengths[ids[i]];
 				}
 				else{
-					dims_model_status[0]= currentStepID[ids[i]];
+					dims_model_status[0]= lastSteps[ids[i]];
 				}
 				dims_model_status[1]= 1;
 
@@ -1111,9 +2759,7 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 				temp_model_status_buffer = new int[ int(dims_model_status[0]*dims_model_status[1]) ];
 				int beginning_id=0;
 				if(trim){ beginning_id =trimLengths[ids[i]];}
-				for(int j = 0 ; j<currentStepID[ids[i]] - beginning_id; j++){
-					temp_model_status_buffer[j ] = positions[ids[i]][j+beginning_id]->modelID;	
-				}
+				copyModelIDs(this, ids[i], beginning_id, lastSteps[ids[i]] - beginning_id, temp_model_status_buffer);
 				dataset_model_status->write(temp_model_status_buffer, H5::PredType::NATIVE_INT);
 
 				//Cleanup
@@ -1138,16 +2784,7 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 		delete dataspace;
 		//#################################################
 		if(calculatedEvidence){
-			hsize_t dimsIL[1];
-			dimsIL[0]= ensembleSize;
-			dataspace = new H5::DataSpace(1,dimsIL);
-			dataset = new H5::DataSet(
-				meta_group.createDataSet("INTEGRATED LIKELIHOODS",
-					H5::PredType::NATIVE_DOUBLE,*dataspace)
-				);
-			dataset->write(integratedLikelihoods, H5::PredType::NATIVE_DOUBLE);	
-			delete dataset;
-			delete dataspace;
+			writeEvidenceMetadata(this, meta_group);
 		}
 		//#################################################
 		//if(integrated_likelihoods_terms){
@@ -1163,19 +2800,6 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 		//	delete dataspace;
 		//}
 		//#################################################
-		if(calculatedEvidence){
-			hsize_t dimsE[1];
-			dimsE[0]= 1;
-			dataspace = new H5::DataSpace(1,dimsE);
-			dataset = new H5::DataSet(
-				meta_group.createDataSet("EVIDENCE",
-					H5::PredType::NATIVE_DOUBLE,*dataspace)
-				);
-			dataset->write(&evidence, H5::PredType::NATIVE_DOUBLE);	
-			delete dataset;
-			delete dataspace;
-		}
-		//#################################################
 		dataspace = new H5::DataSpace(1,dimsT);
 		dataset = new H5::DataSet(
 			meta_group.createDataSet("SUGGESTED TRIM LENGTHS",
@@ -1253,6 +2877,8 @@ int samplerData::create_data_dump(bool cold_only, bool trim,std::string filename
 
 int samplerData::append_to_data_dump( std::string filename)
 {
+	/*Everything is written up to (not including) the last step*/
+	int *lastSteps = endStepIDs ? endStepIDs : currentStepID;
 	int file_id = 0;
 	bool found=false;
 	for(size_t i = 0 ; i<dump_file_names.size(); i++){
@@ -1264,6 +2890,9 @@ int samplerData::append_to_data_dump( std::string filename)
 	if(!found){
 		std::cout<<"ERROR -- File doesn't exist"<<std::endl;
 	}
+	else if(dump_files[file_id]->stacked){
+		return write_stacked_dump(file_id, false);
+	}
 	try{
 		std::string FILE_NAME(filename);
 		int chains;
@@ -1292,17 +2921,13 @@ int samplerData::append_to_data_dump( std::string filename)
 			model_status_group = H5::Group(file.openGroup("/MCMC_OUTPUT/MODEL_STATUS"));
 		}
 		H5::Group meta_group(file.openGroup("/MCMC_METADATA"));
-		double *temp_buffer=NULL;
 		double *temp_buffer_ll_lp=NULL;
-		int *temp_buffer_status=NULL;
 		int *temp_buffer_model_status=NULL;
 		H5::DataSpace *dataspace=NULL ;
 		H5::DataSpace *dataspace_ll_lp=NULL ;
 		H5::DataSpace *dataspace_status=NULL ;
 		H5::DataSpace *dataspace_model_status=NULL ;
-		H5::DataSpace *dataspace_ext=NULL ;
 		H5::DataSpace *dataspace_ext_ll_lp=NULL ;
-		H5::DataSpace *dataspace_ext_status=NULL ;
 		H5::DataSpace *dataspace_ext_model_status=NULL ;
 		H5::DataSet *dataset=NULL;
 		H5::DataSet *dataset_ll_lp=NULL;
@@ -1349,12 +2974,12 @@ int samplerData::append_to_data_dump( std::string filename)
 			hsize_t new_size[RANK];
 			hsize_t new_size_ll_lp[RANK];
 			if(dump_files[file_id]->trimmed){
-				new_size[0]= currentStepID[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
-				new_size_ll_lp[0]= currentStepID[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
+				new_size[0]= lastSteps[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
+				new_size_ll_lp[0]= lastSteps[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
 			}
 			else{
-				new_size[0]= currentStepID[ids[i]];
-				new_size_ll_lp[0]= currentStepID[ids[i]];
+				new_size[0]= lastSteps[ids[i]];
+				new_size_ll_lp[0]= lastSteps[ids[i]];
 			}
 			new_size[1]= maxDim;
 			new_size_ll_lp[1]= 2;
@@ -1383,22 +3008,17 @@ int samplerData::append_to_data_dump( std::string filename)
 			dataspace->selectHyperslab(H5S_SELECT_SET,dimext,offset);
 			dataspace_ll_lp->selectHyperslab(H5S_SELECT_SET,dimext_ll_lp,offset_ll_lp);
 
-			dataspace_ext = new H5::DataSpace(RANK, dimext,NULL);
 			dataspace_ext_ll_lp = new H5::DataSpace(RANK_ll_lp, dimext_ll_lp,NULL);
 
-			temp_buffer = new double[ dimext[0]*dimext[1] ];
 			temp_buffer_ll_lp = new double[ dimext_ll_lp[0]*dimext_ll_lp[1] ];
 			int beginning_id = 0 ; 
 			if(dump_files[file_id]->trimmed){beginning_id = dump_files[file_id]->fileTrimLengths[ids[i]];}
-			for(int j = base_dims[0] ; j<currentStepID[ids[i]]-beginning_id; j++){
-				for(int k = 0 ; k<maxDim; k++){
-					temp_buffer[(j-base_dims[0])*maxDim +k] = positions[ids[i]][j+beginning_id]->parameters[k];	
-				}
+			for(int j = base_dims[0] ; j<lastSteps[ids[i]]-beginning_id; j++){
 				temp_buffer_ll_lp[(j-base_dims_ll_lp[0])*2 ] = likelihoodVals[ids[i]][j+beginning_id];	
 				temp_buffer_ll_lp[(j-base_dims_ll_lp[0])*2+1 ] = priorVals[ids[i]][j+beginning_id];	
 			}
 			
-			dataset->write(temp_buffer,H5::PredType::NATIVE_DOUBLE,*dataspace_ext, *dataspace);
+			writeChainSegments(this, dataset, ids[i], base_dims[0]+beginning_id, lastSteps[ids[i]], base_dims[0], false);
 			dataset_ll_lp->write(temp_buffer_ll_lp,H5::PredType::NATIVE_DOUBLE,*dataspace_ext_ll_lp, *dataspace_ll_lp);
 
 			//Cleanup
@@ -1406,13 +3026,10 @@ int samplerData::append_to_data_dump( std::string filename)
 			delete dataset_ll_lp;
 			delete dataspace;
 			delete dataspace_ll_lp;
-			delete dataspace_ext;
 			delete dataspace_ext_ll_lp;
 			delete plist;
 			delete plist_ll_lp;
-			delete [] temp_buffer;
 			delete [] temp_buffer_ll_lp;
-			temp_buffer = NULL;
 			temp_buffer_ll_lp = NULL;
 
 			if(RJ){
@@ -1432,10 +3049,10 @@ int samplerData::append_to_data_dump( std::string filename)
 				
 				hsize_t new_size_status[RANK];
 				if(dump_files[file_id]->trimmed){
-					new_size_status[0]= currentStepID[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
+					new_size_status[0]= lastSteps[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
 				}
 				else{
-					new_size_status[0]= currentStepID[ids[i]];
+					new_size_status[0]= lastSteps[ids[i]];
 				}
 				new_size_status[1]= maxDim;
 				dataset_status->extend(new_size_status);
@@ -1453,25 +3070,14 @@ int samplerData::append_to_data_dump( std::string filename)
 
 				dataspace_status->selectHyperslab(H5S_SELECT_SET,dimext_status,offset_status);
 
-				dataspace_ext_status = new H5::DataSpace(RANK_status, dimext_status,NULL);
 
-				temp_buffer_status = new int[ dimext_status[0]*dimext_status[1] ];
 				int beginning_id = 0 ; 
 				if(dump_files[file_id]->trimmed){beginning_id = dump_files[file_id]->fileTrimLengths[ids[i]];}
-				for(int j = base_dims_status[0] ; j<currentStepID[ids[i]]-beginning_id; j++){
-					for(int k = 0 ; k<maxDim; k++){
-						temp_buffer_status[(j-base_dims_status[0])*maxDim +k] = positions[ids[i]][j+beginning_id]->status[k];	
-					}
-				}
-				
-				dataset_status->write(temp_buffer_status,H5::PredType::NATIVE_INT,*dataspace_ext_status, *dataspace_status);
+				writeChainSegments(this, dataset_status, ids[i], base_dims_status[0]+beginning_id, lastSteps[ids[i]], base_dims_status[0], true);
 				//Cleanup
 				delete dataset_status;
 				delete dataspace_status;
-				delete dataspace_ext_status;
 				delete plist_status;
-				delete [] temp_buffer_status;
-				temp_buffer_status = NULL;
 
 				{
 				//TODO -- this section can't be right.. 
@@ -1490,10 +3096,10 @@ int samplerData::append_to_data_dump( std::string filename)
 				
 				hsize_t new_size_model_status[RANK];
 				if(dump_files[file_id]->trimmed){
-					new_size_model_status[0]= currentStepID[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
+					new_size_model_status[0]= lastSteps[ids[i]]-dump_files[file_id]->fileTrimLengths[ids[i]];
 				}
 				else{
-					new_size_model_status[0]= currentStepID[ids[i]];
+					new_size_model_status[0]= lastSteps[ids[i]];
 				}
 				new_size_model_status[1]= 1;
 				dataset_model_status->extend(new_size_model_status);
@@ -1516,9 +3122,7 @@ int samplerData::append_to_data_dump( std::string filename)
 				temp_buffer_model_status = new int[ dimext_model_status[0]*dimext_model_status[1] ];
 				int beginning_id = 0 ; 
 				if(dump_files[file_id]->trimmed){beginning_id = dump_files[file_id]->fileTrimLengths[ids[i]];}
-				for(int j = base_dims_model_status[0] ; j<currentStepID[ids[i]]-beginning_id; j++){
-					temp_buffer_model_status[(j-base_dims_model_status[0]) ] = positions[ids[i]][j+beginning_id]->modelID;	
-				}
+				copyModelIDs(this, ids[i], base_dims_model_status[0]+beginning_id, lastSteps[ids[i]]-beginning_id-base_dims_model_status[0], temp_buffer_model_status);
 				
 				dataset_model_status->write(temp_buffer_model_status,H5::PredType::NATIVE_INT,*dataspace_ext_model_status, *dataspace_model_status);
 				//Cleanup
@@ -1553,9 +3157,7 @@ int samplerData::append_to_data_dump( std::string filename)
 		//}
 		////#####################################################
 		if(calculatedEvidence){
-			dataset = new H5::DataSet(meta_group.openDataSet("EVIDENCE"));
-			dataset->write(&evidence, H5::PredType::NATIVE_DOUBLE);	
-			delete dataset;
+			writeEvidenceMetadata(this, meta_group);
 		}
 		////#####################################################
 		if(!dump_files[file_id]->trimmed ){
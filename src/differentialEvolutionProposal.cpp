@@ -39,42 +39,42 @@ void differentialEvolutionProposal::propose(positionInfo *currentPosition, posit
 	if(sampler->burnPeriod || !sampler->burnData){
 	//if(true){
 		int id1, id2=-1 ;
-		id1 = (int) (gsl_rng_uniform(sampler->rvec[chainID])*currentStep);
+		id1 = (int) (sampler->rng->uniform(chainID, rngProposal)*currentStep);
 		do{
-			id2 = (int) (gsl_rng_uniform(sampler->rvec[chainID])*currentStep);
+			id2 = (int) (sampler->rng->uniform(chainID, rngProposal)*currentStep);
 		}while(id1 ==id2)	;
-		historyPosition1 = data->positions[chainID][id1];
-		historyPosition2 = data->positions[chainID][id2];
+		historyPosition1 = data->getPosition(chainID, id1);
+		historyPosition2 = data->getPosition(chainID, id2);
 	}
 	else{
 		int burnIterations = sampler->burnData->currentStepID[chainID];
 		int id1, id2=-1 ;
-		id1 = (int)(gsl_rng_uniform(sampler->rvec[chainID])*(currentStep+burnIterations));
+		id1 = (int)(sampler->rng->uniform(chainID, rngProposal)*(currentStep+burnIterations));
 		do{
-			id2 = (int)(gsl_rng_uniform(sampler->rvec[chainID])*(currentStep+burnIterations));
+			id2 = (int)(sampler->rng->uniform(chainID, rngProposal)*(currentStep+burnIterations));
 		}while(id1 ==id2)	;
 		if(id1 >= burnIterations){
-			historyPosition1 = data->positions[chainID][id1-burnIterations];
+			historyPosition1 = data->getPosition(chainID, id1-burnIterations);
 		}
 		else {
-			historyPosition1 = sampler->burnData->positions[chainID][id1];
+			historyPosition1 = sampler->burnData->getPosition(chainID, id1);
 
 		}
 		if(id2 >= burnIterations){
-			historyPosition2 = data->positions[chainID][id2-burnIterations];
+			historyPosition2 = data->getPosition(chainID, id2-burnIterations);
 		}
 		else {
-			historyPosition2 = sampler->burnData->positions[chainID][id2];
+			historyPosition2 = sampler->burnData->getPosition(chainID, id2);
 
 		}
 
 	}
 
 	//double stepWidth = 1;
-	double  alpha = gsl_rng_uniform(sampler->rvec[chainID]);
+	double  alpha = sampler->rng->uniform(chainID, rngProposal);
 	double gamma = 1;
 	if( alpha < .9){
-		gamma = gsl_ran_gaussian(sampler->rvec[chainID],2.38/std::sqrt(2.*internalDim));
+		gamma = sampler->rng->gaussian(chainID, rngProposal, 2.38/std::sqrt(2.*internalDim));
 	}
 	for(int i = 0 ; i<internalDim; i++){
 		proposedPosition->parameters[i] +=
@@ -59,22 +59,15 @@ gaussianProposal::gaussianProposal(
 	int chainN, /**< Number of chains in the ensemble*/
 	int maxDim, /**< Maximum dimension of the space*/
 	bayesshipSampler *sampler,
-	int seed /**< Seed to use for initiating random numbers*/
+	int seed /**< Unused -- random numbers come from the sampler's counter-based streams (see bayesshipSampler::rng)*/
 	)
 {
 	this->chainN = chainN;
 	this->maxDim = maxDim;
-	gsl_rng_env_setup();
-	r = new gsl_rng *[chainN];
 	gaussWidths = new double*[chainN];
 	this->sampler=sampler;
 
-	const gsl_rng_type *T=gsl_rng_default;
-
 	for(int i =0 ;i<chainN; i++){
-		r[i] = gsl_rng_alloc(T);
-		gsl_rng_set(r[i],seed+i);
-		
 		gaussWidths[i] = new double[maxDim];
 		for(int j = 0 ; j<maxDim; j++){
 			gaussWidths[i][j] = 1;
@@ -90,13 +83,6 @@ gaussianProposal::gaussianProposal(
 }
 gaussianProposal::~gaussianProposal()
 {
-	if(r){
-		for(int i =0 ;i<chainN; i++){
-			gsl_rng_free(r[i]);
-		}
-		delete [] r;	
-		r=nullptr;
-	}
 	if(gaussWidths){
 		for(int i =0 ;i<chainN; i++){
 			delete [] gaussWidths[i];
@@ -144,7 +130,7 @@ void gaussianProposal::propose(positionInfo *currentPosition, positionInfo *prop
 	}
 	int currentDim = currentPosition->countActiveDimensions();
 		
-	int beta = (int) (gsl_rng_uniform(r[chainID])*currentDim);
+	int beta = (int) (sampler->rng->uniform(chainID, rngProposal)*currentDim);
 	int dim = beta;
 	if(sampler->RJ){
 		dim = 0 ;
@@ -163,7 +149,9 @@ void gaussianProposal::propose(positionInfo *currentPosition, positionInfo *prop
 		previousDimID[chainID] = dim;
 		previousAccepts[chainID] = data->successN[chainID][stepID];
 	}
-	proposedPosition->parameters[dim] +=   gsl_ran_gaussian(r[chainID],gaussWidths[chainID][dim]);
+	double step;
+	sampler->rng->stream(chainID, rngProposal)->normalBlock(&step, 1, gaussWidths[chainID][dim]);
+	proposedPosition->parameters[dim] += step;
 	return;
 }
 
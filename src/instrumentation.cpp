@@ -0,0 +1,193 @@
+#include "bayesship/instrumentation.h"
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+/*! \file
+ *
+ * # Source file for the hot-path instrumentation of the sampler
+ */
+
+namespace bayesship{
+
+latencyHistogram::latencyHistogram()
+{
+	reset();
+}
+
+void latencyHistogram::reset()
+{
+	for(int i = 0 ; i<bucketN; i++){
+		counts[i] = 0;
+	}
+	count = 0;
+	total = 0;
+	max = 0;
+}
+
+/*! \brief Bucket holding value -- values below 2*subBuckets get a bucket each, and every power of 2 above that is split into subBuckets
+ */
+int latencyHistogram::bucket(int64_t value)
+{
+	if(value < 2*subBuckets){
+		return (int)value;
+	}
+	int exponent = 63 - __builtin_clzll((unsigned long long)value);
+	int sub = (int)((value >> (exponent - subBucketBits)) & (subBuckets-1));
+	return (exponent - subBucketBits + 1)*subBuckets + sub;
+}
+
+/*! \brief Largest value that lands in bucket
+ */
+int64_t latencyHistogram::bucketValue(int bucket)
+{
+	if(bucket < 2*subBuckets){
+		return bucket;
+	}
+	int exponent = bucket/subBuckets + subBucketBits - 1;
+	int64_t sub = bucket%subBuckets;
+	int64_t width = (int64_t)1<<(exponent - subBucketBits);
+	return ((subBuckets + sub) << (exponent - subBucketBits)) + width - 1;
+}
+
+void latencyHistogram::merge(const latencyHistogram &other)
+{
+	for(int i = 0 ; i<bucketN; i++){
+		counts[i] += other.counts[i];
+	}
+	count += other.count;
+	total += other.total;
+	if(other.max > max){
+		max = other.max;
+	}
+}
+
+/*! \brief Value below which a fraction p of the recorded values fall (to the bucket precision, and never more than the max)
+ */
+int64_t latencyHistogram::percentile(double p)
+{
+	if(count == 0){
+		return 0;
+	}
+	uint64_t target = (uint64_t)(p*count);
+	if(target < 1){
+		target = 1;
+	}
+	uint64_t running = 0;
+	for(int i = 0 ; i<bucketN; i++){
+		running+=counts[i];
+		if(running >= target){
+			int64_t value = bucketValue(i);
+			return (value > max) ? max : value;
+		}
+	}
+	return max;
+}
+
+double latencyHistogram::mean()
+{
+	if(count == 0){
+		return 0;
+	}
+	return (double)total/count;
+}
+
+//##########################################################
+//##########################################################
+
+static std::atomic<uint64_t> instrumentationInstances{0};
+
+instrumentation::instrumentation(
+	int sampleEvery/**< Time one in every sampleEvery events on each thread*/
+	)
+{
+	this->sampleEvery = sampleEvery;
+	instanceID = ++instrumentationInstances;
+}
+
+instrumentation::~instrumentation()
+{
+	for(size_t i = 0 ; i<threadSlots.size(); i++){
+		threadSlots[i]->~threadInstruments();
+		free(threadSlots[i]);
+	}
+	threadSlots.clear();
+}
+
+/*! \brief Histograms belonging to the calling thread -- registered (under a lock) on first use, then cached in thread local storage
+ */
+threadInstruments *instrumentation::local()
+{
+	thread_local uint64_t cachedID = 0;
+	thread_local threadInstruments *cachedSlot = nullptr;
+	if(cachedID == instanceID){
+		return cachedSlot;
+	}
+	void *block = nullptr;
+	if(posix_memalign(&block, 64, sizeof(threadInstruments)) != 0){
+		throw std::bad_alloc();
+	}
+	threadInstruments *slot = new (block) threadInstruments();
+	{
+		std::unique_lock<std::mutex> lock{registerMutex};
+		threadSlots.push_back(slot);
+	}
+	cachedID = instanceID;
+	cachedSlot = slot;
+	return slot;
+}
+
+/*! \brief Histogram for event, merged over every thread
+ *
+ * Should only be called while the threads are idle
+ */
+latencyHistogram instrumentation::merged(instrumentEvent event)
+{
+	latencyHistogram total;
+	std::unique_lock<std::mutex> lock{registerMutex};
+	for(size_t i = 0 ; i<threadSlots.size(); i++){
+		total.merge(threadSlots[i]->histograms[event]);
+	}
+	return total;
+}
+
+/*! \brief Clear every histogram (threads keep their slots)
+ */
+void instrumentation::reset()
+{
+	std::unique_lock<std::mutex> lock{registerMutex};
+	for(size_t i = 0 ; i<threadSlots.size(); i++){
+		for(int j = 0 ; j<eventN; j++){
+			threadSlots[i]->histograms[j].reset();
+		}
+		threadSlots[i]->ticks = 0;
+	}
+}
+
+/*! \brief Write the latency summary for every event (nanoseconds)
+ */
+void instrumentation::writeStatFile(std::string filename)
+{
+	std::string names[eventN] = {"Propose","Prior","Likelihood","Swap","Queue wait"};
+	std::ofstream outFile;
+	outFile.open(filename);
+	outFile<<"Latencies (ns) -- sampled every "<<sampleEvery<<" events per thread, over "<<threadSlots.size()<<" threads"<<std::endl;
+	outFile<<"[event][count, mean, p50, p90, p99, p99.9, max]"<<std::endl;
+	for(int i = 0 ; i<eventN; i++){
+		latencyHistogram histogram = merged((instrumentEvent)i);
+		outFile<<names[i]<<": ";
+		outFile<<histogram.count<<", ";
+		outFile<<histogram.mean()<<", ";
+		outFile<<histogram.percentile(.5)<<", ";
+		outFile<<histogram.percentile(.9)<<", ";
+		outFile<<histogram.percentile(.99)<<", ";
+		outFile<<histogram.percentile(.999)<<", ";
+		outFile<<histogram.max;
+		outFile<<std::endl;
+	}
+	outFile.close();
+}
+
+}
@@ -0,0 +1,164 @@
+#include "bayesship/npyOutput.h"
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*! \file
+ *
+ * # Source file for streaming chains into NumPy .npy files
+ */
+
+namespace bayesship{
+
+const int npyArrayFile::headerBytes;
+
+/*! \brief Constructor -- creates (truncating) filename with room for initialRows rows and an empty header
+ */
+npyArrayFile::npyArrayFile(
+	std::string filename,/**< File to write*/
+	char kind,/**< NumPy type kind -- 'f' for floating point, 'i' for signed integers*/
+	int itemSize,/**< Bytes per element*/
+	int width,/**< Elements per row*/
+	long long initialRows/**< Rows to preallocate*/
+	)
+{
+	this->filename = filename;
+	this->width = width;
+	this->rowBytes = (size_t)itemSize*width;
+	uint16_t probe = 1;
+	bool littleEndian = *(char *)&probe == 1;
+	descr = std::string(1, littleEndian ? '<' : '>') + kind + std::to_string(itemSize);
+	fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0){
+		std::cout<<"ERROR -- Could not open "<<filename<<std::endl;
+		return;
+	}
+	if(grow(std::max(initialRows, 1LL))){
+		writeHeader();
+	}
+}
+
+npyArrayFile::~npyArrayFile()
+{
+	close();
+}
+
+/*! \brief Whether the file is open and mapped
+ */
+bool npyArrayFile::good()
+{
+	return map != nullptr;
+}
+
+/*! \brief Map room for at least neededRows rows (doubling the capacity), extending the file
+ */
+bool npyArrayFile::grow(long long neededRows)
+{
+	long long newCapacity = std::max(neededRows, 2*capacity);
+	size_t newBytes = headerBytes + newCapacity*rowBytes;
+	if(map){
+		munmap(map, headerBytes + capacity*rowBytes);
+		map = nullptr;
+	}
+	if(ftruncate(fd, newBytes) != 0){
+		std::cout<<"ERROR -- Could not extend "<<filename<<std::endl;
+		return false;
+	}
+	void *newMap = mmap(nullptr, newBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(newMap == MAP_FAILED){
+		std::cout<<"ERROR -- Could not map "<<filename<<std::endl;
+		return false;
+	}
+	map = (char *)newMap;
+	capacity = newCapacity;
+	return true;
+}
+
+/*! \brief Write the (version 1.0) header for the rows committed so far, padded with spaces to headerBytes
+ */
+void npyArrayFile::writeHeader()
+{
+	std::string dict = "{'descr': '"+descr+"', 'fortran_order': False, 'shape': ("+std::to_string(rows)+", "+std::to_string(width)+"), }";
+	int dictBytes = headerBytes - 10;
+	dict.resize(dictBytes-1, ' ');
+	dict += '\n';
+	char header[headerBytes];
+	memcpy(header, "\x93NUMPY", 6);
+	header[6] = 1;
+	header[7] = 0;
+	/*The header length is always little endian*/
+	header[8] = dictBytes & 0xff;
+	header[9] = (dictBytes >> 8) & 0xff;
+	memcpy(header+10, dict.data(), dictBytes);
+	memcpy(map, header, headerBytes);
+}
+
+/*! \brief Room for newRows more rows -- returns where the first of them goes. They're not part of the array until commit is called
+ *
+ * The pointer is only good until the next call to reserve or append
+ */
+void *npyArrayFile::reserve(
+	long long newRows/**< Rows to make room for*/
+	)
+{
+	if(!map){
+		return nullptr;
+	}
+	if(rows + newRows > capacity && !grow(rows + newRows)){
+		return nullptr;
+	}
+	return map + headerBytes + rows*rowBytes;
+}
+
+/*! \brief Add the newRows rows written after reserve to the array, and update the header
+ */
+void npyArrayFile::commit(
+	long long newRows/**< Rows written*/
+	)
+{
+	if(!map){
+		return;
+	}
+	rows += newRows;
+	writeHeader();
+}
+
+/*! \brief Copy newRows rows from values to the end of the array
+ */
+void npyArrayFile::append(
+	const void *values,/**< Rows to add -- shape [newRows][width]*/
+	long long newRows/**< Rows to add*/
+	)
+{
+	void *destination = reserve(newRows);
+	if(!destination){
+		return;
+	}
+	memcpy(destination, values, newRows*rowBytes);
+	commit(newRows);
+}
+
+/*! \brief Unmap the file and cut it down to the committed rows
+ */
+void npyArrayFile::close()
+{
+	if(fd < 0){
+		return;
+	}
+	if(map){
+		writeHeader();
+		munmap(map, headerBytes + capacity*rowBytes);
+		map = nullptr;
+	}
+	if(ftruncate(fd, headerBytes + rows*rowBytes) != 0){
+		std::cout<<"WARNING -- Could not trim "<<filename<<std::endl;
+	}
+	::close(fd);
+	fd = -1;
+}
+
+}
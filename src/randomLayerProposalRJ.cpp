@@ -44,7 +44,7 @@ void randomLayerRJProposal::propose(positionInfo *currentStep, positionInfo *pro
 		activeDims += currentStep->status[i];
 	}
 
-	double prob = gsl_rng_uniform(sampler->rvec[chainID]);
+	double prob = sampler->rng->uniform(chainID, rngProposal);
 
 	//##################################################
 	//create
@@ -52,7 +52,7 @@ void randomLayerRJProposal::propose(positionInfo *currentStep, positionInfo *pro
 		if( activeDims < sampler->maxDim){
 				
 			//Pick random, inactive dimension
-			int id = (sampler->maxDim -activeDims)*gsl_rng_uniform(sampler->rvec[chainID]);
+			int id = (sampler->maxDim -activeDims)*sampler->rng->uniform(chainID, rngProposal);
 			int ct=0;
 			for(int i = 0 ; i<sampler->maxDim; i++){
 				if (!proposedStep->status[i] )
@@ -67,12 +67,12 @@ void randomLayerRJProposal::propose(positionInfo *currentStep, positionInfo *pro
 
 			proposedStep->status[id] = 1;
 			if(sampler->priorRanges){
-				proposedStep->parameters[id] = gsl_rng_uniform(sampler->rvec[chainID])*(sampler->priorRanges[id][1]-sampler->priorRanges[id][0])+sampler->priorRanges[id][0];
+				proposedStep->parameters[id] = sampler->rng->uniform(chainID, rngProposal)*(sampler->priorRanges[id][1]-sampler->priorRanges[id][0])+sampler->priorRanges[id][0];
 				//*MHRatioModifications -=std::log(1./(sampler->priorRanges[lastID+1][1]-sampler->priorRanges[lastID+1][0])) ;
 				*MHRatioModifications -=std::log(1./(sampler->priorRanges[id][1]-sampler->priorRanges[id][0])) ;
 			}
 			else{
-				proposedStep->parameters[id] = gsl_rng_uniform(sampler->rvec[chainID]);
+				proposedStep->parameters[id] = sampler->rng->uniform(chainID, rngProposal);
 			}
 			*MHRatioModifications+=std::log((1.-alpha)/(alpha));
 			//proposedStep->parameters[P+1] = gsl_rng_uniform(h->r);
@@ -85,7 +85,7 @@ void randomLayerRJProposal::propose(positionInfo *currentStep, positionInfo *pro
 		if( activeDims >sampler->minDim){
 
 			//Pick random, active dimension
-			int id = (activeDims-sampler->minDim)*gsl_rng_uniform(sampler->rvec[chainID]);
+			int id = (activeDims-sampler->minDim)*sampler->rng->uniform(chainID, rngProposal);
 			int ct=0;
 			for(int i = sampler->minDim ; i<sampler->maxDim; i++){
 				if (proposedStep->status[i] )
@@ -0,0 +1,349 @@
+#include "bayesship/randomNumberUtilities.h"
+#include <math.h>
+#include <algorithm>
+
+/*! \file
+ *
+ * # Source file for the counter-based random number generators
+ */
+
+namespace bayesship{
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+/*! \brief Two 32 bit words to a double with 53 random bits, on the open interval (0,1) (safe to take the log of)
+ */
+static inline double wordsToUniform(uint32_t a, uint32_t b)
+{
+	return ((a>>5)*67108864.0 + (b>>6) + 0.5) * (1.0/9007199254740992.0);
+}
+
+#define PHILOX_CHUNK 16
+
+/*! \brief Philox4x32-10 for blockN independent counters, blockN <= PHILOX_CHUNK
+ *
+ * The rounds are the outer loop and the blocks the inner loop, so the inner loop is a straight line of independent 32x32->64 multiplies that the compiler can vectorize
+ */
+static void philoxChunk(
+	const uint32_t *counters,/**< Counters -- shape [blockN][4]*/
+	const uint32_t *key,/**< Key shared by every block -- length 2*/
+	int blockN,/**< Number of blocks*/
+	uint32_t *output/**< [out] Random words -- shape [blockN][4]*/
+	)
+{
+	uint32_t x0[PHILOX_CHUNK];
+	uint32_t x1[PHILOX_CHUNK];
+	uint32_t x2[PHILOX_CHUNK];
+	uint32_t x3[PHILOX_CHUNK];
+	for(int b = 0 ; b<blockN; b++){
+		x0[b] = counters[4*b];
+		x1[b] = counters[4*b+1];
+		x2[b] = counters[4*b+2];
+		x3[b] = counters[4*b+3];
+	}
+	uint32_t k0 = key[0];
+	uint32_t k1 = key[1];
+	for(int r = 0 ; r<PHILOX_ROUNDS; r++){
+		for(int b = 0 ; b<blockN; b++){
+			uint64_t p0 = (uint64_t)PHILOX_M0 * x0[b];
+			uint64_t p1 = (uint64_t)PHILOX_M1 * x2[b];
+			uint32_t y0 = (uint32_t)(p1>>32) ^ x1[b] ^ k0;
+			uint32_t y2 = (uint32_t)(p0>>32) ^ x3[b] ^ k1;
+			x1[b] = (uint32_t)p1;
+			x3[b] = (uint32_t)p0;
+			x0[b] = y0;
+			x2[b] = y2;
+		}
+		k0+=PHILOX_W0;
+		k1+=PHILOX_W1;
+	}
+	for(int b = 0 ; b<blockN; b++){
+		output[4*b] = x0[b];
+		output[4*b+1] = x1[b];
+		output[4*b+2] = x2[b];
+		output[4*b+3] = x3[b];
+	}
+}
+
+/*! \brief Philox4x32-10 counter-based random number generator
+ *
+ * Maps a 128 bit counter and 64 bit key to 128 random bits
+ */
+void philox4x32(
+	const uint32_t *counter,/**< Counter -- length 4*/
+	const uint32_t *key,/**< Key -- length 2*/
+	uint32_t *output/**< [out] Random words -- length 4*/
+	)
+{
+	philoxChunk(counter, key, 1, output);
+}
+
+//##########################################################
+//##########################################################
+
+rngStream::rngStream()
+{
+	setKey(0);
+	reset(0,0,0);
+}
+
+/*! \brief Set the key (seed) of the stream -- the position in the stream is not changed
+ */
+void rngStream::setKey(uint64_t seed)
+{
+	key[0] = (uint32_t)seed;
+	key[1] = (uint32_t)(seed>>32);
+}
+
+/*! \brief Move the stream to the start of the sequence for (step, streamID, purpose)
+ *
+ * The last counter word holds the purpose in the top 8 bits, and the block index in the bottom 24 bits
+ */
+void rngStream::reset(
+	uint64_t step,/**< Step number of the chain*/
+	uint32_t streamID,/**< Typically the chain ID*/
+	uint32_t purpose/**< See rngPurpose*/
+	)
+{
+	counter[0] = (uint32_t)step;
+	counter[1] = (uint32_t)(step>>32);
+	counter[2] = streamID;
+	counter[3] = purpose<<24;
+	bufferPos = 4;
+	hasSpareGaussian = false;
+}
+
+void rngStream::nextBlock()
+{
+	philox4x32(counter, key, buffer);
+	counter[3]++;
+	bufferPos = 0;
+}
+
+/*! \brief Uniform draw on (0,1)
+ */
+double rngStream::uniform()
+{
+	if(bufferPos > 2){
+		nextBlock();
+	}
+	double u = wordsToUniform(buffer[bufferPos], buffer[bufferPos+1]);
+	bufferPos+=2;
+	return u;
+}
+
+/*! \brief Gaussian draw with standard deviation sigma (Box-Muller -- the second value of each pair is kept for the next call)
+ */
+double rngStream::gaussian(double sigma)
+{
+	if(hasSpareGaussian){
+		hasSpareGaussian = false;
+		return sigma*spareGaussian;
+	}
+	double u1 = uniform();
+	double u2 = uniform();
+	double r = sqrt(-2.*log(u1));
+	spareGaussian = r*sin(2.*M_PI*u2);
+	hasSpareGaussian = true;
+	return sigma*r*cos(2.*M_PI*u2);
+}
+
+/*! \brief Geometric draw with success probability p -- number of trials up to and including the first success (same convention as gsl_ran_geometric)
+ */
+unsigned int rngStream::geometric(double p)
+{
+	if(p >= 1){
+		return 1;
+	}
+	return (unsigned int)(floor(log(uniform())/log1p(-p)) + 1);
+}
+
+/*! \brief Fill output with the next n uniform draws on (0,1) -- the same values n calls to uniform would return
+ *
+ * After the current block is used up, every Philox block (4 words, 2 draws) is generated PHILOX_CHUNK at a time and written straight into output
+ */
+void rngStream::uniformBlock(
+	double *output,/**< [out] Draws -- length n*/
+	int n/**< Number of draws*/
+	)
+{
+	int i = 0;
+	/*Finish the current block first, so the stream stays one sequence*/
+	while(i<n && bufferPos <= 2){
+		output[i] = uniform();
+		i++;
+	}
+	uint32_t counters[4*PHILOX_CHUNK];
+	uint32_t words[4*PHILOX_CHUNK];
+	while(i<n){
+		int blockN = std::min((n-i+1)/2, PHILOX_CHUNK);
+		for(int b = 0 ; b<blockN; b++){
+			counters[4*b] = counter[0];
+			counters[4*b+1] = counter[1];
+			counters[4*b+2] = counter[2];
+			counters[4*b+3] = counter[3]+b;
+		}
+		philoxChunk(counters, key, blockN, words);
+		counter[3]+=blockN;
+		int draws = std::min(2*blockN, n-i);
+		for(int b = 0 ; b<draws; b++){
+			output[i] = wordsToUniform(words[2*b], words[2*b+1]);
+			i++;
+		}
+		/*An odd number of draws leaves the second half of the last block for the next draw*/
+		if(draws < 2*blockN){
+			for(int w = 0 ; w<4; w++){
+				buffer[w] = words[4*(blockN-1)+w];
+			}
+			bufferPos = 2;
+		}
+	}
+}
+
+/*! \brief Fill output with n gaussian draws with standard deviation sigma (Box-Muller on a block of uniforms, see uniformBlock)
+ *
+ * Both values of each pair are used, so for odd n the second value of the last pair is dropped -- the spare value kept by gaussian is left alone
+ */
+void rngStream::normalBlock(
+	double *output,/**< [out] Draws -- length n*/
+	int n,/**< Number of draws*/
+	double sigma/**< Standard deviation*/
+	)
+{
+	int pairs = n/2;
+	uniformBlock(output, 2*pairs);
+	for(int i = 0 ; i<pairs; i++){
+		double r = sigma*sqrt(-2.*log(output[2*i]));
+		double theta = 2.*M_PI*output[2*i+1];
+		output[2*i] = r*cos(theta);
+		output[2*i+1] = r*sin(theta);
+	}
+	if(n%2 == 1){
+		double u[2];
+		uniformBlock(u, 2);
+		output[n-1] = sigma*sqrt(-2.*log(u[0]))*cos(2.*M_PI*u[1]);
+	}
+}
+
+//##########################################################
+//##########################################################
+
+counterRNG::counterRNG(
+	int streamN,/**< Number of streams (chains)*/
+	uint64_t seed/**< Seed shared by all the streams*/
+	)
+{
+	this->streamN = streamN;
+	this->seed = seed;
+	steps = new uint64_t[streamN];
+	streams = new rngStream*[streamN];
+	for(int i = 0 ; i<streamN; i++){
+		streams[i] = new rngStream[rngPurposeN];
+		for(int j = 0 ; j<rngPurposeN; j++){
+			streams[i][j].setKey(seed);
+		}
+		setStep(i,0);
+	}
+}
+
+counterRNG::~counterRNG()
+{
+	if(streams){
+		for(int i = 0 ; i<streamN; i++){
+			delete [] streams[i];
+		}
+		delete [] streams;
+		streams = nullptr;
+	}
+	if(steps){
+		delete [] steps;
+		steps = nullptr;
+	}
+}
+
+/*! \brief Advance chainID to its next step -- every purpose stream for the chain starts a fresh sequence
+ */
+void counterRNG::beginStep(int chainID)
+{
+	setStep(chainID, steps[chainID]+1);
+}
+
+/*! \brief Move chainID to step (used when loading checkpoints)
+ */
+void counterRNG::setStep(int chainID, uint64_t step)
+{
+	steps[chainID] = step;
+	for(int j = 0 ; j<rngPurposeN; j++){
+		streams[chainID][j].reset(step, chainID, j);
+	}
+}
+
+rngStream *counterRNG::stream(int chainID, int purpose)
+{
+	return &streams[chainID][purpose];
+}
+
+double counterRNG::uniform(int chainID, int purpose)
+{
+	return streams[chainID][purpose].uniform();
+}
+
+double counterRNG::gaussian(int chainID, int purpose, double sigma)
+{
+	return streams[chainID][purpose].gaussian(sigma);
+}
+
+/*! \brief Next uniform draw of the purpose stream of each of chainIDs, written to output -- the same values uniform(chainIDs[i], purpose) would return
+ *
+ * The streams that need a new Philox block get them PHILOX_CHUNK chains at a time (the streams share the key, only the counters differ), which is what makes the per-chain draws of a lockstep pass cheap
+ */
+void counterRNG::uniformBlock(
+	const int *chainIDs,/**< Chains to draw for -- each at most once*/
+	int n,/**< Number of chainIDs*/
+	int purpose,/**< See rngPurpose*/
+	double *output/**< [out] Draw for each of chainIDs -- length n*/
+	)
+{
+	uint32_t counters[4*PHILOX_CHUNK];
+	uint32_t words[4*PHILOX_CHUNK];
+	int pending[PHILOX_CHUNK];
+	int blockN = 0;
+	/*Generate the queued blocks, and hand each stream its block with the first draw taken*/
+	auto flush = [&](){
+		philoxChunk(counters, streams[chainIDs[pending[0]]][purpose].key, blockN, words);
+		for(int b = 0 ; b<blockN; b++){
+			rngStream *stream = &streams[chainIDs[pending[b]]][purpose];
+			for(int w = 0 ; w<4; w++){
+				stream->buffer[w] = words[4*b+w];
+			}
+			stream->counter[3]++;
+			stream->bufferPos = 2;
+			output[pending[b]] = wordsToUniform(words[4*b], words[4*b+1]);
+		}
+		blockN = 0;
+	};
+	for(int i = 0 ; i<n; i++){
+		rngStream *stream = &streams[chainIDs[i]][purpose];
+		if(stream->bufferPos <= 2){
+			output[i] = stream->uniform();
+			continue;
+		}
+		for(int w = 0 ; w<4; w++){
+			counters[4*blockN+w] = stream->counter[w];
+		}
+		pending[blockN] = i;
+		blockN++;
+		if(blockN == PHILOX_CHUNK){
+			flush();
+		}
+	}
+	if(blockN > 0){
+		flush();
+	}
+}
+
+}
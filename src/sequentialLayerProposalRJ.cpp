@@ -44,7 +44,7 @@ void sequentialLayerRJProposal::propose(positionInfo *currentStep, positionInfo
 		activeDims += currentStep->status[i];
 	}
 
-	double prob = gsl_rng_uniform(sampler->rvec[chainID]);
+	double prob = sampler->rng->uniform(chainID, rngProposal);
 
 	int lastID = activeDims - 1;// ID of the last active dimension
 
@@ -54,12 +54,12 @@ void sequentialLayerRJProposal::propose(positionInfo *currentStep, positionInfo
 		if( activeDims < sampler->maxDim){
 			proposedStep->status[lastID+1] = 1;
 			if(sampler->priorRanges){
-				proposedStep->parameters[lastID+1] = gsl_rng_uniform(sampler->rvec[chainID])*(sampler->priorRanges[lastID+1][1]-sampler->priorRanges[lastID + 1][0])+sampler->priorRanges[lastID + 1][0];
+				proposedStep->parameters[lastID+1] = sampler->rng->uniform(chainID, rngProposal)*(sampler->priorRanges[lastID+1][1]-sampler->priorRanges[lastID + 1][0])+sampler->priorRanges[lastID + 1][0];
 				//*MHRatioModifications -=std::log(1./(sampler->priorRanges[lastID+1][1]-sampler->priorRanges[lastID+1][0])) ;
 				*MHRatioModifications -=std::log(1./(sampler->priorRanges[lastID+1][1]-sampler->priorRanges[lastID+1][0])) ;
 			}
 			else{
-				proposedStep->parameters[lastID+1] = gsl_rng_uniform(sampler->rvec[chainID]);
+				proposedStep->parameters[lastID+1] = sampler->rng->uniform(chainID, rngProposal);
 			}
 			*MHRatioModifications+=std::log((1.-alpha)/(alpha));
 			//proposedStep->parameters[P+1] = gsl_rng_uniform(h->r);
@@ -0,0 +1,134 @@
+#include "bayesship/temperatureLadder.h"
+#include <algorithm>
+#include <math.h>
+
+/*! \file
+ *
+ * # Source file for tuning the temperature ladder from the swap statistics of a run
+ */
+
+namespace bayesship{
+
+/*! \brief Swap attempts between each pair of adjacent rungs, pooled over the ensembles (including swaps between ensembles)
+ */
+void ladderSwapCounts(
+	samplerData *data,/**< Data with the swap statistics*/
+	long long *accepts,/**< [out] Accepted swaps between rungs k and k+1 -- shape [ensembleSize-1]*/
+	long long *rejects/**< [out] Rejected swaps between rungs k and k+1 -- shape [ensembleSize-1]*/
+	)
+{
+	int ensembleN = data->ensembleN;
+	for(int k = 0 ; k<data->ensembleSize-1; k++){
+		accepts[k] = 0;
+		rejects[k] = 0;
+		for(int i = 0 ; i<ensembleN; i++){
+			int chainID1 = i + k*ensembleN;
+			for(int j = 0 ; j<ensembleN; j++){
+				int chainID2 = j + (k+1)*ensembleN;
+				accepts[k] += data->swapAccepts[chainID1][chainID2];
+				rejects[k] += data->swapRejects[chainID1][chainID2];
+			}
+		}
+	}
+}
+
+/*! \brief Swap rejection rate between each pair of adjacent rungs -- -1 for pairs that were never tried
+ */
+void ladderRejectionRates(
+	samplerData *data,/**< Data with the swap statistics*/
+	double *rejection/**< [out] Rejection rate between rungs k and k+1 -- shape [ensembleSize-1]*/
+	)
+{
+	int pairs = data->ensembleSize-1;
+	if(pairs < 1){
+		return;
+	}
+	long long accepts[pairs];
+	long long rejects[pairs];
+	ladderSwapCounts(data, accepts, rejects);
+	for(int k = 0 ; k<pairs; k++){
+		long long attempts = accepts[k]+rejects[k];
+		rejection[k] = (attempts > 0) ? (double)rejects[k]/attempts : -1;
+	}
+}
+
+/*! \brief Global communication barrier Lambda -- the sum of the rejection rates over the ladder (pairs that were never tried are skipped)
+ */
+double communicationBarrier(
+	double *rejection,/**< Rejection rate between rungs k and k+1 -- shape [pairs]*/
+	int pairs/**< Number of adjacent pairs (ensembleSize-1)*/
+	)
+{
+	double barrier = 0;
+	for(int k = 0 ; k<pairs; k++){
+		if(rejection[k] > 0){
+			barrier += rejection[k];
+		}
+	}
+	return barrier;
+}
+
+/*! \brief Move the intermediate temperatures so every pair of adjacent rungs has the same rejection rate
+ *
+ * The cumulative barrier is interpolated linearly in beta between the current rungs, and the new rungs are placed at equal steps in the barrier. The coldest and hottest temperatures are kept.
+ *
+ * Returns false (and copies betaSchedule) if any pair was never tried, or there's no barrier to equalize
+ */
+bool respaceLadder(
+	double *betaSchedule,/**< Current betas, coldest (1) first -- shape [ensembleSize]*/
+	double *rejection,/**< Rejection rate between rungs k and k+1 -- shape [ensembleSize-1]*/
+	int ensembleSize,/**< Number of rungs*/
+	double *newBetaSchedule/**< [out] Respaced betas -- shape [ensembleSize] (may be the same array as betaSchedule)*/
+	)
+{
+	int pairs = ensembleSize-1;
+	double cumulative[ensembleSize];
+	double betas[ensembleSize];
+	cumulative[0] = 0;
+	bool valid = pairs > 1;
+	for(int k = 0 ; k<ensembleSize; k++){
+		betas[k] = betaSchedule[k];
+	}
+	for(int k = 0 ; k<pairs; k++){
+		if(rejection[k] < 0){
+			valid = false;
+		}
+		/*A floor on the rejection keeps the map strictly monotonic, so no two rungs collapse onto each other*/
+		cumulative[k+1] = cumulative[k] + std::max(rejection[k], 1e-3);
+	}
+	if(!valid || cumulative[pairs] <= pairs*1e-3){
+		for(int k = 0 ; k<ensembleSize; k++){
+			newBetaSchedule[k] = betas[k];
+		}
+		return false;
+	}
+	newBetaSchedule[0] = betas[0];
+	newBetaSchedule[pairs] = betas[pairs];
+	int segment = 0;
+	for(int i = 1 ; i<pairs; i++){
+		double target = cumulative[pairs]*i/pairs;
+		while(segment < pairs-1 && cumulative[segment+1] < target){
+			segment++;
+		}
+		double fraction = (target - cumulative[segment])/(cumulative[segment+1] - cumulative[segment]);
+		newBetaSchedule[i] = betas[segment] + fraction*(betas[segment+1] - betas[segment]);
+	}
+	return true;
+}
+
+/*! \brief Smallest ensembleSize that keeps the rejection rate of every pair under targetRejection, once the ladder is respaced
+ *
+ * The default of .5 is about where more rungs stop shortening the round trips of the even-odd schedule
+ */
+int suggestEnsembleSize(
+	double barrier,/**< Global communication barrier (see communicationBarrier)*/
+	double targetRejection/**< Largest rejection rate to allow between adjacent rungs*/
+	)
+{
+	if(targetRejection <= 0 || barrier <= 0){
+		return 2;
+	}
+	return std::max((int)ceil(barrier/targetRejection - 1e-9) + 1, 2);
+}
+
+}
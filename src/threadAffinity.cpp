@@ -0,0 +1,200 @@
+#include "bayesship/threadAffinity.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <cctype>
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#endif
+#ifdef _NUMA
+#include <numa.h>
+#endif
+
+/*! \file
+ *
+ * # Source file for pinning worker threads to CPUs
+ */
+
+namespace bayesship{
+
+#if defined(__linux__) && !defined(_NUMA)
+/*! \brief Parse a sysfs cpulist string (ie, "0-3,8,10-11")
+ */
+static std::vector<int> parseCPUList(std::string list)
+{
+	std::vector<int> cpus;
+	std::stringstream stream(list);
+	std::string range;
+	while(std::getline(stream, range, ',')){
+		if(range.empty() || range[0] == '\n'){
+			continue;
+		}
+		size_t dash = range.find('-');
+		int first = std::stoi(range.substr(0,dash));
+		int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash+1));
+		for(int i = first ; i<=last; i++){
+			cpus.push_back(i);
+		}
+	}
+	return cpus;
+}
+#endif
+
+/*! \brief Constructor -- reads the CPUs available to the process and their NUMA domains, and orders them according to policy
+ */
+threadAffinity::threadAffinity(
+	affinityPolicy policy,/**< Placement policy*/
+	std::vector<int> cpuList/**< CPUs to use for affinityList (ignored otherwise)*/
+	)
+{
+	this->policy = policy;
+	std::vector<int> available;
+	if(policy == affinityList){
+		available = cpuList;
+		if(available.empty()){
+			std::cout<<"WARNING -- affinityList requested with an empty CPU list -- threads will not be pinned"<<std::endl;
+			this->policy = affinityNone;
+		}
+	}
+#ifdef __linux__
+	else{
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		if(sched_getaffinity(0, sizeof(mask), &mask) == 0){
+			for(int i = 0 ; i<CPU_SETSIZE; i++){
+				if(CPU_ISSET(i, &mask)){
+					available.push_back(i);
+				}
+			}
+		}
+	}
+#endif
+	std::vector<int> nodes;
+	for(size_t i = 0 ; i<available.size(); i++){
+		nodes.push_back(nodeOfCPU(available[i]));
+	}
+	std::vector<int> distinctNodes = nodes;
+	std::sort(distinctNodes.begin(), distinctNodes.end());
+	distinctNodes.erase(std::unique(distinctNodes.begin(), distinctNodes.end()), distinctNodes.end());
+	nodeN = std::max((int)distinctNodes.size(), 1);
+
+	if(this->policy == affinityList){
+		cpuOrder = available;
+		nodeOrder = nodes;
+	}
+	else if(this->policy == affinityCompact || this->policy == affinityScatter){
+		/*Group the CPUs by NUMA domain*/
+		std::vector<std::vector<int>> groups(distinctNodes.size());
+		for(size_t i = 0 ; i<available.size(); i++){
+			int group = std::lower_bound(distinctNodes.begin(), distinctNodes.end(), nodes[i]) - distinctNodes.begin();
+			groups[group].push_back(available[i]);
+		}
+		if(this->policy == affinityCompact){
+			for(size_t g = 0 ; g<groups.size(); g++){
+				for(size_t i = 0 ; i<groups[g].size(); i++){
+					cpuOrder.push_back(groups[g][i]);
+					nodeOrder.push_back(distinctNodes[g]);
+				}
+			}
+		}
+		else{
+			for(size_t i = 0 ; cpuOrder.size()<available.size(); i++){
+				for(size_t g = 0 ; g<groups.size(); g++){
+					if(i < groups[g].size()){
+						cpuOrder.push_back(groups[g][i]);
+						nodeOrder.push_back(distinctNodes[g]);
+					}
+				}
+			}
+		}
+	}
+	if(this->policy != affinityNone && cpuOrder.empty()){
+		std::cout<<"WARNING -- Could not read the available CPUs -- threads will not be pinned"<<std::endl;
+		this->policy = affinityNone;
+	}
+}
+
+/*! \brief CPU assigned to threadID (-1 if threads are not pinned)
+ *
+ * Threads beyond the number of CPUs wrap around
+ */
+int threadAffinity::cpuForThread(int threadID)
+{
+	if(policy == affinityNone){
+		return -1;
+	}
+	return cpuOrder[threadID % cpuOrder.size()];
+}
+
+/*! \brief NUMA domain assigned to threadID (-1 if threads are not pinned)
+ */
+int threadAffinity::nodeForThread(int threadID)
+{
+	if(policy == affinityNone){
+		return -1;
+	}
+	return nodeOrder[threadID % nodeOrder.size()];
+}
+
+/*! \brief NUMA domain containing cpu (0 if it can't be determined)
+ */
+int threadAffinity::nodeOfCPU(int cpu)
+{
+#ifdef _NUMA
+	if(numa_available() >= 0){
+		int node = numa_node_of_cpu(cpu);
+		return (node < 0) ? 0 : node;
+	}
+#elif defined(__linux__)
+	DIR *nodeDir = opendir("/sys/devices/system/node");
+	if(nodeDir){
+		struct dirent *entry;
+		while((entry = readdir(nodeDir)) != nullptr){
+			std::string name(entry->d_name);
+			if(name.compare(0,4,"node") != 0 || name.size() == 4 || !isdigit(name[4])){
+				continue;
+			}
+			std::ifstream listFile("/sys/devices/system/node/"+name+"/cpulist");
+			std::string list;
+			std::getline(listFile, list);
+			std::vector<int> cpus = parseCPUList(list);
+			if(std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()){
+				closedir(nodeDir);
+				return std::stoi(name.substr(4));
+			}
+		}
+		closedir(nodeDir);
+	}
+#endif
+	return 0;
+}
+
+/*! \brief Pin the calling thread to the CPU for threadID
+ *
+ * Memory the thread touches first is then placed in its NUMA domain by the kernel's default (local) policy
+ *
+ * Returns false if the thread wasn't pinned
+ */
+bool threadAffinity::pinCurrentThread(int threadID)
+{
+	int cpu = cpuForThread(threadID);
+	if(cpu < 0){
+		return false;
+	}
+#ifdef __linux__
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if(sched_setaffinity(0, sizeof(mask), &mask) != 0){
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+}
@@ -252,6 +252,120 @@ TEST_F(ThreadPoolTest,PoolTestFIFO)
 	delete [] jobs;
 }
 
+TEST(ThreadPoolBarrierTest,EpochReuse)
+{
+	/*Number of jobs to use for testing*/
+	int iterations = 100;
+	bayesship::ThreadPoolBarrier<testPoolFnStruct> *barrierPool = new bayesship::ThreadPoolBarrier<testPoolFnStruct>(4,testPoolFn);
+	/*Create array of jobs*/
+	testPoolFnStruct *jobs = new testPoolFnStruct[iterations];
+	for( int i = 0 ;i<iterations; i++){
+		jobs[i].ID = i;
+		jobs[i].output = new double[2];
+	}
+	/*The same team should be reusable for many epochs*/
+	for(int epoch = 0 ; epoch<20; epoch++){
+		for( int i = 0 ;i<iterations; i++){
+			jobs[i].output[0] = -1;
+			jobs[i].output[1] = -1;
+			barrierPool->enqueue(jobs[i]);
+		}
+  		EXPECT_EQ(barrierPool->get_queue_length(), iterations);
+
+		/*Blocks until every job in the epoch is finished*/
+		barrierPool->runEpoch();
+  		EXPECT_EQ(barrierPool->get_queue_length(), 0);
+		for( int i = 0 ;i<iterations; i++){
+  			EXPECT_EQ(jobs[i].output[1], i);
+  			EXPECT_GE(jobs[i].output[0], 0);
+  			EXPECT_LT(jobs[i].output[0], 4);
+		}
+	}
+	/*Cleanup*/
+	for( int i = 0 ;i<iterations; i++){
+		delete [] jobs[i].output;
+	}
+	delete [] jobs;
+	delete barrierPool;
+}
+
+TEST(ThreadPoolBarrierTest,StaticSchedule)
+{
+	/*With a static schedule, job i should always run on thread i % 4*/
+	int iterations = 50;
+	bayesship::threadAffinity *affinity = new bayesship::threadAffinity(bayesship::affinityCompact);
+	bayesship::ThreadPoolBarrier<testPoolFnStruct> *barrierPool = new bayesship::ThreadPoolBarrier<testPoolFnStruct>(4,testPoolFn,false);
+	barrierPool->setAffinity(affinity);
+	barrierPool->setStaticSchedule(true);
+	barrierPool->startPool();
+	testPoolFnStruct *jobs = new testPoolFnStruct[iterations];
+	for( int i = 0 ;i<iterations; i++){
+		jobs[i].ID = i;
+		jobs[i].output = new double[2];
+	}
+	for(int epoch = 0 ; epoch<5; epoch++){
+		for( int i = 0 ;i<iterations; i++){
+			jobs[i].output[0] = -1;
+			jobs[i].output[1] = -1;
+			barrierPool->enqueue(jobs[i]);
+		}
+		barrierPool->runEpoch();
+		for( int i = 0 ;i<iterations; i++){
+	  		EXPECT_EQ(jobs[i].output[1], i);
+	  		EXPECT_EQ(jobs[i].output[0], i%4);
+		}
+	}
+	for( int i = 0 ;i<iterations; i++){
+		delete [] jobs[i].output;
+	}
+	delete [] jobs;
+	delete barrierPool;
+	delete affinity;
+}
+
+TEST(ThreadPoolPairTest,BucketedPairing)
+{
+	/*Jobs are rungs 0-9 (10 jobs each), and may only pair with a different rung less than 3 away*/
+	int rungs = 10;
+	int perRung = 10;
+	int radius = 3;
+	std::mutex outputMutex;
+	std::vector<std::pair<int,int>> pairs;
+	bayesship::ThreadPoolPair<int> *pairPool = new bayesship::ThreadPoolPair<int>(2,
+		[&](int thread, int j, int k){
+			std::unique_lock<std::mutex> lock{outputMutex};
+			pairs.push_back(std::pair<int,int>(j,k));
+		},
+		[&](int j){return j/perRung;},
+		rungs,
+		[&](int a, int b){
+			int diff = abs(a - b);
+			return diff < radius && diff > 0;
+		},
+		radius
+	);
+	for(int i = 0 ; i<rungs*perRung; i++){
+		pairPool->enqueue(i);
+	}
+	pairPool->stopPool();
+
+	/*Every job should be used at most once, and only with a nearby rung*/
+	std::vector<int> used(rungs*perRung,0);
+	for(size_t i = 0 ; i<pairs.size(); i++){
+		int diff = abs(pairs[i].first/perRung - pairs[i].second/perRung);
+		EXPECT_LT(diff, radius);
+		EXPECT_GT(diff, 0);
+		used[pairs[i].first]++;
+		used[pairs[i].second]++;
+	}
+	for(int i = 0 ; i<rungs*perRung; i++){
+		EXPECT_LE(used[i], 1);
+	}
+	/*All but (at most) a handful of jobs should find a partner*/
+	EXPECT_GE((int)pairs.size(), rungs*perRung/2 - rungs);
+	delete pairPool;
+}
+
 // Demonstrate some basic assertions.
 TEST_F(ThreadPoolTest, BasicAssertions) {
   // Expect two strings not to be equal.
@@ -0,0 +1,88 @@
+#include <bayesship/autoConfigure.h>
+#include <algorithm>
+
+
+#include <gtest/gtest.h>
+
+namespace{
+
+TEST(autoConfigureTest,EnsembleSizeFromAcceptance)
+{
+	bayesship::pilotStatistics stats;
+	stats.ensembleSize = 5;
+	/*At the target already -- the pilot ladder is (about) right*/
+	stats.swapAcceptance = .25;
+	EXPECT_EQ(bayesship::predictEnsembleSize(stats, .25), 5);
+	/*Poor acceptance needs more temperatures, good acceptance fewer*/
+	stats.swapAcceptance = .01;
+	EXPECT_GT(bayesship::predictEnsembleSize(stats, .25), 5);
+	stats.swapAcceptance = .9;
+	EXPECT_LT(bayesship::predictEnsembleSize(stats, .25), 5);
+	stats.swapAcceptance = 0;
+	EXPECT_LE(bayesship::predictEnsembleSize(stats, .25, 20), 20);
+}
+
+TEST(autoConfigureTest,Throughput)
+{
+	bayesship::pilotStatistics stats;
+	stats.stepTime = 1e-3;
+	stats.swapTime = 1e-7;
+	/*Expensive, uniform steps scale with the threads in lockstep*/
+	double one = bayesship::predictChainStepsPerSecond(stats, 1, 16, false, .2);
+	double eight = bayesship::predictChainStepsPerSecond(stats, 8, 16, false, .2);
+	EXPECT_NEAR(eight/one, 8, .1);
+	/*Threads beyond the number of chains don't help*/
+	EXPECT_DOUBLE_EQ(bayesship::predictChainStepsPerSecond(stats, 32, 16, false, .2), bayesship::predictChainStepsPerSecond(stats, 16, 16, false, .2));
+	/*The thread pool needs 3 threads*/
+	EXPECT_EQ(bayesship::predictChainStepsPerSecond(stats, 2, 16, true, .2), 0);
+	/*Uneven steps make lockstep straggle, but not the thread pool*/
+	bayesship::pilotStatistics uneven = stats;
+	uneven.stepTimeSpread = 1;
+	EXPECT_LT(bayesship::predictChainStepsPerSecond(uneven, 8, 16, false, .2), eight);
+	EXPECT_DOUBLE_EQ(bayesship::predictChainStepsPerSecond(uneven, 8, 16, true, .2), bayesship::predictChainStepsPerSecond(stats, 8, 16, true, .2));
+}
+
+TEST(autoConfigureTest,ChooseConfiguration)
+{
+	bayesship::pilotStatistics stats;
+	stats.stepTime = 1e-3;
+	stats.swapTime = 1e-7;
+	stats.swapAcceptance = .25;
+	stats.autocorrelation = 10;
+	stats.ensembleSize = 5;
+	bayesship::autoConfigureLimits limits;
+	limits.cores = 16;
+	limits.iterations = 10000;
+	limits.maxDim = 4;
+
+	/*Close to one chain per core (a whole number of ensembles), with a thread for every chain*/
+	bayesship::runConfiguration config = bayesship::chooseConfiguration(stats, limits);
+	int chainN = config.ensembleN*config.ensembleSize;
+	EXPECT_EQ(config.ensembleSize, 5);
+	EXPECT_GT(chainN, 16-config.ensembleSize);
+	EXPECT_EQ(config.threads, std::min(16, chainN));
+	EXPECT_GT(config.essPerSecond, 0);
+	EXPECT_NEAR(config.runtime, (double)limits.iterations*config.ensembleN*config.ensembleSize/config.chainStepsPerSecond, 1e-6);
+	EXPECT_EQ(config.batchSize, 0);
+
+	/*Uneven steps favor the thread pool*/
+	stats.stepTimeSpread = 2;
+	config = bayesship::chooseConfiguration(stats, limits);
+	EXPECT_TRUE(config.threadPool);
+
+	/*Fixed chains are kept as they are*/
+	limits.tuneEnsembles = false;
+	limits.ensembleN = 3;
+	limits.ensembleSize = 7;
+	config = bayesship::chooseConfiguration(stats, limits);
+	EXPECT_EQ(config.ensembleN, 3);
+	EXPECT_EQ(config.ensembleSize, 7);
+
+	/*Runs that don't fit in memory are batched*/
+	limits.memoryBudget = 1e6;
+	config = bayesship::chooseConfiguration(stats, limits);
+	EXPECT_GT(config.batchSize, 0);
+	EXPECT_LT(config.batchSize, limits.iterations);
+}
+
+}
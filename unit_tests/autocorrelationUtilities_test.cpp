@@ -0,0 +1,156 @@
+#include <bayesship/autocorrelationUtilities.h>
+#include <random>
+#include <math.h>
+
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <mutex>
+#include <map>
+
+TEST(batchMeansACTest,AR1)
+{
+	/*AR(1) with phi = .9 -- integrated time (1+phi)/(1-phi) = 19*/
+	double phi = .9;
+	std::mt19937 gen(1);
+	std::normal_distribution<double> normal(0,1);
+	bayesship::batchMeansAC ac;
+	double x = 0;
+	int steps = 40000;
+	for(int i = 0 ; i<steps; i++){
+		x = phi*x + normal(gen);
+		ac.add(x);
+	}
+	EXPECT_EQ(ac.count, steps);
+	EXPECT_NEAR(ac.integratedTime(), 19, 19*.25);
+}
+
+TEST(batchMeansACTest,Independent)
+{
+	std::mt19937 gen(2);
+	std::normal_distribution<double> normal(0,1);
+	bayesship::batchMeansAC ac;
+	for(int i = 0 ; i<100000; i++){
+		ac.add(normal(gen));
+	}
+	EXPECT_LT(ac.integratedTime(), 1.5);
+
+	/*Not enough steps for any batches -- nothing to go on*/
+	bayesship::batchMeansAC empty;
+	EXPECT_EQ(empty.integratedTime(), 1);
+}
+
+TEST(spectralACTest,BatchedFromData)
+{
+	/*Two chains of [steps][2] -- parameter 0 is AR(1) with phi = .9, parameter 1 is independent*/
+	double phi = .9;
+	int chainN = 2;
+	int steps = 20000;
+	std::mt19937 gen(3);
+	std::normal_distribution<double> normal(0,1);
+	double ***data = new double**[chainN];
+	for(int i = 0 ; i<chainN; i++){
+		data[i] = new double*[steps];
+		double x = 0;
+		for(int j = 0 ; j<steps; j++){
+			x = phi*x + normal(gen);
+			data[i][j] = new double[2];
+			data[i][j][0] = x;
+			data[i][j][1] = normal(gen);
+		}
+	}
+	int segments = 2;
+	int ***output = new int**[chainN];
+	for(int i = 0 ; i<chainN; i++){
+		output[i] = new int*[2];
+		output[i][0] = new int[segments];
+		output[i][1] = new int[segments];
+	}
+	for(int threads = 1 ; threads<=3; threads+=2){
+		bayesship::auto_corr_from_data_batch(data, steps, 2, chainN, output, segments, .01, threads, false);
+		for(int i = 0 ; i<chainN; i++){
+			for(int j = 0 ; j<segments; j++){
+				EXPECT_NEAR(output[i][0][j], 19, 19*.3);
+				EXPECT_LE(output[i][1][j], 2);
+			}
+		}
+	}
+
+	/*A single chain, cumulatively*/
+	int **single = new int*[2];
+	single[0] = new int[segments];
+	single[1] = new int[segments];
+	bayesship::auto_corr_from_data(data[1], steps, 2, single, segments, .01, 2, true);
+	for(int j = 0 ; j<segments; j++){
+		EXPECT_NEAR(single[0][j], 19, 19*.3);
+		EXPECT_LE(single[1][j], 2);
+	}
+	delete [] single[0];
+	delete [] single[1];
+	delete [] single;
+
+	for(int i = 0 ; i<chainN; i++){
+		for(int j = 0 ; j<steps; j++){
+			delete [] data[i][j];
+		}
+		delete [] data[i];
+		delete [] output[i][0];
+		delete [] output[i][1];
+		delete [] output[i];
+	}
+	delete [] data;
+	delete [] output;
+	bayesship::clearACPlans();
+}
+
+TEST(spectralACTest,LongestJobFirst)
+{
+	bayesship::threaded_ac_jobs_fft shortJob, longJob;
+	shortJob.seriesN = 4;
+	shortJob.paddedLength = 1024;
+	longJob.seriesN = 4;
+	longJob.paddedLength = 4096;
+	bayesship::comparator_ac_fft comp;
+	EXPECT_TRUE(comp(shortJob, longJob));
+	EXPECT_FALSE(comp(longJob, shortJob));
+	EXPECT_FALSE(comp(longJob, longJob));
+}
+
+/*Blocks too big to transform at once are split into transforms, but each block is still read by a single thread*/
+TEST(spectralACTest,WholeBlocks)
+{
+	/*Padded to 2^18, so at most 32 series fit in a transform -- blocks of 35 go as 18 then 17*/
+	int length = 70000;
+	int blockSize = 35;
+	int seriesN = 2*blockSize;
+	std::mutex mutex;
+	std::map<int, std::thread::id> readers;
+	bool sameThread = true;
+	bayesship::acSeriesReader reader = [&](int series, int start, int length, double *buffer){
+		std::mt19937 gen(series);
+		std::normal_distribution<double> normal(0,1);
+		for(int i = 0 ; i<length; i++){
+			buffer[i] = normal(gen);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		int block = series/blockSize;
+		if(readers.count(block) && readers[block] != std::this_thread::get_id()){
+			sameThread = false;
+		}
+		readers[block] = std::this_thread::get_id();
+	};
+	int lags[seriesN];
+	int *output[seriesN];
+	for(int i = 0 ; i<seriesN; i++){
+		lags[i] = -1;
+		output[i] = &lags[i];
+	}
+	bayesship::auto_corr_from_reader(reader, seriesN, length, output, 1, .01, 2, true, blockSize);
+	EXPECT_TRUE(sameThread);
+	EXPECT_EQ(readers.size(), 2);
+	for(int i = 0 ; i<seriesN; i++){
+		EXPECT_GE(lags[i], 0);
+		EXPECT_LE(lags[i], 2);
+	}
+	bayesship::clearACPlans();
+}
@@ -0,0 +1,42 @@
+#include <bayesship/batchPipeline.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+
+#include <gtest/gtest.h>
+
+TEST(batchPipelineTest,InOrderAndBounded)
+{
+	int maxOutstanding = 2;
+	std::vector<int> order;
+	std::atomic<int> running(0);
+	std::atomic<int> submitted(0);
+	int mostAhead = 0;
+	{
+		bayesship::batchPipeline pipeline(maxOutstanding);
+		for(int i = 0 ; i<6; i++){
+			pipeline.submit([&, i]{
+				running++;
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+				order.push_back(i);
+				running--;
+			});
+			submitted++;
+			/*Submit only returns once there's room, so the caller is never more than maxOutstanding ahead*/
+			mostAhead = std::max(mostAhead, pipeline.outstanding());
+			EXPECT_LE(running.load(), 1);
+		}
+		pipeline.wait();
+		EXPECT_EQ(pipeline.outstanding(), 0);
+		EXPECT_EQ((int)order.size(), 6);
+
+		/*The destructor finishes anything still queued*/
+		pipeline.submit([&]{order.push_back(6);});
+	}
+	EXPECT_LE(mostAhead, maxOutstanding);
+	ASSERT_EQ((int)order.size(), 7);
+	for(int i = 0 ; i<7; i++){
+		EXPECT_EQ(order[i], i);
+	}
+}
@@ -0,0 +1,107 @@
+#include <bayesship/convergenceMonitor.h>
+#include <bayesship/dataUtilities.h>
+#include <random>
+#include <math.h>
+
+
+#include <gtest/gtest.h>
+
+namespace{
+
+/*! AR(1) chains with unit marginal variance -- the ESS of n draws is n(1-phi)/(1+phi)*/
+void fillAR1(double **chains, int chainN, int length, double phi, double offset, unsigned int seed)
+{
+	std::mt19937 gen(seed);
+	std::normal_distribution<double> normal(0,1);
+	double scale = sqrt(1-phi*phi);
+	for(int i = 0 ; i<chainN; i++){
+		double x = normal(gen);
+		for(int j = 0 ; j<length; j++){
+			x = phi*x + scale*normal(gen);
+			chains[i][j] = x + offset*i;
+		}
+	}
+}
+
+}
+
+TEST(convergenceMonitorTest,RankNormalize)
+{
+	double values[5] = {3,1,2,2,5};
+	double z[5];
+	bayesship::rankNormalize(values, 5, z);
+	EXPECT_EQ(z[2], z[3]);
+	EXPECT_LT(z[1], z[2]);
+	EXPECT_LT(z[0], z[4]);
+	/*Ranks 4, 1, 2.5, 2.5, 5*/
+	EXPECT_LT(z[2], 0);
+	EXPECT_GT(z[0], 0);
+	EXPECT_NEAR(z[1], -z[4], 1e-9);
+}
+
+TEST(convergenceMonitorTest,RhatAndESS)
+{
+	int chainN = 4;
+	int length = 4000;
+	double **chains = new double*[chainN];
+	for(int i = 0 ; i<chainN; i++){
+		chains[i] = new double[length];
+	}
+
+	fillAR1(chains, chainN, length, 0, 0, 1);
+	EXPECT_LT(bayesship::splitRhat(chains, chainN, length), 1.01);
+	double ess = bayesship::multiChainESS(chains, chainN, length);
+	EXPECT_GT(ess, .8*chainN*length);
+	EXPECT_LT(ess, 1.2*chainN*length);
+
+	double phi = .9;
+	fillAR1(chains, chainN, length, phi, 0, 2);
+	ess = bayesship::multiChainESS(chains, chainN, length);
+	double expected = chainN*length*(1-phi)/(1+phi);
+	EXPECT_GT(ess, .7*expected);
+	EXPECT_LT(ess, 1.3*expected);
+
+	/*Chains stuck in different places*/
+	fillAR1(chains, chainN, length, .5, 1, 3);
+	EXPECT_GT(bayesship::splitRhat(chains, chainN, length), 1.1);
+
+	for(int i = 0 ; i<chainN; i++){
+		delete [] chains[i];
+	}
+	delete [] chains;
+}
+
+TEST(convergenceMonitorTest,StreamingUpdates)
+{
+	int ensembleN = 3;
+	int ensembleSize = 2;
+	int steps = 3000;
+	double betas[6] = {1,1,1,.5,.5,.5};
+	bayesship::samplerData *data = new bayesship::samplerData(2, ensembleN, ensembleSize, steps, 1, false, betas);
+	std::mt19937 gen(4);
+	std::normal_distribution<double> normal(0,1);
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		for(int j = 0 ; j<steps; j++){
+			data->positions[i][j]->parameters[0] = normal(gen);
+			data->positions[i][j]->parameters[1] = normal(gen);
+		}
+	}
+
+	/*Small enough that the monitor has to thin*/
+	bayesship::convergenceMonitor monitor(ensembleN, 2, 512);
+	EXPECT_FALSE(monitor.converged(1.01, 0));
+	for(int batch = 1 ; batch<=3; batch++){
+		for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+			data->currentStepID[i] = batch*steps/3 - 1;
+		}
+		monitor.update(data);
+	}
+	EXPECT_GT(monitor.thin, 1);
+	EXPECT_LT(monitor.rhat, 1.05);
+	/*Independent draws, so the ESS is about all the kept draws*/
+	EXPECT_GT(monitor.ess, .7*ensembleN*steps/monitor.thin);
+	EXPECT_TRUE(monitor.converged(1.05, 0));
+	EXPECT_FALSE(monitor.converged(1.05, 1e9));
+	EXPECT_FALSE(monitor.converged(0, 0));
+	delete data;
+}
@@ -0,0 +1,474 @@
+#include <bayesship/dataUtilities.h>
+#include <random>
+#include <math.h>
+
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+#ifdef _HDF5
+#include <H5Cpp.h>
+#endif
+
+/*Evidence from the running accumulators -- N(0,1) prior and L = exp(-x^2/2), so the tempered posterior is N(0,1/(1+beta)) and ln Z = -ln(2)/2*/
+TEST(samplerDataTest,EvidenceAccumulators)
+{
+	int ensembleN = 3;
+	int ensembleSize = 5;
+	int steps = 20000;
+	double schedule[5] = {1,.5,.25,.1,0};
+	double betas[15];
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		betas[i] = schedule[i/ensembleN];
+	}
+	bayesship::samplerData *data = new bayesship::samplerData(1, ensembleN, ensembleSize, steps, 1, false, betas);
+	std::mt19937 gen(5);
+	std::normal_distribution<double> normal(0,1);
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		double sigma = 1./sqrt(1+betas[i]);
+		for(int j = 0 ; j<steps; j++){
+			double x = sigma*normal(gen);
+			data->likelihoodVals[i][j] = -.5*x*x;
+			/*The sampler folds in each step as the chain moves on*/
+			data->currentStepID[i] = j;
+			if(j < steps-1){
+				data->accumulateLikelihood(i);
+			}
+		}
+	}
+	data->calculateEvidence(2);
+	ASSERT_TRUE(data->calculatedEvidence);
+	double expected = -.5*log(2.);
+	/*integratedLikelihoods runs from the hottest rung to the coldest*/
+	for(int k = 0 ; k<ensembleSize; k++){
+		double beta = schedule[ensembleSize-1-k];
+		EXPECT_NEAR(data->integratedLikelihoods[k], -.5/(1+beta), 5*sqrt(data->integratedLikelihoodVariances[k]));
+	}
+	EXPECT_GT(data->evidenceError, 0);
+	EXPECT_GT(data->evidenceBootstrapError, 0);
+	EXPECT_NEAR(data->evidence, expected, .01);
+	EXPECT_GT(data->steppingStoneEvidenceError, 0);
+	EXPECT_GT(data->steppingStoneBootstrapError, 0);
+	EXPECT_NEAR(data->steppingStoneEvidence, expected, 5*data->steppingStoneEvidenceError);
+	delete data;
+}
+
+/*A run that starts small and grows a batch at a time still gets whole segments*/
+TEST(samplerDataTest,SmallRunSegments)
+{
+	double betas[1] = {1};
+	bayesship::samplerData *data = new bayesship::samplerData(3, 1, 1, 10, 1, false, betas);
+	EXPECT_EQ(data->segmentSteps, 4096);
+	for(int i = 0 ; i<50; i++){
+		data->extendSize(9);
+	}
+	int rows;
+	double *block = data->parameterBlock(0, 0, &rows);
+	EXPECT_EQ(rows, 4096);
+	int mismatches = 0;
+	for(int j = 0 ; j<data->iterations; j++){
+		mismatches += data->positions[0][j]->parameters != block + 3*j;
+	}
+	EXPECT_EQ(mismatches, 0);
+	delete data;
+
+	/*Wide rows get shorter segments*/
+	data = new bayesship::samplerData(1000, 1, 1, 10, 1, false, betas);
+	EXPECT_EQ(data->segmentSteps, (1<<20)/(1000*(int)sizeof(double)));
+	delete data;
+}
+
+/*Swaps only redirect the current states -- the rows stay put until settleSwaps copies the states in*/
+TEST(samplerDataTest,SwapCurrent)
+{
+	double betas[3] = {1,.5,.25};
+	bayesship::samplerData *data = new bayesship::samplerData(2, 1, 3, 10, 1, false, betas);
+	for(int i = 0 ; i<3; i++){
+		data->currentStepID[i] = 4;
+		data->positions[i][4]->parameters[0] = i;
+		data->likelihoodVals[i][4] = 10*i;
+		data->priorVals[i][4] = -i;
+	}
+	/*0 <- 1, 1 <- 0, then 1 <- 2, 2 <- 0*/
+	data->swapCurrent(0, 1);
+	data->swapCurrent(1, 2);
+	int expected[3] = {1, 2, 0};
+	for(int i = 0 ; i<3; i++){
+		EXPECT_EQ(data->currentPosition(i)->parameters[0], expected[i]);
+		EXPECT_EQ(data->currentLikelihood(i), 10*expected[i]);
+		EXPECT_EQ(data->currentPrior(i), -expected[i]);
+		/*Own rows are untouched*/
+		EXPECT_EQ(data->positions[i][4]->parameters[0], i);
+	}
+	/*Swapping 1 and 2 back sends 2's state home*/
+	data->swapCurrent(1, 2);
+	EXPECT_EQ(data->swapSourceChainID[2], -1);
+	EXPECT_EQ(data->currentPosition(1)->parameters[0], 0);
+
+	data->swapCurrent(1, 2);
+	data->settleSwaps();
+	for(int i = 0 ; i<3; i++){
+		EXPECT_EQ(data->swapSourceChainID[i], -1);
+		EXPECT_EQ(data->positions[i][4]->parameters[0], expected[i]);
+		EXPECT_EQ(data->likelihoodVals[i][4], 10*expected[i]);
+		EXPECT_EQ(data->priorVals[i][4], -expected[i]);
+	}
+	delete data;
+}
+
+/*Spilled history reads back the same through getPosition and positionBlock, from several threads at once*/
+TEST(samplerDataTest,SpilledHistory)
+{
+	double betas[2] = {1,.5};
+	int steps = 4*4096;
+	bayesship::samplerData *data = new bayesship::samplerData(2, 1, 2, steps, 1, true, betas);
+	ASSERT_EQ(data->segmentSteps, 4096);
+	for(int i = 0 ; i<2; i++){
+		for(int j = 0 ; j<steps; j++){
+			data->positions[i][j]->parameters[0] = i*steps + j;
+			data->positions[i][j]->parameters[1] = -j;
+			data->positions[i][j]->status[0] = 1;
+			data->positions[i][j]->status[1] = j%2;
+			data->positions[i][j]->modelID = j%7;
+		}
+		data->currentStepID[i] = steps-1;
+	}
+	std::string filename("spillTest.dat");
+	data->enableSpilling(filename, 4096);
+	/*Queue, then release once written*/
+	data->spillHistory();
+	data->spillHistory();
+	ASSERT_EQ(data->firstResidentStep(0), 2*4096);
+	ASSERT_EQ(data->positions[0][0], nullptr);
+
+	int mismatches[4] = {0,0,0,0};
+	auto reader = [&](int threadID){
+		std::mt19937 gen(threadID);
+		std::uniform_int_distribution<int> uniform(0, steps-1);
+		int chainID = threadID%2;
+		for(int k = 0 ; k<20000; k++){
+			/*Random access, like differential evolution -- two positions in use at once*/
+			int step1 = uniform(gen);
+			int step2 = uniform(gen);
+			bayesship::positionInfo *position1 = data->getPosition(chainID, step1);
+			bayesship::positionInfo *position2 = data->getPosition(chainID, step2);
+			mismatches[threadID] += position1->parameters[0] != chainID*steps + step1 || position1->parameters[1] != -step1;
+			mismatches[threadID] += position1->status[1] != step1%2 || position1->modelID != step1%7;
+			mismatches[threadID] += position2->parameters[0] != chainID*steps + step2 || position2->modelID != step2%7;
+		}
+		/*Sequential reads*/
+		int step = 0;
+		while(step < steps){
+			int rows;
+			bayesship::positionInfo *block = data->positionBlock(chainID, step, &rows);
+			double *parameters = data->parameterBlock(chainID, step, &rows);
+			for(int k = 0 ; k<rows; k++, step++){
+				mismatches[threadID] += block[k].parameters[0] != chainID*steps + step || block[k].modelID != step%7;
+				mismatches[threadID] += parameters[k*2+1] != -step;
+			}
+		}
+	};
+	std::thread threads[4];
+	for(int i = 0 ; i<4; i++){
+		threads[i] = std::thread(reader, i);
+	}
+	for(int i = 0 ; i<4; i++){
+		threads[i].join();
+		EXPECT_EQ(mismatches[i], 0);
+	}
+	delete data;
+}
+
+/*Read the rows of a .npy file written by samplerData::create_npy_dump, and remove it*/
+template<class T>
+static std::vector<T> readNpyRows(std::string filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	remove(filename.c_str());
+	std::vector<T> rows((contents.size() - bayesship::npyArrayFile::headerBytes)/sizeof(T));
+	memcpy(rows.data(), contents.data() + bayesship::npyArrayFile::headerBytes, rows.size()*sizeof(T));
+	return rows;
+}
+
+/*npy output of an RJ run -- trimmed cold chains, written in two parts*/
+TEST(samplerDataTest,NpyDump)
+{
+	int ensembleN = 2;
+	int ensembleSize = 2;
+	int steps = 5000;
+	double betas[4] = {1,1,.5,.5};
+	bayesship::samplerData *data = new bayesship::samplerData(2, ensembleN, ensembleSize, steps, 1, true, betas);
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		for(int j = 0 ; j<steps; j++){
+			data->positions[i][j]->parameters[0] = i*steps + j;
+			data->positions[i][j]->parameters[1] = -j;
+			data->positions[i][j]->status[0] = 1;
+			data->positions[i][j]->status[1] = j%2;
+			data->positions[i][j]->modelID = j%2;
+			data->likelihoodVals[i][j] = .5*j;
+			data->priorVals[i][j] = i;
+		}
+		data->trimLengths[i] = 10*(i+1);
+	}
+	std::string prefix("npyDumpTest");
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		data->currentStepID[i] = 1000;
+	}
+	ASSERT_EQ(data->create_npy_dump(true, true, prefix), 0);
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		data->currentStepID[i] = steps-1;
+	}
+	ASSERT_EQ(data->append_to_npy_dump(prefix), 0);
+	/*Closes the files*/
+	delete data;
+
+	std::ifstream manifestFile(prefix+"_manifest.json");
+	nlohmann::json manifest;
+	manifestFile >> manifest;
+	manifestFile.close();
+	remove((prefix+"_manifest.json").c_str());
+	EXPECT_EQ(manifest["files"]["parameters"].size(), (size_t)ensembleN);
+	EXPECT_EQ(manifest["chainBetas"].size(), (size_t)(ensembleN*ensembleSize));
+	int mismatches = 0;
+	for(int i = 0 ; i<ensembleN; i++){
+		int start = 10*(i+1);
+		int length = steps-1-start;
+		EXPECT_EQ(manifest["chainStartSteps"][i].get<int>(), start);
+		EXPECT_EQ(manifest["chainLengths"][i].get<int>(), length);
+		std::string chainPrefix = prefix+"_chain"+std::to_string(i);
+		std::vector<double> p = readNpyRows<double>(chainPrefix+".npy");
+		std::vector<double> lp = readNpyRows<double>(chainPrefix+"_logl_logp.npy");
+		std::vector<int> status = readNpyRows<int>(chainPrefix+"_status.npy");
+		std::vector<int> modelStatus = readNpyRows<int>(chainPrefix+"_model_status.npy");
+		ASSERT_EQ(p.size(), (size_t)(2*length));
+		ASSERT_EQ(lp.size(), (size_t)(2*length));
+		ASSERT_EQ(status.size(), (size_t)(2*length));
+		ASSERT_EQ(modelStatus.size(), (size_t)length);
+		for(int j = 0 ; j<length; j++){
+			int step = start + j;
+			mismatches += (p[2*j] != i*steps + step) + (p[2*j+1] != -step);
+			mismatches += (lp[2*j] != .5*step) + (lp[2*j+1] != i);
+			mismatches += (status[2*j] != 1) + (status[2*j+1] != step%2);
+			mismatches += modelStatus[j] != step%2;
+		}
+	}
+	EXPECT_EQ(mismatches, 0);
+}
+
+/*Run length storage -- rejected steps share their state's row, and reading the history back gives every step*/
+TEST(samplerDataTest,RunLengthStorage)
+{
+	int steps = 10000;
+	double betas[2] = {1,.5};
+	bayesship::samplerData *data = new bayesship::samplerData(2, 1, 2, steps/2, 1, false, betas, true);
+	for(int i = 0 ; i<2; i++){
+		data->positions[i][0]->parameters[0] = i;
+		data->positions[i][0]->parameters[1] = 0;
+		data->likelihoodVals[i][0] = 0;
+		data->priorVals[i][0] = 0;
+	}
+	/*Every third proposal is accepted, and the storage grows half way through*/
+	std::vector<double> expected[2];
+	for(int i = 0 ; i<2; i++){
+		expected[i].push_back(i);
+	}
+	for(int j = 1 ; j<steps; j++){
+		if(j == steps/2){
+			data->extendSize(steps/2);
+		}
+		for(int i = 0 ; i<2; i++){
+			data->positions[i][j]->parameters[0] = -1;
+			if(j%3 == 0){
+				data->positions[i][j]->parameters[0] = 10*j+i;
+				data->acceptProposal(i);
+			}
+			else{
+				data->rejectProposal(i);
+			}
+			data->likelihoodVals[i][j] = j;
+			data->priorVals[i][j] = 0;
+			data->setCurrentStep(i, j);
+			expected[i].push_back(data->positions[i][j]->parameters[0]);
+		}
+	}
+	int mismatches = 0;
+	for(int i = 0 ; i<2; i++){
+		EXPECT_EQ(data->stateN[i], 1 + (steps-1)/3);
+		for(int j = 0 ; j<steps; j++){
+			mismatches += data->positions[i][j]->parameters[0] != (j < 3 ? i : 10*(j-j%3)+i);
+			mismatches += expected[i][j] != data->positions[i][j]->parameters[0];
+		}
+		/*A block never runs past a repeated state -- at most the last repeat of one state and the next*/
+		int step = 0;
+		while(step < steps){
+			int rows;
+			double *block = data->parameterBlock(i, step, &rows);
+			EXPECT_LE(rows, 2);
+			for(int k = 0 ; k<rows; k++){
+				mismatches += block[2*k] != expected[i][step+k];
+			}
+			step += rows;
+		}
+	}
+	EXPECT_EQ(mismatches, 0);
+
+	/*npy output expands the states back into steps*/
+	std::string prefix("runLengthStorageTest");
+	ASSERT_EQ(data->create_npy_dump(false, false, prefix), 0);
+	for(int i = 0 ; i<2; i++){
+		std::string chainPrefix = prefix+"_chain"+std::to_string(i);
+		std::vector<double> p = readNpyRows<double>(chainPrefix+".npy");
+		readNpyRows<double>(chainPrefix+"_logl_logp.npy");
+		ASSERT_EQ(p.size(), (size_t)(2*(steps-1)));
+		for(int j = 0 ; j<steps-1; j++){
+			mismatches += p[2*j] != expected[i][j];
+		}
+	}
+	remove((prefix+"_manifest.json").c_str());
+	EXPECT_EQ(mismatches, 0);
+
+	/*Swapped states get a row of their own when settled*/
+	data->swapCurrent(0, 1);
+	int stateN = data->stateN[0];
+	data->settleSwaps();
+	EXPECT_EQ(data->stateN[0], stateN+1);
+	EXPECT_EQ(data->positions[0][steps-1]->parameters[0], expected[1][steps-1]);
+	EXPECT_EQ(data->positions[1][steps-1]->parameters[0], expected[0][steps-1]);
+	EXPECT_EQ(data->positions[0][steps-2]->parameters[0], expected[0][steps-2]);
+
+	/*Restarting reuses the rows of the dropped steps*/
+	data->restartChain(0, 4, data->currentPosition(0), 1, 2);
+	EXPECT_EQ(data->stateN[0], 3);
+	EXPECT_EQ(data->currentStepID[0], 4);
+	EXPECT_EQ(data->positions[0][4]->parameters[0], expected[1][steps-1]);
+	EXPECT_EQ(data->positions[0][3]->parameters[0], 30);
+	EXPECT_EQ(data->currentLikelihood(0), 1);
+	EXPECT_EQ(data->currentPrior(0), 2);
+	delete data;
+}
+
+#ifdef _HDF5
+/*Stacked layout -- a dump and an append should hold each chain's steps, read back as one [chain][step][dim] dataset*/
+TEST(samplerDataTest,StackedDump)
+{
+	int ensembleN = 2;
+	int ensembleSize = 2;
+	int steps = 3000;
+	double betas[4] = {1,1,.5,.5};
+	bayesship::samplerData *data = new bayesship::samplerData(2, ensembleN, ensembleSize, steps, 1, false, betas);
+	data->stackedOutput = true;
+	/*Small chunks, so the chains span several*/
+	data->outputChunkBytes = 4096;
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		for(int j = 0 ; j<steps; j++){
+			data->positions[i][j]->parameters[0] = i*steps + j;
+			data->positions[i][j]->parameters[1] = -j;
+			data->likelihoodVals[i][j] = .5*j;
+			data->priorVals[i][j] = i;
+		}
+	}
+	std::string filename("stackedDumpTest.hdf5");
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		data->currentStepID[i] = 1000;
+	}
+	ASSERT_EQ(data->create_data_dump(false, false, filename), 0);
+	for(int i = 0 ; i<ensembleN*ensembleSize; i++){
+		data->currentStepID[i] = steps-1;
+	}
+	ASSERT_EQ(data->append_to_data_dump(filename), 0);
+
+	int chains = ensembleN*ensembleSize;
+	H5::H5File file(filename, H5F_ACC_RDONLY);
+	H5::DataSet parameters = file.openDataSet("/MCMC_OUTPUT/PARAMETERS");
+	H5::DataSet logLP = file.openDataSet("/MCMC_OUTPUT/LOGL_LOGP");
+	H5::DataSet lengths = file.openDataSet("/MCMC_METADATA/CHAIN LENGTHS");
+	hsize_t dims[3];
+	parameters.getSpace().getSimpleExtentDims(dims);
+	EXPECT_EQ(dims[0], (hsize_t)chains);
+	EXPECT_EQ(dims[1], (hsize_t)(steps-1));
+	EXPECT_EQ(dims[2], (hsize_t)2);
+	std::vector<int> chainLengths(chains);
+	lengths.read(chainLengths.data(), H5::PredType::NATIVE_INT);
+	std::vector<double> p(chains*(steps-1)*2);
+	std::vector<double> lp(chains*(steps-1)*2);
+	parameters.read(p.data(), H5::PredType::NATIVE_DOUBLE);
+	logLP.read(lp.data(), H5::PredType::NATIVE_DOUBLE);
+	file.close();
+	remove(filename.c_str());
+	int mismatches = 0;
+	for(int i = 0 ; i<chains; i++){
+		EXPECT_EQ(chainLengths[i], steps-1);
+		for(int j = 0 ; j<steps-1; j++){
+			int row = (i*(steps-1) + j)*2;
+			mismatches += (p[row] != i*steps + j) + (p[row+1] != -j);
+			mismatches += (lp[row] != .5*j) + (lp[row+1] != i);
+		}
+	}
+	EXPECT_EQ(mismatches, 0);
+	delete data;
+}
+
+/*Run length output -- each state once, with the step it starts on, including a run that carries over an append*/
+TEST(samplerDataTest,RunLengthDump)
+{
+	int steps = 100;
+	double betas[1] = {1};
+	bayesship::samplerData *data = new bayesship::samplerData(2, 1, 1, steps, 1, false, betas);
+	data->stackedOutput = true;
+	data->runLengthOutput = true;
+	/*Each state lasts state%4+1 steps*/
+	std::vector<int> stateStarts;
+	int state = -1;
+	int left = 0;
+	for(int j = 0 ; j<steps; j++){
+		if(left == 0){
+			state++;
+			left = state%4+1;
+			stateStarts.push_back(j);
+		}
+		left--;
+		data->positions[0][j]->parameters[0] = state;
+		data->positions[0][j]->parameters[1] = -state;
+		data->likelihoodVals[0][j] = .5*state;
+		data->priorVals[0][j] = 0;
+	}
+	/*Step 41 is in the middle of a state*/
+	std::string filename("runLengthDumpTest.hdf5");
+	data->currentStepID[0] = 41;
+	ASSERT_EQ(data->create_data_dump(false, false, filename), 0);
+	data->currentStepID[0] = steps-1;
+	ASSERT_EQ(data->append_to_data_dump(filename), 0);
+
+	int expectedStates = 0;
+	while(expectedStates < (int)stateStarts.size() && stateStarts[expectedStates] < steps-1){
+		expectedStates++;
+	}
+	H5::H5File file(filename, H5F_ACC_RDONLY);
+	int states, length;
+	file.openDataSet("/MCMC_METADATA/CHAIN STATES").read(&states, H5::PredType::NATIVE_INT);
+	file.openDataSet("/MCMC_METADATA/CHAIN LENGTHS").read(&length, H5::PredType::NATIVE_INT);
+	EXPECT_EQ(states, expectedStates);
+	EXPECT_EQ(length, steps-1);
+	H5::DataSet parameters = file.openDataSet("/MCMC_OUTPUT/PARAMETERS");
+	hsize_t dims[3];
+	parameters.getSpace().getSimpleExtentDims(dims);
+	ASSERT_EQ(dims[1], (hsize_t)expectedStates);
+	std::vector<double> p(expectedStates*2);
+	std::vector<int> starts(expectedStates);
+	parameters.read(p.data(), H5::PredType::NATIVE_DOUBLE);
+	file.openDataSet("/MCMC_OUTPUT/STATE START STEPS").read(starts.data(), H5::PredType::NATIVE_INT);
+	file.close();
+	remove(filename.c_str());
+	for(int k = 0 ; k<expectedStates; k++){
+		EXPECT_EQ(starts[k], stateStarts[k]);
+		EXPECT_EQ(p[2*k], k);
+		EXPECT_EQ(p[2*k+1], -k);
+	}
+	delete data;
+}
+#endif
@@ -0,0 +1,72 @@
+#include <bayesship/instrumentation.h>
+#include <thread>
+#include <vector>
+
+
+#include <gtest/gtest.h>
+
+namespace{
+
+TEST(latencyHistogramTest,Percentiles)
+{
+	bayesship::latencyHistogram histogram;
+	/*Values 1..100000 -- every percentile should be within the bucket precision (1/16)*/
+	int n = 100000;
+	for(int i = 1 ; i<=n; i++){
+		histogram.record(i);
+	}
+	EXPECT_EQ(histogram.count, (uint64_t)n);
+	EXPECT_EQ(histogram.max, n);
+	EXPECT_NEAR(histogram.mean(), (n+1)/2., 1e-6);
+	double ps[4] = {.5,.9,.99,.999};
+	for(int i = 0 ; i<4; i++){
+		double exact = ps[i]*n;
+		EXPECT_GE(histogram.percentile(ps[i]), exact);
+		EXPECT_LE(histogram.percentile(ps[i]), exact*(1+1./16));
+	}
+	EXPECT_EQ(histogram.percentile(1), n);
+
+	/*Small values are exact*/
+	bayesship::latencyHistogram small;
+	small.record(3);
+	small.record(7);
+	EXPECT_EQ(small.percentile(.5), 3);
+	EXPECT_EQ(small.percentile(1), 7);
+}
+
+TEST(instrumentationTest,PerThreadMerge)
+{
+	bayesship::instrumentation *instruments = new bayesship::instrumentation(1);
+	std::vector<std::thread> threads;
+	for(int t = 0 ; t<4; t++){
+		threads.emplace_back([=]{
+			for(int i = 0 ; i<1000; i++){
+				instruments->record(bayesship::eventLikelihood, 100*(t+1));
+			}
+		});
+	}
+	for(auto &thread : threads){
+		thread.join();
+	}
+	bayesship::latencyHistogram merged = instruments->merged(bayesship::eventLikelihood);
+	EXPECT_EQ(merged.count, (uint64_t)4000);
+	EXPECT_EQ(merged.max, 400);
+	EXPECT_EQ(instruments->merged(bayesship::eventPrior).count, (uint64_t)0);
+
+	/*Every 10th event is sampled*/
+	bayesship::instrumentation *sampled = new bayesship::instrumentation(10);
+	int timed = 0;
+	for(int i = 0 ; i<1000; i++){
+		if(sampled->sampleNext()){
+			timed++;
+		}
+	}
+	EXPECT_EQ(timed, 100);
+	sampled->enabled = false;
+	EXPECT_FALSE(sampled->sampleNext());
+
+	delete instruments;
+	delete sampled;
+}
+
+}
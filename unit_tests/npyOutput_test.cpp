@@ -0,0 +1,72 @@
+#include <bayesship/npyOutput.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+
+
+#include <gtest/gtest.h>
+
+/*Read a whole file back*/
+static std::string readFile(std::string filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/*Growing past the preallocated rows, through both append and reserve/commit, then trimming on close*/
+TEST(npyArrayFileTest,GrowAndClose)
+{
+	std::string filename("npyArrayFileTest.npy");
+	bayesship::npyArrayFile *array = new bayesship::npyArrayFile(filename, 'f', sizeof(double), 3, 4);
+	ASSERT_TRUE(array->good());
+	int rows = 0;
+	for(int k = 0 ; k<10; k++){
+		double values[15];
+		for(int j = 0 ; j<15; j++){
+			values[j] = 3*rows + j;
+		}
+		array->append(values, 5);
+		rows += 5;
+		/*The header always has the committed rows*/
+		std::string header = readFile(filename).substr(0, bayesship::npyArrayFile::headerBytes);
+		EXPECT_NE(header.find("'shape': ("+std::to_string(rows)+", 3)"), std::string::npos);
+	}
+	double *reserved = (double *)array->reserve(7);
+	ASSERT_NE(reserved, nullptr);
+	for(int j = 0 ; j<21; j++){
+		reserved[j] = 3*rows + j;
+	}
+	array->commit(7);
+	rows += 7;
+	EXPECT_EQ(array->rows, rows);
+	delete array;
+
+	std::string contents = readFile(filename);
+	remove(filename.c_str());
+	ASSERT_EQ(contents.size(), (size_t)(bayesship::npyArrayFile::headerBytes + rows*3*sizeof(double)));
+	EXPECT_EQ(contents.substr(0, 8), std::string("\x93NUMPY\x01\x00", 8));
+	/*Header length (little endian), and the header ends in a newline*/
+	int headerLength = (unsigned char)contents[8] + 256*(unsigned char)contents[9];
+	EXPECT_EQ(headerLength + 10, bayesship::npyArrayFile::headerBytes);
+	EXPECT_EQ(contents[bayesship::npyArrayFile::headerBytes-1], '\n');
+	EXPECT_NE(contents.find("'descr': '<f8', 'fortran_order': False, 'shape': ("+std::to_string(rows)+", 3), }"), std::string::npos);
+	std::vector<double> values(rows*3);
+	memcpy(values.data(), contents.data() + bayesship::npyArrayFile::headerBytes, values.size()*sizeof(double));
+	int mismatches = 0;
+	for(int j = 0 ; j<rows*3; j++){
+		mismatches += values[j] != j;
+	}
+	EXPECT_EQ(mismatches, 0);
+}
+
+TEST(npyArrayFileTest,BadPath)
+{
+	bayesship::npyArrayFile array("no/such/directory/npyArrayFileTest.npy", 'i', sizeof(int), 1);
+	EXPECT_FALSE(array.good());
+	int value = 1;
+	array.append(&value, 1);
+	EXPECT_EQ(array.rows, 0);
+}
@@ -0,0 +1,66 @@
+#include "allocationCounter.h"
+#include <new>
+#include <stdlib.h>
+
+/*! \file
+ *
+ * # Global operator new/delete replacement behind allocationCounter
+ *
+ * Outside an allocationCounter scope the replacement behaves exactly like the default one -- the only cost is one relaxed load
+ */
+
+std::atomic<int> allocationScopes{0};
+std::atomic<long long> allocationCount{0};
+
+void *operator new(std::size_t size)
+{
+	if(allocationScopes.load(std::memory_order_relaxed) > 0){
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	if(size == 0){
+		size = 1;
+	}
+	void *ptr = malloc(size);
+	while(!ptr){
+		std::new_handler handler = std::get_new_handler();
+		if(!handler){
+			throw std::bad_alloc();
+		}
+		handler();
+		ptr = malloc(size);
+	}
+	return ptr;
+}
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	try{
+		return operator new(size);
+	}
+	catch(...){
+		return nullptr;
+	}
+}
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+	return operator new(size, tag);
+}
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void *ptr) noexcept
+{
+	free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	free(ptr);
+}
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+	free(ptr);
+}
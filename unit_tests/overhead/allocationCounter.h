@@ -0,0 +1,39 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+#include <atomic>
+
+/*! \file
+ *
+ * # Heap allocation counting for the overhead gates and micro-benchmarks
+ *
+ * The counts come from the global operator new replaced in allocationCounter.cpp, so only executables that link that file (bayesship_overhead_test and bayesship_microbench) may use allocationCounter
+ */
+
+/*! Number of allocationCounter objects alive*/
+extern std::atomic<int> allocationScopes;
+/*! Allocations made (by any thread) while an allocationCounter was alive*/
+extern std::atomic<long long> allocationCount;
+
+/*! \brief Counts the heap allocations made (by any thread) while it's alive*/
+class allocationCounter
+{
+public:
+	allocationCounter()
+	{
+		allocationScopes.fetch_add(1);
+		start = allocationCount.load();
+	}
+	~allocationCounter()
+	{
+		allocationScopes.fetch_sub(1);
+	}
+	/*! \brief Allocations since this counter was created*/
+	long long count()
+	{
+		return allocationCount.load() - start;
+	}
+private:
+	long long start;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/dataUtilities.h>
+#include <bayesship/proposalFunctions.h>
+#include <bayesship/ThreadPool.h>
+#include <atomic>
+#include <thread>
+#include "allocationCounter.h"
+#include "../testSupport.h"
+
+
+#include <gtest/gtest.h>
+
+/*Regression gate for the allocations on the per-step paths of the framework -- the hot path should never touch the heap
+ *
+ * Allocation counts are exact, so they are checked strictly. Timings are left to benchmarks/src/microBenchmarks.cpp, which shares the sampler setup (testSupport.h) and allocation counter (allocationCounter.h)
+ *
+ * Built as its own executable (bayesship_overhead_test), since allocationCounter.cpp replaces the global operator new*/
+
+namespace{
+
+TEST(overheadTest,StepMH)
+{
+	int chainN = 10;
+	int steps = 1000;
+	overheadSampler fixture(10, chainN, steps+1);
+	for(int c = 0 ; c<chainN; c++){
+		fixture.sampler->stepMH(c, fixture.data);
+	}
+	allocationCounter allocations;
+	for(int s = 1 ; s<steps; s++){
+		for(int c = 0 ; c<chainN; c++){
+			fixture.sampler->stepMH(c, fixture.data);
+		}
+	}
+	EXPECT_EQ(allocations.count(), 0);
+}
+
+TEST(overheadTest,ChainSwap)
+{
+	overheadSampler fixture(10, 10, 2);
+	bayesship::bayesshipSampler *sampler = fixture.sampler;
+	int swaps = 100000;
+	allocationCounter allocations;
+	for(int i = 0 ; i<swaps; i++){
+		int e = i%sampler->ensembleN;
+		sampler->chainSwap(sampler->chainIndex(e,0), sampler->chainIndex(e,1), fixture.data);
+	}
+	EXPECT_EQ(allocations.count(), 0);
+}
+
+TEST(overheadTest,ExtendSize)
+{
+	/*Storage grows by whole segments -- a handful of allocations per call, independent of the number of steps*/
+	int chainN = 10;
+	overheadSampler fixture(10, chainN, 1001);
+	int calls = 16;
+	int block = 64;
+	allocationCounter allocations;
+	for(int i = 0 ; i<calls; i++){
+		fixture.data->extendSize(block);
+	}
+	double perStep = (double)allocations.count()/(calls*block*chainN);
+	EXPECT_LT(perStep, .1);
+}
+
+TEST(overheadPositionTest,UpdatePosition)
+{
+	int maxDim = 10;
+	int updates = 1000000;
+	bayesship::positionInfo a(maxDim, false);
+	bayesship::positionInfo b(maxDim, false);
+	for(int i = 0 ; i<maxDim; i++){
+		a.parameters[i] = i;
+		b.parameters[i] = -i;
+	}
+	allocationCounter allocations;
+	for(int i = 0 ; i<updates; i++){
+		a.updatePosition(&b);
+	}
+	EXPECT_EQ(allocations.count(), 0);
+	EXPECT_EQ(a.parameters[maxDim-1], -(maxDim-1));
+}
+
+TEST(overheadPoolTest,ThreadPoolDispatch)
+{
+	/*The queue is a deque, so it allocates one block every few hundred jobs -- nothing per job*/
+	int chainN = 100;
+	int rounds = 1000;
+	std::atomic<long long> done{0};
+	bayesship::ThreadPool<int> *pool = new bayesship::ThreadPool<int>(2, [&](int thread, int job){done.fetch_add(1);});
+	double perJob = 0;
+	{
+		allocationCounter allocations;
+		for(int r = 0 ; r<rounds; r++){
+			for(int i = 0 ; i<chainN; i++){
+				pool->enqueue(i);
+			}
+			while(done.load() < (long long)(r+1)*chainN){
+				std::this_thread::yield();
+			}
+		}
+		perJob = (double)allocations.count()/(rounds*chainN);
+	}
+	pool->stopPool();
+	delete pool;
+	EXPECT_LT(perJob, .05);
+}
+
+TEST(overheadPoolTest,ThreadPoolPairDispatch)
+{
+	int ensembleN = 50;
+	int rounds = 1000;
+	std::atomic<long long> done{0};
+	bayesship::ThreadPoolPair<int> *pool = new bayesship::ThreadPoolPair<int>(1,
+		[&](int thread, int j, int k){done.fetch_add(2);},
+		[&](int j){return j/ensembleN;},
+		2,
+		[&](int a, int b){return a != b;},
+		2
+	);
+	double perJob = 0;
+	{
+		allocationCounter allocations;
+		for(int r = 0 ; r<rounds; r++){
+			for(int e = 0 ; e<ensembleN; e++){
+				pool->enqueue(e);
+				pool->enqueue(e+ensembleN);
+			}
+			while(done.load() < (long long)(r+1)*2*ensembleN){
+				std::this_thread::yield();
+			}
+		}
+		perJob = (double)allocations.count()/(rounds*2*ensembleN);
+	}
+	pool->stopPool();
+	delete pool;
+	EXPECT_LT(perJob, .05);
+}
+
+}
@@ -0,0 +1,144 @@
+#include <bayesship/randomNumberUtilities.h>
+#include <math.h>
+
+
+#include <gtest/gtest.h>
+
+namespace{
+
+/*Known answer tests from the Random123 distribution*/
+TEST(philoxTest,KnownAnswers)
+{
+	uint32_t output[4];
+
+	uint32_t counterZero[4] = {0,0,0,0};
+	uint32_t keyZero[2] = {0,0};
+	bayesship::philox4x32(counterZero, keyZero, output);
+	EXPECT_EQ(output[0], 0x6627e8d5u);
+	EXPECT_EQ(output[1], 0xe169c58du);
+	EXPECT_EQ(output[2], 0xbc57ac4cu);
+	EXPECT_EQ(output[3], 0x9b00dbd8u);
+
+	uint32_t counterPi[4] = {0x243f6a88,0x85a308d3,0x13198a2e,0x03707344};
+	uint32_t keyPi[2] = {0xa4093822,0x299f31d0};
+	bayesship::philox4x32(counterPi, keyPi, output);
+	EXPECT_EQ(output[0], 0xd16cfe09u);
+	EXPECT_EQ(output[1], 0x94fdccebu);
+	EXPECT_EQ(output[2], 0x5001e420u);
+	EXPECT_EQ(output[3], 0x24126ea1u);
+}
+
+TEST(rngStreamTest,BlockKnownAnswers)
+{
+	/*Key 0, step 0, stream 0, purpose 0 starts at counter 0 -- the first block is the all zero Philox known answer*/
+	bayesship::rngStream stream;
+	stream.setKey(0);
+	stream.reset(0,0,0);
+	double draws[2];
+	stream.uniformBlock(draws, 2);
+	EXPECT_EQ(draws[0], ((0x6627e8d5u>>5)*67108864.0 + (0xe169c58du>>6) + 0.5) * (1.0/9007199254740992.0));
+	EXPECT_EQ(draws[1], ((0xbc57ac4cu>>5)*67108864.0 + (0x9b00dbd8u>>6) + 0.5) * (1.0/9007199254740992.0));
+}
+
+TEST(rngStreamTest,BlockMatchesSingleDraws)
+{
+	bayesship::rngStream single;
+	bayesship::rngStream block;
+	single.setKey(7);
+	block.setKey(7);
+	single.reset(3,1,bayesship::rngProposal);
+	block.reset(3,1,bayesship::rngProposal);
+
+	/*Start the block stream part way through a Philox block, and end it part way through another*/
+	EXPECT_EQ(single.uniform(), block.uniform());
+	int n = 101;
+	double *draws = new double[n];
+	block.uniformBlock(draws, n);
+	for(int i = 0 ; i<n; i++){
+		EXPECT_EQ(draws[i], single.uniform());
+		EXPECT_GT(draws[i], 0);
+		EXPECT_LT(draws[i], 1);
+	}
+	EXPECT_EQ(single.uniform(), block.uniform());
+	delete [] draws;
+}
+
+TEST(counterRNGTest,BlockMatchesSingleDraws)
+{
+	/*One draw per chain for the whole ensemble -- the same values as drawing chain by chain*/
+	int chainN = 37;
+	bayesship::counterRNG *single = new bayesship::counterRNG(chainN,5);
+	bayesship::counterRNG *block = new bayesship::counterRNG(chainN,5);
+	int *chainIDs = new int[chainN];
+	double *draws = new double[chainN];
+	for(int i = 0 ; i<chainN; i++){
+		chainIDs[i] = chainN-1-i;
+	}
+	for(int step = 0 ; step<3; step++){
+		for(int chain = 0 ; chain<chainN; chain++){
+			single->beginStep(chain);
+			block->beginStep(chain);
+		}
+		/*Some streams already have a block started*/
+		for(int chain = 0 ; chain<chainN; chain+=4){
+			EXPECT_EQ(single->uniform(chain, bayesship::rngAccept), block->uniform(chain, bayesship::rngAccept));
+		}
+		block->uniformBlock(chainIDs, chainN, bayesship::rngAccept, draws);
+		for(int i = 0 ; i<chainN; i++){
+			EXPECT_EQ(draws[i], single->uniform(chainIDs[i], bayesship::rngAccept));
+		}
+		for(int chain = 0 ; chain<chainN; chain++){
+			EXPECT_EQ(single->uniform(chain, bayesship::rngAccept), block->uniform(chain, bayesship::rngAccept));
+		}
+	}
+	delete [] chainIDs;
+	delete [] draws;
+	delete single;
+	delete block;
+}
+
+TEST(counterRNGTest,StreamsIndependentOfOrder)
+{
+	/*Draws for a chain depend only on (seed, chain, step, purpose), not on what the other chains or purposes did*/
+	bayesship::counterRNG *rngA = new bayesship::counterRNG(4,11);
+	bayesship::counterRNG *rngB = new bayesship::counterRNG(4,11);
+	for(int step = 0 ; step<10; step++){
+		for(int chain = 0 ; chain<4; chain++){
+			rngA->beginStep(chain);
+		}
+		for(int chain = 3 ; chain>=0; chain--){
+			rngB->beginStep(chain);
+			/*Extra proposal draws shouldn't move the acceptance stream*/
+			rngB->gaussian(chain, bayesship::rngProposal);
+		}
+		for(int chain = 0 ; chain<4; chain++){
+			EXPECT_EQ(rngA->uniform(chain, bayesship::rngAccept), rngB->uniform(chain, bayesship::rngAccept));
+		}
+	}
+	EXPECT_NE(rngA->uniform(0, bayesship::rngAccept), rngA->uniform(1, bayesship::rngAccept));
+	delete rngA;
+	delete rngB;
+}
+
+TEST(rngStreamTest,NormalMoments)
+{
+	bayesship::rngStream stream;
+	stream.setKey(3);
+	stream.reset(0,0,bayesship::rngProposal);
+	int n = 100001;
+	double *draws = new double[n];
+	stream.normalBlock(draws, n);
+	double mean = 0;
+	double var = 0;
+	for(int i = 0 ; i<n; i++){
+		mean+=draws[i];
+		var+=draws[i]*draws[i];
+	}
+	mean/=n;
+	var = var/n - mean*mean;
+	EXPECT_NEAR(mean, 0, .02);
+	EXPECT_NEAR(var, 1, .02);
+	delete [] draws;
+}
+
+}
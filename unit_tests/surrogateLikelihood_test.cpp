@@ -0,0 +1,48 @@
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/dataUtilities.h>
+#include <atomic>
+#include "testSupport.h"
+
+
+#include <gtest/gtest.h>
+
+namespace{
+
+/*! \brief Null surrogate that counts its evaluations*/
+class countingSurrogate: public bayesship::probabilityFn
+{
+public:
+	std::atomic<long long> evaluations{0};
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		evaluations.fetch_add(1);
+		return 0;
+	}
+};
+
+TEST(surrogateLikelihoodTest,EvaluationsPerStep)
+{
+	/*S(current) is cached per chain and travels with the state through swaps, so every step costs exactly one surrogate evaluation once each chain has been primed*/
+	int chainN = 10;
+	int steps = 1000;
+	countingSurrogate surrogate;
+	overheadSampler fixture(10, chainN, steps+1);
+	bayesship::bayesshipSampler *sampler = fixture.sampler;
+	sampler->surrogateLikelihood = &surrogate;
+	for(int c = 0 ; c<chainN; c++){
+		sampler->stepMH(c, fixture.data);
+	}
+	long long primed = surrogate.evaluations.load();
+	EXPECT_EQ(primed, 2*chainN);
+	for(int s = 1 ; s<steps; s++){
+		for(int c = 0 ; c<chainN; c++){
+			sampler->stepMH(c, fixture.data);
+		}
+		int e = s%sampler->ensembleN;
+		sampler->chainSwap(sampler->chainIndex(e,0), sampler->chainIndex(e,1), fixture.data);
+	}
+	EXPECT_EQ(surrogate.evaluations.load() - primed, (long long)(steps-1)*chainN);
+	sampler->surrogateLikelihood = nullptr;
+}
+
+}
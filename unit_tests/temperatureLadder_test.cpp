@@ -0,0 +1,77 @@
+#include <bayesship/temperatureLadder.h>
+#include <bayesship/dataUtilities.h>
+
+
+#include <gtest/gtest.h>
+
+TEST(temperatureLadderTest,RespaceEqualizesRejection)
+{
+	/*Rejection concentrated in the first pair -- the new rungs should crowd towards the cold end*/
+	int ensembleSize = 5;
+	double schedule[5] = {1,.75,.5,.25,0};
+	double rejection[4] = {.8,.1,.1,.2};
+	double newSchedule[5];
+	EXPECT_TRUE(bayesship::respaceLadder(schedule, rejection, ensembleSize, newSchedule));
+	EXPECT_EQ(newSchedule[0], 1);
+	EXPECT_EQ(newSchedule[4], 0);
+	/*Barrier is 1.2, so the rungs sit at .3, .6, .9 -- the first two inside the first pair*/
+	EXPECT_NEAR(newSchedule[1], 1 - .25*.3/.8, 1e-12);
+	EXPECT_NEAR(newSchedule[2], 1 - .25*.6/.8, 1e-12);
+	EXPECT_NEAR(newSchedule[3], .5 - .25*.0/.1, 1e-12);
+	for(int k = 0 ; k<ensembleSize-1; k++){
+		EXPECT_GT(newSchedule[k], newSchedule[k+1]);
+	}
+	EXPECT_NEAR(bayesship::communicationBarrier(rejection, 4), 1.2, 1e-12);
+
+	/*Untried pairs leave the ladder alone*/
+	rejection[2] = -1;
+	EXPECT_FALSE(bayesship::respaceLadder(schedule, rejection, ensembleSize, newSchedule));
+	EXPECT_EQ(newSchedule[1], .75);
+}
+
+TEST(temperatureLadderTest,SuggestEnsembleSize)
+{
+	EXPECT_EQ(bayesship::suggestEnsembleSize(0), 2);
+	EXPECT_EQ(bayesship::suggestEnsembleSize(.4), 2);
+	EXPECT_EQ(bayesship::suggestEnsembleSize(2), 5);
+	EXPECT_EQ(bayesship::suggestEnsembleSize(2.1), 6);
+	EXPECT_EQ(bayesship::suggestEnsembleSize(2, .25), 9);
+}
+
+TEST(temperatureLadderTest,RoundTrips)
+{
+	/*One ensemble of three rungs -- walk the cold replica to the hottest rung and back*/
+	double betas[3] = {1,.5,0};
+	bayesship::samplerData *data = new bayesship::samplerData(1, 1, 3, 10, 1, false, betas);
+	for(int i = 0 ; i<3; i++){
+		data->currentStepID[i] = 2;
+	}
+	data->recordSwap(0,1);
+	data->recordSwap(1,2);
+	EXPECT_EQ(data->replicaIDs[2], 0);
+	EXPECT_EQ(data->replicaDirection[0], -1);
+	for(int i = 0 ; i<3; i++){
+		data->currentStepID[i] = 8;
+	}
+	data->recordSwap(1,2);
+	data->recordSwap(0,1);
+	EXPECT_EQ(data->replicaIDs[0], 0);
+	EXPECT_EQ(data->roundTrips[0], 1);
+	EXPECT_EQ(data->roundTripSteps[0], 8);
+	/*Replica 1 started in the middle and hasn't been to both ends yet*/
+	EXPECT_EQ(data->roundTrips[1], 0);
+
+	long long accepts[2];
+	long long rejects[2];
+	data->swapAccepts[0][1] = 3;
+	data->swapRejects[0][1] = 1;
+	bayesship::ladderSwapCounts(data, accepts, rejects);
+	EXPECT_EQ(accepts[0], 3);
+	EXPECT_EQ(rejects[0], 1);
+	EXPECT_EQ(accepts[1] + rejects[1], 0);
+	double rejection[2];
+	bayesship::ladderRejectionRates(data, rejection);
+	EXPECT_NEAR(rejection[0], .25, 1e-12);
+	EXPECT_EQ(rejection[1], -1);
+	delete data;
+}
@@ -0,0 +1,67 @@
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+#include <algorithm>
+#include <bayesship/bayesshipSampler.h>
+#include <bayesship/dataUtilities.h>
+#include <bayesship/proposalFunctions.h>
+
+/*! \file
+ *
+ * # Sampler fixtures shared by the unit tests and the micro-benchmarks
+ */
+
+/*! \brief Likelihood/prior that costs nothing*/
+class nullProbability: public bayesship::probabilityFn
+{
+public:
+	virtual double eval(bayesship::positionInfo *position, int chainID)
+	{
+		return 0;
+	}
+};
+
+/*! \brief Sampler with the null likelihood, ready to step (ensembleSize 2, so chainN/2 ensembles)
+ *
+ * Proposals are gaussian only -- the other default proposals need the history and training that sample() sets up, and would measure themselves rather than the framework
+ */
+struct overheadSampler
+{
+	nullProbability likelihood;
+	nullProbability prior;
+	bayesship::bayesshipSampler *sampler=nullptr;
+	bayesship::samplerData *data=nullptr;
+	bayesship::proposal *proposals[1];
+	bayesship::proposalData *proposalFns=nullptr;
+
+	overheadSampler(int maxDim, int chainN, int iterations)
+	{
+		sampler = new bayesship::bayesshipSampler(&likelihood, &prior);
+		sampler->maxDim = maxDim;
+		sampler->ensembleSize = 2;
+		sampler->ensembleN = std::max(chainN/2, 1);
+		sampler->threads = 1;
+		sampler->initialPosition = new bayesship::positionInfo(maxDim, false);
+		for(int i = 0 ; i<maxDim; i++){
+			sampler->initialPosition->parameters[i] = 0;
+		}
+		int n = sampler->ensembleN*sampler->ensembleSize;
+		proposals[0] = new bayesship::gaussianProposal(n, maxDim, sampler);
+		double proposalProb[1] = {1};
+		proposalFns = new bayesship::proposalData(n, 1, proposals, proposalProb);
+		sampler->proposalFns = proposalFns;
+		sampler->allocateMemory();
+		data = new bayesship::samplerData(maxDim, sampler->ensembleN, sampler->ensembleSize, iterations, sampler->proposalFns->proposalN, false, sampler->betas);
+		sampler->assignInitialPosition(data);
+	}
+	~overheadSampler()
+	{
+		delete data;
+		delete sampler->initialPosition;
+		sampler->initialPosition = nullptr;
+		delete sampler;
+		delete proposals[0];
+		delete proposalFns;
+	}
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include <bayesship/threadAffinity.h>
+#include <sched.h>
+#include <algorithm>
+
+
+#include <gtest/gtest.h>
+
+namespace{
+
+TEST(threadAffinityTest,CompactAndScatterUseAvailableCPUs)
+{
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	ASSERT_EQ(sched_getaffinity(0, sizeof(mask), &mask), 0);
+	int cpuN = CPU_COUNT(&mask);
+
+	bayesship::threadAffinity compact(bayesship::affinityCompact);
+	bayesship::threadAffinity scatter(bayesship::affinityScatter);
+	std::vector<int> seenCompact;
+	std::vector<int> seenScatter;
+	for(int i = 0 ; i<cpuN; i++){
+		EXPECT_TRUE(CPU_ISSET(compact.cpuForThread(i), &mask));
+		EXPECT_TRUE(CPU_ISSET(scatter.cpuForThread(i), &mask));
+		seenCompact.push_back(compact.cpuForThread(i));
+		seenScatter.push_back(scatter.cpuForThread(i));
+	}
+	/*Every CPU is used once before any wrap around*/
+	std::sort(seenCompact.begin(), seenCompact.end());
+	std::sort(seenScatter.begin(), seenScatter.end());
+	EXPECT_EQ(std::unique(seenCompact.begin(), seenCompact.end()) - seenCompact.begin(), cpuN);
+	EXPECT_EQ(seenCompact, seenScatter);
+	EXPECT_EQ(compact.cpuForThread(cpuN), compact.cpuForThread(0));
+	/*Scatter visits every NUMA domain before reusing one*/
+	for(int i = 1 ; i<compact.getNodeN() && i<cpuN; i++){
+		EXPECT_NE(scatter.nodeForThread(i), scatter.nodeForThread(0));
+	}
+}
+
+TEST(threadAffinityTest,ListAndNone)
+{
+	std::vector<int> cpus = {0};
+	bayesship::threadAffinity list(bayesship::affinityList, cpus);
+	EXPECT_EQ(list.cpuForThread(0), 0);
+	EXPECT_EQ(list.cpuForThread(3), 0);
+	EXPECT_TRUE(list.pinCurrentThread(0));
+
+	bayesship::threadAffinity none(bayesship::affinityNone);
+	EXPECT_EQ(none.cpuForThread(0), -1);
+	EXPECT_FALSE(none.pinCurrentThread(0));
+}
+
+}